@@ -0,0 +1,121 @@
+/**
+ * @file agent.h
+ * @brief Agent task - runs chats without blocking loop()
+ *
+ * Chat requests are queued to a FreeRTOS task that runs the LLM loop, so
+ * rules, sensors, NATS and the web server keep running while a reply is
+ * generated. Tools are not thread-safe: calls made from the task are run
+ * by loop() in agentPoll(), as are finished jobs and streamed text.
+ *
+ * Waiting jobs are taken by priority (serial, then Telegram, then NATS),
+ * oldest first. A message from a conversation that already has a job
+ * waiting is merged into it, and a full queue makes room for a job of
+ * higher priority by dropping the newest job of the lowest.
+ */
+
+#ifndef AGENT_H
+#define AGENT_H
+
+#include <Arduino.h>
+
+#define AGENT_MSG_LEN       512
+#define AGENT_REPLY_TO_LEN  128
+#define AGENT_QUEUE_LEN     4      /* jobs waiting behind the running one */
+#define AGENT_SRC_COUNT     3
+#define AGENT_TASK_STACK    12288  /* TLS handshake + JSON parsing */
+
+/* Where a job came from, i.e. where its reply goes. Also the priority. */
+enum AgentSource {
+    AGENT_SRC_SERIAL,
+    AGENT_SRC_TELEGRAM,
+    AGENT_SRC_NATS
+};
+
+struct AgentJob {
+    uint8_t source;                     /* AgentSource */
+    char message[AGENT_MSG_LEN];
+    char replyTo[AGENT_REPLY_TO_LEN];   /* NATS reply subject, or "" */
+};
+
+/* Runs in the agent task. Returns the reply, valid until the next job. */
+typedef const char *(*AgentRunFn)(const AgentJob *job);
+
+/* Runs in loop() from agentPoll(). response is nullptr on failure. */
+typedef void (*AgentDoneFn)(const AgentJob *job, const char *response);
+
+/* Runs in loop() from agentPoll() with text passed to agentStreamWrite() */
+typedef void (*AgentStreamFn)(const char *text, int len);
+
+/* Runs in loop() for a waiting job that will not run; reason is the reply */
+typedef void (*AgentDropFn)(const AgentJob *job, const char *reason);
+
+/* Per source, since boot. Times are in ms, from submit to delivery. */
+struct AgentSourceStats {
+    unsigned long jobs;      /* delivered */
+    unsigned long merged;    /* messages folded into a waiting job */
+    unsigned long dropped;   /* pushed out of a full queue, or stopped */
+    unsigned long waitMs;    /* total time spent waiting */
+    unsigned long totalMs;   /* total time to the reply */
+    unsigned long maxMs;     /* slowest reply */
+};
+
+/**
+ * Start the agent task. Call after the watchdog is configured. If the task
+ * cannot be created, jobs run inline in agentSubmit() as before.
+ */
+bool agentBegin(AgentRunFn run, AgentDoneFn done, AgentStreamFn stream,
+                AgentDropFn drop);
+
+/**
+ * Queue a job (loop() only). The job is copied. A message for a
+ * conversation (source and replyTo) that has a job waiting is appended to
+ * that job's message if it fits; a repeat of it is absorbed. Without a
+ * task, a job submitted while another runs inline waits for it.
+ * @return false if the queue is full of jobs of the same or higher priority
+ */
+bool agentSubmit(const AgentJob *job);
+
+/**
+ * Drop all waiting jobs and ask the running one to stop before its next
+ * LLM request (loop() only).
+ * @return number of waiting jobs dropped
+ */
+int agentStop();
+
+/* The running job has been asked to stop (agent task) */
+bool agentStopping();
+
+/* A job is running or queued */
+bool agentBusy();
+
+/* Jobs waiting behind the running one */
+int agentQueued();
+
+/* Counters for an AgentSource */
+const AgentSourceStats *agentStats(int source);
+
+/**
+ * Service the agent from loop(): run a pending tool call, forward streamed
+ * text and deliver a finished job.
+ */
+void agentPoll();
+
+/**
+ * Execute a tool on behalf of the running job. From the agent task the call
+ * is handed to loop() and this blocks until agentPoll() has run it;
+ * elsewhere it calls toolExecuteChat() directly.
+ */
+void agentToolExecute(const char *name, const char *args,
+                      char *result, int result_len);
+
+/**
+ * Run fn(arg) in loop() on behalf of the running job, for anything that
+ * reads state loop() changes. Blocks like agentToolExecute(); elsewhere it
+ * calls fn directly.
+ */
+void agentRunInLoop(void (*fn)(void *arg), void *arg);
+
+/* Pass reply text to the AgentStreamFn in loop() */
+void agentStreamWrite(const char *text, int len);
+
+#endif /* AGENT_H */
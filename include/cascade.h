@@ -0,0 +1,44 @@
+/**
+ * @file cascade.h
+ * @brief Fast/main model cascade for the chat loop
+ *
+ * With model_fast set, each chat starts on the fast model, which picks the
+ * tools and writes short replies. The main model takes over for the rest
+ * of the chat when the fast one fails or sounds unsure, or when a tool
+ * returns an error. Messages asking for long-form text skip the fast model.
+ */
+
+#ifndef CASCADE_H
+#define CASCADE_H
+
+#include <Arduino.h>
+#include "llm_client.h"
+
+#define CASCADE_LONG_MSG 200  /* longer messages start on the main model */
+
+/* Requests, time and tokens per model */
+struct CascadeTier {
+    unsigned long requests;
+    unsigned long failures;
+    unsigned long ms;         /* total request time */
+    unsigned long promptTokens;
+    unsigned long completionTokens;
+};
+
+/** The message asks for more than the fast model should write. */
+bool cascadeLongForm(const char *msg);
+
+/** A fast-model answer without tool calls that is empty or hedges. */
+bool cascadeUnsure(const LlmResult *r);
+
+/** Count one request on the fast or the main model. */
+void cascadeAccount(bool fast, bool ok, const LlmResult *r, unsigned long ms);
+
+/** Count and log a switch to the main model. */
+void cascadeEscalate(const char *why, const char *mainModel);
+
+/** Totals per model, tier 0 fast and 1 main, and escalations since boot. */
+const CascadeTier *cascadeTier(int tier);
+unsigned long cascadeEscalations();
+
+#endif /* CASCADE_H */
@@ -91,6 +91,10 @@ Device *deviceFind(const char *name);
 /* Read a sensor device. Returns the reading as a float. */
 float deviceReadSensor(Device *dev, bool record_hist = false);
 
+/* Last known value without touching hardware: EMA or latest history sample,
+ * NATS/serial value, clock, or an actuator's last set value. False if none. */
+bool deviceCachedValue(const Device *dev, float *out);
+
 /* Set an actuator device. value: 0/1 for digital/relay, 0-255 for PWM. Returns true on success. */
 bool deviceSetActuator(Device *dev, int value);
 
@@ -109,6 +113,9 @@ const char *deviceKindName(DeviceKind kind);
 /* Get mutable device array (for NATS subscription management) */
 Device *deviceGetAllMutable();
 
+/* Changes whenever a device is registered or removed */
+uint32_t deviceGeneration();
+
 /* Set the NATS value + message on a device */
 void deviceSetNatsValue(Device *dev, float value, const char *msg);
 
@@ -0,0 +1,68 @@
+/**
+ * @file gzip_inflate.h
+ * @brief Streaming gzip decompressor (RFC 1952 / deflate, RFC 1951)
+ *
+ * Compressed bytes are pushed in as they come off the socket, split
+ * anywhere. Output goes to a caller-owned window, which is also the
+ * deflate history: either a plain buffer that receives the whole body,
+ * or a ring of GZIP_WINDOW_LEN bytes that the caller drains after each
+ * call. The decoder state is about 1.1 KB and uses no heap.
+ */
+
+#ifndef GZIP_INFLATE_H
+#define GZIP_INFLATE_H
+
+#include <stdint.h>
+
+#define GZIP_WINDOW_LEN 32768  /* ring size that covers any deflate distance */
+
+enum GzipStatus {
+    GZIP_MORE = 0,   /* waiting for input */
+    GZIP_DONE,       /* member ended and the CRC and length matched */
+    GZIP_FULL,       /* plain buffer is full; the rest is dropped */
+    GZIP_ERROR       /* not gzip, corrupt, or a distance past the window */
+};
+
+struct GzipInflater {
+    GzipStatus status;
+    uint8_t    state;
+    uint8_t    flags;        /* gzip header FLG */
+    bool       final;        /* last deflate block */
+    bool       ring;
+    uint8_t   *window;
+    uint32_t   window_len;
+    uint32_t   pos;          /* bytes produced */
+    uint32_t   crc;
+
+    uint64_t   bits;
+    int        bit_count;
+
+    int        count;        /* header bytes, stored bytes or lengths left */
+    int        copy_len;     /* back-reference being copied */
+    uint32_t   copy_dist;
+
+    int        nlit, ndist, nlens;
+    uint8_t    lens[288 + 32];
+    uint16_t   lit_counts[16];
+    uint16_t   lit_syms[288];
+    uint16_t   dist_counts[16];
+    uint16_t   dist_syms[32];  /* also the code length code while reading lengths */
+};
+
+/**
+ * Start a gzip member. With ring, window_len must be a power of two and
+ * output wraps around; without, output stops at window_len (GZIP_FULL).
+ */
+void gzipInit(GzipInflater *z, uint8_t *window, uint32_t window_len, bool ring);
+
+/**
+ * Decompress from in. Output is written to the window as one contiguous
+ * run starting at *out; the return value is its length. *used is how much
+ * input was taken; it is less than in_len only when the status is no
+ * longer GZIP_MORE, or a ring run reached the end of the window (call
+ * again with the rest).
+ */
+int gzipInflate(GzipInflater *z, const uint8_t *in, int in_len, int *used,
+                const uint8_t **out);
+
+#endif /* GZIP_INFLATE_H */
@@ -0,0 +1,35 @@
+/**
+ * @file intent.h
+ * @brief Local fast path for simple device commands
+ *
+ * Matches short imperative requests ("turn the led red", "read chip_temp",
+ * "relay off") against a small grammar built from the registered devices
+ * and runs the tool directly, without an LLM round trip. Anything the
+ * grammar does not fully account for is left to the LLM.
+ */
+
+#ifndef INTENT_H
+#define INTENT_H
+
+#include <Arduino.h>
+
+/* Longer messages always go to the LLM */
+#define INTENT_MAX_MSG_LEN 64
+
+/**
+ * Try to handle a message locally.
+ *
+ * @param msg       User message
+ * @param reply     Output: tool result to show as the reply
+ * @param reply_len Size of reply buffer
+ * @return true if the message was handled (reply written)
+ */
+bool intentHandle(const char *msg, char *reply, int reply_len);
+
+/**
+ * Fast path counters since boot: messages handled locally (hits) and
+ * passed on to the LLM (misses).
+ */
+void intentStats(unsigned *hits, unsigned *misses);
+
+#endif /* INTENT_H */
@@ -3,7 +3,11 @@
  * @brief OpenRouter LLM client for ESP32
  *
  * Sends chat completion requests to OpenRouter API over HTTPS.
- * Supports tool calling for the agentic loop.
+ * Supports tool calling for the agentic loop, and streamed responses
+ * (OpenAI-style SSE or Ollama NDJSON) with content delivered as it arrives.
+ * Fallback endpoints take over when one fails, and a late request can be
+ * hedged to the next endpoint. Responses may come gzip-compressed and are
+ * inflated as they are read.
  */
 
 #ifndef LLM_CLIENT_H
@@ -18,10 +22,29 @@ extern bool g_debug;
 
 /* Maximum sizes */
 #define LLM_MAX_RESPONSE_LEN   4096  /* Max content we extract from response */
-#define LLM_MAX_REQUEST_LEN    20480 /* Max JSON request body */
+#define LLM_MAX_REQUEST_LEN    65536 /* Max JSON request body (streamed, not buffered) */
+#define LLM_WRITE_BUF_LEN      1024  /* Socket write buffer for the request body */
 #define LLM_READ_TIMEOUT_MS    120000 /* 120s read timeout for LLM response */
 #define LLM_MAX_MESSAGES       26    /* Max messages in conversation (more for tool loops) */
 #define LLM_MAX_TOOL_CALLS     4     /* Max tool calls per LLM response */
+#define LLM_STREAM_LINE_LEN    2048  /* Max streamed event line (SSE data / NDJSON) */
+#define LLM_STREAM_IDLE_MS     30000 /* Max gap between streamed events */
+#define LLM_KEEPALIVE_IDLE_MS  20000 /* Reconnect rather than reuse an idle connection */
+#define LLM_DNS_CACHE_MS       600000 /* Re-resolve the LLM host after 10 min */
+#define LLM_MAX_ENDPOINTS      3     /* api_base_url + fallbacks */
+#define LLM_CONNECT_TIMEOUT_MS 5000  /* fail fast to the next endpoint */
+#define LLM_DOWN_MS            10000 /* skip a failed endpoint, doubling per failure */
+#define LLM_DOWN_MAX_MS        300000
+#define LLM_LATENCY_SAMPLES    16    /* first-byte times kept per endpoint for the p95 */
+#define LLM_HEDGE_MIN_MS       1000  /* never hedge sooner than this */
+#define LLM_HEDGE_DEFAULT_MS   8000  /* hedge deadline until there are enough samples */
+#define LLM_HEDGE_MIN_HEAP     60000 /* free heap needed to open a second TLS session */
+#define LLM_REPLY_TOKENS       2048  /* max_tokens, reserved in the context for the reply */
+#define LLM_BYTES_PER_TOKEN    3     /* request size estimate; prose is closer to 4 */
+#define LLM_GZIP_MIN_HEAP      80000 /* free heap needed to take a streamed reply gzipped */
+
+/* Receives response text as it streams in (not null-terminated) */
+typedef void (*LlmDeltaFn)(const char *text, int len, void *ctx);
 
 /* A single tool call parsed from LLM response */
 struct LlmToolCall {
@@ -44,6 +67,42 @@ struct LlmMessage {
     const char *tool_calls_json;/* For type=TOOL_CALL: raw JSON array of tool calls */
 };
 
+/* An API server and the model used on it, with its health */
+struct LlmEndpoint {
+    const char *api_key;
+    const char *model;
+    char host[64];
+    int  port;
+    char path[64];
+    bool use_tls;
+
+    /* DNS cache */
+    IPAddress     ip;
+    bool          ip_valid;
+    unsigned long dns_time;
+
+    /* Health */
+    uint8_t       failures;     /* consecutive */
+    unsigned long down_until;   /* tried last until then (millis) */
+    unsigned long requests;
+    unsigned long errors;
+    uint16_t      latency[LLM_LATENCY_SAMPLES]; /* first-byte times, ms */
+    uint8_t       latency_count;
+    uint8_t       latency_next;
+};
+
+/* A connection: one carries the request, the other a hedged copy */
+struct LlmConn {
+    WiFiClientSecure secure;
+    WiFiClient       plain;
+    Client          *client;     /* secure or plain, for ep */
+    int              ep;         /* endpoint connected to, or -1 */
+    bool             keep_alive; /* may carry the next request */
+    unsigned long    last_used;
+    bool             reused;     /* the last open reused it */
+    unsigned long    connect_ms; /* setup time of the last open */
+};
+
 /* Result of an LLM call */
 struct LlmResult {
     bool ok;
@@ -52,6 +111,7 @@ struct LlmResult {
     int  http_status;
     int  prompt_tokens;
     int  completion_tokens;
+    int  cached_tokens;     /* prompt tokens served from the provider's cache */
 
     /* Tool calls (if any) */
     LlmToolCall tool_calls[LLM_MAX_TOOL_CALLS];
@@ -67,43 +127,182 @@ public:
 
     void begin(const char *api_key, const char *model, const char *base_url = nullptr);
 
+    /**
+     * Add a fallback endpoint, used in order when the ones before it are
+     * down. Strings must stay valid. Call after begin().
+     * @return false if all LLM_MAX_ENDPOINTS are in use
+     */
+    bool addEndpoint(const char *base_url, const char *model, const char *api_key);
+
+    /* Send a copy of the request to the next endpoint when the first byte
+     * is later than the current one's p95. Off by default. */
+    void setHedging(bool enabled) { m_hedge = enabled; }
+
+    /* Model for the main endpoint in the following requests, instead of
+     * the one given to begin(); nullptr goes back to it. Fallback
+     * endpoints keep their own models. The string must stay valid. */
+    void setModel(const char *model) { m_model = model; }
+
+    /* Request streamed responses ("stream":true). On by default; when
+     * off, each reply is read whole into a buffer taken from the heap for
+     * the chat() call. */
+    void setStreaming(bool enabled) { m_stream = enabled; }
+    bool streaming() const { return m_stream; }
+
+    /* Send Accept-Encoding: gzip. A buffered reply inflates into its
+     * response buffer; a streamed one needs a GZIP_WINDOW_LEN window from
+     * the heap, so it is only asked for with LLM_GZIP_MIN_HEAP free.
+     * On by default. */
+    void setGzip(bool enabled) { m_gzip = enabled; }
+
+    /* Mark the system prefix and the newest message with cache_control
+     * breakpoints (Anthropic/Gemini via OpenRouter). Off by default: some
+     * OpenAI-compatible servers reject the content-part form. */
+    void setPromptCache(bool enabled) { m_prompt_cache = enabled; }
+
     /**
      * Send a chat completion request, optionally with tools.
      *
+     * When streaming, content deltas are passed to on_delta as they arrive
+     * and tool calls are assembled from their fragments; result is filled
+     * the same way as for a buffered response.
+     *
      * @param messages   Array of messages
      * @param count      Number of messages
-     * @param tools_json Raw JSON string of tools array (or nullptr for no tools)
+     * @param tools      Tool definitions, one JSON object each (or nullptr)
+     * @param tool_count Number of tool definitions
      * @param result     Output: parsed response with content and/or tool calls
+     * @param on_delta   Optional sink for streamed content
+     * @param delta_ctx  Context passed to on_delta
      * @return true on success
      */
     bool chat(const LlmMessage *messages, int count,
-              const char *tools_json, LlmResult *result);
+              const char *const *tools, int tool_count, LlmResult *result,
+              LlmDeltaFn on_delta = nullptr, void *delta_ctx = nullptr);
 
     const char *lastError() const { return m_error; }
 
+    /**
+     * Extract content, tool calls and usage from a complete (buffered)
+     * response body. Used by chat(); public for the host parse bench.
+     * @return false with lastError() set if there is neither content nor
+     *         a tool call
+     */
+    bool parseResponse(const char *body, int body_len, LlmResult *result);
+
+    /**
+     * Upper bound for the request body without its messages: settings,
+     * the longest model name in use and the tool definitions. Add
+     * llmMessageBytes() of each message for the whole body.
+     */
+    int envelopeBytes(const char *const *tools, int tool_count) const;
+
+    /**
+     * Open the connection ahead of the first chat(). A no-op if a live
+     * kept-alive connection exists.
+     */
+    bool preconnect();
+
+    /* Close the kept-alive connection and release its TLS buffers */
+    void disconnect();
+
+    /* Connection setup of the last chat(): 0 ms and reused when the
+     * kept-alive connection was used */
+    unsigned long lastConnectMs() const { return m_connect_ms; }
+    bool lastReused() const { return m_reused; }
+
+    /* Time from request sent to first response byte in the last chat()
+     * (close to time-to-first-token when streaming) */
+    unsigned long lastFirstByteMs() const { return m_first_byte_ms; }
+
+    /* New connections opened and time spent opening them, since boot */
+    unsigned long connectCount() const { return m_connect_count; }
+    unsigned long connectTotalMs() const { return m_connect_total_ms; }
+
+    int endpointCount() const { return m_ep_count; }
+    const LlmEndpoint *endpoint(int i) const { return &m_eps[i]; }
+
+    /* Endpoint that answered the last chat(), or -1 */
+    int lastEndpoint() const { return m_last_ep; }
+
+    /* p95 of the endpoint's recent first-byte times, 0 without samples */
+    unsigned long endpointP95(int i) const;
+
+    /* Hedged requests sent, and how many of them answered first */
+    unsigned long hedgeCount() const { return m_hedges; }
+    unsigned long hedgeWins() const { return m_hedge_wins; }
+
+    /* Response body bytes received, and the same bodies once inflated,
+     * since boot */
+    unsigned long rxWireBytes() const { return m_rx_wire; }
+    unsigned long rxBodyBytes() const { return m_rx_body; }
+
 private:
-    WiFiClientSecure m_secure_client;
-    WiFiClient       m_plain_client;
-    Client          *m_client;          /* points to active one */
-    const char *m_api_key;
-    const char *m_model;
-    char m_host[64];
-    int  m_port;
-    char m_path[64];
-    bool m_use_tls;
+    LlmEndpoint m_eps[LLM_MAX_ENDPOINTS];
+    int         m_ep_count;
+    int         m_last_ep;
+    LlmConn     m_conns[2];      /* [0] request, [1] hedge */
+    LlmConn    *m_conn;          /* the one being read */
+    Client     *m_client;        /* m_conn->client */
+    const char *m_model;         /* setModel() override for m_eps[0] */
+    bool m_stream;
+    bool m_prompt_cache;
+    bool m_hedge;
+    bool m_gzip;
+    uint8_t *m_gzip_window;      /* ring for a streamed gzip reply, during chat() */
+    char *m_response_buf;        /* whole buffered reply, during chat() */
+    unsigned long m_first_byte_ms;
     char m_error[128];
 
-    int buildRequest(char *buf, int buf_len,
-                     const LlmMessage *messages, int count,
-                     const char *tools_json);
+    unsigned long m_connect_ms;
+    bool          m_reused;
+    unsigned long m_connect_count;
+    unsigned long m_connect_total_ms;
+    unsigned long m_hedges;
+    unsigned long m_hedge_wins;
+    unsigned long m_rx_wire;
+    unsigned long m_rx_body;
 
-    bool parseResponse(const char *body, int body_len, LlmResult *result);
-    int readResponse(char *buf, int buf_len);
+    const char *modelFor(int ep) const {
+        return (ep == 0 && m_model) ? m_model : m_eps[ep].model;
+    }
+
+    bool parseUrl(LlmEndpoint *ep, const char *base_url);
+    bool endpointDown(int i) const;
+    int  pickEndpoints(int *order) const;
+    void endpointFailed(int i);
+    void endpointLatency(int i, unsigned long ms);
+    unsigned long hedgeDeadline(int i) const;
+
+    bool resolveHost(LlmEndpoint *ep);
+    bool openConnection(LlmConn *conn, int ep);
+    bool sendRequest(LlmConn *conn, int body_len, const LlmMessage *messages, int count,
+                     const char *const *tools, int tool_count);
+    int  request(int ep, int hedge_ep, int body_len, const LlmMessage *messages, int count,
+                 const char *const *tools, int tool_count);
 
-    /* Parse tool_calls array from response body */
-    int parseToolCalls(const char *body, int body_len, LlmResult *result);
+    int writeBody(Client *client, const char *model, const LlmMessage *messages, int count,
+                  const char *const *tools, int tool_count);
+    bool chatEndpoints(const LlmMessage *messages, int count,
+                       const char *const *tools, int tool_count, LlmResult *result,
+                       LlmDeltaFn on_delta, void *delta_ctx);
+
+    int readHeaders(int *content_length, bool *chunked, bool *gzip);
+    int readResponse(char *buf, int buf_len, int *status);
+    bool readStream(LlmResult *result, LlmDeltaFn on_delta, void *delta_ctx);
 };
 
+/* Length of text once JSON-escaped into the request body */
+int llmEscapedLen(const char *text);
+
+/* Upper bound for one message in the request body, cache_control included */
+int llmMessageBytes(const LlmMessage *msg);
+
+/* Token estimate for request bytes (conservative) */
+inline int llmTokens(int bytes) {
+    return (bytes + LLM_BYTES_PER_TOKEN - 1) / LLM_BYTES_PER_TOKEN;
+}
+
 /* Helper to make a normal message */
 inline LlmMessage llmMsg(const char *role, const char *content) {
     return {LLM_MSG_NORMAL, role, content, nullptr, nullptr};
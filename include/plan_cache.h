@@ -0,0 +1,55 @@
+/**
+ * @file plan_cache.h
+ * @brief Learned tool plans for repeated requests
+ *
+ * When a chat's tool calls were all chosen up front (before the model saw
+ * any tool result), the sequence is remembered for the normalized message
+ * together with a hash of the state the model saw: models, system prompt,
+ * registered devices and rules. Once the model has produced the same plan
+ * twice, later identical requests replay it through toolExecute() without
+ * an LLM call. The table is kept in /plans.bin.
+ */
+
+#ifndef PLAN_CACHE_H
+#define PLAN_CACHE_H
+
+#include <Arduino.h>
+
+#define PLAN_CACHE_ENTRIES   12
+#define PLAN_CACHE_PLAN_LEN  200   /* "name\0args\0" per call */
+#define PLAN_CACHE_MAX_CALLS 4
+#define PLAN_CACHE_CONFIRM   2     /* identical plans before replaying */
+
+/* Load /plans.bin */
+void planCacheInit();
+
+/**
+ * Try to answer a message from a learned plan (loop() only). Each call's
+ * result goes into reply, one per line.
+ *
+ * @return true if a plan was replayed (reply written)
+ */
+bool planCacheReplay(const char *msg, char *reply, int reply_len);
+
+/* Start tracing a chat's tool calls (loop(), before the first request) */
+void planTraceBegin();
+
+/* Record a tool call made in iteration iter (agent task) */
+void planTraceCall(int iter, const char *name, const char *args);
+
+/* The chat is over; ok if it ended with a reply (agent task) */
+void planTraceEnd(bool ok);
+
+/**
+ * Learn the traced plan for msg, if it is replayable (loop(), after the
+ * chat has been delivered). Consumes the trace.
+ */
+void planCacheLearn(const char *msg);
+
+/**
+ * Counters since boot: messages answered from a plan (hits) and passed
+ * on (misses), plus the number of plans that can be replayed.
+ */
+void planCacheStats(unsigned *hits, unsigned *misses, int *ready);
+
+#endif /* PLAN_CACHE_H */
@@ -110,6 +110,9 @@ Rule *ruleFind(const char *id);
 /* Get the rules array (for listing) */
 const Rule *ruleGetAll();
 
+/* Changes whenever a rule is created, deleted, enabled or disabled */
+uint32_t ruleGeneration();
+
 /* Get condition op name as string */
 const char *conditionOpName(ConditionOp op);
 
@@ -0,0 +1,26 @@
+/**
+ * @file state_snapshot.h
+ * @brief Compact device and rule state for the LLM prompt
+ *
+ * Sent with each chat as a system message so the model can act in its
+ * first iteration instead of spending one on device_list, rule_list or
+ * sensor_read just to learn what exists. Device and rule lines are
+ * rebuilt when the registry's generation changes, values only when a
+ * cached reading prints differently.
+ */
+
+#ifndef STATE_SNAPSHOT_H
+#define STATE_SNAPSHOT_H
+
+#include <Arduino.h>
+
+#define SNAPSHOT_MAX_LEN 3072
+
+/**
+ * The current snapshot (loop() only: it reads the registries loop()
+ * changes). Static buffer, valid until the next call; empty if there are
+ * no devices and no rules.
+ */
+const char *stateSnapshot();
+
+#endif /* STATE_SNAPSHOT_H */
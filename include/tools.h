@@ -13,11 +13,47 @@
 /* Max length of a tool result string */
 #define TOOL_RESULT_MAX_LEN 512
 
+/* Tool categories. Each request carries only the categories picked for
+ * the current message; the model can load the rest via tools_more. */
+#define TOOL_CAT_GPIO    0x01  /* LED, GPIO pins */
+#define TOOL_CAT_SYSTEM  0x02  /* device info, files, chip temperature */
+#define TOOL_CAT_DEVICES 0x04  /* device registry, sensors, actuators */
+#define TOOL_CAT_RULES   0x08  /* automation rules and chains */
+#define TOOL_CAT_COMMS   0x10  /* NATS, serial, remote devices */
+#define TOOL_CAT_ALL     0x1F
+
+/* Max tool definitions in one request (every tool + tools_more + run_plan) */
+#define TOOL_MAX_DEFS    24
+
+/**
+ * Pick the tool categories for a new chat from keywords in the user
+ * message, registered device names it mentions, and categories used in
+ * the last few chats. Returns the selected mask (0 = tools_more only).
+ */
+uint8_t toolsSelect(const char *userMessage);
+
+/**
+ * Get the tool definitions for the current chat: one JSON object per tool
+ * in the selected categories, plus tools_more while some are left out.
+ * Pointers are static strings - do not free.
+ *
+ * @param defs Output array of JSON object strings
+ * @param max  Capacity of defs
+ * @return Number of definitions written
+ */
+int toolsGetDefinitions(const char **defs, int max);
+
 /**
- * Get the JSON array of tool definitions for the LLM API.
- * Returns a static string - do not free.
+ * Offer run_plan, which runs several tool calls from one response, with
+ * every request. Off by default.
  */
-const char *toolsGetDefinitions();
+void toolsSetPlanMode(bool enabled);
+
+/**
+ * Drop the selected categories not in mask, to make a request fit the
+ * context. tools_more can still load them.
+ */
+void toolsLimit(uint8_t mask);
 
 /**
  * Execute a tool by name with JSON arguments.
@@ -31,4 +67,22 @@ const char *toolsGetDefinitions();
 bool toolExecute(const char *name, const char *args_json,
                   char *result, int result_len);
 
+/**
+ * toolExecute() for a tool call made by a chat. Only these (and the steps
+ * of a run_plan they start) keep a category selected for the next chats;
+ * NATS tool_exec, the intent fast path and plan replays do not.
+ */
+bool toolExecuteChat(const char *name, const char *args_json,
+                     char *result, int result_len);
+
+/**
+ * A chat tool that waits on another device (remote_chat) only starts its
+ * request and returns with toolPending() set, so loop() keeps running.
+ * toolPoll() from a later loop() pass fills result and returns true once
+ * it has finished; toolWait() blocks for callers with no later pass.
+ */
+bool toolPending();
+bool toolPoll(char *result, int result_len);
+void toolWait(char *result, int result_len);
+
 #endif /* TOOLS_H */
@@ -0,0 +1,361 @@
+/**
+ * @file nats_bench.c
+ * @brief NATS Embedded Client - End-to-End Throughput Benchmark
+ *
+ * Runs the core against a local nats-server over the POSIX transport and
+ * reports publish throughput, request/reply latency percentiles and
+ * subscription fan-in, across payload sizes and subscription counts.
+ * Re-run whenever the parser or TX path changes and compare.
+ *
+ * Build (from lib/nats):
+ *   cc -O2 -std=gnu11 -Iproto -Iparse -Itransport bench/nats_bench.c \
+ *      proto/nats_core.c parse/nats_parse.c -o nats_bench
+ *
+ * Run:
+ *   nats-server &
+ *   ./nats_bench [-s host] [-p port] [-n msgs] [-c]
+ *
+ * -c prints CSV (bench,param,value,metric,result) for tracking over time.
+ *
+ * @author Mario Schallner
+ * @copyright Copyright (c) 2026 Mario Schallner
+ */
+
+#include "nats_core.h"
+#include "nats_transport_posix.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*============================================================================
+ * Configuration
+ *============================================================================*/
+
+#define BENCH_DEFAULT_MSGS 100000U
+#define BENCH_MAX_REQUESTS 5000U
+#define BENCH_TIMEOUT_MS 10000U
+#define BENCH_FANIN_PAYLOAD 128U
+
+static const size_t BENCH_SIZES[] = {16U, 128U, 1024U, NATS_MAX_PAYLOAD_LEN};
+#define BENCH_SIZE_COUNT (sizeof(BENCH_SIZES) / sizeof(BENCH_SIZES[0]))
+
+static const size_t BENCH_SUBS[] = {1U, 4U, NATS_MAX_SUBSCRIPTIONS};
+#define BENCH_SUB_COUNT (sizeof(BENCH_SUBS) / sizeof(BENCH_SUBS[0]))
+
+/*============================================================================
+ * State
+ *============================================================================*/
+
+static const char *g_host = "127.0.0.1";
+static uint16_t g_port = NATS_DEFAULT_PORT;
+static uint32_t g_msgs = BENCH_DEFAULT_MSGS;
+static bool g_csv = false;
+
+static uint8_t g_payload[NATS_MAX_PAYLOAD_LEN];
+static uint32_t g_latency_us[BENCH_MAX_REQUESTS];
+
+/* Clients are large (RX buffer) - keep them off the stack */
+static nats_client_t g_pub;
+static nats_client_t g_sub;
+static nats_posix_t g_pub_tp;
+static nats_posix_t g_sub_tp;
+
+static uint32_t g_received;
+
+/*============================================================================
+ * Helpers
+ *============================================================================*/
+
+static bool bench_connect(nats_client_t *client, nats_posix_t *t,
+                          const char *name) {
+  nats_options_t opts = NATS_OPTIONS_DEFAULT;
+  opts.name = name;
+  opts.echo = false;
+
+  (void)nats_init_opts(client, &opts);
+  (void)nats_posix_init(t, client);
+
+  nats_err_t err = nats_posix_connect(t, client, g_host, g_port, 2000U);
+  if (err != NATS_OK) {
+    fprintf(stderr, "connect %s:%u failed: %s\n", g_host, (unsigned)g_port,
+            nats_err_str(err));
+    return false;
+  }
+  return true;
+}
+
+static void bench_close(nats_client_t *client) { (void)nats_close(client); }
+
+/**
+ * @brief PING and wait for the PONG - all earlier traffic is processed
+ */
+static bool bench_flush(nats_client_t *client, nats_posix_t *t) {
+  uint8_t target = client->pings_out;
+  if (nats_flush(client) != NATS_OK) {
+    return false;
+  }
+
+  uint32_t start = nats_posix_time_ms();
+  while (client->pings_out > target) {
+    if ((nats_posix_time_ms() - start) > BENCH_TIMEOUT_MS) {
+      return false;
+    }
+    (void)nats_posix_wait(t, 10U);
+    if (nats_process(client) != NATS_OK) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/**
+ * @brief Process whatever is buffered on the socket without waiting
+ */
+static void bench_drain(nats_client_t *client, nats_posix_t *t) {
+  while (nats_posix_wait(t, 0U)) {
+    if (nats_process(client) != NATS_OK) {
+      break;
+    }
+  }
+}
+
+static int cmp_u32(const void *a, const void *b) {
+  uint32_t x = *(const uint32_t *)a;
+  uint32_t y = *(const uint32_t *)b;
+  return (x > y) - (x < y);
+}
+
+static uint32_t percentile(const uint32_t *sorted, size_t n, uint32_t pct) {
+  size_t idx = (n * pct) / 100U;
+  if (idx >= n) {
+    idx = n - 1U;
+  }
+  return sorted[idx];
+}
+
+static void report(const char *bench, const char *param, size_t value,
+                   const char *metric, double result, const char *unit) {
+  if (g_csv) {
+    printf("%s,%s,%zu,%s,%.1f\n", bench, param, value, metric, result);
+  } else {
+    printf("%-8s %-5s=%-6zu %-8s %12.1f %s\n", bench, param, value, metric,
+           result, unit);
+  }
+}
+
+/*============================================================================
+ * Benchmarks
+ *============================================================================*/
+
+/**
+ * @brief Publish throughput: N messages, timed until the server has them
+ */
+static bool bench_publish(size_t size) {
+  if (!bench_connect(&g_pub, &g_pub_tp, "bench-pub")) {
+    return false;
+  }
+
+  uint32_t start = nats_posix_time_us();
+  for (uint32_t i = 0U; i < g_msgs; i++) {
+    nats_err_t err = nats_publish(&g_pub, "bench.pub", g_payload, size);
+    if (err != NATS_OK) {
+      fprintf(stderr, "publish failed: %s\n", nats_err_str(err));
+      bench_close(&g_pub);
+      return false;
+    }
+  }
+  bool ok = bench_flush(&g_pub, &g_pub_tp);
+  uint32_t elapsed_us = nats_posix_time_us() - start;
+  bench_close(&g_pub);
+
+  if (!ok || (elapsed_us == 0U)) {
+    return false;
+  }
+
+  double secs = (double)elapsed_us / 1e6;
+  report("publish", "size", size, "msgs/s", (double)g_msgs / secs, "");
+  report("publish", "size", size, "MB/s",
+         ((double)g_msgs * (double)size) / secs / 1e6, "");
+  return true;
+}
+
+static void echo_cb(nats_client_t *client, const nats_msg_t *msg,
+                    void *userdata) {
+  (void)userdata;
+  (void)nats_msg_respond(client, msg, msg->data, msg->data_len);
+}
+
+/**
+ * @brief Request/reply round trip latency through a responder client
+ */
+static bool bench_request(size_t size) {
+  if (!bench_connect(&g_sub, &g_sub_tp, "bench-echo")) {
+    return false;
+  }
+  if (!bench_connect(&g_pub, &g_pub_tp, "bench-req")) {
+    bench_close(&g_sub);
+    return false;
+  }
+
+  bool ok = (nats_subscribe(&g_sub, "bench.echo", echo_cb, NULL, NULL) ==
+             NATS_OK) &&
+            bench_flush(&g_sub, &g_sub_tp);
+
+  size_t count = (g_msgs < BENCH_MAX_REQUESTS) ? g_msgs : BENCH_MAX_REQUESTS;
+  static nats_request_t req;
+
+  for (size_t i = 0U; ok && (i < count); i++) {
+    uint32_t start = nats_posix_time_us();
+    if (nats_request_start(&g_pub, &req, "bench.echo", g_payload, size,
+                           BENCH_TIMEOUT_MS) != NATS_OK) {
+      ok = false;
+      break;
+    }
+
+    nats_err_t err = NATS_ERR_WOULD_BLOCK;
+    while (err == NATS_ERR_WOULD_BLOCK) {
+      bench_drain(&g_sub, &g_sub_tp);
+      (void)nats_process(&g_pub);
+      err = nats_request_check(&g_pub, &req);
+    }
+    if (err != NATS_OK) {
+      fprintf(stderr, "request failed: %s\n", nats_err_str(err));
+      ok = false;
+      break;
+    }
+    g_latency_us[i] = nats_posix_time_us() - start;
+  }
+
+  bench_close(&g_pub);
+  bench_close(&g_sub);
+  if (!ok) {
+    return false;
+  }
+
+  qsort(g_latency_us, count, sizeof(g_latency_us[0]), cmp_u32);
+  report("request", "size", size, "p50_us",
+         (double)percentile(g_latency_us, count, 50U), "");
+  report("request", "size", size, "p90_us",
+         (double)percentile(g_latency_us, count, 90U), "");
+  report("request", "size", size, "p99_us",
+         (double)percentile(g_latency_us, count, 99U), "");
+  report("request", "size", size, "max_us",
+         (double)g_latency_us[count - 1U], "");
+  return true;
+}
+
+static void count_cb(nats_client_t *client, const nats_msg_t *msg,
+                     void *userdata) {
+  (void)client;
+  (void)msg;
+  (void)userdata;
+  g_received++;
+}
+
+/**
+ * @brief Fan-in: N messages spread over k subjects into one client
+ */
+static bool bench_fanin(size_t subs) {
+  if (!bench_connect(&g_sub, &g_sub_tp, "bench-fanin")) {
+    return false;
+  }
+  if (!bench_connect(&g_pub, &g_pub_tp, "bench-pub")) {
+    bench_close(&g_sub);
+    return false;
+  }
+
+  char subjects[NATS_MAX_SUBSCRIPTIONS][32];
+  bool ok = true;
+  for (size_t i = 0U; ok && (i < subs); i++) {
+    (void)snprintf(subjects[i], sizeof(subjects[i]), "bench.fan.%zu", i);
+    ok = (nats_subscribe(&g_sub, subjects[i], count_cb, NULL, NULL) ==
+          NATS_OK);
+  }
+  ok = ok && bench_flush(&g_sub, &g_sub_tp);
+
+  g_received = 0U;
+  uint32_t start = nats_posix_time_us();
+  for (uint32_t i = 0U; ok && (i < g_msgs); i++) {
+    ok = (nats_publish(&g_pub, subjects[i % subs], g_payload,
+                       BENCH_FANIN_PAYLOAD) == NATS_OK);
+    if ((i & 0xFFU) == 0U) {
+      bench_drain(&g_sub, &g_sub_tp);
+    }
+  }
+
+  uint32_t wait_start = nats_posix_time_ms();
+  while (ok && (g_received < g_msgs)) {
+    if ((nats_posix_time_ms() - wait_start) > BENCH_TIMEOUT_MS) {
+      fprintf(stderr, "fan-in: %u of %u received\n", (unsigned)g_received,
+              (unsigned)g_msgs);
+      ok = false;
+      break;
+    }
+    (void)nats_posix_wait(&g_sub_tp, 10U);
+    bench_drain(&g_sub, &g_sub_tp);
+  }
+  uint32_t elapsed_us = nats_posix_time_us() - start;
+
+  bench_close(&g_pub);
+  bench_close(&g_sub);
+  if (!ok || (elapsed_us == 0U)) {
+    return false;
+  }
+
+  report("fanin", "subs", subs, "msgs/s",
+         (double)g_msgs / ((double)elapsed_us / 1e6), "");
+  return true;
+}
+
+/*============================================================================
+ * Main
+ *============================================================================*/
+
+static void usage(const char *prog) {
+  fprintf(stderr, "usage: %s [-s host] [-p port] [-n msgs] [-c]\n", prog);
+}
+
+int main(int argc, char **argv) {
+  for (int i = 1; i < argc; i++) {
+    if ((strcmp(argv[i], "-s") == 0) && ((i + 1) < argc)) {
+      g_host = argv[++i];
+    } else if ((strcmp(argv[i], "-p") == 0) && ((i + 1) < argc)) {
+      g_port = (uint16_t)atoi(argv[++i]);
+    } else if ((strcmp(argv[i], "-n") == 0) && ((i + 1) < argc)) {
+      g_msgs = (uint32_t)strtoul(argv[++i], NULL, 10);
+    } else if (strcmp(argv[i], "-c") == 0) {
+      g_csv = true;
+    } else {
+      usage(argv[0]);
+      return 2;
+    }
+  }
+  if (g_msgs == 0U) {
+    usage(argv[0]);
+    return 2;
+  }
+
+  for (size_t i = 0U; i < sizeof(g_payload); i++) {
+    g_payload[i] = (uint8_t)('a' + (i % 26U));
+  }
+
+  if (g_csv) {
+    printf("bench,param,value,metric,result\n");
+  } else {
+    printf("nats-esp32 %s bench: %s:%u, %u msgs\n\n", nats_version(), g_host,
+           (unsigned)g_port, (unsigned)g_msgs);
+  }
+
+  bool ok = true;
+  for (size_t i = 0U; i < BENCH_SIZE_COUNT; i++) {
+    ok = bench_publish(BENCH_SIZES[i]) && ok;
+  }
+  for (size_t i = 0U; i < BENCH_SIZE_COUNT; i++) {
+    ok = bench_request(BENCH_SIZES[i]) && ok;
+  }
+  for (size_t i = 0U; i < BENCH_SUB_COUNT; i++) {
+    ok = bench_fanin(BENCH_SUBS[i]) && ok;
+  }
+
+  return ok ? 0 : 1;
+}
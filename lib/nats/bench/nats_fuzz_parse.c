@@ -0,0 +1,256 @@
+/**
+ * @file nats_fuzz_parse.c
+ * @brief NATS Embedded Client - Receive Parser Fuzz Target
+ *
+ * libFuzzer target for parse_data(). Each input is fed to one client in a
+ * single piece and to a second client in a chunking chosen by the first
+ * input byte (byte-by-byte or pseudo-random slices). Besides memory
+ * errors, it aborts if the two clients disagree on what was delivered:
+ * the parser must not depend on where reads split the stream.
+ *
+ * Build (from lib/nats):
+ *   clang -g -O1 -fsanitize=fuzzer,address,undefined -DNATS_TESTING \
+ *      -Iproto -Iparse -Ijson bench/nats_fuzz_parse.c proto/nats_core.c \
+ *      parse/nats_parse.c json/nats_json.c -o nats_fuzz_parse
+ *   ./nats_fuzz_parse -max_len=16384
+ *
+ * Without libFuzzer (gcc, or to replay crash files), add -DNATS_FUZZ_MAIN
+ * and drop "fuzzer" from -fsanitize:
+ *   ./nats_fuzz_parse crash-<hash> ...
+ *
+ * Subscriptions in the fuzzed client: sid 1 "a.>" (callback), sid 2 "b.*"
+ * (streaming), sid 3 "c" (callback, auto-unsubscribes after 2 messages).
+ *
+ * @author Mario Schallner
+ * @copyright Copyright (c) 2026 Mario Schallner
+ */
+
+#include "nats_core.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*============================================================================
+ * Delivery Digest
+ *============================================================================*/
+
+/**
+ * @brief What one client saw, independent of chunk boundaries
+ *
+ * Streamed payloads are hashed as one byte sequence, so CHUNK events
+ * split differently by the two feeds still produce the same digest.
+ */
+typedef struct {
+  uint32_t hash;
+  uint32_t msgs;
+  uint32_t stream_begins;
+  uint32_t stream_ends;
+  uint32_t stream_aborts;
+  bool failed;
+} fuzz_digest_t;
+
+static uint32_t fnv1a(uint32_t hash, const void *data, size_t len) {
+  const uint8_t *p = (const uint8_t *)data;
+  for (size_t i = 0U; i < len; i++) {
+    hash ^= p[i];
+    hash *= 16777619U;
+  }
+  return hash;
+}
+
+static void digest_header(fuzz_digest_t *d, const nats_msg_t *msg) {
+  d->hash = fnv1a(d->hash, msg->subject, msg->subject_len);
+  d->hash = fnv1a(d->hash, &msg->sid, sizeof(msg->sid));
+  if (msg->reply != NULL) {
+    d->hash = fnv1a(d->hash, msg->reply, msg->reply_len);
+  }
+}
+
+static void msg_cb(nats_client_t *client, const nats_msg_t *msg,
+                   void *userdata) {
+  (void)client;
+  fuzz_digest_t *d = (fuzz_digest_t *)userdata;
+
+  if ((msg->subject == NULL) || (msg->subject[msg->subject_len] != '\0') ||
+      ((msg->data == NULL) && (msg->data_len > 0U))) {
+    abort();
+  }
+
+  digest_header(d, msg);
+  if (msg->data_len > 0U) {
+    d->hash = fnv1a(d->hash, msg->data, msg->data_len);
+  }
+  d->msgs++;
+}
+
+static void stream_cb(nats_client_t *client, nats_stream_event_t event,
+                      const nats_msg_t *msg, size_t offset, size_t total,
+                      void *userdata) {
+  (void)client;
+  fuzz_digest_t *d = (fuzz_digest_t *)userdata;
+
+  switch (event) {
+  case NATS_STREAM_BEGIN:
+    digest_header(d, msg);
+    d->hash = fnv1a(d->hash, &total, sizeof(total));
+    d->stream_begins++;
+    break;
+  case NATS_STREAM_CHUNK:
+    if ((offset + msg->data_len) > total) {
+      abort();
+    }
+    d->hash = fnv1a(d->hash, msg->data, msg->data_len);
+    break;
+  case NATS_STREAM_END:
+    if (offset != total) {
+      abort();
+    }
+    d->stream_ends++;
+    break;
+  case NATS_STREAM_ABORT:
+    d->stream_aborts++;
+    break;
+  default:
+    abort();
+  }
+}
+
+/*============================================================================
+ * Client Setup
+ *============================================================================*/
+
+static int32_t sink_send(void *ctx, const uint8_t *data, size_t len) {
+  (void)ctx;
+  (void)data;
+  return (int32_t)len;
+}
+
+static int32_t sink_recv(void *ctx, uint8_t *data, size_t len) {
+  (void)ctx;
+  (void)data;
+  (void)len;
+  return 0;
+}
+
+static bool sink_connected(void *ctx) {
+  (void)ctx;
+  return true;
+}
+
+static void sink_close(void *ctx) { (void)ctx; }
+
+static uint32_t fake_time_ms(void) { return 0U; }
+
+/* Clients are large (RX buffer) - keep them off the stack */
+static nats_client_t g_whole;
+static nats_client_t g_split;
+
+static void setup_client(nats_client_t *client, fuzz_digest_t *d) {
+  static const char info[] = "INFO {\"server_id\":\"fuzz\"}\r\n";
+  nats_transport_t transport = {sink_send, sink_recv, sink_connected,
+                                sink_close, NULL};
+  uint16_t sid = 0U;
+
+  (void)nats_init(client);
+  (void)nats_set_transport(client, &transport);
+  (void)nats_set_time_fn(client, fake_time_ms);
+  if ((nats_handshake(client) != NATS_OK) ||
+      (nats_test_feed(client, (const uint8_t *)info, sizeof(info) - 1U) !=
+       NATS_OK) ||
+      (nats_subscribe(client, "a.>", msg_cb, d, NULL) != NATS_OK) ||
+      (nats_subscribe_stream(client, "b.*", stream_cb, d, NULL) !=
+       NATS_OK) ||
+      (nats_subscribe(client, "c", msg_cb, d, &sid) != NATS_OK) ||
+      (nats_unsubscribe_after(client, sid, 2U) != NATS_OK)) {
+    abort();
+  }
+}
+
+/*============================================================================
+ * Fuzz Entry Point
+ *============================================================================*/
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+  if (size < 1U) {
+    return 0;
+  }
+
+  /* First byte picks the chunking: 0 = byte-by-byte, else PRNG seed */
+  uint32_t seed = data[0];
+  data++;
+  size--;
+
+  fuzz_digest_t whole;
+  fuzz_digest_t split;
+  memset(&whole, 0, sizeof(whole));
+  memset(&split, 0, sizeof(split));
+  whole.hash = 2166136261U;
+  split.hash = 2166136261U;
+
+  setup_client(&g_whole, &whole);
+  setup_client(&g_split, &split);
+
+  whole.failed = (nats_test_feed(&g_whole, data, size) != NATS_OK);
+
+  size_t pos = 0U;
+  while (pos < size) {
+    size_t n = 1U;
+    if (seed != 0U) {
+      seed = (seed * 1103515245U) + 12345U;
+      n = 1U + ((seed >> 16) % 512U);
+    }
+    if (n > (size - pos)) {
+      n = size - pos;
+    }
+    if (nats_test_feed(&g_split, &data[pos], n) != NATS_OK) {
+      split.failed = true;
+      break;
+    }
+    pos += n;
+  }
+
+  if ((whole.failed != split.failed) || (whole.hash != split.hash) ||
+      (whole.msgs != split.msgs) ||
+      (whole.stream_begins != split.stream_begins) ||
+      (whole.stream_ends != split.stream_ends)) {
+    abort();
+  }
+
+  /* Mid-stream disconnect must report ABORT exactly once */
+  (void)nats_close(&g_whole);
+  (void)nats_close(&g_split);
+  if ((whole.stream_begins != (whole.stream_ends + whole.stream_aborts)) ||
+      (split.stream_begins != (split.stream_ends + split.stream_aborts))) {
+    abort();
+  }
+
+  return 0;
+}
+
+#ifdef NATS_FUZZ_MAIN
+
+/*============================================================================
+ * Standalone Replay
+ *============================================================================*/
+
+int main(int argc, char **argv) {
+  static uint8_t buf[1U << 20];
+
+  for (int i = 1; i < argc; i++) {
+    FILE *f = fopen(argv[i], "rb");
+    if (f == NULL) {
+      perror(argv[i]);
+      return 1;
+    }
+    size_t len = fread(buf, 1U, sizeof(buf), f);
+    (void)fclose(f);
+
+    (void)LLVMFuzzerTestOneInput(buf, len);
+    printf("%s: ok (%zu bytes)\n", argv[i], len);
+  }
+  return 0;
+}
+
+#endif /* NATS_FUZZ_MAIN */
@@ -0,0 +1,433 @@
+/**
+ * @file nats_microbench.c
+ * @brief NATS Embedded Client - Parser Micro-Benchmarks
+ *
+ * Times the receive hot path one function at a time (command detection,
+ * MSG header parsing, subject matching, JSON lookup, number parsing) and
+ * end-to-end parse_data() on a recorded-style protocol stream fed in
+ * different chunk sizes. No server or network needed.
+ *
+ * Build (from lib/nats):
+ *   cc -O2 -std=gnu11 -DNATS_TESTING -Iproto -Iparse -Ijson \
+ *      bench/nats_microbench.c proto/nats_core.c parse/nats_parse.c \
+ *      json/nats_json.c -o nats_microbench
+ *
+ * Run:
+ *   ./nats_microbench [-n iterations] [-c]
+ *
+ * Report ns/op from an -O2 build on a quiet machine; compare before and
+ * after any parser change.
+ *
+ * @author Mario Schallner
+ * @copyright Copyright (c) 2026 Mario Schallner
+ */
+
+#include "nats_core.h"
+#include "nats_json.h"
+#include "nats_parse.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/*============================================================================
+ * Configuration
+ *============================================================================*/
+
+#define MB_DEFAULT_ITERS 1000000U
+#define MB_STREAM_MSGS 2000U
+#define MB_STREAM_MAX (MB_STREAM_MSGS * 384U)
+
+/** Chunk sizes for parse_data: byte-wise, small reads, TCP MSS, whole */
+static const size_t MB_CHUNKS[] = {1U, 64U, 1460U, 0U};
+#define MB_CHUNK_COUNT (sizeof(MB_CHUNKS) / sizeof(MB_CHUNKS[0]))
+
+/*============================================================================
+ * Inputs
+ *============================================================================*/
+
+/* Lines as they arrive from a server, \r\n stripped */
+static const char *const MB_LINES[] = {
+    "MSG wireclaw.sensors.temp 3 42",
+    "MSG _INBOX.a1b2c3d4e5f6.7 12 87",
+    "PING",
+    "PONG",
+    "+OK",
+    "MSG wireclaw.chat 1 wireclaw.reply.9f 156",
+    "-ERR 'Authorization Violation'",
+    "INFO {\"server_id\":\"N\",\"max_payload\":1048576}",
+};
+#define MB_LINE_COUNT (sizeof(MB_LINES) / sizeof(MB_LINES[0]))
+
+/* MSG headers as passed to parse_msg_header (after "MSG") */
+static const char *const MB_HEADERS[] = {
+    " wireclaw.sensors.temp 3 42",
+    " _INBOX.a1b2c3d4e5f6.7 12 87",
+    " wireclaw.chat 1 wireclaw.reply.9f 156",
+    " wireclaw.upload.rules 15 _INBOX.x9y8z7.22 4096",
+};
+#define MB_HEADER_COUNT (sizeof(MB_HEADERS) / sizeof(MB_HEADERS[0]))
+
+/* Subscription patterns against incoming subjects */
+static const char *const MB_PATTERNS[] = {
+    "wireclaw.chat",
+    "wireclaw.sensors.*",
+    "wireclaw.>",
+    "_INBOX.a1b2c3d4e5f6.*",
+};
+#define MB_PATTERN_COUNT (sizeof(MB_PATTERNS) / sizeof(MB_PATTERNS[0]))
+
+static const char *const MB_SUBJECTS[] = {
+    "wireclaw.chat",
+    "wireclaw.sensors.temp",
+    "wireclaw.upload.rules",
+    "_INBOX.a1b2c3d4e5f6.7",
+    "other.device.chat",
+};
+#define MB_SUBJECT_COUNT (sizeof(MB_SUBJECTS) / sizeof(MB_SUBJECTS[0]))
+
+static const char MB_INFO_JSON[] =
+    "{\"server_id\":\"NCXAMPLEABCDEFGHIJKLMNOPQRSTUVWXYZ\","
+    "\"server_name\":\"hub\",\"version\":\"2.10.14\",\"proto\":1,"
+    "\"go\":\"go1.21.9\",\"host\":\"0.0.0.0\",\"port\":4222,"
+    "\"headers\":true,\"auth_required\":false,\"max_payload\":1048576,"
+    "\"client_id\":42,\"client_ip\":\"192.168.1.50\"}";
+
+static const char *const MB_NUMBERS[] = {"0", "42", "4096", "1048576",
+                                         "65535"};
+#define MB_NUMBER_COUNT (sizeof(MB_NUMBERS) / sizeof(MB_NUMBERS[0]))
+
+/*============================================================================
+ * State
+ *============================================================================*/
+
+static uint32_t g_iters = MB_DEFAULT_ITERS;
+static bool g_csv = false;
+
+static nats_client_t g_client;
+static uint8_t g_stream[MB_STREAM_MAX];
+static size_t g_stream_len;
+static uint32_t g_stream_msgs;
+static uint32_t g_delivered;
+
+/* Keeps results observable so the compiler cannot drop the work */
+static volatile size_t g_sink;
+
+/*============================================================================
+ * Helpers
+ *============================================================================*/
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  (void)clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ((uint64_t)ts.tv_sec * 1000000000U) + (uint64_t)ts.tv_nsec;
+}
+
+static void report(const char *bench, const char *param, double ns_per_op,
+                   double mb_per_s) {
+  if (g_csv) {
+    printf("%s,%s,%.1f,%.1f\n", bench, param, ns_per_op, mb_per_s);
+  } else if (mb_per_s > 0.0) {
+    printf("%-16s %-10s %10.1f ns/op %10.1f MB/s\n", bench, param, ns_per_op,
+           mb_per_s);
+  } else {
+    printf("%-16s %-10s %10.1f ns/op\n", bench, param, ns_per_op);
+  }
+}
+
+/*--- Sink transport: accepts every write, never has data ---*/
+
+static int32_t sink_send(void *ctx, const uint8_t *data, size_t len) {
+  (void)ctx;
+  (void)data;
+  return (int32_t)len;
+}
+
+static int32_t sink_recv(void *ctx, uint8_t *data, size_t len) {
+  (void)ctx;
+  (void)data;
+  (void)len;
+  return 0;
+}
+
+static bool sink_connected(void *ctx) {
+  (void)ctx;
+  return true;
+}
+
+static void sink_close(void *ctx) { (void)ctx; }
+
+static uint32_t fake_time_ms(void) { return 0U; }
+
+static void count_cb(nats_client_t *client, const nats_msg_t *msg,
+                     void *userdata) {
+  (void)client;
+  (void)userdata;
+  g_sink += msg->data_len;
+  g_delivered++;
+}
+
+/**
+ * @brief Bring a client to CONNECTED over the sink transport
+ */
+static bool setup_client(nats_client_t *client) {
+  static const char info[] = "INFO {\"server_id\":\"bench\"}\r\n";
+  nats_transport_t transport = {sink_send, sink_recv, sink_connected,
+                                sink_close, NULL};
+
+  (void)nats_init(client);
+  (void)nats_set_transport(client, &transport);
+  (void)nats_set_time_fn(client, fake_time_ms);
+  if ((nats_handshake(client) != NATS_OK) ||
+      (nats_test_feed(client, (const uint8_t *)info, sizeof(info) - 1U) !=
+       NATS_OK)) {
+    return false;
+  }
+
+  return (nats_subscribe(client, "wireclaw.>", count_cb, NULL, NULL) ==
+          NATS_OK) &&
+         (nats_subscribe(client, "_INBOX.a1b2c3d4e5f6.*", count_cb, NULL,
+                         NULL) == NATS_OK) &&
+         nats_is_connected(client);
+}
+
+/**
+ * @brief Build a mixed stream: mostly MSG, some with reply, PING and +OK
+ */
+static void build_stream(void) {
+  static const size_t sizes[] = {16U, 42U, 128U, 300U};
+  uint8_t payload[300];
+  memset(payload, 'x', sizeof(payload));
+
+  size_t pos = 0U;
+  for (uint32_t i = 0U; i < MB_STREAM_MSGS; i++) {
+    size_t size = sizes[i % 4U];
+    int n;
+    if ((i % 3U) == 0U) {
+      n = snprintf((char *)&g_stream[pos], MB_STREAM_MAX - pos,
+                   "MSG wireclaw.chat 1 _INBOX.r%u.1 %zu\r\n", (unsigned)i,
+                   size);
+    } else {
+      n = snprintf((char *)&g_stream[pos], MB_STREAM_MAX - pos,
+                   "MSG _INBOX.a1b2c3d4e5f6.%u 2 %zu\r\n", (unsigned)i, size);
+    }
+    pos += (size_t)n;
+    memcpy(&g_stream[pos], payload, size);
+    pos += size;
+    memcpy(&g_stream[pos], "\r\n", 2U);
+    pos += 2U;
+
+    if ((i % 50U) == 0U) {
+      memcpy(&g_stream[pos], "PING\r\n+OK\r\n", 11U);
+      pos += 11U;
+    }
+  }
+  g_stream_len = pos;
+  g_stream_msgs = MB_STREAM_MSGS;
+}
+
+/*============================================================================
+ * Benchmarks
+ *============================================================================*/
+
+static void bench_detect_cmd(void) {
+  size_t lens[MB_LINE_COUNT];
+  for (size_t i = 0U; i < MB_LINE_COUNT; i++) {
+    lens[i] = strlen(MB_LINES[i]);
+  }
+
+  uint64_t start = now_ns();
+  for (uint32_t i = 0U; i < g_iters; i++) {
+    size_t k = i % MB_LINE_COUNT;
+    g_sink += (size_t)nats_test_detect_cmd(MB_LINES[k], lens[k]);
+  }
+  report("detect_cmd", "mixed", (double)(now_ns() - start) / g_iters, 0.0);
+}
+
+static void bench_msg_header(void) {
+  size_t lens[MB_HEADER_COUNT];
+  for (size_t i = 0U; i < MB_HEADER_COUNT; i++) {
+    lens[i] = strlen(MB_HEADERS[i]);
+  }
+
+  uint64_t start = now_ns();
+  for (uint32_t i = 0U; i < g_iters; i++) {
+    size_t k = i % MB_HEADER_COUNT;
+    g_sink += (size_t)nats_test_parse_msg_header(&g_client, MB_HEADERS[k],
+                                                 lens[k]);
+  }
+  report("parse_msg_header", "mixed", (double)(now_ns() - start) / g_iters,
+         0.0);
+}
+
+static void bench_subject_matches(void) {
+  size_t plen[MB_PATTERN_COUNT];
+  size_t slen[MB_SUBJECT_COUNT];
+  for (size_t i = 0U; i < MB_PATTERN_COUNT; i++) {
+    plen[i] = strlen(MB_PATTERNS[i]);
+  }
+  for (size_t i = 0U; i < MB_SUBJECT_COUNT; i++) {
+    slen[i] = strlen(MB_SUBJECTS[i]);
+  }
+
+  uint64_t start = now_ns();
+  for (uint32_t i = 0U; i < g_iters; i++) {
+    size_t p = i % MB_PATTERN_COUNT;
+    size_t s = (i / MB_PATTERN_COUNT) % MB_SUBJECT_COUNT;
+    g_sink += (size_t)nats_subject_matches(MB_PATTERNS[p], plen[p],
+                                           MB_SUBJECTS[s], slen[s]);
+  }
+  report("subject_matches", "mixed", (double)(now_ns() - start) / g_iters,
+         0.0);
+}
+
+static void bench_json_get(void) {
+  /* First key, last key, and a miss (full scan) */
+  static const char *const keys[] = {"server_id", "client_ip", "nonce"};
+  static const char *const names[] = {"first", "last", "miss"};
+
+  for (size_t k = 0U; k < 3U; k++) {
+    const char *val = NULL;
+    size_t val_len = 0U;
+    uint64_t start = now_ns();
+    for (uint32_t i = 0U; i < g_iters; i++) {
+      g_sink += (size_t)nats_json_get(MB_INFO_JSON, keys[k], &val, &val_len);
+      g_sink += val_len;
+    }
+    report("json_get", names[k], (double)(now_ns() - start) / g_iters, 0.0);
+  }
+}
+
+static void bench_parse_numbers(void) {
+  size_t lens[MB_NUMBER_COUNT];
+  for (size_t i = 0U; i < MB_NUMBER_COUNT; i++) {
+    lens[i] = strlen(MB_NUMBERS[i]);
+  }
+
+  uint64_t start = now_ns();
+  for (uint32_t i = 0U; i < g_iters; i++) {
+    size_t k = i % MB_NUMBER_COUNT;
+    uint32_t v = 0U;
+    (void)nats_parse_uint(MB_NUMBERS[k], lens[k], &v);
+    g_sink += v;
+  }
+  report("parse_uint", "mixed", (double)(now_ns() - start) / g_iters, 0.0);
+
+  start = now_ns();
+  for (uint32_t i = 0U; i < g_iters; i++) {
+    size_t k = i % MB_NUMBER_COUNT;
+    size_t v = 0U;
+    (void)nats_parse_size(MB_NUMBERS[k], lens[k], &v);
+    g_sink += v;
+  }
+  report("parse_size", "mixed", (double)(now_ns() - start) / g_iters, 0.0);
+}
+
+static void bench_find_crlf(void) {
+  /* A MSG line followed by its payload: CRLF after ~40 bytes */
+  const uint8_t *buf = g_stream;
+  size_t len = 256U;
+
+  uint64_t start = now_ns();
+  for (uint32_t i = 0U; i < g_iters; i++) {
+    g_sink += (size_t)nats_find_crlf(buf, len);
+  }
+  report("find_crlf", "msg_line", (double)(now_ns() - start) / g_iters, 0.0);
+}
+
+/**
+ * @brief Full receive path: parse and dispatch the stream in chunks
+ */
+static bool bench_parse_data(size_t chunk) {
+  uint32_t rounds = g_iters / (MB_STREAM_MSGS * 10U);
+  if (rounds == 0U) {
+    rounds = 1U;
+  }
+  if (chunk == 1U) {
+    rounds = (rounds + 9U) / 10U;
+  }
+
+  g_delivered = 0U;
+  uint64_t start = now_ns();
+  for (uint32_t r = 0U; r < rounds; r++) {
+    size_t step = (chunk == 0U) ? g_stream_len : chunk;
+    for (size_t pos = 0U; pos < g_stream_len; pos += step) {
+      size_t n = ((g_stream_len - pos) < step) ? (g_stream_len - pos) : step;
+      nats_err_t err = nats_test_feed(&g_client, &g_stream[pos], n);
+      if (err != NATS_OK) {
+        fprintf(stderr, "parse_data failed: %s\n", nats_err_str(err));
+        return false;
+      }
+    }
+  }
+  uint64_t elapsed = now_ns() - start;
+
+  if (g_delivered != (rounds * g_stream_msgs)) {
+    fprintf(stderr, "parse_data: %u of %u delivered\n", (unsigned)g_delivered,
+            (unsigned)(rounds * g_stream_msgs));
+    return false;
+  }
+
+  char param[32];
+  if (chunk == 0U) {
+    (void)snprintf(param, sizeof(param), "whole");
+  } else {
+    (void)snprintf(param, sizeof(param), "chunk=%zu", chunk);
+  }
+  double ns_per_msg = (double)elapsed / ((double)rounds * g_stream_msgs);
+  double mb_per_s = ((double)g_stream_len * rounds) / ((double)elapsed / 1e3);
+  report("parse_data", param, ns_per_msg, mb_per_s);
+  return true;
+}
+
+/*============================================================================
+ * Main
+ *============================================================================*/
+
+static void usage(const char *prog) {
+  fprintf(stderr, "usage: %s [-n iterations] [-c]\n", prog);
+}
+
+int main(int argc, char **argv) {
+  for (int i = 1; i < argc; i++) {
+    if ((strcmp(argv[i], "-n") == 0) && ((i + 1) < argc)) {
+      g_iters = (uint32_t)strtoul(argv[++i], NULL, 10);
+    } else if (strcmp(argv[i], "-c") == 0) {
+      g_csv = true;
+    } else {
+      usage(argv[0]);
+      return 2;
+    }
+  }
+  if (g_iters == 0U) {
+    usage(argv[0]);
+    return 2;
+  }
+
+  if (!setup_client(&g_client)) {
+    fprintf(stderr, "client setup failed\n");
+    return 1;
+  }
+  build_stream();
+
+  if (g_csv) {
+    printf("bench,param,ns_per_op,mb_per_s\n");
+  } else {
+    printf("nats-esp32 %s microbench: %u iterations, stream %zu bytes\n\n",
+           nats_version(), (unsigned)g_iters, g_stream_len);
+  }
+
+  bench_detect_cmd();
+  bench_msg_header();
+  bench_subject_matches();
+  bench_json_get();
+  bench_parse_numbers();
+  bench_find_crlf();
+
+  bool ok = true;
+  for (size_t i = 0U; i < MB_CHUNK_COUNT; i++) {
+    ok = bench_parse_data(MB_CHUNKS[i]) && ok;
+  }
+
+  return ok ? 0 : 1;
+}
@@ -78,6 +78,8 @@ struct Options {
     bool verbose = false;
     bool pedantic = false;
     bool echo = true;
+    uint16_t max_process_msgs = 0;
+    uint32_t max_process_us = 0;
 
     nats_options_t to_c() const {
         nats_options_t opts;
@@ -91,6 +93,8 @@ struct Options {
         opts.verbose = verbose;
         opts.pedantic = pedantic;
         opts.echo = echo;
+        opts.max_process_msgs = max_process_msgs;
+        opts.max_process_us = max_process_us;
         return opts;
     }
 };
@@ -106,6 +110,8 @@ struct Stats {
     uint32_t reconnects = 0;
     uint32_t pings_sent = 0;
     uint32_t pongs_recv = 0;
+    uint32_t msgs_dropped = 0;
+    uint32_t budget_hits = 0;
 
     static Stats from_c(const nats_stats_t& s) {
         Stats stats;
@@ -116,6 +122,8 @@ struct Stats {
         stats.reconnects = s.reconnects;
         stats.pings_sent = s.pings_sent;
         stats.pongs_recv = s.pongs_recv;
+        stats.msgs_dropped = s.msgs_dropped;
+        stats.budget_hits = s.budget_hits;
         return stats;
     }
 };
@@ -265,6 +273,14 @@ public:
         return nats_publish_reply(&client_, subject, reply, data, len);
     }
 
+    /**
+     * @brief Publish a payload gathered from several segments
+     */
+    Error publish_iov(const char* subject, const nats_iovec_t* iov,
+                      size_t iovcnt) {
+        return nats_publish_iov(&client_, subject, iov, iovcnt);
+    }
+
     //--- Subscribe ---//
 
     /**
@@ -284,6 +300,14 @@ public:
         return nats_subscribe_queue(&client_, subject, queue, cb, userdata, sid);
     }
 
+    /**
+     * @brief Subscribe with streaming delivery
+     */
+    Error subscribe_stream(const char* subject, nats_stream_cb_t cb,
+                           void* userdata, uint16_t* sid = nullptr) {
+        return nats_subscribe_stream(&client_, subject, cb, userdata, sid);
+    }
+
     /**
      * @brief Unsubscribe
      */
@@ -353,6 +377,13 @@ public:
         return nats_is_connected(&client_);
     }
 
+    /**
+     * @brief Check if the last process() stopped on its budget
+     */
+    bool work_pending() const {
+        return nats_work_pending(&client_);
+    }
+
     /**
      * @brief Get last error
      */
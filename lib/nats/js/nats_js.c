@@ -0,0 +1,361 @@
+/**
+ * @file nats_js.c
+ * @brief NATS Embedded Client - JetStream Publishing Implementation
+ *
+ * @author Mario Schallner
+ * @copyright Copyright (c) 2026 Mario Schallner
+ */
+
+#include "nats_js.h"
+#include "../json/nats_json.h"
+#include "../parse/nats_parse.h"
+#include <stdio.h>
+#include <string.h>
+
+/** Largest PubAck payload inspected (acks are ~60 bytes, errors ~120) */
+#define NATS_JS_ACK_JSON_LEN 192U
+
+/*============================================================================
+ * Internal Helpers
+ *============================================================================*/
+
+/**
+ * @brief Wrap-safe timer elapsed check (see nats_core.c)
+ */
+static bool js_timer_elapsed(uint32_t now, uint32_t start,
+                             uint32_t interval_ms) {
+  return ((int32_t)(now - start) >= (int32_t)interval_ms);
+}
+
+/**
+ * @brief Find the pending slot for a publish ID
+ */
+static nats_js_pending_t *js_find_pending(nats_js_t *js, uint32_t id) {
+  for (size_t i = 0U; i < NATS_JS_MAX_PENDING; i++) {
+    if (js->pending[i].in_use && (js->pending[i].id == id)) {
+      return &js->pending[i];
+    }
+  }
+  return NULL;
+}
+
+/**
+ * @brief Release a slot and report its outcome
+ */
+static void js_complete(nats_js_t *js, nats_js_pending_t *slot,
+                        nats_js_ack_t *ack) {
+  ack->id = slot->id;
+  slot->in_use = false;
+  if (js->pending_count > 0U) {
+    js->pending_count--;
+  }
+
+  if (js->ack_cb != NULL) {
+    js->ack_cb(js, ack, js->ack_userdata);
+  }
+}
+
+/**
+ * @brief Send (or re-send) a pending publish with its ack reply subject
+ */
+static nats_err_t js_send(nats_js_t *js, const nats_js_pending_t *slot) {
+  char reply[NATS_MAX_SUBJECT_LEN];
+  int ret = snprintf(reply, sizeof(reply), "%s%lu", js->inbox,
+                     (unsigned long)slot->id);
+  if ((ret < 0) || ((size_t)ret >= sizeof(reply))) {
+    return NATS_ERR_BUFFER_OVERFLOW;
+  }
+
+  const uint8_t *data = &slot->buf[slot->subject_len + 1U];
+  return nats_publish_reply(js->client, (const char *)slot->buf, reply,
+                            (slot->data_len > 0U) ? data : NULL,
+                            slot->data_len);
+}
+
+/**
+ * @brief Inbox callback - match a PubAck to its pending publish
+ */
+static void js_ack_cb(nats_client_t *client, const nats_msg_t *msg,
+                      void *userdata) {
+  (void)client;
+  nats_js_t *js = (nats_js_t *)userdata;
+
+  if ((js == NULL) || (msg->subject_len <= js->inbox_len)) {
+    return;
+  }
+
+  /* Last token of the reply subject is the publish ID */
+  uint32_t id = 0U;
+  if (nats_parse_uint(&msg->subject[js->inbox_len],
+                      msg->subject_len - js->inbox_len,
+                      &id) != NATS_PARSE_OK) {
+    return;
+  }
+
+  nats_js_pending_t *slot = js_find_pending(js, id);
+  if (slot == NULL) {
+    /* Late ack for a publish already re-sent and acked, or expired */
+    return;
+  }
+
+  /* Payload is not NUL-terminated in the RX buffer */
+  char json[NATS_JS_ACK_JSON_LEN];
+  size_t len = msg->data_len;
+  if (len >= sizeof(json)) {
+    len = sizeof(json) - 1U;
+  }
+  if ((msg->data != NULL) && (len > 0U)) {
+    memcpy(json, msg->data, len);
+  }
+  json[len] = '\0';
+
+  nats_js_ack_t ack;
+  memset(&ack, 0, sizeof(ack));
+
+  const char *err_obj = NULL;
+  size_t err_len = 0U;
+  if (nats_json_get(json, "error", &err_obj, &err_len) ==
+      NATS_JSON_OBJECT) {
+    ack.status = NATS_JS_ACK_ERROR;
+    ack.err_code = nats_json_get_int(err_obj, "err_code",
+                                     nats_json_get_int(err_obj, "code", 0));
+    js->stats.errors++;
+  } else if (nats_json_get_string(json, "stream", ack.stream,
+                                  sizeof(ack.stream)) != 0) {
+    ack.status = NATS_JS_ACK_OK;
+    ack.seq = nats_json_get_uint(json, "seq", 0U);
+    ack.duplicate = nats_json_get_bool(json, "duplicate", false);
+    js->stats.acked++;
+    if (ack.duplicate) {
+      js->stats.duplicates++;
+    }
+  } else {
+    /* Not a PubAck: no stream captured the subject */
+    ack.status = NATS_JS_ACK_ERROR;
+    js->stats.errors++;
+  }
+
+  js_complete(js, slot, &ack);
+}
+
+/**
+ * @brief Subscribe the wildcard ack inbox (once per context)
+ */
+static nats_err_t js_ensure_inbox(nats_js_t *js) {
+  if (js->subscribed) {
+    return NATS_OK;
+  }
+
+  char pattern[NATS_MAX_SUBJECT_LEN];
+  nats_err_t err = nats_new_inbox(js->client, pattern, sizeof(pattern));
+  if (err != NATS_OK) {
+    return err;
+  }
+
+  /* "_INBOX.<id>." is the reply prefix, "_INBOX.<id>.*" the subscription */
+  size_t len = strlen(pattern);
+  if ((len + 2U) >= sizeof(pattern)) {
+    return NATS_ERR_BUFFER_OVERFLOW;
+  }
+  pattern[len] = '.';
+  pattern[len + 1U] = '\0';
+  (void)nats_safe_strcpy(js->inbox, pattern, sizeof(js->inbox));
+  js->inbox_len = len + 1U;
+  pattern[len + 1U] = '*';
+  pattern[len + 2U] = '\0';
+
+  err = nats_subscribe(js->client, pattern, js_ack_cb, js, &js->sid);
+  if (err == NATS_OK) {
+    js->subscribed = true;
+  }
+  return err;
+}
+
+/*============================================================================
+ * Public API Implementation
+ *============================================================================*/
+
+nats_err_t nats_js_init(nats_js_t *js, nats_client_t *client,
+                        const nats_js_options_t *opts) {
+  if ((js == NULL) || (client == NULL)) {
+    return NATS_ERR_INVALID_ARG;
+  }
+
+  memset(js, 0, sizeof(nats_js_t));
+  js->client = client;
+  js->next_id = 1U;
+
+  if (opts != NULL) {
+    js->opts = *opts;
+  } else {
+    js->opts.max_retries = NATS_JS_MAX_RETRIES;
+  }
+  if (js->opts.ack_timeout_ms == 0U) {
+    js->opts.ack_timeout_ms = NATS_JS_ACK_TIMEOUT_MS;
+  }
+
+  return NATS_OK;
+}
+
+nats_err_t nats_js_set_ack_callback(nats_js_t *js, nats_js_ack_cb_t cb,
+                                    void *userdata) {
+  if (js == NULL) {
+    return NATS_ERR_INVALID_ARG;
+  }
+
+  js->ack_cb = cb;
+  js->ack_userdata = userdata;
+  return NATS_OK;
+}
+
+nats_err_t nats_js_publish(nats_js_t *js, const char *subject,
+                           const uint8_t *data, size_t len, uint32_t *id) {
+  nats_iovec_t iov = {.base = data, .len = len};
+  return nats_js_publish_iov(js, subject, &iov, 1U, id);
+}
+
+nats_err_t nats_js_publish_iov(nats_js_t *js, const char *subject,
+                               const nats_iovec_t *iov, size_t iovcnt,
+                               uint32_t *id) {
+  if ((js == NULL) || (js->client == NULL) || (subject == NULL)) {
+    return NATS_ERR_INVALID_ARG;
+  }
+  if ((iov == NULL) && (iovcnt > 0U)) {
+    return NATS_ERR_INVALID_ARG;
+  }
+  if (!nats_is_connected(js->client)) {
+    return NATS_ERR_NOT_CONNECTED;
+  }
+
+  size_t subject_len = strlen(subject);
+  if ((subject_len == 0U) || ((subject_len + 1U) > NATS_JS_SLOT_SIZE)) {
+    return NATS_ERR_BUFFER_OVERFLOW;
+  }
+
+  size_t len = 0U;
+  for (size_t i = 0U; i < iovcnt; i++) {
+    if ((iov[i].base == NULL) && (iov[i].len > 0U)) {
+      return NATS_ERR_INVALID_ARG;
+    }
+    if (iov[i].len > (NATS_JS_SLOT_SIZE - subject_len - 1U - len)) {
+      return NATS_ERR_BUFFER_OVERFLOW;
+    }
+    len += iov[i].len;
+  }
+
+  /* Find free window slot */
+  nats_js_pending_t *slot = NULL;
+  for (size_t i = 0U; i < NATS_JS_MAX_PENDING; i++) {
+    if (!js->pending[i].in_use) {
+      slot = &js->pending[i];
+      break;
+    }
+  }
+  if (slot == NULL) {
+    js->stats.window_full++;
+    return NATS_ERR_BUFFER_FULL;
+  }
+
+  nats_err_t err = js_ensure_inbox(js);
+  if (err != NATS_OK) {
+    return err;
+  }
+
+  /* Gather subject and payload into the retry slot */
+  memcpy(slot->buf, subject, subject_len + 1U);
+  size_t pos = subject_len + 1U;
+  for (size_t i = 0U; i < iovcnt; i++) {
+    if (iov[i].len > 0U) {
+      memcpy(&slot->buf[pos], iov[i].base, iov[i].len);
+      pos += iov[i].len;
+    }
+  }
+  slot->subject_len = subject_len;
+  slot->data_len = len;
+  slot->id = js->next_id++;
+  if (js->next_id == 0U) {
+    js->next_id = 1U; /* 0 is never a valid ID */
+  }
+
+  err = js_send(js, slot);
+  if (err != NATS_OK) {
+    return err;
+  }
+
+  slot->sent_at = js->client->time_fn();
+  slot->attempts = 1U;
+  slot->in_use = true;
+  js->pending_count++;
+  js->stats.published++;
+
+  if (id != NULL) {
+    *id = slot->id;
+  }
+
+  return NATS_OK;
+}
+
+nats_err_t nats_js_process(nats_js_t *js) {
+  if ((js == NULL) || (js->client == NULL)) {
+    return NATS_ERR_INVALID_ARG;
+  }
+  if (js->pending_count == 0U) {
+    return NATS_OK;
+  }
+
+  uint32_t now = js->client->time_fn();
+  bool connected = nats_is_connected(js->client);
+  nats_err_t result = NATS_OK;
+
+  for (size_t i = 0U; i < NATS_JS_MAX_PENDING; i++) {
+    nats_js_pending_t *slot = &js->pending[i];
+    if (!slot->in_use) {
+      continue;
+    }
+    if (!js_timer_elapsed(now, slot->sent_at, js->opts.ack_timeout_ms)) {
+      continue;
+    }
+
+    if (slot->attempts > js->opts.max_retries) {
+      nats_js_ack_t ack;
+      memset(&ack, 0, sizeof(ack));
+      ack.status = NATS_JS_ACK_TIMEOUT;
+      js->stats.timeouts++;
+      js_complete(js, slot, &ack);
+      continue;
+    }
+
+    /* Hold the slot while disconnected; the retry budget is for lost
+     * acks, not for outages. */
+    if (!connected) {
+      continue;
+    }
+
+    nats_err_t err = js_send(js, slot);
+    slot->sent_at = now;
+    if (err == NATS_OK) {
+      slot->attempts++;
+      js->stats.retries++;
+    } else if (result == NATS_OK) {
+      result = err;
+    }
+  }
+
+  return result;
+}
+
+size_t nats_js_pending(const nats_js_t *js) {
+  if (js == NULL) {
+    return 0U;
+  }
+  return (size_t)js->pending_count;
+}
+
+nats_err_t nats_js_get_stats(const nats_js_t *js, nats_js_stats_t *stats) {
+  if ((js == NULL) || (stats == NULL)) {
+    return NATS_ERR_INVALID_ARG;
+  }
+
+  *stats = js->stats;
+  return NATS_OK;
+}
@@ -0,0 +1,273 @@
+/**
+ * @file nats_js.h
+ * @brief NATS Embedded Client - JetStream Publishing
+ *
+ * Pipelined JetStream publish with asynchronous PubAck tracking.
+ * Publishes go out as core PUBs with a per-message reply subject under a
+ * single wildcard inbox subscription. Up to NATS_JS_MAX_PENDING publishes
+ * may be awaiting their PubAck at once; a publish whose ack does not arrive
+ * within the ack timeout is re-sent from its retry slot until the retry
+ * budget is spent.
+ *
+ * Delivery is at-least-once: a retried publish whose first ack was lost
+ * may be stored twice by the stream.
+ *
+ * @author Mario Schallner
+ * @copyright Copyright (c) 2026 Mario Schallner
+ *
+ * MISRA-C:2012 Compliance Notes:
+ * - No dynamic memory allocation (caller provides nats_js_t storage)
+ * - No recursion
+ * - All functions return explicit error codes
+ */
+
+#ifndef NATS_JS_H
+#define NATS_JS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*============================================================================
+ * Includes
+ *============================================================================*/
+
+#include "../proto/nats_core.h"
+
+/*============================================================================
+ * Configuration - Override these before including if needed
+ *============================================================================*/
+
+/** Maximum publishes awaiting a PubAck (window size) */
+#ifndef NATS_JS_MAX_PENDING
+#define NATS_JS_MAX_PENDING 8U
+#endif
+
+/** Retry slot size: subject + NUL + payload must fit */
+#ifndef NATS_JS_SLOT_SIZE
+#define NATS_JS_SLOT_SIZE 384U
+#endif
+
+/** Default time to wait for a PubAck before re-sending */
+#ifndef NATS_JS_ACK_TIMEOUT_MS
+#define NATS_JS_ACK_TIMEOUT_MS 2000U
+#endif
+
+/** Default number of re-sends before a publish is reported as failed */
+#ifndef NATS_JS_MAX_RETRIES
+#define NATS_JS_MAX_RETRIES 3U
+#endif
+
+/** Maximum stream name length kept from a PubAck */
+#ifndef NATS_JS_MAX_STREAM_LEN
+#define NATS_JS_MAX_STREAM_LEN 32U
+#endif
+
+NATS_STATIC_ASSERT(NATS_JS_MAX_PENDING <= 255U,
+                   "JetStream window exceeds uint8_t range");
+
+/*============================================================================
+ * Types
+ *============================================================================*/
+
+/**
+ * @brief Final outcome of a JetStream publish
+ */
+typedef enum {
+  NATS_JS_ACK_OK = 0,      /**< Stored by the stream */
+  NATS_JS_ACK_ERROR = 1,   /**< Server returned a JetStream error */
+  NATS_JS_ACK_TIMEOUT = 2, /**< No PubAck after all retries */
+
+  NATS_JS_ACK_COUNT
+} nats_js_ack_status_t;
+
+/**
+ * @brief PubAck report passed to the ack callback
+ */
+typedef struct {
+  nats_js_ack_status_t status;          /**< Outcome */
+  uint32_t id;                          /**< ID from nats_js_publish() */
+  uint32_t seq;                         /**< Stream sequence (OK only) */
+  int32_t err_code;                     /**< JetStream err_code (ERROR only) */
+  bool duplicate;                       /**< Server flagged as duplicate */
+  char stream[NATS_JS_MAX_STREAM_LEN];  /**< Stream name (OK only) */
+} nats_js_ack_t;
+
+/* Forward declaration */
+struct nats_js;
+
+/**
+ * @brief PubAck callback function type
+ *
+ * Called exactly once per accepted publish, from nats_process() (ack or
+ * error) or nats_js_process() (timeout).
+ *
+ * @param js        JetStream context
+ * @param ack       Outcome (valid only during callback)
+ * @param userdata  User-provided context pointer
+ */
+typedef void (*nats_js_ack_cb_t)(struct nats_js *js, const nats_js_ack_t *ack,
+                                 void *userdata);
+
+/**
+ * @brief JetStream publish options
+ */
+typedef struct {
+  uint32_t ack_timeout_ms; /**< PubAck wait before re-send (0 = default) */
+  uint8_t max_retries;     /**< Re-sends before failing */
+} nats_js_options_t;
+
+/**
+ * @brief Outstanding publish (internal)
+ *
+ * buf holds "subject\0payload" so a timed-out publish can be re-sent
+ * without the caller keeping its payload alive.
+ */
+typedef struct {
+  uint8_t buf[NATS_JS_SLOT_SIZE];
+  size_t subject_len;  /**< Subject length (excluding NUL) */
+  size_t data_len;     /**< Payload length */
+  uint32_t id;         /**< Publish ID (also the reply token) */
+  uint32_t sent_at;    /**< Timestamp of last send attempt */
+  uint8_t attempts;    /**< Sends so far */
+  bool in_use;         /**< Slot holds an unacked publish */
+} nats_js_pending_t;
+
+/**
+ * @brief JetStream publish statistics
+ */
+typedef struct {
+  uint32_t published;   /**< Publishes accepted into the window */
+  uint32_t acked;       /**< PubAcks received */
+  uint32_t duplicates;  /**< PubAcks flagged duplicate */
+  uint32_t errors;      /**< JetStream error replies */
+  uint32_t retries;     /**< Re-sends after ack timeout */
+  uint32_t timeouts;    /**< Publishes failed after all retries */
+  uint32_t window_full; /**< Publishes rejected with a full window */
+} nats_js_stats_t;
+
+/**
+ * @brief JetStream publish context
+ */
+typedef struct nats_js {
+  nats_client_t *client;                   /**< Underlying core client */
+  char inbox[NATS_MAX_SUBJECT_LEN];        /**< "_INBOX.<id>." ack prefix */
+  size_t inbox_len;                        /**< Prefix length */
+  uint16_t sid;                            /**< Ack inbox subscription */
+  bool subscribed;                         /**< Ack inbox is subscribed */
+  uint32_t next_id;                        /**< Next publish ID */
+  nats_js_options_t opts;                  /**< Effective options */
+  nats_js_ack_cb_t ack_cb;                 /**< Ack callback (optional) */
+  void *ack_userdata;                      /**< Ack callback context */
+  nats_js_pending_t pending[NATS_JS_MAX_PENDING];
+  uint8_t pending_count;                   /**< Slots in use */
+  nats_js_stats_t stats;
+} nats_js_t;
+
+/*============================================================================
+ * API Functions
+ *============================================================================*/
+
+/**
+ * @brief Initialize a JetStream publish context
+ *
+ * The ack inbox is subscribed lazily on the first publish, so this may
+ * be called before the client is connected.
+ *
+ * @param js        Context to initialize
+ * @param client    Initialized core client
+ * @param opts      Options (NULL for defaults)
+ * @return          NATS_OK on success, error code otherwise
+ */
+nats_err_t nats_js_init(nats_js_t *js, nats_client_t *client,
+                        const nats_js_options_t *opts);
+
+/**
+ * @brief Set the PubAck callback
+ *
+ * @param js        JetStream context
+ * @param cb        Ack callback (NULL to disable)
+ * @param userdata  User context for callback
+ * @return          NATS_OK on success, error code otherwise
+ */
+nats_err_t nats_js_set_ack_callback(nats_js_t *js, nats_js_ack_cb_t cb,
+                                    void *userdata);
+
+/**
+ * @brief Publish to a JetStream-captured subject
+ *
+ * Does not wait for the PubAck. The outcome is reported through the ack
+ * callback once the ack arrives or the retries are spent.
+ *
+ * @param js        JetStream context
+ * @param subject   Subject (must be captured by a stream)
+ * @param data      Payload data (can be NULL if len is 0)
+ * @param len       Payload length
+ * @param[out] id   Publish ID (output, can be NULL)
+ * @return          NATS_OK if sent and tracked,
+ *                  NATS_ERR_BUFFER_FULL if the ack window is full,
+ *                  NATS_ERR_BUFFER_OVERFLOW if subject + payload exceed
+ *                  NATS_JS_SLOT_SIZE, error code otherwise
+ */
+nats_err_t nats_js_publish(nats_js_t *js, const char *subject,
+                           const uint8_t *data, size_t len, uint32_t *id);
+
+/**
+ * @brief Publish a payload gathered from several segments
+ *
+ * Segments are gathered into the retry slot, so they need not outlive
+ * the call.
+ *
+ * @param js        JetStream context
+ * @param subject   Subject (must be captured by a stream)
+ * @param iov       Payload segments (can be NULL if iovcnt is 0)
+ * @param iovcnt    Number of segments
+ * @param[out] id   Publish ID (output, can be NULL)
+ * @return          As nats_js_publish()
+ */
+nats_err_t nats_js_publish_iov(nats_js_t *js, const char *subject,
+                               const nats_iovec_t *iov, size_t iovcnt,
+                               uint32_t *id);
+
+/**
+ * @brief Re-send timed-out publishes and expire exhausted ones
+ *
+ * Call this regularly after nats_process().
+ *
+ * @param js        JetStream context
+ * @return          NATS_OK on success, error code otherwise
+ */
+nats_err_t nats_js_process(nats_js_t *js);
+
+/**
+ * @brief Number of publishes awaiting a PubAck
+ *
+ * @param js        JetStream context
+ * @return          Outstanding publish count
+ */
+size_t nats_js_pending(const nats_js_t *js);
+
+/**
+ * @brief Get JetStream publish statistics
+ *
+ * @param js        JetStream context
+ * @param[out] stats    Statistics output
+ * @return          NATS_OK on success, error code otherwise
+ */
+nats_err_t nats_js_get_stats(const nats_js_t *js, nats_js_stats_t *stats);
+
+/*============================================================================
+ * Default Options Initializer
+ *============================================================================*/
+
+/**
+ * @brief Default JetStream options initializer
+ */
+#define NATS_JS_OPTIONS_DEFAULT                                                \
+  {.ack_timeout_ms = NATS_JS_ACK_TIMEOUT_MS, .max_retries = NATS_JS_MAX_RETRIES}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* NATS_JS_H */
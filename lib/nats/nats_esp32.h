@@ -19,11 +19,14 @@
 /* JSON utilities */
 #include "json/nats_json.h"
 
+/* JetStream publishing */
+#include "js/nats_js.h"
+
 /* Platform-specific transport (auto-detected) */
 #if defined(ARDUINO)
 #include "transport/nats_transport_arduino.h"
 #elif defined(__unix__) || defined(__APPLE__)
-#error "POSIX transport not included in this copy"
+#include "transport/nats_transport_posix.h"
 #endif
 
 #endif /* NATS_ESP32_H */
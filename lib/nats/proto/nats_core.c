@@ -167,6 +167,46 @@ static nats_err_t send_linef(nats_client_t *client, const char *fmt, ...) {
   return send_line(client, (const char *)client->tx_buf);
 }
 
+/**
+ * @brief Send bytes coalesced in tx_buf
+ */
+static nats_err_t tx_flush(nats_client_t *client) {
+  nats_err_t err = send_data(client, client->tx_buf, client->tx_len);
+  client->tx_len = 0U;
+  return err;
+}
+
+/**
+ * @brief Append to tx_buf, flushing when full
+ *
+ * Blocks too large to coalesce are sent directly after a flush.
+ */
+static nats_err_t tx_append(nats_client_t *client, const uint8_t *data,
+                            size_t len) {
+  nats_err_t err;
+
+  if (len >= sizeof(client->tx_buf)) {
+    err = tx_flush(client);
+    if (err != NATS_OK) {
+      return err;
+    }
+    return send_data(client, data, len);
+  }
+
+  if (len > (sizeof(client->tx_buf) - client->tx_len)) {
+    err = tx_flush(client);
+    if (err != NATS_OK) {
+      return err;
+    }
+  }
+
+  if (len > 0U) {
+    memcpy(&client->tx_buf[client->tx_len], data, len);
+    client->tx_len += len;
+  }
+  return NATS_OK;
+}
+
 /*============================================================================
  * Protocol Handlers
  *============================================================================*/
@@ -228,13 +268,25 @@ static nats_err_t send_connect(nats_client_t *client) {
   /* Re-subscribe existing subscriptions (for reconnect) */
   nats_err_t resub_err = NATS_OK;
   for (size_t i = 0U; i < NATS_MAX_SUBSCRIPTIONS; i++) {
-    if (client->subs[i].active) {
-      err = send_linef(client, "SUB %s %u", client->subs[i].subject,
-                       client->subs[i].sid);
-      /* Track first error - subscriptions may be silently lost */
-      if ((err != NATS_OK) && (resub_err == NATS_OK)) {
-        resub_err = err;
-      }
+    const nats_sub_t *sub = &client->subs[i];
+    if (!sub->active) {
+      continue;
+    }
+
+    if (sub->queue[0] != '\0') {
+      err = send_linef(client, "SUB %s %s %u", sub->subject, sub->queue,
+                       sub->sid);
+    } else {
+      err = send_linef(client, "SUB %s %u", sub->subject, sub->sid);
+    }
+    /* The server forgot any auto-unsubscribe limit along with the SUB */
+    if ((err == NATS_OK) && (sub->max_msgs > sub->recv_msgs)) {
+      err = send_linef(client, "UNSUB %u %u", sub->sid,
+                       (unsigned)(sub->max_msgs - sub->recv_msgs));
+    }
+    /* Track first error - subscriptions may be silently lost */
+    if ((err != NATS_OK) && (resub_err == NATS_OK)) {
+      resub_err = err;
     }
   }
 
@@ -362,8 +414,9 @@ static bool parse_msg_header(nats_client_t *client, const char *header,
     client->parser.expected_bytes = parse_uint(p, len);
   }
 
-  /* Validate payload size */
-  if (client->parser.expected_bytes > NATS_MAX_PAYLOAD_LEN) {
+  /* Validate payload size - sizes above NATS_MAX_PAYLOAD_LEN are streamed
+   * or skipped by the caller */
+  if (client->parser.expected_bytes > NATS_MAX_STREAM_PAYLOAD_LEN) {
     return false; /* Payload too large */
   }
 
@@ -371,50 +424,175 @@ static bool parse_msg_header(nats_client_t *client, const char *header,
 }
 
 /**
- * @brief Deliver message to subscription callback
+ * @brief Find the active subscription for the message being parsed
  */
-static void deliver_msg(nats_client_t *client, const uint8_t *payload,
-                        size_t len) {
-  /* Find subscription */
-  nats_sub_t *sub = NULL;
+static nats_sub_t *find_msg_sub(nats_client_t *client) {
   for (size_t i = 0U; i < NATS_MAX_SUBSCRIPTIONS; i++) {
     if (client->subs[i].active &&
         (client->subs[i].sid == client->parser.msg_sid)) {
-      sub = &client->subs[i];
-      break;
+      return &client->subs[i];
     }
   }
+  return NULL;
+}
+
+/**
+ * @brief Build message struct for the message being parsed
+ */
+static void build_msg(const nats_client_t *client, nats_msg_t *msg,
+                      const uint8_t *payload, size_t len) {
+  bool has_reply = (client->parser.msg_reply[0] != '\0');
+  msg->subject = client->parser.msg_subject;
+  msg->subject_len = strlen(client->parser.msg_subject);
+  msg->reply = has_reply ? client->parser.msg_reply : NULL;
+  msg->reply_len = has_reply ? strlen(client->parser.msg_reply) : 0U;
+  msg->data = payload;
+  msg->data_len = len;
+  msg->sid = client->parser.msg_sid;
+}
+
+/**
+ * @brief Emit a streaming event for the message being parsed
+ */
+static void emit_stream(nats_client_t *client, nats_sub_t *sub,
+                        nats_stream_event_t event, const uint8_t *payload,
+                        size_t len, size_t offset) {
+  nats_msg_t msg;
+  build_msg(client, &msg, payload, len);
+  sub->stream_cb(client, event, &msg, offset, client->parser.expected_bytes,
+                 sub->userdata);
+}
 
+/**
+ * @brief Account a completed message and apply auto-unsubscribe
+ */
+static void finish_msg(nats_client_t *client, nats_sub_t *sub, size_t len) {
+  client->stats.msgs_in++;
+  client->stats.bytes_in += (uint32_t)len;
+  sub->recv_msgs++;
+
+  /* Auto-unsubscribe if max reached */
+  if ((sub->max_msgs > 0U) && (sub->recv_msgs >= sub->max_msgs)) {
+    sub->active = false;
+  }
+}
+
+/**
+ * @brief Deliver message to subscription callback
+ */
+static void deliver_msg(nats_client_t *client, const uint8_t *payload,
+                        size_t len) {
+  nats_sub_t *sub = find_msg_sub(client);
   if (sub == NULL) {
     /* No subscription found, ignore message */
     return;
   }
 
-  /* Build message struct */
-  bool has_reply = (client->parser.msg_reply[0] != '\0');
-  nats_msg_t msg = {.subject = client->parser.msg_subject,
-                    .subject_len = strlen(client->parser.msg_subject),
-                    .reply = has_reply ? client->parser.msg_reply : NULL,
-                    .reply_len =
-                        has_reply ? strlen(client->parser.msg_reply) : 0U,
-                    .data = payload,
-                    .data_len = len,
-                    .sid = client->parser.msg_sid};
-
-  /* Update stats */
-  client->stats.msgs_in++;
-  client->stats.bytes_in += (uint32_t)len;
-  sub->recv_msgs++;
+  if (sub->stream_cb != NULL) {
+    /* Fully buffered message to a streaming subscription */
+    emit_stream(client, sub, NATS_STREAM_BEGIN, NULL, 0U, 0U);
+    if (len > 0U) {
+      emit_stream(client, sub, NATS_STREAM_CHUNK, payload, len, 0U);
+    }
+    emit_stream(client, sub, NATS_STREAM_END, NULL, 0U, len);
+    finish_msg(client, sub, len);
+    return;
+  }
+
+  nats_msg_t msg;
+  build_msg(client, &msg, payload, len);
 
   /* Invoke callback */
   if (sub->callback != NULL) {
     sub->callback(client, &msg, sub->userdata);
   }
 
-  /* Auto-unsubscribe if max reached */
-  if ((sub->max_msgs > 0U) && (sub->recv_msgs >= sub->max_msgs)) {
-    sub->active = false;
+  finish_msg(client, sub, len);
+}
+
+/**
+ * @brief Start consuming a payload too large for the receive buffer
+ *
+ * Streaming subscriptions get it in fragments; for anything else the
+ * payload is discarded so the connection survives.
+ */
+static void begin_large_msg(nats_client_t *client) {
+  client->parser.stream_offset = 0U;
+
+  nats_sub_t *sub = find_msg_sub(client);
+  if ((sub != NULL) && (sub->stream_cb != NULL)) {
+    client->parser.state = NATS_PARSE_MSG_STREAM;
+    emit_stream(client, sub, NATS_STREAM_BEGIN, NULL, 0U, 0U);
+  } else {
+    client->parser.state = NATS_PARSE_MSG_SKIP;
+    client->stats.msgs_dropped++;
+  }
+}
+
+/**
+ * @brief Report ABORT for a message cut off mid-stream
+ */
+static void abort_stream(nats_client_t *client) {
+  if (client->parser.state != NATS_PARSE_MSG_STREAM) {
+    return;
+  }
+
+  nats_sub_t *sub = find_msg_sub(client);
+  if ((sub != NULL) && (sub->stream_cb != NULL)) {
+    emit_stream(client, sub, NATS_STREAM_ABORT, NULL, 0U,
+                client->parser.stream_offset);
+  }
+  client->parser.state = NATS_PARSE_LINE;
+}
+
+/**
+ * @brief Consume buffered bytes of an oversized payload
+ *
+ * @return NATS_OK (possibly waiting for more data), or a protocol error
+ */
+static nats_err_t parse_large_payload(nats_client_t *client) {
+  size_t remaining =
+      client->parser.expected_bytes - client->parser.stream_offset;
+
+  if (remaining > 0U) {
+    size_t n = (client->rx_len < remaining) ? client->rx_len : remaining;
+
+    if (client->parser.state == NATS_PARSE_MSG_STREAM) {
+      nats_sub_t *sub = find_msg_sub(client);
+      if ((sub != NULL) && (sub->stream_cb != NULL)) {
+        emit_stream(client, sub, NATS_STREAM_CHUNK, client->rx_buf, n,
+                    client->parser.stream_offset);
+      } else {
+        /* Unsubscribed from inside the callback - discard the rest */
+        client->parser.state = NATS_PARSE_MSG_SKIP;
+      }
+    }
+
+    client->parser.stream_offset += n;
+    compact_rx_buf(client, n);
+    return NATS_OK;
+  }
+
+  /* Payload consumed, need trailing \r\n */
+  if (client->rx_len < 2U) {
+    return NATS_OK;
+  }
+  if ((client->rx_buf[0] != '\r') || (client->rx_buf[1] != '\n')) {
+    return NATS_ERR_PROTOCOL;
+  }
+  compact_rx_buf(client, 2U);
+
+  if (client->parser.state == NATS_PARSE_MSG_STREAM) {
+    nats_sub_t *sub = find_msg_sub(client);
+    if ((sub != NULL) && (sub->stream_cb != NULL)) {
+      emit_stream(client, sub, NATS_STREAM_END, NULL, 0U,
+                  client->parser.stream_offset);
+      finish_msg(client, sub, client->parser.stream_offset);
+    }
   }
+
+  client->parser.state = NATS_PARSE_LINE;
+  return NATS_OK;
 }
 
 /**
@@ -477,13 +655,40 @@ static cmd_type_t detect_cmd(const char *line, size_t len) {
   return CMD_UNKNOWN;
 }
 
+/**
+ * @brief Check whether the process budget is spent
+ */
+static bool budget_spent(const nats_client_t *client, uint16_t dispatched,
+                         uint32_t start_us) {
+  if ((client->opts.max_process_msgs > 0U) &&
+      (dispatched >= client->opts.max_process_msgs)) {
+    return true;
+  }
+  if ((client->opts.max_process_us > 0U) && (client->time_us_fn != NULL)) {
+    return ((uint32_t)(client->time_us_fn() - start_us) >=
+            client->opts.max_process_us);
+  }
+  return false;
+}
+
 /**
  * @brief Parse incoming data
  */
 static nats_err_t parse_data(nats_client_t *client) {
   nats_err_t err = NATS_OK;
+  uint16_t dispatched = 0U;
+  uint32_t start_us =
+      (client->time_us_fn != NULL) ? client->time_us_fn() : 0U;
+
+  client->work_pending = false;
 
   while (client->rx_len > 0U) {
+    if ((dispatched > 0U) && budget_spent(client, dispatched, start_us)) {
+      client->work_pending = true;
+      client->stats.budget_hits++;
+      break;
+    }
+
     if (client->parser.state == NATS_PARSE_LINE) {
       /* Look for complete line */
       int32_t line_end = nats_find_crlf(client->rx_buf, client->rx_len);
@@ -526,6 +731,8 @@ static nats_err_t parse_data(nats_client_t *client) {
         if (!parse_msg_header(client, (const char *)&client->rx_buf[4],
                               line_len - 4U)) {
           err = NATS_ERR_PROTOCOL;
+        } else if (client->parser.expected_bytes > NATS_MAX_PAYLOAD_LEN) {
+          begin_large_msg(client);
         } else {
           client->parser.state = NATS_PARSE_MSG_PAYLOAD;
         }
@@ -593,12 +800,26 @@ static nats_err_t parse_data(nats_client_t *client) {
 
       /* Deliver message */
       deliver_msg(client, client->rx_buf, client->parser.expected_bytes);
+      dispatched++;
 
       /* Consume payload + \r\n */
       compact_rx_buf(client, needed);
 
       /* Back to line mode */
       client->parser.state = NATS_PARSE_LINE;
+    } else if ((client->parser.state == NATS_PARSE_MSG_STREAM) ||
+               (client->parser.state == NATS_PARSE_MSG_SKIP)) {
+      size_t before = client->rx_len;
+      err = parse_large_payload(client);
+      if (err != NATS_OK) {
+        client->last_error = err;
+        break;
+      }
+      if (client->rx_len == before) {
+        /* Wait for more data */
+        break;
+      }
+      dispatched++;
     } else {
       /* Unknown parser state */
       err = NATS_ERR_INVALID_STATE;
@@ -673,6 +894,26 @@ nats_err_t nats_set_time_fn(nats_client_t *client, nats_time_ms_t time_fn) {
   return NATS_OK;
 }
 
+nats_err_t nats_set_time_us_fn(nats_client_t *client, nats_time_us_t time_fn) {
+  if ((client == NULL) || (time_fn == NULL)) {
+    return NATS_ERR_INVALID_ARG;
+  }
+
+  client->time_us_fn = time_fn;
+  return NATS_OK;
+}
+
+nats_err_t nats_set_process_budget(nats_client_t *client, uint16_t max_msgs,
+                                   uint32_t max_us) {
+  if (client == NULL) {
+    return NATS_ERR_INVALID_ARG;
+  }
+
+  client->opts.max_process_msgs = max_msgs;
+  client->opts.max_process_us = max_us;
+  return NATS_OK;
+}
+
 nats_err_t nats_set_event_callback(nats_client_t *client, nats_event_cb_t cb,
                                    void *userdata) {
   if (client == NULL) {
@@ -696,10 +937,12 @@ nats_err_t nats_handshake(nats_client_t *client) {
   }
 
   /* Reset state */
+  abort_stream(client);
   client->rx_len = 0U;
   client->tx_len = 0U;
   client->parser.state = NATS_PARSE_LINE;
   client->pings_out = 0U;
+  client->work_pending = false;
   client->last_error = NATS_OK;
 
   /* Wait for INFO */
@@ -718,6 +961,7 @@ nats_err_t nats_close(nats_client_t *client) {
     client->transport.close(client->transport.ctx);
   }
 
+  abort_stream(client);
   client->state = NATS_STATE_CLOSED;
 
   if (client->event_cb != NULL) {
@@ -740,7 +984,9 @@ nats_err_t nats_process(nats_client_t *client) {
       client->last_error = NATS_ERR_CONNECTION_LOST;
 
       /* Reset parser state to prevent desync on reconnect */
+      abort_stream(client);
       client->parser.state = NATS_PARSE_LINE;
+      client->work_pending = false;
       client->parser.expected_bytes = 0U;
       client->parser.msg_sid = 0U;
       client->parser.msg_subject[0] = '\0';
@@ -836,41 +1082,66 @@ nats_err_t nats_publish(nats_client_t *client, const char *subject,
 nats_err_t nats_publish_reply(nats_client_t *client, const char *subject,
                               const char *reply, const uint8_t *data,
                               size_t len) {
+  nats_iovec_t iov = {.base = data, .len = len};
+  return nats_publish_reply_iov(client, subject, reply, &iov, 1U);
+}
+
+nats_err_t nats_publish_iov(nats_client_t *client, const char *subject,
+                            const nats_iovec_t *iov, size_t iovcnt) {
+  return nats_publish_reply_iov(client, subject, NULL, iov, iovcnt);
+}
+
+nats_err_t nats_publish_reply_iov(nats_client_t *client, const char *subject,
+                                  const char *reply, const nats_iovec_t *iov,
+                                  size_t iovcnt) {
   if ((client == NULL) || (subject == NULL)) {
     return NATS_ERR_INVALID_ARG;
   }
-  if ((data == NULL) && (len > 0U)) {
+  if ((iov == NULL) && (iovcnt > 0U)) {
     return NATS_ERR_INVALID_ARG;
   }
   if (client->state != NATS_STATE_CONNECTED) {
     return NATS_ERR_NOT_CONNECTED;
   }
-  if (len > NATS_MAX_PAYLOAD_LEN) {
-    return NATS_ERR_BUFFER_OVERFLOW;
-  }
 
-  nats_err_t err;
+  /* Total payload length is needed up front for the PUB line */
+  size_t len = 0U;
+  for (size_t i = 0U; i < iovcnt; i++) {
+    if ((iov[i].base == NULL) && (iov[i].len > 0U)) {
+      return NATS_ERR_INVALID_ARG;
+    }
+    if (iov[i].len > (NATS_MAX_PAYLOAD_LEN - len)) {
+      return NATS_ERR_BUFFER_OVERFLOW;
+    }
+    len += iov[i].len;
+  }
 
-  /* Send PUB line */
+  /* PUB line goes first in tx_buf; segments are coalesced behind it */
+  int ret;
   if (reply != NULL) {
-    err = send_linef(client, "PUB %s %s %u", subject, reply, (unsigned)len);
+    ret = snprintf((char *)client->tx_buf, sizeof(client->tx_buf),
+                   "PUB %s %s %u\r\n", subject, reply, (unsigned)len);
   } else {
-    err = send_linef(client, "PUB %s %u", subject, (unsigned)len);
+    ret = snprintf((char *)client->tx_buf, sizeof(client->tx_buf),
+                   "PUB %s %u\r\n", subject, (unsigned)len);
   }
-  if (err != NATS_OK) {
-    return err;
+  if ((ret < 0) || ((size_t)ret >= sizeof(client->tx_buf))) {
+    return NATS_ERR_BUFFER_OVERFLOW;
   }
+  client->tx_len = (size_t)ret;
 
-  /* Send payload */
-  if (len > 0U) {
-    err = send_data(client, data, len);
-    if (err != NATS_OK) {
-      return err;
-    }
+  nats_err_t err = NATS_OK;
+  for (size_t i = 0U; (i < iovcnt) && (err == NATS_OK); i++) {
+    err = tx_append(client, (const uint8_t *)iov[i].base, iov[i].len);
+  }
+  if (err == NATS_OK) {
+    err = tx_append(client, (const uint8_t *)"\r\n", 2U);
+  }
+  if (err == NATS_OK) {
+    err = tx_flush(client);
   }
+  client->tx_len = 0U;
 
-  /* Send trailing CRLF */
-  err = send_data(client, (const uint8_t *)"\r\n", 2U);
   if (err != NATS_OK) {
     return err;
   }
@@ -887,20 +1158,56 @@ nats_err_t nats_publish_str(nats_client_t *client, const char *subject,
   return nats_publish(client, subject, (const uint8_t *)str, strlen(str));
 }
 
-nats_err_t nats_subscribe(nats_client_t *client, const char *subject,
-                          nats_msg_cb_t cb, void *userdata, uint16_t *sid) {
-  return nats_subscribe_queue(client, subject, NULL, cb, userdata, sid);
+/**
+ * @brief Take the next SID not held by an active subscription
+ *
+ * SIDs count up and wrap from UINT16_MAX back to 1, so a client that keeps
+ * subscribing and unsubscribing never runs out. A freed SID comes round
+ * again only after all others, long after the server has dropped it.
+ *
+ * @return SID, or 0 if none is free
+ */
+static uint16_t next_free_sid(nats_client_t *client) {
+  for (uint32_t tries = 0U; tries < UINT16_MAX; tries++) {
+    uint16_t sid = client->next_sid;
+    client->next_sid = (sid >= UINT16_MAX) ? 1U : (uint16_t)(sid + 1U);
+    if (sid == 0U) {
+      continue;
+    }
+
+    bool used = false;
+    for (size_t i = 0U; i < NATS_MAX_SUBSCRIPTIONS; i++) {
+      if (client->subs[i].active && (client->subs[i].sid == sid)) {
+        used = true;
+        break;
+      }
+    }
+    if (!used) {
+      return sid;
+    }
+  }
+  return 0U;
 }
 
-nats_err_t nats_subscribe_queue(nats_client_t *client, const char *subject,
-                                const char *queue, nats_msg_cb_t cb,
-                                void *userdata, uint16_t *sid) {
-  if ((client == NULL) || (subject == NULL) || (cb == NULL)) {
+/**
+ * @brief Claim a subscription slot and send SUB
+ */
+static nats_err_t subscribe_internal(nats_client_t *client,
+                                     const char *subject, const char *queue,
+                                     nats_msg_cb_t cb,
+                                     nats_stream_cb_t stream_cb,
+                                     void *userdata, uint16_t *sid) {
+  if ((client == NULL) || (subject == NULL)) {
     return NATS_ERR_INVALID_ARG;
   }
   if (!nats_subject_valid(subject, NATS_MAX_SUBJECT_LEN)) {
     return NATS_ERR_INVALID_ARG;
   }
+  if ((queue != NULL) &&
+      ((queue[0] == '\0') || (strlen(queue) >= NATS_MAX_QUEUE_LEN) ||
+       (strpbrk(queue, " \t\r\n") != NULL))) {
+    return NATS_ERR_INVALID_ARG;
+  }
   if (client->state != NATS_STATE_CONNECTED) {
     return NATS_ERR_NOT_CONNECTED;
   }
@@ -920,14 +1227,19 @@ nats_err_t nats_subscribe_queue(nats_client_t *client, const char *subject,
 
   /* Fill subscription */
   safe_strcpy(sub->subject, subject, sizeof(sub->subject));
+  if (queue != NULL) {
+    safe_strcpy(sub->queue, queue, sizeof(sub->queue));
+  } else {
+    sub->queue[0] = '\0';
+  }
   sub->callback = cb;
+  sub->stream_cb = stream_cb;
   sub->userdata = userdata;
 
-  /* Check for SID exhaustion before incrementing */
-  if (client->next_sid == UINT16_MAX) {
-    return NATS_ERR_NO_MEMORY; /* SID space exhausted */
+  sub->sid = next_free_sid(client);
+  if (sub->sid == 0U) {
+    return NATS_ERR_NO_MEMORY; /* cannot happen with fewer subs than SIDs */
   }
-  sub->sid = client->next_sid++;
   sub->max_msgs = 0U;
   sub->recv_msgs = 0U;
   sub->active = true;
@@ -952,6 +1264,29 @@ nats_err_t nats_subscribe_queue(nats_client_t *client, const char *subject,
   return NATS_OK;
 }
 
+nats_err_t nats_subscribe(nats_client_t *client, const char *subject,
+                          nats_msg_cb_t cb, void *userdata, uint16_t *sid) {
+  return nats_subscribe_queue(client, subject, NULL, cb, userdata, sid);
+}
+
+nats_err_t nats_subscribe_queue(nats_client_t *client, const char *subject,
+                                const char *queue, nats_msg_cb_t cb,
+                                void *userdata, uint16_t *sid) {
+  if (cb == NULL) {
+    return NATS_ERR_INVALID_ARG;
+  }
+  return subscribe_internal(client, subject, queue, cb, NULL, userdata, sid);
+}
+
+nats_err_t nats_subscribe_stream(nats_client_t *client, const char *subject,
+                                 nats_stream_cb_t cb, void *userdata,
+                                 uint16_t *sid) {
+  if (cb == NULL) {
+    return NATS_ERR_INVALID_ARG;
+  }
+  return subscribe_internal(client, subject, NULL, NULL, cb, userdata, sid);
+}
+
 nats_err_t nats_unsubscribe(nats_client_t *client, uint16_t sid) {
   return nats_unsubscribe_after(client, sid, 0U);
 }
@@ -1035,6 +1370,13 @@ bool nats_is_connected(const nats_client_t *client) {
   return (client->state == NATS_STATE_CONNECTED);
 }
 
+bool nats_work_pending(const nats_client_t *client) {
+  if (client == NULL) {
+    return false;
+  }
+  return client->work_pending;
+}
+
 const char *nats_err_str(nats_err_t err) {
   if ((size_t)err < NATS_ERR_COUNT) {
     return NATS_ERR_STRINGS[err];
@@ -1075,6 +1417,20 @@ nats_err_t nats_msg_respond_str(nats_client_t *client, const nats_msg_t *msg,
   return nats_msg_respond(client, msg, (const uint8_t *)str, strlen(str));
 }
 
+nats_err_t nats_msg_respond_iov(nats_client_t *client, const nats_msg_t *msg,
+                                const nats_iovec_t *iov, size_t iovcnt) {
+  if ((client == NULL) || (msg == NULL)) {
+    return NATS_ERR_INVALID_ARG;
+  }
+
+  /* Must have a reply-to subject */
+  if ((msg->reply == NULL) || (msg->reply_len == 0U)) {
+    return NATS_ERR_INVALID_ARG;
+  }
+
+  return nats_publish_iov(client, msg->reply, iov, iovcnt);
+}
+
 /*============================================================================
  * Async Request/Reply Implementation
  *============================================================================*/
@@ -1418,4 +1774,40 @@ nats_test_cmd_t nats_test_detect_cmd(const char *line, size_t len) {
   }
 }
 
+nats_err_t nats_test_feed(nats_client_t *client, const uint8_t *data,
+                          size_t len) {
+  if ((client == NULL) || ((data == NULL) && (len > 0U))) {
+    return NATS_ERR_INVALID_ARG;
+  }
+
+  /* Same fill/parse cycle as nats_process(), minus the transport read */
+  size_t pos = 0U;
+  do {
+    size_t space = sizeof(client->rx_buf) - client->rx_len;
+    size_t n = ((len - pos) < space) ? (len - pos) : space;
+    if (n > 0U) {
+      memcpy(&client->rx_buf[client->rx_len], &data[pos], n);
+      client->rx_len += n;
+      client->stats.bytes_in += (uint32_t)n;
+      pos += n;
+    }
+
+    nats_err_t err = parse_data(client);
+    if ((err == NATS_OK) && (client->state == NATS_STATE_SEND_CONNECT)) {
+      err = send_connect(client);
+    }
+    if (err != NATS_OK) {
+      return err;
+    }
+
+    /* Full buffer the parser cannot make progress on */
+    if ((pos < len) && (client->rx_len == sizeof(client->rx_buf)) &&
+        !client->work_pending) {
+      return NATS_ERR_BUFFER_FULL;
+    }
+  } while (pos < len);
+
+  return NATS_OK;
+}
+
 #endif /* NATS_TESTING */
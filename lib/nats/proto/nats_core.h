@@ -59,6 +59,20 @@ extern "C" {
 #define NATS_MAX_PAYLOAD_LEN 4096U
 #endif
 
+/**
+ * Largest payload accepted at all. Messages above NATS_MAX_PAYLOAD_LEN are
+ * delivered in fragments to streaming subscriptions and discarded for
+ * regular ones; messages above this limit are a protocol error.
+ */
+#ifndef NATS_MAX_STREAM_PAYLOAD_LEN
+#define NATS_MAX_STREAM_PAYLOAD_LEN (1024U * 1024U)
+#endif
+
+/** Maximum queue group name length (including null terminator) */
+#ifndef NATS_MAX_QUEUE_LEN
+#define NATS_MAX_QUEUE_LEN 32U
+#endif
+
 /** Maximum number of concurrent subscriptions */
 #ifndef NATS_MAX_SUBSCRIPTIONS
 #define NATS_MAX_SUBSCRIPTIONS 16U
@@ -108,6 +122,8 @@ NATS_STATIC_ASSERT(NATS_TX_BUFFER_SIZE <= 2147483647UL,
 /* Verify payload fits in unsigned int for %u format specifier portability */
 NATS_STATIC_ASSERT(NATS_MAX_PAYLOAD_LEN <= 4294967295UL,
                    "Payload size exceeds uint32_t range");
+NATS_STATIC_ASSERT(NATS_MAX_STREAM_PAYLOAD_LEN >= NATS_MAX_PAYLOAD_LEN,
+                   "Stream payload limit below buffered payload limit");
 
 /** Default NATS port */
 #define NATS_DEFAULT_PORT 4222U
@@ -182,6 +198,8 @@ typedef enum {
   NATS_PARSE_MSG_PAYLOAD = 1,  /**< Reading MSG payload */
   NATS_PARSE_HMSG_HEADERS = 2, /**< Reading HMSG headers */
   NATS_PARSE_HMSG_PAYLOAD = 3, /**< Reading HMSG payload */
+  NATS_PARSE_MSG_STREAM = 4,   /**< Streaming oversized MSG payload */
+  NATS_PARSE_MSG_SKIP = 5,     /**< Discarding oversized MSG payload */
 
   NATS_PARSE_COUNT
 } nats_parse_state_t;
@@ -226,6 +244,14 @@ typedef struct {
   uint16_t sid;        /**< Subscription ID */
 } nats_msg_t;
 
+/**
+ * @brief Payload segment for scatter-gather publish
+ */
+typedef struct {
+  const void *base; /**< Segment data (can be NULL if len is 0) */
+  size_t len;       /**< Segment length */
+} nats_iovec_t;
+
 /**
  * @brief Message callback function type
  *
@@ -239,6 +265,38 @@ typedef struct {
 typedef void (*nats_msg_cb_t)(struct nats_client *client, const nats_msg_t *msg,
                               void *userdata);
 
+/**
+ * @brief Streaming delivery events
+ */
+typedef enum {
+  NATS_STREAM_BEGIN = 0, /**< Message header parsed, no payload yet */
+  NATS_STREAM_CHUNK = 1, /**< Payload fragment */
+  NATS_STREAM_END = 2,   /**< Payload complete */
+  NATS_STREAM_ABORT = 3, /**< Connection lost mid-message */
+
+  NATS_STREAM_COUNT
+} nats_stream_event_t;
+
+/**
+ * @brief Streaming message callback function type
+ *
+ * Called BEGIN, then CHUNK zero or more times, then END (or ABORT) for
+ * each message. subject, reply and sid are valid for every event; data
+ * and data_len hold the fragment for CHUNK and are empty otherwise.
+ *
+ * @param client    Pointer to the NATS client
+ * @param event     Delivery event
+ * @param msg       Message (valid only during callback)
+ * @param offset    Payload offset of this fragment (CHUNK), bytes
+ *                  delivered so far (END, ABORT)
+ * @param total     Total payload length announced by the server
+ * @param userdata  User-provided context pointer
+ */
+typedef void (*nats_stream_cb_t)(struct nats_client *client,
+                                 nats_stream_event_t event,
+                                 const nats_msg_t *msg, size_t offset,
+                                 size_t total, void *userdata);
+
 /**
  * @brief Event callback function type
  *
@@ -296,6 +354,15 @@ typedef void (*nats_transport_close_t)(void *ctx);
  */
 typedef uint32_t (*nats_time_ms_t)(void);
 
+/**
+ * @brief Time function type - returns microseconds since boot
+ *
+ * Optional; only needed for the nats_process() time budget.
+ *
+ * @return          Current time in microseconds (may wrap)
+ */
+typedef uint32_t (*nats_time_us_t)(void);
+
 /**
  * @brief Transport interface structure
  */
@@ -313,7 +380,9 @@ typedef struct {
 
 typedef struct {
   char subject[NATS_MAX_SUBJECT_LEN]; /**< Subject pattern */
+  char queue[NATS_MAX_QUEUE_LEN];     /**< Queue group ("" = none) */
   nats_msg_cb_t callback;             /**< Message callback */
+  nats_stream_cb_t stream_cb;         /**< Streaming callback (or NULL) */
   void *userdata;                     /**< User context */
   uint16_t sid;                       /**< Subscription ID */
   uint16_t max_msgs;                  /**< Max messages (0=unlimited) */
@@ -329,6 +398,7 @@ typedef struct {
   nats_parse_state_t state;
   size_t expected_bytes; /**< Payload bytes expected */
   size_t header_bytes;   /**< Header bytes (HMSG only) */
+  size_t stream_offset;  /**< Payload bytes consumed (STREAM/SKIP only) */
   uint16_t msg_sid;      /**< Current message SID */
   char msg_subject[NATS_MAX_SUBJECT_LEN];
   char msg_reply[NATS_MAX_SUBJECT_LEN];
@@ -349,6 +419,10 @@ typedef struct {
   bool verbose;                /**< Verbose mode (server sends +OK) */
   bool pedantic;               /**< Pedantic mode */
   bool echo;                   /**< Echo own messages (default true) */
+  uint16_t max_process_msgs;   /**< Dispatch budget per nats_process()
+                                    (0 = unlimited) */
+  uint32_t max_process_us;     /**< Time budget per nats_process() in us
+                                    (0 = unlimited, needs time_us_fn) */
 } nats_options_t;
 
 /*============================================================================
@@ -361,13 +435,15 @@ typedef struct {
  * needing long-term accuracy should track deltas periodically.
  */
 typedef struct {
-  uint32_t msgs_in;    /**< Messages received */
-  uint32_t msgs_out;   /**< Messages published */
-  uint32_t bytes_in;   /**< Bytes received */
-  uint32_t bytes_out;  /**< Bytes sent */
-  uint32_t reconnects; /**< Number of reconnections */
-  uint32_t pings_sent; /**< PING commands sent */
-  uint32_t pongs_recv; /**< PONG responses received */
+  uint32_t msgs_in;      /**< Messages received */
+  uint32_t msgs_out;     /**< Messages published */
+  uint32_t bytes_in;     /**< Bytes received */
+  uint32_t bytes_out;    /**< Bytes sent */
+  uint32_t reconnects;   /**< Number of reconnections */
+  uint32_t pings_sent;   /**< PING commands sent */
+  uint32_t pongs_recv;   /**< PONG responses received */
+  uint32_t msgs_dropped; /**< Oversized messages discarded */
+  uint32_t budget_hits;  /**< nats_process() calls cut short by budget */
 } nats_stats_t;
 
 /*============================================================================
@@ -378,6 +454,7 @@ typedef struct nats_client {
   /* Transport */
   nats_transport_t transport;
   nats_time_ms_t time_fn; /**< Millisecond time function */
+  nats_time_us_t time_us_fn; /**< Microsecond time function (optional) */
 
   /* Buffers (no heap allocation!) */
   uint8_t rx_buf[NATS_RX_BUFFER_SIZE];
@@ -392,12 +469,13 @@ typedef struct nats_client {
 
   /* Subscriptions */
   nats_sub_t subs[NATS_MAX_SUBSCRIPTIONS];
-  uint16_t next_sid; /**< Next subscription ID */
+  uint16_t next_sid; /**< Next subscription ID to try (wraps, skips 0) */
 
   /* Timing */
   uint32_t last_activity;  /**< Last rx/tx timestamp */
   uint32_t last_ping_sent; /**< Last PING sent timestamp */
   uint8_t pings_out;       /**< Outstanding PING count */
+  bool work_pending;       /**< Last nats_process() stopped on budget */
 
   /* Callbacks */
   nats_event_cb_t event_cb; /**< Event callback */
@@ -463,6 +541,32 @@ nats_err_t nats_set_transport(nats_client_t *client,
  */
 nats_err_t nats_set_time_fn(nats_client_t *client, nats_time_ms_t time_fn);
 
+/**
+ * @brief Set the microsecond time function (for the process time budget)
+ *
+ * @param client    Initialized client
+ * @param time_fn   Function returning microseconds since boot
+ * @return          NATS_OK on success, error code otherwise
+ */
+nats_err_t nats_set_time_us_fn(nats_client_t *client, nats_time_us_t time_fn);
+
+/**
+ * @brief Limit the work done by a single nats_process() call
+ *
+ * Once either budget is spent, nats_process() returns and leaves the
+ * remaining buffered messages for the next call; nats_work_pending()
+ * reports this. A message being delivered is never split.
+ *
+ * @param client    Initialized client
+ * @param max_msgs  Max messages (or stream fragments) dispatched per call,
+ *                  0 = unlimited
+ * @param max_us    Max microseconds spent dispatching per call,
+ *                  0 = unlimited (ignored without a time_us_fn)
+ * @return          NATS_OK on success, error code otherwise
+ */
+nats_err_t nats_set_process_budget(nats_client_t *client, uint16_t max_msgs,
+                                   uint32_t max_us);
+
 /**
  * @brief Set event callback
  *
@@ -508,6 +612,9 @@ nats_err_t nats_close(nats_client_t *client);
  * - Handle PING/PONG
  * - Update connection state
  *
+ * Dispatch is bounded by the process budget (see
+ * nats_set_process_budget()).
+ *
  * @param client    Client to process
  * @return          NATS_OK on success, error code otherwise
  *
@@ -553,6 +660,37 @@ nats_err_t nats_publish_reply(nats_client_t *client, const char *subject,
                               const char *reply, const uint8_t *data,
                               size_t len);
 
+/**
+ * @brief Publish a payload gathered from several segments
+ *
+ * The segments are written to the connection back to back, coalesced
+ * through the transmit buffer, so callers need no assembly buffer.
+ *
+ * @param client    Connected client
+ * @param subject   Subject to publish to
+ * @param iov       Payload segments (can be NULL if iovcnt is 0)
+ * @param iovcnt    Number of segments
+ * @return          NATS_OK on success,
+ *                  NATS_ERR_BUFFER_OVERFLOW if the total exceeds
+ *                  NATS_MAX_PAYLOAD_LEN, error code otherwise
+ */
+nats_err_t nats_publish_iov(nats_client_t *client, const char *subject,
+                            const nats_iovec_t *iov, size_t iovcnt);
+
+/**
+ * @brief Publish gathered segments with reply-to subject
+ *
+ * @param client    Connected client
+ * @param subject   Subject to publish to
+ * @param reply     Reply-to subject (can be NULL)
+ * @param iov       Payload segments (can be NULL if iovcnt is 0)
+ * @param iovcnt    Number of segments
+ * @return          NATS_OK on success, error code otherwise
+ */
+nats_err_t nats_publish_reply_iov(nats_client_t *client, const char *subject,
+                                  const char *reply, const nats_iovec_t *iov,
+                                  size_t iovcnt);
+
 /**
  * @brief Publish a null-terminated string
  *
@@ -584,9 +722,12 @@ nats_err_t nats_subscribe(nats_client_t *client, const char *subject,
 /**
  * @brief Subscribe with queue group
  *
+ * Each message on the subject goes to one member of the group. The group
+ * is kept with the subscription and restored on reconnect.
+ *
  * @param client    Connected client
  * @param subject   Subject pattern (may include wildcards)
- * @param queue     Queue group name
+ * @param queue     Queue group name (< NATS_MAX_QUEUE_LEN, no whitespace)
  * @param cb        Message callback
  * @param userdata  User context for callback
  * @param[out] sid  Subscription ID (output, can be NULL)
@@ -596,6 +737,25 @@ nats_err_t nats_subscribe_queue(nats_client_t *client, const char *subject,
                                 const char *queue, nats_msg_cb_t cb,
                                 void *userdata, uint16_t *sid);
 
+/**
+ * @brief Subscribe with streaming delivery
+ *
+ * Payloads are handed to the callback in fragments as they arrive, so
+ * messages up to NATS_MAX_STREAM_PAYLOAD_LEN can be received with the
+ * fixed-size receive buffer. Small messages are delivered through the
+ * same BEGIN/CHUNK/END sequence.
+ *
+ * @param client    Connected client
+ * @param subject   Subject pattern (may include wildcards)
+ * @param cb        Streaming callback
+ * @param userdata  User context for callback
+ * @param[out] sid  Subscription ID (output, can be NULL)
+ * @return          NATS_OK on success, error code otherwise
+ */
+nats_err_t nats_subscribe_stream(nats_client_t *client, const char *subject,
+                                 nats_stream_cb_t cb, void *userdata,
+                                 uint16_t *sid);
+
 /**
  * @brief Unsubscribe
  *
@@ -656,6 +816,18 @@ nats_err_t nats_msg_respond(nats_client_t *client, const nats_msg_t *msg,
 nats_err_t nats_msg_respond_str(nats_client_t *client, const nats_msg_t *msg,
                                 const char *str);
 
+/**
+ * @brief Respond to a received message with gathered segments
+ *
+ * @param client    Connected client
+ * @param msg       Message to respond to (must have reply-to)
+ * @param iov       Payload segments (can be NULL if iovcnt is 0)
+ * @param iovcnt    Number of segments
+ * @return          NATS_OK on success, NATS_ERR_INVALID_ARG if no reply-to
+ */
+nats_err_t nats_msg_respond_iov(nats_client_t *client, const nats_msg_t *msg,
+                                const nats_iovec_t *iov, size_t iovcnt);
+
 /*--- Async Request/Reply ---*/
 
 /**
@@ -781,6 +953,15 @@ nats_err_t nats_get_stats(const nats_client_t *client, nats_stats_t *stats);
  */
 bool nats_is_connected(const nats_client_t *client);
 
+/**
+ * @brief Check whether the last nats_process() left work behind
+ *
+ * @param client    Client to query
+ * @return          true if the process budget was hit with data still
+ *                  buffered - call nats_process() again soon
+ */
+bool nats_work_pending(const nats_client_t *client);
+
 /*--- Subject Utilities ---*/
 
 /**
@@ -857,7 +1038,9 @@ const char *nats_version(void);
    .max_pings_out = 2U,                                                        \
    .verbose = false,                                                           \
    .pedantic = false,                                                          \
-   .echo = true}
+   .echo = true,                                                               \
+   .max_process_msgs = 0U,                                                     \
+   .max_process_us = 0U}
 
 /*============================================================================
  * Assertion Macro (for development)
@@ -935,6 +1118,22 @@ bool nats_test_parse_msg_header(nats_client_t *client, const char *header,
  */
 nats_test_cmd_t nats_test_detect_cmd(const char *line, size_t len);
 
+/**
+ * @brief [TEST ONLY] Feed received bytes straight into the parser
+ *
+ * Runs the same buffer fill and parse cycle as nats_process() without a
+ * transport read, so benchmarks and fuzzers can drive parse_data() with
+ * any chunking. Replies (PONG, CONNECT) still go out via the transport.
+ *
+ * @param client    Client (any state)
+ * @param data      Bytes as they would arrive from the socket
+ * @param len       Number of bytes
+ * @return          NATS_OK, the parser error, or NATS_ERR_BUFFER_FULL if
+ *                  the RX buffer filled without a complete line
+ */
+nats_err_t nats_test_feed(nats_client_t *client, const uint8_t *data,
+                          size_t len);
+
 #endif /* NATS_TESTING */
 
 #ifdef __cplusplus
@@ -147,6 +147,14 @@ public:
     return nats_publish_str(&m_client, subject, str);
   }
 
+  /**
+   * @brief Publish a payload gathered from several segments
+   */
+  nats_err_t publishIov(const char *subject, const nats_iovec_t *iov,
+                        size_t iovcnt) {
+    return nats_publish_iov(&m_client, subject, iov, iovcnt);
+  }
+
   /**
    * @brief Subscribe to a subject
    */
@@ -171,6 +179,15 @@ public:
     return nats_subscribe_queue(&m_client, subject, queue, cb, userdata, sid);
   }
 
+  /**
+   * @brief Subscribe with streaming delivery (payloads of any size)
+   */
+  nats_err_t subscribeStream(const char *subject, nats_stream_cb_t cb,
+                             void *userdata = nullptr,
+                             uint16_t *sid = nullptr) {
+    return nats_subscribe_stream(&m_client, subject, cb, userdata, sid);
+  }
+
   /**
    * @brief Respond to a message (for request/reply pattern)
    */
@@ -185,6 +202,14 @@ public:
     return nats_msg_respond_str(&m_client, msg, str);
   }
 
+  /**
+   * @brief Respond to a message with gathered segments
+   */
+  nats_err_t respondIov(const nats_msg_t *msg, const nats_iovec_t *iov,
+                        size_t iovcnt) {
+    return nats_msg_respond_iov(&m_client, msg, iov, iovcnt);
+  }
+
   /**
    * @brief Start an async request
    *
@@ -267,6 +292,18 @@ public:
    */
   const char *lastErrorStr() const { return nats_err_str(lastError()); }
 
+  /**
+   * @brief Bound the work done per process() call (0 = unlimited)
+   */
+  nats_err_t setProcessBudget(uint16_t maxMsgs, uint32_t maxUs) {
+    return nats_set_process_budget(&m_client, maxMsgs, maxUs);
+  }
+
+  /**
+   * @brief Check if the last process() stopped on its budget
+   */
+  bool workPending() const { return nats_work_pending(&m_client); }
+
   /**
    * @brief Get current state
    */
@@ -287,6 +324,7 @@ private:
     transport.ctx = this;
     nats_set_transport(&m_client, &transport);
     nats_set_time_fn(&m_client, millis);
+    nats_set_time_us_fn(&m_client, micros);
   }
 
   // Static transport callbacks (C-compatible)
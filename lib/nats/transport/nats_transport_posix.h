@@ -0,0 +1,306 @@
+/**
+ * @file nats_transport_posix.h
+ * @brief NATS Embedded Client - POSIX Socket Adapter
+ *
+ * Header-only TCP transport for Linux and macOS hosts. Runs the
+ * platform-independent core against a real nats-server, for benchmarks
+ * and host-side testing.
+ *
+ * Requires POSIX.1-2008 declarations: compile with -std=gnu11, or define
+ * _POSIX_C_SOURCE 200809L before the first system include.
+ *
+ * Sends block until the kernel has taken the data (the core treats a
+ * short write as an error); receives never block.
+ *
+ * @author Mario Schallner
+ * @copyright Copyright (c) 2026 Mario Schallner
+ */
+
+#ifndef NATS_TRANSPORT_POSIX_H
+#define NATS_TRANSPORT_POSIX_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*============================================================================
+ * Includes
+ *============================================================================*/
+
+#include "../proto/nats_core.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+/*============================================================================
+ * Configuration
+ *============================================================================*/
+
+/** Flags for send(): suppress SIGPIPE where the platform supports it */
+#ifndef NATS_POSIX_SEND_FLAGS
+#ifdef MSG_NOSIGNAL
+#define NATS_POSIX_SEND_FLAGS MSG_NOSIGNAL
+#else
+#define NATS_POSIX_SEND_FLAGS 0
+#endif
+#endif
+
+/*============================================================================
+ * Types
+ *============================================================================*/
+
+/**
+ * @brief POSIX transport context
+ */
+typedef struct {
+  int fd; /**< Socket descriptor (-1 when closed) */
+} nats_posix_t;
+
+/*============================================================================
+ * Time Functions
+ *============================================================================*/
+
+/**
+ * @brief Monotonic milliseconds (nats_time_ms_t)
+ */
+static inline uint32_t nats_posix_time_ms(void) {
+  struct timespec ts;
+  (void)clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint32_t)(((uint64_t)ts.tv_sec * 1000U) +
+                    ((uint64_t)ts.tv_nsec / 1000000U));
+}
+
+/**
+ * @brief Monotonic microseconds (nats_time_us_t)
+ */
+static inline uint32_t nats_posix_time_us(void) {
+  struct timespec ts;
+  (void)clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint32_t)(((uint64_t)ts.tv_sec * 1000000U) +
+                    ((uint64_t)ts.tv_nsec / 1000U));
+}
+
+/*============================================================================
+ * Transport Callbacks
+ *============================================================================*/
+
+static inline int32_t nats_posix_send(void *ctx, const uint8_t *data,
+                                      size_t len) {
+  nats_posix_t *t = (nats_posix_t *)ctx;
+  ssize_t n;
+
+  do {
+    n = send(t->fd, data, len, NATS_POSIX_SEND_FLAGS);
+  } while ((n < 0) && (errno == EINTR));
+
+  if (n < 0) {
+    return -1;
+  }
+  return (int32_t)n;
+}
+
+static inline int32_t nats_posix_recv(void *ctx, uint8_t *data, size_t len) {
+  nats_posix_t *t = (nats_posix_t *)ctx;
+  ssize_t n = recv(t->fd, data, len, MSG_DONTWAIT);
+
+  if (n < 0) {
+    if ((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR)) {
+      return 0;
+    }
+    return -1;
+  }
+  if (n == 0) {
+    /* Orderly shutdown by the server */
+    (void)close(t->fd);
+    t->fd = -1;
+    return -1;
+  }
+  return (int32_t)n;
+}
+
+static inline bool nats_posix_connected(void *ctx) {
+  const nats_posix_t *t = (const nats_posix_t *)ctx;
+  return (t->fd >= 0);
+}
+
+static inline void nats_posix_close(void *ctx) {
+  nats_posix_t *t = (nats_posix_t *)ctx;
+  if (t->fd >= 0) {
+    (void)close(t->fd);
+    t->fd = -1;
+  }
+}
+
+/*============================================================================
+ * API Functions
+ *============================================================================*/
+
+/**
+ * @brief Wire a client to a POSIX transport context
+ *
+ * Sets the transport callbacks and both time functions.
+ *
+ * @param t         Transport context
+ * @param client    Initialized client
+ * @return          NATS_OK on success, error code otherwise
+ */
+static inline nats_err_t nats_posix_init(nats_posix_t *t,
+                                         nats_client_t *client) {
+  if ((t == NULL) || (client == NULL)) {
+    return NATS_ERR_INVALID_ARG;
+  }
+
+  t->fd = -1;
+
+  nats_transport_t transport;
+  transport.send = nats_posix_send;
+  transport.recv = nats_posix_recv;
+  transport.connected = nats_posix_connected;
+  transport.close = nats_posix_close;
+  transport.ctx = t;
+
+  nats_err_t err = nats_set_transport(client, &transport);
+  if (err == NATS_OK) {
+    err = nats_set_time_fn(client, nats_posix_time_ms);
+  }
+  if (err == NATS_OK) {
+    err = nats_set_time_us_fn(client, nats_posix_time_us);
+  }
+  return err;
+}
+
+/**
+ * @brief Wait until the socket is readable
+ *
+ * @param t           Transport context
+ * @param timeout_ms  Max wait (0 = just poll)
+ * @return            true if data (or EOF) is ready
+ */
+static inline bool nats_posix_wait(const nats_posix_t *t, uint32_t timeout_ms) {
+  if (t->fd < 0) {
+    return false;
+  }
+
+  struct pollfd pfd;
+  pfd.fd = t->fd;
+  pfd.events = POLLIN;
+  pfd.revents = 0;
+  return (poll(&pfd, 1U, (int)timeout_ms) > 0);
+}
+
+/**
+ * @brief Open the TCP connection (no NATS handshake)
+ */
+static inline nats_err_t nats_posix_tcp_connect(nats_posix_t *t,
+                                                const char *host,
+                                                uint16_t port,
+                                                uint32_t timeout_ms) {
+  char port_str[8];
+  (void)snprintf(port_str, sizeof(port_str), "%u", (unsigned)port);
+
+  struct addrinfo hints;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+
+  struct addrinfo *res = NULL;
+  if (getaddrinfo(host, port_str, &hints, &res) != 0) {
+    return NATS_ERR_IO;
+  }
+
+  nats_err_t err = NATS_ERR_IO;
+  for (struct addrinfo *ai = res; ai != NULL; ai = ai->ai_next) {
+    int fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+    if (fd < 0) {
+      continue;
+    }
+
+    /* Non-blocking connect so the timeout applies */
+    int flags = fcntl(fd, F_GETFL, 0);
+    (void)fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+
+    int rc = connect(fd, ai->ai_addr, ai->ai_addrlen);
+    if ((rc < 0) && (errno == EINPROGRESS)) {
+      struct pollfd pfd;
+      pfd.fd = fd;
+      pfd.events = POLLOUT;
+      pfd.revents = 0;
+      rc = -1;
+      if (poll(&pfd, 1U, (int)timeout_ms) > 0) {
+        int so_err = 0;
+        socklen_t so_len = sizeof(so_err);
+        if ((getsockopt(fd, SOL_SOCKET, SO_ERROR, &so_err, &so_len) == 0) &&
+            (so_err == 0)) {
+          rc = 0;
+        }
+      }
+    }
+
+    if (rc == 0) {
+      (void)fcntl(fd, F_SETFL, flags);
+      int one = 1;
+      (void)setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+      t->fd = fd;
+      err = NATS_OK;
+      break;
+    }
+    (void)close(fd);
+  }
+
+  freeaddrinfo(res);
+  return err;
+}
+
+/**
+ * @brief Connect to a server and complete the NATS handshake
+ *
+ * @param t           Transport context (from nats_posix_init)
+ * @param client      Client wired to t
+ * @param host        Server hostname or IP
+ * @param port        Server port
+ * @param timeout_ms  Timeout for TCP connect and handshake each
+ * @return            NATS_OK once CONNECTED, error code otherwise
+ */
+static inline nats_err_t nats_posix_connect(nats_posix_t *t,
+                                            nats_client_t *client,
+                                            const char *host, uint16_t port,
+                                            uint32_t timeout_ms) {
+  if ((t == NULL) || (client == NULL) || (host == NULL)) {
+    return NATS_ERR_INVALID_ARG;
+  }
+
+  nats_err_t err = nats_posix_tcp_connect(t, host, port, timeout_ms);
+  if (err != NATS_OK) {
+    return err;
+  }
+
+  err = nats_handshake(client);
+  uint32_t start = nats_posix_time_ms();
+  while ((err == NATS_OK) && !nats_is_connected(client)) {
+    if ((nats_posix_time_ms() - start) > timeout_ms) {
+      err = NATS_ERR_TIMEOUT;
+      break;
+    }
+    (void)nats_posix_wait(t, 10U);
+    err = nats_process(client);
+  }
+
+  if (err != NATS_OK) {
+    nats_posix_close(t);
+  }
+  return err;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* NATS_TRANSPORT_POSIX_H */
@@ -0,0 +1,420 @@
+/**
+ * @file agent.cpp
+ * @brief Agent task - runs chats without blocking loop()
+ *
+ * The task owns the LLM connection and spends most of a chat waiting on
+ * the network. It shares the loop task's priority, so on single-core chips
+ * the two are time-sliced and loop() still gets the CPU during TLS work;
+ * on dual-core chips it is pinned to the core loop() does not use.
+ *
+ * Everything else stays on loop(): tool calls are handed over through a
+ * one-slot queue and the task waits for the result (remote_chat, which
+ * waits on another device, is polled on later passes); reply text goes
+ * through a stream buffer; a finished job is delivered by agentPoll()
+ * and the task waits until that is done before taking the next one.
+ *
+ * Waiting jobs sit in a small table under a mutex: loop() adds, merges
+ * and drops them, the task takes the best one when it is free.
+ */
+
+#include "agent.h"
+#include "tools.h"
+#include <esp_task_wdt.h>
+#include <freertos/task.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+#include <freertos/stream_buffer.h>
+
+extern bool g_debug;
+
+#define AGENT_TASK_PRIORITY  1      /* same as loop() */
+#define AGENT_WAKE_MS        1000   /* watchdog feed while waiting */
+#define AGENT_STREAM_LEN     512
+#define AGENT_STREAM_WAIT_MS 100
+
+#if CONFIG_FREERTOS_UNICORE
+#define AGENT_TASK_CORE 0
+#else
+#define AGENT_TASK_CORE (ARDUINO_RUNNING_CORE == 0 ? 1 : 0)
+#endif
+
+struct AgentSlot {
+    bool used;
+    uint32_t seq;             /* submit order */
+    unsigned long queuedAt;   /* millis() of the first message */
+    AgentJob job;
+};
+
+/* A tool call, or any function, to run in loop() (fn set) */
+struct AgentToolCall {
+    void (*fn)(void *arg);
+    void *arg;
+    const char *name;
+    const char *args;
+    char *result;
+    int result_len;
+};
+
+static AgentRunFn    agentRunFn = nullptr;
+static AgentDoneFn   agentDoneFn = nullptr;
+static AgentStreamFn agentStreamFn = nullptr;
+static AgentDropFn   agentDropFn = nullptr;
+
+static TaskHandle_t         agentTaskHandle = nullptr;
+static SemaphoreHandle_t    agentSlotLock = nullptr;  /* guards agentSlots */
+static SemaphoreHandle_t    agentJobReady = nullptr;  /* loop -> task */
+static QueueHandle_t        agentResults = nullptr;   /* task -> loop: reply */
+static QueueHandle_t        agentToolCalls = nullptr; /* task -> loop: AgentToolCall* */
+static SemaphoreHandle_t    agentToolDone = nullptr;  /* loop -> task */
+static SemaphoreHandle_t    agentDelivered = nullptr; /* loop -> task */
+static StreamBufferHandle_t agentStream = nullptr;    /* task -> loop: reply text */
+
+static AgentSlot agentSlots[AGENT_QUEUE_LEN];
+static uint32_t agentSeq = 0;
+
+static AgentJob agentJob;     /* running job; read by loop() on delivery */
+static AgentToolCall *agentToolWaiting = nullptr;  /* tool still running (toolPending) */
+static unsigned long agentJobQueuedAt = 0;
+static unsigned long agentJobStartedAt = 0;
+static int agentPending = 0;  /* jobs queued or running (loop() only) */
+static bool agentInline = false;          /* a job is running in agentSubmit() */
+static volatile bool agentStopFlag = false;
+
+static AgentSourceStats agentSourceStats[AGENT_SRC_COUNT];
+
+/*============================================================================
+ * Job Table
+ *============================================================================*/
+
+/* Without a task there is only loop(), and no mutex is needed */
+static void agentLock() {
+    if (agentSlotLock) xSemaphoreTake(agentSlotLock, portMAX_DELAY);
+}
+
+static void agentUnlock() {
+    if (agentSlotLock) xSemaphoreGive(agentSlotLock);
+}
+
+/** Move the waiting job of highest priority, oldest first, to agentJob. */
+static bool agentTake() {
+    agentLock();
+    int best = -1;
+    for (int i = 0; i < AGENT_QUEUE_LEN; i++) {
+        const AgentSlot *s = &agentSlots[i];
+        if (!s->used) continue;
+        if (best < 0 || s->job.source < agentSlots[best].job.source ||
+            (s->job.source == agentSlots[best].job.source && s->seq < agentSlots[best].seq)) {
+            best = i;
+        }
+    }
+    if (best >= 0) {
+        memcpy(&agentJob, &agentSlots[best].job, sizeof(AgentJob));
+        agentJobQueuedAt = agentSlots[best].queuedAt;
+        agentJobStartedAt = millis();
+        agentSlots[best].used = false;
+    }
+    agentUnlock();
+    return best >= 0;
+}
+
+/**
+ * Fold job into a waiting job of the same conversation.
+ * @return true if it was merged or repeats that job's last message
+ */
+static bool agentMerge(const AgentJob *job) {
+    bool merged = false;
+    agentLock();
+    for (int i = 0; i < AGENT_QUEUE_LEN && !merged; i++) {
+        AgentJob *w = &agentSlots[i].job;
+        if (!agentSlots[i].used || w->source != job->source ||
+            strcmp(w->replyTo, job->replyTo) != 0) continue;
+
+        const char *last = strrchr(w->message, '\n');
+        if (strcmp(last ? last + 1 : w->message, job->message) == 0) {
+            merged = true;
+            break;
+        }
+        int len = strlen(w->message);
+        if (len + 1 + (int)strlen(job->message) >= AGENT_MSG_LEN) continue;
+        snprintf(w->message + len, AGENT_MSG_LEN - len, "\n%s", job->message);
+        merged = true;
+    }
+    agentUnlock();
+    return merged;
+}
+
+/** loop(): hand a finished job to the AgentDoneFn. */
+static void agentDeliver(const char *response) {
+    AgentSourceStats *st = &agentSourceStats[agentJob.source];
+    unsigned long total = millis() - agentJobQueuedAt;
+    st->jobs++;
+    st->waitMs += agentJobStartedAt - agentJobQueuedAt;
+    st->totalMs += total;
+    if (total > st->maxMs) st->maxMs = total;
+
+    agentPending--;
+    agentStopFlag = false;
+    agentDoneFn(&agentJob, response);
+}
+
+/**
+ * No task: run jobs in the caller until none are left. A chat submitted
+ * from inside a running one (remote_chat dispatching a NATS chat) is run
+ * after it by the outer call.
+ */
+static void agentRunInline() {
+    if (agentInline) return;
+    agentInline = true;
+    while (agentTake()) {
+        const char *response = agentRunFn(&agentJob);
+        agentDeliver(response);
+    }
+    agentInline = false;
+}
+
+/*============================================================================
+ * Agent Task
+ *============================================================================*/
+
+static bool inAgentTask() {
+    return agentTaskHandle && xTaskGetCurrentTaskHandle() == agentTaskHandle;
+}
+
+/** Block on sem, feeding the watchdog. */
+static void agentWait(SemaphoreHandle_t sem) {
+    while (xSemaphoreTake(sem, pdMS_TO_TICKS(AGENT_WAKE_MS)) != pdTRUE) {
+        esp_task_wdt_reset();
+    }
+}
+
+static void agentTask(void *arg) {
+    (void)arg;
+    esp_task_wdt_add(NULL);
+
+    for (;;) {
+        esp_task_wdt_reset();
+        if (!agentTake()) {
+            xSemaphoreTake(agentJobReady, pdMS_TO_TICKS(AGENT_WAKE_MS));
+            continue;
+        }
+
+        const char *response = agentRunFn(&agentJob);
+        xQueueSend(agentResults, &response, portMAX_DELAY);
+
+        /* The reply lives in the chat's static buffers until delivered */
+        agentWait(agentDelivered);
+        if (g_debug) Serial.printf("[Agent] task stack free: %u bytes\n",
+                                   (unsigned)uxTaskGetStackHighWaterMark(NULL));
+    }
+}
+
+/*============================================================================
+ * Public API
+ *============================================================================*/
+
+bool agentBegin(AgentRunFn run, AgentDoneFn done, AgentStreamFn stream,
+                AgentDropFn drop) {
+    agentRunFn = run;
+    agentDoneFn = done;
+    agentStreamFn = stream;
+    agentDropFn = drop;
+
+    agentSlotLock = xSemaphoreCreateMutex();
+    agentJobReady = xSemaphoreCreateBinary();
+    agentResults = xQueueCreate(1, sizeof(const char *));
+    agentToolCalls = xQueueCreate(1, sizeof(AgentToolCall *));
+    agentToolDone = xSemaphoreCreateBinary();
+    agentDelivered = xSemaphoreCreateBinary();
+    agentStream = xStreamBufferCreate(AGENT_STREAM_LEN, 1);
+    if (!agentSlotLock || !agentJobReady || !agentResults || !agentToolCalls ||
+        !agentToolDone || !agentDelivered || !agentStream) {
+        Serial.printf("[Agent] Out of memory, chats will block the main loop\n");
+        return false;
+    }
+
+    if (xTaskCreatePinnedToCore(agentTask, "agent", AGENT_TASK_STACK, nullptr,
+                                AGENT_TASK_PRIORITY, &agentTaskHandle,
+                                AGENT_TASK_CORE) != pdPASS) {
+        agentTaskHandle = nullptr;
+        Serial.printf("[Agent] Task create failed, chats will block the main loop\n");
+        return false;
+    }
+    Serial.printf("Agent: task started on core %d\n", AGENT_TASK_CORE);
+    return true;
+}
+
+bool agentSubmit(const AgentJob *job) {
+    if (agentMerge(job)) {
+        agentSourceStats[job->source].merged++;
+        if (g_debug) Serial.printf("[Agent] Merged into the waiting job\n");
+        return true;
+    }
+
+    static AgentJob dropped;
+    bool drop = false;
+    agentLock();
+    int slot = -1;
+    for (int i = 0; i < AGENT_QUEUE_LEN && slot < 0; i++) {
+        if (!agentSlots[i].used) slot = i;
+    }
+    if (slot < 0) {
+        /* Full: the newest job of the lowest priority below this one goes */
+        for (int i = 0; i < AGENT_QUEUE_LEN; i++) {
+            const AgentSlot *s = &agentSlots[i];
+            if (s->job.source <= job->source) continue;
+            if (slot < 0 || s->job.source > agentSlots[slot].job.source ||
+                (s->job.source == agentSlots[slot].job.source && s->seq > agentSlots[slot].seq)) {
+                slot = i;
+            }
+        }
+        if (slot >= 0) {
+            memcpy(&dropped, &agentSlots[slot].job, sizeof(AgentJob));
+            drop = true;
+        }
+    }
+    if (slot >= 0) {
+        AgentSlot *s = &agentSlots[slot];
+        memcpy(&s->job, job, sizeof(AgentJob));
+        s->seq = agentSeq++;
+        s->queuedAt = millis();
+        s->used = true;
+    }
+    agentUnlock();
+    if (slot < 0) return false;
+
+    if (drop) {
+        agentSourceStats[dropped.source].dropped++;
+        Serial.printf("[Agent] Queue full, dropping: %s\n", dropped.message);
+        agentDropFn(&dropped, "[error: busy]");
+    } else {
+        agentPending++;
+    }
+
+    if (!agentTaskHandle) {
+        /* No task: run inline, the old blocking way */
+        agentRunInline();
+        return true;
+    }
+    xSemaphoreGive(agentJobReady);
+    return true;
+}
+
+int agentStop() {
+    static AgentJob dropped;
+    int count = 0;
+    for (;;) {
+        bool found = false;
+        agentLock();
+        for (int i = 0; i < AGENT_QUEUE_LEN && !found; i++) {
+            if (!agentSlots[i].used) continue;
+            memcpy(&dropped, &agentSlots[i].job, sizeof(AgentJob));
+            agentSlots[i].used = false;
+            found = true;
+        }
+        agentUnlock();
+        if (!found) break;
+
+        agentPending--;
+        agentSourceStats[dropped.source].dropped++;
+        agentDropFn(&dropped, "[stopped]");
+        count++;
+    }
+    /* What is left is the running job */
+    if (agentPending > 0) agentStopFlag = true;
+    return count;
+}
+
+bool agentStopping() {
+    return agentStopFlag;
+}
+
+bool agentBusy() {
+    return agentPending > 0;
+}
+
+int agentQueued() {
+    int count = 0;
+    agentLock();
+    for (int i = 0; i < AGENT_QUEUE_LEN; i++) {
+        if (agentSlots[i].used) count++;
+    }
+    agentUnlock();
+    return count;
+}
+
+const AgentSourceStats *agentStats(int source) {
+    if (source < 0 || source >= AGENT_SRC_COUNT) return nullptr;
+    return &agentSourceStats[source];
+}
+
+static void agentDrainStream() {
+    char buf[64];
+    size_t n;
+    while ((n = xStreamBufferReceive(agentStream, buf, sizeof(buf), 0)) > 0) {
+        agentStreamFn(buf, (int)n);
+    }
+}
+
+void agentPoll() {
+    if (!agentTaskHandle) return;
+
+    AgentToolCall *call;
+    if (agentToolWaiting) {
+        /* remote_chat: the task waits while loop() keeps going */
+        if (toolPoll(agentToolWaiting->result, agentToolWaiting->result_len)) {
+            agentToolWaiting = nullptr;
+            xSemaphoreGive(agentToolDone);
+        }
+    } else if (xQueueReceive(agentToolCalls, &call, 0) == pdTRUE) {
+        if (call->fn)
+            call->fn(call->arg);
+        else
+            toolExecuteChat(call->name, call->args, call->result, call->result_len);
+        if (!call->fn && toolPending())
+            agentToolWaiting = call;
+        else
+            xSemaphoreGive(agentToolDone);
+    }
+
+    agentDrainStream();
+
+    const char *response;
+    if (xQueueReceive(agentResults, &response, 0) == pdTRUE) {
+        agentDrainStream(); /* text written just before the result */
+        agentDeliver(response);
+        xSemaphoreGive(agentDelivered);
+    }
+}
+
+void agentToolExecute(const char *name, const char *args,
+                      char *result, int result_len) {
+    if (!inAgentTask()) {
+        toolExecuteChat(name, args, result, result_len);
+        if (toolPending()) toolWait(result, result_len);
+        return;
+    }
+    AgentToolCall call = { nullptr, nullptr, name, args, result, result_len };
+    AgentToolCall *p = &call;
+    xQueueSend(agentToolCalls, &p, portMAX_DELAY);
+    agentWait(agentToolDone);
+}
+
+void agentRunInLoop(void (*fn)(void *arg), void *arg) {
+    if (!inAgentTask()) {
+        fn(arg);
+        return;
+    }
+    AgentToolCall call = { fn, arg, nullptr, nullptr, nullptr, 0 };
+    AgentToolCall *p = &call;
+    xQueueSend(agentToolCalls, &p, portMAX_DELAY);
+    agentWait(agentToolDone);
+}
+
+void agentStreamWrite(const char *text, int len) {
+    if (!inAgentTask()) {
+        agentStreamFn(text, len);
+        return;
+    }
+    /* loop() drains every pass; a stalled loop drops text, not the chat */
+    xStreamBufferSend(agentStream, text, len, pdMS_TO_TICKS(AGENT_STREAM_WAIT_MS));
+}
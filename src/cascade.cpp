@@ -0,0 +1,73 @@
+/**
+ * @file cascade.cpp
+ * @brief Fast/main model cascade for the chat loop
+ *
+ * Only the decisions and the accounting live here; chatWithLLM() picks
+ * the model per step and calls LlmClient::setModel().
+ */
+
+#include "cascade.h"
+#include <ctype.h>
+
+static CascadeTier cascadeTiers[2];  /* [0] fast, [1] main */
+static unsigned long cascadeEscalationCount = 0;
+
+static const char *const CASCADE_LONG_WORDS[] = {
+    "explain", "why", "how", "describe", "write", "compare", "summarize", nullptr
+};
+static const char *const CASCADE_UNSURE[] = {
+    "not sure", "don't know", "do not know", "cannot", "can't", "unable to", nullptr
+};
+
+bool cascadeLongForm(const char *msg) {
+    if (strlen(msg) > CASCADE_LONG_MSG) return true;
+    while (*msg && !isalpha((unsigned char)*msg)) msg++;
+    char word[12];
+    int n = 0;
+    while (isalpha((unsigned char)msg[n]) && n < (int)sizeof(word) - 1) {
+        word[n] = tolower((unsigned char)msg[n]);
+        n++;
+    }
+    word[n] = '\0';
+    for (int i = 0; CASCADE_LONG_WORDS[i]; i++) {
+        if (strcmp(word, CASCADE_LONG_WORDS[i]) == 0) return true;
+    }
+    return false;
+}
+
+bool cascadeUnsure(const LlmResult *r) {
+    if (r->tool_call_count > 0) return false;
+    if (r->content_len == 0) return true;
+    for (const char *p = r->content; *p; p++) {
+        for (int i = 0; CASCADE_UNSURE[i]; i++) {
+            if (strncasecmp(p, CASCADE_UNSURE[i], strlen(CASCADE_UNSURE[i])) == 0)
+                return true;
+        }
+    }
+    return false;
+}
+
+void cascadeAccount(bool fast, bool ok, const LlmResult *r, unsigned long ms) {
+    CascadeTier *t = &cascadeTiers[fast ? 0 : 1];
+    t->requests++;
+    t->ms += ms;
+    if (!ok) {
+        t->failures++;
+        return;
+    }
+    t->promptTokens += r->prompt_tokens;
+    t->completionTokens += r->completion_tokens;
+}
+
+void cascadeEscalate(const char *why, const char *mainModel) {
+    cascadeEscalationCount++;
+    Serial.printf("[Agent] Fast model: %s, switching to %s\n", why, mainModel);
+}
+
+const CascadeTier *cascadeTier(int tier) {
+    return &cascadeTiers[tier];
+}
+
+unsigned long cascadeEscalations() {
+    return cascadeEscalationCount;
+}
@@ -17,6 +17,7 @@ extern void led(uint8_t r, uint8_t g, uint8_t b);
 extern bool g_led_user;
 
 static Device g_devices[MAX_DEVICES];
+static uint32_t g_device_gen = 0;  /* bumped when devices are added or removed */
 
 /*============================================================================
  * Kind helpers
@@ -80,6 +81,10 @@ Device *deviceGetAllMutable() {
     return g_devices;
 }
 
+uint32_t deviceGeneration() {
+    return g_device_gen;
+}
+
 Device *deviceFind(const char *name) {
     for (int i = 0; i < MAX_DEVICES; i++) {
         if (g_devices[i].used && strcmp(g_devices[i].name, name) == 0)
@@ -124,6 +129,7 @@ bool deviceRegister(const char *name, DeviceKind kind, uint8_t pin,
             g_devices[i].nats_msg[0] = '\0';
             g_devices[i].nats_sid = 0;
             g_devices[i].baud = baud;
+            g_device_gen++;
 
             /* Initialize serial_text UART */
             if (kind == DEV_SENSOR_SERIAL_TEXT) {
@@ -149,6 +155,7 @@ bool deviceRemove(const char *name) {
     }
     dev->used = false;
     dev->name[0] = '\0';
+    g_device_gen++;
     return true;
 }
 
@@ -261,6 +268,52 @@ float deviceReadSensor(Device *dev, bool record_hist) {
     return result;
 }
 
+bool deviceCachedValue(const Device *dev, float *out) {
+    if (!dev || !dev->used) return false;
+
+    switch (dev->kind) {
+        case DEV_SENSOR_NTC_10K:
+            *out = dev->ema;
+            return dev->ema_init;
+
+        case DEV_SENSOR_ANALOG_RAW:
+        case DEV_SENSOR_LDR:
+        case DEV_SENSOR_INTERNAL_TEMP: {
+            /* Latest sample sensorsPoll() recorded */
+            if (!dev->history_full && dev->history_idx == 0) return false;
+            int last = (dev->history_idx + DEV_HISTORY_LEN - 1) % DEV_HISTORY_LEN;
+            *out = dev->history[last];
+            return true;
+        }
+
+        case DEV_SENSOR_CLOCK_HOUR:
+        case DEV_SENSOR_CLOCK_MINUTE:
+        case DEV_SENSOR_CLOCK_HHMM: {
+            struct tm timeinfo;
+            if (!getLocalTime(&timeinfo, 0)) return false;
+            if (dev->kind == DEV_SENSOR_CLOCK_HOUR)        *out = (float)timeinfo.tm_hour;
+            else if (dev->kind == DEV_SENSOR_CLOCK_MINUTE) *out = (float)timeinfo.tm_min;
+            else *out = (float)(timeinfo.tm_hour * 100 + timeinfo.tm_min);
+            return true;
+        }
+
+        case DEV_SENSOR_NATS_VALUE:
+            *out = dev->nats_value;
+            return true;
+
+        case DEV_SENSOR_SERIAL_TEXT:
+            *out = serialTextGetValue();
+            return true;
+
+        case DEV_SENSOR_DIGITAL:
+            return false;
+
+        default:
+            *out = (float)dev->last_value;   /* actuators */
+            return true;
+    }
+}
+
 /*============================================================================
  * Actuator Control
  *============================================================================*/
@@ -538,6 +591,7 @@ void devicesClear() {
     /* Deinit serial_text if active */
     if (serialTextActive()) serialTextDeinit();
     memset(g_devices, 0, sizeof(g_devices));
+    g_device_gen++;
 }
 
 void devicesReload() {
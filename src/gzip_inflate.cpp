@@ -0,0 +1,455 @@
+/**
+ * @file gzip_inflate.cpp
+ * @brief Streaming gzip decompressor
+ *
+ * Decoding goes in steps that each read at most 48 bits: one header
+ * field, one code length, one literal, or one length/distance pair. A
+ * step that runs out of input is undone and the leftover input is kept
+ * in the 64-bit bit buffer, so the next call repeats the step with more
+ * bits and the caller never has to hold input back. Huffman codes are
+ * decoded a bit at a time from canonical counts (as in zlib's puff),
+ * which is slow next to table lookup but small, and fast enough for a
+ * few KB per reply.
+ */
+
+#include "gzip_inflate.h"
+#include <string.h>
+
+enum {
+    ST_HEADER, ST_MTIME, ST_EXTRA_LEN, ST_EXTRA, ST_NAME, ST_COMMENT, ST_HCRC,
+    ST_BLOCK, ST_STORED_LEN, ST_STORED, ST_TABLE_SIZES, ST_CODE_LENS, ST_LENS,
+    ST_CODES, ST_CRC, ST_SIZE
+};
+
+enum { STEP_OK, STEP_INPUT, STEP_OUTPUT, STEP_ERROR };
+
+/* gzip header FLG bits */
+#define GZ_FHCRC    0x02
+#define GZ_FEXTRA   0x04
+#define GZ_FNAME    0x08
+#define GZ_FCOMMENT 0x10
+
+static const uint16_t LEN_BASE[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+static const uint8_t LEN_EXTRA[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+    3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+static const uint16_t DIST_BASE[30] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577
+};
+static const uint8_t DIST_EXTRA[30] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+    7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+};
+static const uint8_t CLEN_ORDER[19] = {
+    16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15
+};
+
+/* CRC-32 (IEEE 802.3), four bits at a time */
+static const uint32_t CRC_NIBBLE[16] = {
+    0x00000000, 0x1db71064, 0x3b6e20c8, 0x26d930ac, 0x76dc4190, 0x6b6b51f4,
+    0x4db26158, 0x5005713c, 0xedb88320, 0xf00f9344, 0xd6d6a3e8, 0xcb61b38c,
+    0x9b64c2b0, 0x86d3d2d4, 0xa00ae278, 0xbdbdf21c
+};
+
+struct GzipInput {
+    const uint8_t *data;
+    int len;
+    int pos;
+};
+
+/*============================================================================
+ * Bits and codes
+ *============================================================================*/
+
+static bool need(GzipInflater *z, GzipInput *in, int n) {
+    while (z->bit_count < n) {
+        if (in->pos >= in->len) return false;
+        z->bits |= (uint64_t)in->data[in->pos++] << z->bit_count;
+        z->bit_count += 8;
+    }
+    return true;
+}
+
+/* n <= 32, after need(n) */
+static uint32_t take(GzipInflater *z, int n) {
+    uint32_t v = (uint32_t)(z->bits & (((uint64_t)1 << n) - 1));
+    z->bits >>= n;
+    z->bit_count -= n;
+    return v;
+}
+
+/** Canonical code from code lengths. False if over-subscribed. */
+static bool buildCode(uint16_t *counts, uint16_t *syms, const uint8_t *lens, int n) {
+    uint16_t offs[16];
+    memset(counts, 0, 16 * sizeof(uint16_t));
+    for (int i = 0; i < n; i++) counts[lens[i]]++;
+    counts[0] = 0;
+
+    int left = 1;
+    for (int len = 1; len < 16; len++) {
+        left = (left << 1) - counts[len];
+        if (left < 0) return false;
+    }
+
+    offs[1] = 0;
+    for (int len = 1; len < 15; len++) offs[len + 1] = offs[len] + counts[len];
+    for (int i = 0; i < n; i++) {
+        if (lens[i]) syms[offs[lens[i]]++] = i;
+    }
+    return true;
+}
+
+/**
+ * Decode one symbol. Bits are only peeked until the code is complete.
+ * Returns the symbol, -1 if more input is needed, -2 for an unused code.
+ */
+static int decodeSym(GzipInflater *z, GzipInput *in,
+                     const uint16_t *counts, const uint16_t *syms) {
+    int code = 0, first = 0, index = 0;
+    for (int len = 1; len < 16; len++) {
+        if (!need(z, in, len)) return -1;
+        code |= (int)(z->bits >> (len - 1)) & 1;
+        int count = counts[len];
+        if (code - first < count) {
+            take(z, len);
+            return syms[index + code - first];
+        }
+        index += count;
+        first = (first + count) << 1;
+        code <<= 1;
+    }
+    return -2;
+}
+
+/*============================================================================
+ * Output
+ *============================================================================*/
+
+/** Room for the current run: up to the end of the window. */
+static int outputRoom(const GzipInflater *z, uint32_t start) {
+    if (!z->ring) return (int)(z->window_len - z->pos);
+    uint32_t idx = z->pos & (z->window_len - 1);
+    if (idx == 0 && z->pos != start) return 0;
+    return (int)(z->window_len - idx);
+}
+
+static void put(GzipInflater *z, uint8_t b) {
+    uint32_t idx = z->ring ? (z->pos & (z->window_len - 1)) : z->pos;
+    z->window[idx] = b;
+    z->pos++;
+    uint32_t c = z->crc ^ b;
+    c = (c >> 4) ^ CRC_NIBBLE[c & 15];
+    z->crc = (c >> 4) ^ CRC_NIBBLE[c & 15];
+}
+
+/*============================================================================
+ * Decoder
+ *============================================================================*/
+
+/* The next optional header field, or the first block */
+static void headerNext(GzipInflater *z) {
+    if (z->flags & GZ_FEXTRA)        z->state = ST_EXTRA_LEN;
+    else if (z->flags & GZ_FNAME)    z->state = ST_NAME;
+    else if (z->flags & GZ_FCOMMENT) z->state = ST_COMMENT;
+    else if (z->flags & GZ_FHCRC)    z->state = ST_HCRC;
+    else                             z->state = ST_BLOCK;
+}
+
+static void blockEnd(GzipInflater *z) {
+    if (z->final) {
+        take(z, z->bit_count & 7);   /* trailer is byte aligned */
+        z->state = ST_CRC;
+    } else {
+        z->state = ST_BLOCK;
+    }
+}
+
+static int fail(GzipInflater *z) {
+    z->status = GZIP_ERROR;
+    return STEP_ERROR;
+}
+
+static int step(GzipInflater *z, GzipInput *in, uint32_t start) {
+    switch (z->state) {
+    case ST_HEADER: {
+        if (!need(z, in, 32)) return STEP_INPUT;
+        uint32_t h = take(z, 32);
+        /* ID1 ID2 CM FLG; reserved flags must be clear */
+        if ((h & 0xFFFFFF) != 0x088B1F || (h >> 24) & 0xE0) return fail(z);
+        z->flags = h >> 24;
+        z->state = ST_MTIME;
+        return STEP_OK;
+    }
+    case ST_MTIME:
+        if (!need(z, in, 48)) return STEP_INPUT;
+        take(z, 32);                  /* MTIME */
+        take(z, 16);                  /* XFL, OS */
+        headerNext(z);
+        return STEP_OK;
+
+    case ST_EXTRA_LEN:
+        if (!need(z, in, 16)) return STEP_INPUT;
+        z->count = take(z, 16);
+        z->state = ST_EXTRA;
+        return STEP_OK;
+
+    case ST_EXTRA:
+        if (z->count > 0) {
+            if (!need(z, in, 8)) return STEP_INPUT;
+            take(z, 8);
+            z->count--;
+            return STEP_OK;
+        }
+        z->flags &= ~GZ_FEXTRA;
+        headerNext(z);
+        return STEP_OK;
+
+    case ST_NAME:
+    case ST_COMMENT:
+        if (!need(z, in, 8)) return STEP_INPUT;
+        if (take(z, 8) == 0) {
+            z->flags &= z->state == ST_NAME ? ~GZ_FNAME : ~GZ_FCOMMENT;
+            headerNext(z);
+        }
+        return STEP_OK;
+
+    case ST_HCRC:
+        if (!need(z, in, 16)) return STEP_INPUT;
+        take(z, 16);
+        z->flags &= ~GZ_FHCRC;
+        headerNext(z);
+        return STEP_OK;
+
+    case ST_BLOCK: {
+        if (!need(z, in, 3)) return STEP_INPUT;
+        z->final = take(z, 1);
+        int type = take(z, 2);
+        if (type == 0) {
+            take(z, z->bit_count & 7);
+            z->state = ST_STORED_LEN;
+        } else if (type == 1) {
+            /* Fixed codes */
+            int i = 0;
+            for (; i < 144; i++) z->lens[i] = 8;
+            for (; i < 256; i++) z->lens[i] = 9;
+            for (; i < 280; i++) z->lens[i] = 7;
+            for (; i < 288; i++) z->lens[i] = 8;
+            for (; i < 288 + 30; i++) z->lens[i] = 5;
+            buildCode(z->lit_counts, z->lit_syms, z->lens, 288);
+            buildCode(z->dist_counts, z->dist_syms, z->lens + 288, 30);
+            z->state = ST_CODES;
+        } else if (type == 2) {
+            z->state = ST_TABLE_SIZES;
+        } else {
+            return fail(z);
+        }
+        return STEP_OK;
+    }
+
+    case ST_STORED_LEN: {
+        if (!need(z, in, 32)) return STEP_INPUT;
+        uint32_t len = take(z, 16);
+        uint32_t nlen = take(z, 16);
+        if (len != (~nlen & 0xFFFF)) return fail(z);
+        z->count = len;
+        if (z->count > 0) z->state = ST_STORED;
+        else blockEnd(z);
+        return STEP_OK;
+    }
+
+    case ST_STORED: {
+        int room = outputRoom(z, start);
+        if (room == 0) return STEP_OUTPUT;
+        int n = 0;
+        while (n < room && n < z->count) {
+            if (z->bit_count >= 8) put(z, take(z, 8));
+            else if (in->pos < in->len) put(z, in->data[in->pos++]);
+            else break;
+            n++;
+        }
+        if (n == 0) return STEP_INPUT;
+        z->count -= n;
+        if (z->count == 0) blockEnd(z);
+        return STEP_OK;
+    }
+
+    case ST_TABLE_SIZES:
+        if (!need(z, in, 14)) return STEP_INPUT;
+        z->nlit = take(z, 5) + 257;
+        z->ndist = take(z, 5) + 1;
+        z->nlens = take(z, 4) + 4;
+        if (z->nlit > 286 || z->ndist > 30) return fail(z);
+        memset(z->lens, 0, 19);
+        z->count = 0;
+        z->state = ST_CODE_LENS;
+        return STEP_OK;
+
+    case ST_CODE_LENS:
+        if (!need(z, in, 3)) return STEP_INPUT;
+        z->lens[CLEN_ORDER[z->count++]] = take(z, 3);
+        if (z->count == z->nlens) {
+            /* The code length code lives in the distance code until the
+             * lengths are read */
+            if (!buildCode(z->dist_counts, z->dist_syms, z->lens, 19)) return fail(z);
+            z->count = 0;
+            z->state = ST_LENS;
+        }
+        return STEP_OK;
+
+    case ST_LENS: {
+        int total = z->nlit + z->ndist;
+        int sym = decodeSym(z, in, z->dist_counts, z->dist_syms);
+        if (sym == -1) return STEP_INPUT;
+        if (sym < 0) return fail(z);
+
+        int value = 0, repeat = 1;
+        if (sym < 16) {
+            value = sym;
+        } else if (sym == 16) {
+            if (z->count == 0) return fail(z);
+            if (!need(z, in, 2)) return STEP_INPUT;
+            value = z->lens[z->count - 1];
+            repeat = 3 + take(z, 2);
+        } else if (sym == 17) {
+            if (!need(z, in, 3)) return STEP_INPUT;
+            repeat = 3 + take(z, 3);
+        } else {
+            if (!need(z, in, 7)) return STEP_INPUT;
+            repeat = 11 + take(z, 7);
+        }
+        if (z->count + repeat > total) return fail(z);
+        memset(z->lens + z->count, value, repeat);
+        z->count += repeat;
+
+        if (z->count == total) {
+            if (z->lens[256] == 0) return fail(z);   /* no end-of-block code */
+            if (!buildCode(z->lit_counts, z->lit_syms, z->lens, z->nlit) ||
+                !buildCode(z->dist_counts, z->dist_syms, z->lens + z->nlit, z->ndist))
+                return fail(z);
+            z->state = ST_CODES;
+        }
+        return STEP_OK;
+    }
+
+    case ST_CODES: {
+        int room = outputRoom(z, start);
+
+        if (z->copy_len > 0) {
+            if (room == 0) return STEP_OUTPUT;
+            int n = room < z->copy_len ? room : z->copy_len;
+            for (int i = 0; i < n; i++) {
+                uint32_t src = z->pos - z->copy_dist;
+                if (z->ring) src &= z->window_len - 1;
+                put(z, z->window[src]);
+            }
+            z->copy_len -= n;
+            return STEP_OK;
+        }
+
+        /* A full window still takes the end-of-block code, so an exact fit
+         * finishes; anything else is pushed back until there is room. */
+        uint64_t bits = z->bits;
+        int bit_count = z->bit_count;
+        uint32_t in_pos = in->pos;
+        int sym = decodeSym(z, in, z->lit_counts, z->lit_syms);
+        if (sym == -1) return STEP_INPUT;
+        if (sym < 0) return fail(z);
+        if (room == 0 && sym != 256) {
+            z->bits = bits;
+            z->bit_count = bit_count;
+            in->pos = in_pos;
+            return STEP_OUTPUT;
+        }
+        if (sym < 256) {
+            put(z, sym);
+            return STEP_OK;
+        }
+        if (sym == 256) {
+            blockEnd(z);
+            return STEP_OK;
+        }
+
+        sym -= 257;
+        if (sym >= 29) return fail(z);
+        if (!need(z, in, LEN_EXTRA[sym])) return STEP_INPUT;
+        int len = LEN_BASE[sym] + take(z, LEN_EXTRA[sym]);
+
+        int dsym = decodeSym(z, in, z->dist_counts, z->dist_syms);
+        if (dsym == -1) return STEP_INPUT;
+        if (dsym < 0 || dsym >= 30) return fail(z);
+        if (!need(z, in, DIST_EXTRA[dsym])) return STEP_INPUT;
+        uint32_t dist = DIST_BASE[dsym] + take(z, DIST_EXTRA[dsym]);
+
+        uint32_t history = z->ring && z->pos > z->window_len ? z->window_len : z->pos;
+        if (dist > history) return fail(z);
+        z->copy_len = len;
+        z->copy_dist = dist;
+        return STEP_OK;
+    }
+
+    case ST_CRC:
+        if (!need(z, in, 32)) return STEP_INPUT;
+        if (take(z, 32) != ~z->crc) return fail(z);
+        z->state = ST_SIZE;
+        return STEP_OK;
+
+    case ST_SIZE:
+        if (!need(z, in, 32)) return STEP_INPUT;
+        if (take(z, 32) != z->pos) return fail(z);
+        z->status = GZIP_DONE;
+        return STEP_OK;
+    }
+    return fail(z);
+}
+
+/*============================================================================
+ * Public API
+ *============================================================================*/
+
+void gzipInit(GzipInflater *z, uint8_t *window, uint32_t window_len, bool ring) {
+    memset(z, 0, sizeof(*z));
+    z->status = GZIP_MORE;
+    z->state = ST_HEADER;
+    z->window = window;
+    z->window_len = window_len;
+    z->ring = ring;
+    z->crc = 0xFFFFFFFF;
+}
+
+int gzipInflate(GzipInflater *z, const uint8_t *in, int in_len, int *used,
+                const uint8_t **out) {
+    GzipInput input = { in, in_len, 0 };
+    uint32_t start = z->pos;
+    *out = z->window + (z->ring ? (z->pos & (z->window_len - 1)) : z->pos);
+
+    while (z->status == GZIP_MORE) {
+        uint64_t bits = z->bits;
+        int bit_count = z->bit_count;
+        int pos = input.pos;
+
+        int r = step(z, &input, start);
+        if (r == STEP_OK) continue;
+        if (r == STEP_INPUT) {
+            /* Undo the partial step and keep what is left of the input:
+             * a step needs at most 48 bits, so it fits */
+            z->bits = bits;
+            z->bit_count = bit_count;
+            input.pos = pos;
+            while (input.pos < input.len) {
+                z->bits |= (uint64_t)input.data[input.pos++] << z->bit_count;
+                z->bit_count += 8;
+            }
+        } else if (r == STEP_OUTPUT && !z->ring) {
+            z->status = GZIP_FULL;
+        }
+        break;
+    }
+
+    *used = input.pos;
+    return (int)(z->pos - start);
+}
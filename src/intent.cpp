@@ -0,0 +1,202 @@
+/**
+ * @file intent.cpp
+ * @brief Local fast path for simple device commands
+ *
+ * The message is normalized, a registered device name is looked up in it,
+ * and every remaining word must be known vocabulary (verbs, on/off,
+ * colors, numbers, filler). Only then is the request mapped to one tool
+ * call; a single unknown word sends the message to the LLM instead.
+ */
+
+#include "intent.h"
+#include "tools.h"
+#include "devices.h"
+#include <ctype.h>
+
+extern bool g_debug;
+
+static unsigned intentHits = 0;
+static unsigned intentMisses = 0;
+
+/*============================================================================
+ * Vocabulary
+ *============================================================================*/
+
+static const struct {
+    const char *name;
+    uint8_t r, g, b;
+} INTENT_COLORS[] = {
+    { "red",     255,   0,   0 },
+    { "green",     0, 255,   0 },
+    { "blue",      0,   0, 255 },
+    { "white",   255, 255, 255 },
+    { "yellow",  255, 255,   0 },
+    { "orange",  255, 128,   0 },
+    { "purple",  128,   0, 255 },
+    { "pink",    255,  64, 128 },
+    { "cyan",      0, 255, 255 },
+    { "magenta", 255,   0, 255 },
+};
+#define INTENT_COLOR_COUNT ((int)(sizeof(INTENT_COLORS) / sizeof(INTENT_COLORS[0])))
+
+static const char *const INTENT_FILLER[] = {
+    "the", "to", "please", "now", "a", "my", "of", "value", "current", nullptr
+};
+static const char *const INTENT_SET_VERBS[] = {
+    "turn", "switch", "set", "make", nullptr
+};
+static const char *const INTENT_READ_VERBS[] = {
+    "read", "get", "show", "check", "what", "whats", "is", nullptr
+};
+
+static bool inList(const char *word, const char *const *list) {
+    for (; *list; list++) {
+        if (strcmp(word, *list) == 0) return true;
+    }
+    return false;
+}
+
+/*============================================================================
+ * Matching
+ *============================================================================*/
+
+/**
+ * Lowercase, turn '_' and '-' into spaces, drop apostrophes, replace other
+ * punctuation with spaces, and pad with one space at each end so words
+ * can be found as " word ". A minus sign before a number and a percent
+ * sign after one are kept, so "-5" and "50%" stay words no rule accepts
+ * instead of becoming 5 and 50. Returns false if the result does not fit.
+ */
+static bool normalize(const char *src, char *dst, int dst_len) {
+    int w = 0;
+    dst[w++] = ' ';
+    for (int i = 0; src[i]; i++) {
+        char c = tolower((unsigned char)src[i]);
+        if (c == '\'') continue;
+        bool sign = c == '-' && dst[w - 1] == ' ' && isdigit((unsigned char)src[i + 1]);
+        bool percent = c == '%' && isdigit((unsigned char)dst[w - 1]);
+        if (!isalnum((unsigned char)c) && !sign && !percent) c = ' ';
+        if (c == ' ' && dst[w - 1] == ' ') continue;
+        if (w >= dst_len - 2) return false;
+        dst[w++] = c;
+    }
+    if (dst[w - 1] != ' ') dst[w++] = ' ';
+    dst[w] = '\0';
+    return true;
+}
+
+/** Find the longest registered device name in msg and blank it out. */
+static Device *takeDevice(char *msg) {
+    Device *devs = deviceGetAll();
+    Device *best = nullptr;
+    char *bestAt = nullptr;
+    int bestLen = 0;
+    char name[DEV_NAME_LEN + 2];
+
+    for (int i = 0; i < MAX_DEVICES; i++) {
+        if (!devs[i].used) continue;
+        if (!normalize(devs[i].name, name, sizeof(name))) continue;
+        int len = strlen(name);
+        if (len <= 2) continue;
+        char *at = strstr(msg, name);
+        if (at && len > bestLen) {
+            best = &devs[i];
+            bestAt = at;
+            bestLen = len;
+        }
+    }
+    if (best) memset(bestAt + 1, ' ', bestLen - 2);
+    return best;
+}
+
+bool intentHandle(const char *msg, char *reply, int reply_len) {
+    static char norm[INTENT_MAX_MSG_LEN + 3];
+    if ((int)strlen(msg) > INTENT_MAX_MSG_LEN ||
+        !normalize(msg, norm, sizeof(norm))) {
+        intentMisses++;
+        return false;
+    }
+
+    Device *dev = takeDevice(norm);
+
+    /* Every remaining word must be known vocabulary */
+    bool setVerb = false, readVerb = false, led = false, ok = true;
+    int state = -1, number = -1, color = -1;
+    for (char *word = strtok(norm, " "); word && ok; word = strtok(nullptr, " ")) {
+        if (inList(word, INTENT_FILLER)) continue;
+        if (inList(word, INTENT_SET_VERBS)) { setVerb = true; continue; }
+        if (inList(word, INTENT_READ_VERBS)) { readVerb = true; continue; }
+        if (strcmp(word, "led") == 0) { led = true; continue; }
+        if (strcmp(word, "on") == 0 || strcmp(word, "off") == 0) {
+            if (state >= 0) ok = false;
+            state = (word[1] == 'n') ? 1 : 0;
+            continue;
+        }
+        if (isdigit((unsigned char)word[0])) {
+            char *end;
+            long v = strtol(word, &end, 10);
+            if (*end || v > 255 || number >= 0) ok = false;
+            number = (int)v;
+            continue;
+        }
+        int c = 0;
+        while (c < INTENT_COLOR_COUNT && strcmp(word, INTENT_COLORS[c].name) != 0) c++;
+        if (c == INTENT_COLOR_COUNT || color >= 0) ok = false;
+        color = c;
+    }
+
+    /* Map to a single tool call, or give up */
+    const char *tool = nullptr;
+    char args[96];
+    int values = (state >= 0) + (number >= 0) + (color >= 0);
+
+    if (ok && dev && deviceIsActuator(dev->kind) && !readVerb && !led && values == 1) {
+        int value = -1;
+        bool binary = dev->kind == DEV_ACTUATOR_DIGITAL || dev->kind == DEV_ACTUATOR_RELAY;
+        if (state >= 0) {
+            if (state == 0) value = 0;
+            else if (dev->kind == DEV_ACTUATOR_PWM) value = 255;
+            else if (dev->kind == DEV_ACTUATOR_RGB_LED) value = 0xFFFFFF;
+            else value = 1;
+        } else if (number >= 0 && (!binary || number <= 1)) {
+            value = number;
+        } else if (color >= 0 && dev->kind == DEV_ACTUATOR_RGB_LED) {
+            value = (INTENT_COLORS[color].r << 16) | (INTENT_COLORS[color].g << 8) |
+                    INTENT_COLORS[color].b;
+        }
+        if (value >= 0) {
+            tool = "actuator_set";
+            snprintf(args, sizeof(args), "{\"name\":\"%s\",\"value\":%d}", dev->name, value);
+        }
+    } else if (ok && dev && deviceIsSensor(dev->kind) && !setVerb && !led && values == 0) {
+        tool = "sensor_read";
+        snprintf(args, sizeof(args), "{\"name\":\"%s\"}", dev->name);
+    } else if (ok && !dev && led && !readVerb && number < 0 &&
+               (state >= 0) + (color >= 0) == 1) {
+        uint8_t r = 0, g = 0, b = 0;
+        if (color >= 0) {
+            r = INTENT_COLORS[color].r;
+            g = INTENT_COLORS[color].g;
+            b = INTENT_COLORS[color].b;
+        } else if (state == 1) {
+            r = g = b = 255;
+        }
+        tool = "led_set";
+        snprintf(args, sizeof(args), "{\"r\":%u,\"g\":%u,\"b\":%u}", r, g, b);
+    }
+
+    if (!tool) {
+        intentMisses++;
+        return false;
+    }
+
+    intentHits++;
+    if (g_debug) Serial.printf("[Intent] %s(%s)\n", tool, args);
+    toolExecute(tool, args, reply, reply_len);
+    return true;
+}
+
+void intentStats(unsigned *hits, unsigned *misses) {
+    *hits = intentHits;
+    *misses = intentMisses;
+}
@@ -4,6 +4,7 @@
  */
 
 #include "llm_client.h"
+#include "gzip_inflate.h"
 #include <WiFiClientSecure.h>
 #include <esp_task_wdt.h>
 
@@ -94,6 +95,21 @@ static int json_find_int(const char *json, int json_len,
     return atoi(after_key);
 }
 
+/* Prompt tokens served from the provider's prefix cache, in the usage
+ * shapes we know: OpenAI/OpenRouter (prompt_tokens_details.cached_tokens),
+ * Anthropic (cache_read_input_tokens), DeepSeek (prompt_cache_hit_tokens),
+ * llama.cpp server (timings.cache_n) */
+static int json_find_cached_tokens(const char *json, int json_len) {
+    static const char *const KEYS[] = {
+        "cached_tokens", "cache_read_input_tokens", "prompt_cache_hit_tokens", "cache_n"
+    };
+    for (int i = 0; i < (int)(sizeof(KEYS) / sizeof(KEYS[0])); i++) {
+        int v = json_find_int(json, json_len, KEYS[i], 0);
+        if (v > 0) return v;
+    }
+    return 0;
+}
+
 static int json_unescape(char *buf, int len) {
     int r = 0, w = 0;
     while (r < len) {
@@ -159,313 +175,1152 @@ static const char *json_skip_value(const char *p, const char *end) {
     return p;
 }
 
-/* ---- LlmClient implementation ---- */
+/**
+ * Find the raw value of a key (string with quotes, object, array, number).
+ * Returns pointer to the value start, or nullptr.
+ */
+static const char *json_find_value(const char *json, int json_len,
+                                    const char *key, int *out_len) {
+    char pattern[128];
+    int plen = snprintf(pattern, sizeof(pattern), "\"%s\"", key);
+    if (plen < 0 || plen >= (int)sizeof(pattern)) return nullptr;
 
-LlmClient::LlmClient()
-    : m_client(nullptr), m_api_key(nullptr), m_model(nullptr),
-      m_port(443), m_use_tls(true) {
-    m_error[0] = '\0';
-    m_host[0] = '\0';
-    m_path[0] = '\0';
+    const char *found = (const char *)memmem(json, json_len, pattern, plen);
+    if (!found) return nullptr;
+
+    const char *end = json + json_len;
+    const char *p = found + plen;
+    while (p < end && (*p == ' ' || *p == ':')) p++;
+    const char *val_end = json_skip_value(p, end);
+    if (!val_end) return nullptr;
+
+    *out_len = val_end - p;
+    return p;
 }
 
-void LlmClient::begin(const char *api_key, const char *model, const char *base_url) {
-    m_api_key = api_key;
-    m_model = model;
-
-    /* Parse base_url or use defaults */
-    if (base_url && base_url[0]) {
-        const char *p = base_url;
-        if (strncmp(p, "https://", 8) == 0) {
-            m_use_tls = true;
-            m_port = 443;
-            p += 8;
-        } else if (strncmp(p, "http://", 7) == 0) {
-            m_use_tls = false;
-            m_port = 80;
-            p += 7;
-        } else {
-            m_use_tls = true;
-            m_port = 443;
-        }
-
-        /* Extract host:port and path */
-        const char *slash = strchr(p, '/');
-        const char *colon = strchr(p, ':');
-        if (colon && (!slash || colon < slash)) {
-            int hlen = colon - p;
-            if (hlen >= (int)sizeof(m_host)) hlen = sizeof(m_host) - 1;
-            memcpy(m_host, p, hlen);
-            m_host[hlen] = '\0';
-            m_port = atoi(colon + 1);
-            if (slash) {
-                strncpy(m_path, slash, sizeof(m_path) - 1);
-                m_path[sizeof(m_path) - 1] = '\0';
+/* ---- Single-pass JSON scanner ---- */
+
+/*
+ * Walks a document once and reports each value with its dotted path, e.g.
+ * "choices.0.message.tool_calls.1.function.name". Strings are reported as
+ * the raw (still escaped) text between the quotes, type '"'; numbers and
+ * literals as type '0'; objects and arrays as their full span, type '{' or
+ * '[', once closed. Values under a key that does not fit the path buffer
+ * are not reported.
+ */
+#define JSON_SAX_PATH_LEN  96
+#define JSON_SAX_MAX_DEPTH 16
+
+struct JsonSax;
+typedef void (*JsonSaxFn)(JsonSax *sax, const char *val, int len, char type);
+
+struct JsonSax {
+    const char *end;
+    char        path[JSON_SAX_PATH_LEN];
+    int         path_len;
+    int         lost;        /* levels below a key that did not fit */
+    JsonSaxFn   on_value;
+    void       *ctx;
+};
+
+static const char *json_sax_ws(const char *p, const char *end) {
+    while (p < end && (*p == ' ' || *p == '\n' || *p == '\r' || *p == '\t')) p++;
+    return p;
+}
+
+/* The closing quote of the string body starting at p, or nullptr. A quote
+ * closes the string unless preceded by an odd run of backslashes; memchr()
+ * skips plain text a word at a time. */
+static const char *json_sax_string_end(const char *p, const char *end) {
+    const char *start = p;
+    while ((p = (const char *)memchr(p, '"', end - p)) != nullptr) {
+        const char *b = p;
+        while (b > start && b[-1] == '\\') b--;
+        if (((p - b) & 1) == 0) return p;
+        p++;
+    }
+    return nullptr;
+}
+
+/* Append a path segment; returns the length to restore in json_sax_pop() */
+static int json_sax_push(JsonSax *sax, const char *seg, int len) {
+    int old = sax->path_len;
+    int at = old > 0 ? old + 1 : 0;
+    if (sax->lost > 0 || at + len >= JSON_SAX_PATH_LEN) {
+        sax->lost++;
+        return old;
+    }
+    if (old > 0) sax->path[old] = '.';
+    memcpy(sax->path + at, seg, len);
+    sax->path_len = at + len;
+    sax->path[sax->path_len] = '\0';
+    return old;
+}
+
+static void json_sax_pop(JsonSax *sax, int old) {
+    if (sax->lost > 0) {
+        sax->lost--;
+        return;
+    }
+    sax->path_len = old;
+    sax->path[old] = '\0';
+}
+
+/**
+ * Scan one value at p. Returns pointer past it, or nullptr if the document
+ * is malformed or truncated (values completed before that were reported).
+ */
+static const char *json_sax_value(JsonSax *sax, const char *p, int depth) {
+    const char *end = sax->end;
+    p = json_sax_ws(p, end);
+    if (p >= end) return nullptr;
+    const char *start = p;
+
+    if (*p == '"') {
+        p = json_sax_string_end(p + 1, end);
+        if (!p) return nullptr;
+        if (!sax->lost) sax->on_value(sax, start + 1, p - start - 1, '"');
+        return p + 1;
+    }
+
+    if (*p == '{' || *p == '[') {
+        if (depth >= JSON_SAX_MAX_DEPTH) return nullptr;
+        char type = *p;
+        char close = (type == '{') ? '}' : ']';
+        p = json_sax_ws(p + 1, end);
+        for (int i = 0; p < end && *p != close; i++) {
+            int old;
+            if (type == '{') {
+                if (*p != '"') return nullptr;
+                const char *key = p + 1;
+                p = json_sax_string_end(key, end);
+                if (!p) return nullptr;
+                old = json_sax_push(sax, key, p - key);
+                p = json_sax_ws(p + 1, end);
+                if (p >= end || *p != ':') {
+                    json_sax_pop(sax, old);
+                    return nullptr;
+                }
+                p++;
             } else {
-                strncpy(m_path, "/", sizeof(m_path));
+                char idx[12];
+                old = json_sax_push(sax, idx, snprintf(idx, sizeof(idx), "%d", i));
             }
-        } else if (slash) {
-            int hlen = slash - p;
-            if (hlen >= (int)sizeof(m_host)) hlen = sizeof(m_host) - 1;
-            memcpy(m_host, p, hlen);
-            m_host[hlen] = '\0';
-            strncpy(m_path, slash, sizeof(m_path) - 1);
-            m_path[sizeof(m_path) - 1] = '\0';
-        } else {
-            strncpy(m_host, p, sizeof(m_host) - 1);
-            m_host[sizeof(m_host) - 1] = '\0';
-            strncpy(m_path, "/", sizeof(m_path));
+            p = json_sax_value(sax, p, depth + 1);
+            json_sax_pop(sax, old);
+            if (!p) return nullptr;
+            p = json_sax_ws(p, end);
+            if (p < end && *p == ',') p = json_sax_ws(p + 1, end);
+            else if (p < end && *p != close) return nullptr;
         }
-        Serial.printf("LLM: %s://%s:%d%s\n",
-                      m_use_tls ? "https" : "http", m_host, m_port, m_path);
-    } else {
-        m_use_tls = true;
-        strncpy(m_host, DEFAULT_HOST, sizeof(m_host));
-        m_port = DEFAULT_PORT;
-        strncpy(m_path, DEFAULT_PATH, sizeof(m_path));
+        if (p >= end) return nullptr;
+        p++;
+        if (!sax->lost) sax->on_value(sax, start, p - start, type);
+        return p;
     }
 
-    if (m_use_tls) {
-        m_secure_client.setInsecure();
-        m_secure_client.setTimeout(LLM_READ_TIMEOUT_MS / 1000);
-        m_client = &m_secure_client;
-    } else {
-        m_plain_client.setTimeout(LLM_READ_TIMEOUT_MS / 1000);
-        m_client = &m_plain_client;
-    }
+    /* Number, true, false, null */
+    while (p < end && *p != ',' && *p != '}' && *p != ']' &&
+           *p != ' ' && *p != '\n' && *p != '\r' && *p != '\t')
+        p++;
+    if (!sax->lost) sax->on_value(sax, start, p - start, '0');
+    return p;
 }
 
-int LlmClient::buildRequest(char *buf, int buf_len,
-                              const LlmMessage *messages, int count,
-                              const char *tools_json) {
+/**
+ * Copy an escaped string body into dst, unescaping as it goes (same
+ * escapes as json_unescape()). Runs without escapes are copied whole.
+ * Returns the length written.
+ */
+static int json_copy_string(char *dst, int dst_len, const char *src, int len) {
+    const char *end = src + len;
     int w = 0;
+    while (w < dst_len - 1) {
+        const char *esc = (const char *)memchr(src, '\\', end - src);
+        int run = (esc ? esc : end) - src;
+        if (run > dst_len - 1 - w) run = dst_len - 1 - w;
+        memcpy(dst + w, src, run);
+        w += run;
+        src += run;
+        if (src + 1 >= end || w >= dst_len - 1) break;
+        switch (src[1]) {
+            case 'n':  dst[w++] = '\n'; break;
+            case 'r':  dst[w++] = '\r'; break;
+            case 't':  dst[w++] = '\t'; break;
+            default:   dst[w++] = src[1]; break;
+        }
+        src += 2;
+    }
+    dst[w] = '\0';
+    return w;
+}
 
-    w += snprintf(buf + w, buf_len - w,
-        "{\"model\":\"%s\",\"messages\":[", m_model);
-    if (w >= buf_len) return -1;
+/* ---- HTTP chunked transfer decoding ---- */
 
-    for (int i = 0; i < count; i++) {
-        if (i > 0) {
-            if (w + 1 >= buf_len) return -1;
-            buf[w++] = ',';
-        }
+enum ChunkState { CHUNK_SIZE, CHUNK_EXT, CHUNK_DATA, CHUNK_DATA_END,
+                  CHUNK_TRAILER, CHUNK_DONE };
 
-        const LlmMessage *msg = &messages[i];
+struct ChunkDecoder {
+    ChunkState state;
+    int remaining;   /* payload bytes left in the current chunk */
+    int line_len;    /* length of the current trailer line */
+};
 
-        if (msg->type == LLM_MSG_TOOL_CALL) {
-            /* Assistant message with tool_calls */
-            w += snprintf(buf + w, buf_len - w,
-                "{\"role\":\"assistant\"");
-            if (w >= buf_len) return -1;
+static void chunk_init(ChunkDecoder *d) {
+    d->state = CHUNK_SIZE;
+    d->remaining = 0;
+    d->line_len = 0;
+}
 
-            if (msg->content && msg->content[0]) {
-                w += snprintf(buf + w, buf_len - w, ",\"content\":\"");
-                if (w >= buf_len) return -1;
-                int esc = json_escape(buf + w, buf_len - w, msg->content);
-                if (esc < 0) return -1;
-                w += esc;
-                w += snprintf(buf + w, buf_len - w, "\"");
-            } else {
-                w += snprintf(buf + w, buf_len - w, ",\"content\":null");
-            }
-            if (w >= buf_len) return -1;
+static int hex_val(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
 
-            if (msg->tool_calls_json) {
-                w += snprintf(buf + w, buf_len - w,
-                    ",\"tool_calls\":%s", msg->tool_calls_json);
+/**
+ * Strip chunk framing in place. Returns the number of payload bytes now
+ * at the start of buf. Framing may be split across calls at any byte.
+ */
+static int chunk_decode(ChunkDecoder *d, char *buf, int len) {
+    int w = 0;
+    int r = 0;
+    while (r < len && d->state != CHUNK_DONE) {
+        char c = buf[r];
+        switch (d->state) {
+        case CHUNK_SIZE: {
+            int v = hex_val(c);
+            if (v >= 0 && d->remaining < 0x0FFFFFFF) {
+                d->remaining = d->remaining * 16 + v;
+            } else if (c == '\n') {
+                d->state = d->remaining > 0 ? CHUNK_DATA : CHUNK_TRAILER;
+            } else if (v < 0) {
+                d->state = CHUNK_EXT; /* ";ext" or CR before LF */
             }
-            if (w >= buf_len) return -1;
-            w += snprintf(buf + w, buf_len - w, "}");
+            r++;
+            break;
+        }
+        case CHUNK_EXT:
+            if (c == '\n')
+                d->state = d->remaining > 0 ? CHUNK_DATA : CHUNK_TRAILER;
+            r++;
+            break;
+        case CHUNK_DATA: {
+            int n = len - r < d->remaining ? len - r : d->remaining;
+            memmove(buf + w, buf + r, n);
+            w += n;
+            r += n;
+            d->remaining -= n;
+            if (d->remaining == 0) d->state = CHUNK_DATA_END;
+            break;
+        }
+        case CHUNK_DATA_END:
+            if (c == '\n') d->state = CHUNK_SIZE;
+            r++;
+            break;
+        case CHUNK_TRAILER:
+            /* Zero-size chunk seen; body ends at the first empty line */
+            if (c == '\n') {
+                if (d->line_len == 0) d->state = CHUNK_DONE;
+                d->line_len = 0;
+            } else if (c != '\r') {
+                d->line_len++;
+            }
+            r++;
+            break;
+        default:
+            r++;
+            break;
+        }
+    }
+    return w;
+}
 
-        } else if (msg->type == LLM_MSG_TOOL_RESULT) {
-            /* Tool result message */
-            w += snprintf(buf + w, buf_len - w,
-                "{\"role\":\"tool\",\"tool_call_id\":\"%s\",\"content\":\"",
-                msg->tool_call_id ? msg->tool_call_id : "");
-            if (w >= buf_len) return -1;
-
-            int esc = json_escape(buf + w, buf_len - w,
-                                   msg->content ? msg->content : "");
-            if (esc < 0) return -1;
-            w += esc;
-            w += snprintf(buf + w, buf_len - w, "\"}");
+/* ---- Streamed response parsing (SSE and NDJSON) ---- */
+
+struct StreamCtx {
+    LlmResult  *result;
+    LlmDeltaFn  on_delta;
+    void       *delta_ctx;
+    char       *error;       /* LlmClient::m_error */
+    int         error_len;
+    bool        ndjson;      /* Ollama native: tool arguments are objects */
+    bool        done;
+    bool        failed;
+    char       *line;        /* event being assembled */
+    int         line_len;
+    bool        overflow;    /* rest of an over-long line is dropped */
+};
+
+static void stream_content(StreamCtx *sc, const char *text, int len) {
+    static char frag[LLM_STREAM_LINE_LEN];
+    if (len >= (int)sizeof(frag)) len = sizeof(frag) - 1;
+    memcpy(frag, text, len);
+    int n = json_unescape(frag, len);
+    if (n <= 0) return;
+
+    LlmResult *r = sc->result;
+    int room = LLM_MAX_RESPONSE_LEN - 1 - r->content_len;
+    int copy = n < room ? n : room;
+    if (copy > 0) {
+        memcpy(r->content + r->content_len, frag, copy);
+        r->content_len += copy;
+        r->content[r->content_len] = '\0';
+    }
+
+    if (sc->on_delta) sc->on_delta(frag, n, sc->delta_ctx);
+}
+
+/**
+ * Merge one tool call fragment. OpenAI streams carry "index" and split
+ * the arguments string across events; Ollama sends whole calls.
+ */
+static void stream_tool_call(StreamCtx *sc, const char *obj, int obj_len) {
+    LlmResult *r = sc->result;
+
+    int idx = json_find_int(obj, obj_len, "index", -1);
+    if (idx < 0) idx = r->tool_call_count;
+    if (idx >= LLM_MAX_TOOL_CALLS) {
+        Serial.printf("[LLM] Warning: more than %d tool calls, ignoring #%d\n",
+                      LLM_MAX_TOOL_CALLS, idx);
+        return;
+    }
+    while (r->tool_call_count <= idx) {
+        LlmToolCall *blank = &r->tool_calls[r->tool_call_count++];
+        blank->id[0] = '\0';
+        blank->name[0] = '\0';
+        blank->arguments[0] = '\0';
+    }
+    LlmToolCall *tc = &r->tool_calls[idx];
+
+    int len = 0;
+    const char *id = json_find_string(obj, obj_len, "id", &len);
+    if (id && len > 0) {
+        int clen = len < (int)sizeof(tc->id) - 1 ? len : (int)sizeof(tc->id) - 1;
+        memcpy(tc->id, id, clen);
+        tc->id[clen] = '\0';
+    }
+
+    const char *name = json_find_string(obj, obj_len, "name", &len);
+    if (name && len > 0) {
+        int clen = len < (int)sizeof(tc->name) - 1 ? len : (int)sizeof(tc->name) - 1;
+        memcpy(tc->name, name, clen);
+        tc->name[clen] = '\0';
+    }
+
+    const char *args = json_find_value(obj, obj_len, "arguments", &len);
+    if (!args || len <= 0) return;
+    bool is_str = (*args == '"');
+    if (is_str) {
+        /* String fragment: strip quotes, unescape, append */
+        args++;
+        len -= 2;
+    }
+    if (len <= 0) return;
 
+    int have = strlen(tc->arguments);
+    int room = (int)sizeof(tc->arguments) - 1 - have;
+    if (len > room) {
+        Serial.printf("[LLM] Warning: tool arguments truncated (%s)\n", tc->name);
+        len = room;
+    }
+    memcpy(tc->arguments + have, args, len);
+    tc->arguments[have + len] = '\0';
+    if (is_str) json_unescape(tc->arguments + have, len);
+}
+
+static void stream_event(StreamCtx *sc, const char *json, int len) {
+    /* Error object: mid-stream failure, or the body of a non-200 reply */
+    int elen = 0;
+    const char *err = json_find_value(json, len, "error", &elen);
+    if (err && *err != 'n') {
+        const char *msg = json_find_string(err, elen, "message", &elen);
+        if (!msg && *err == '"') msg = json_find_string(json, len, "error", &elen);
+        if (msg && elen > 0) {
+            int copy = elen < sc->error_len - 1 ? elen : sc->error_len - 1;
+            memcpy(sc->error, msg, copy);
+            sc->error[copy] = '\0';
         } else {
-            /* Normal message */
-            w += snprintf(buf + w, buf_len - w,
-                "{\"role\":\"%s\",\"content\":\"", msg->role);
-            if (w >= buf_len) return -1;
+            snprintf(sc->error, sc->error_len, "API error");
+        }
+        sc->failed = true;
+        sc->done = true;
+        return;
+    }
 
-            int esc = json_escape(buf + w, buf_len - w,
-                                   msg->content ? msg->content : "");
-            if (esc < 0) return -1;
+    int clen = 0;
+    const char *content = json_find_string(json, len, "content", &clen);
+    if (content && clen > 0) stream_content(sc, content, clen);
+
+    const char *tc_key = (const char *)memmem(json, len, "\"tool_calls\"", 12);
+    if (tc_key) {
+        const char *end = json + len;
+        const char *p = tc_key + 12;
+        while (p < end && *p != '[' && *p != ',' && *p != '}') p++;
+        const char *arr_end = (p < end && *p == '[') ? json_skip_value(p, end) : nullptr;
+        if (arr_end) {
+            p++;
+            while (p < arr_end) {
+                while (p < arr_end && *p != '{') p++;
+                if (p >= arr_end) break;
+                const char *obj_end = json_skip_value(p, arr_end);
+                if (!obj_end) break;
+                stream_tool_call(sc, p, obj_end - p);
+                p = obj_end;
+            }
+        }
+    }
+
+    /* Usage arrives in the last event (OpenAI: usage{}, Ollama: *_count) */
+    LlmResult *r = sc->result;
+    int v = json_find_int(json, len, "prompt_tokens", 0);
+    if (v == 0) v = json_find_int(json, len, "prompt_eval_count", 0);
+    if (v > 0) r->prompt_tokens = v;
+    v = json_find_int(json, len, "completion_tokens", 0);
+    if (v == 0) v = json_find_int(json, len, "eval_count", 0);
+    if (v > 0) r->completion_tokens = v;
+    v = json_find_cached_tokens(json, len);
+    if (v > 0) r->cached_tokens = v;
+}
+
+/**
+ * Handle one line of the stream: "data: {...}" (SSE) or "{...}" (NDJSON).
+ */
+static void stream_line(StreamCtx *sc, char *line, int len) {
+    if (len > 0 && line[len - 1] == '\r') len--;
+    line[len] = '\0';
+    if (len == 0 || line[0] == ':') return; /* blank or SSE keep-alive comment */
+
+    if (strncmp(line, "data:", 5) == 0) {
+        const char *p = line + 5;
+        while (*p == ' ') p++;
+        if (strcmp(p, "[DONE]") == 0) {
+            sc->done = true;
+            return;
+        }
+        stream_event(sc, p, len - (p - line));
+    } else if (line[0] == '{') {
+        sc->ndjson = true;
+        stream_event(sc, line, len);
+        if (strstr(line, "\"done\":true")) sc->done = true;
+    }
+    /* Other SSE fields (event:, id:, retry:) carry nothing we need */
+}
+
+/** Split body bytes into lines for stream_line(). */
+static void stream_bytes(StreamCtx *sc, const char *data, int len) {
+    for (int i = 0; i < len && !sc->done; i++) {
+        if (data[i] == '\n') {
+            if (!sc->overflow) stream_line(sc, sc->line, sc->line_len);
+            sc->line_len = 0;
+            sc->overflow = false;
+        } else if (sc->line_len < LLM_STREAM_LINE_LEN - 1) {
+            sc->line[sc->line_len++] = data[i];
+        } else if (!sc->overflow) {
+            Serial.printf("[LLM] Warning: stream event over %d bytes dropped\n",
+                          LLM_STREAM_LINE_LEN);
+            sc->overflow = true;
+        }
+    }
+}
+
+/**
+ * Rebuild the tool_calls array (OpenAI format) from the assembled calls,
+ * for echoing back in the next request.
+ */
+static void build_tool_calls_json(LlmResult *r, bool raw_args) {
+    char *buf = r->tool_calls_json;
+    int cap = sizeof(r->tool_calls_json);
+    int w = snprintf(buf, cap, "[");
+
+    for (int i = 0; i < r->tool_call_count && w < cap; i++) {
+        LlmToolCall *tc = &r->tool_calls[i];
+        if (tc->id[0] == '\0') snprintf(tc->id, sizeof(tc->id), "call_%d", i);
+
+        w += snprintf(buf + w, cap - w,
+            "%s{\"id\":\"%s\",\"type\":\"function\","
+            "\"function\":{\"name\":\"%s\",\"arguments\":",
+            i > 0 ? "," : "", tc->id, tc->name);
+        if (w >= cap) break;
+
+        if (raw_args) {
+            w += snprintf(buf + w, cap - w, "%s",
+                          tc->arguments[0] ? tc->arguments : "{}");
+        } else {
+            w += snprintf(buf + w, cap - w, "\"");
+            if (w >= cap) break;
+            int esc = json_escape(buf + w, cap - w, tc->arguments);
+            if (esc < 0) { w = cap; break; }
             w += esc;
-            w += snprintf(buf + w, buf_len - w, "\"}");
+            w += snprintf(buf + w, cap - w, "\"");
         }
+        if (w >= cap) break;
+        w += snprintf(buf + w, cap - w, "}}");
+    }
+    if (w < cap) w += snprintf(buf + w, cap - w, "]");
 
-        if (w >= buf_len) return -1;
+    if (w >= cap) {
+        Serial.printf("[LLM] Warning: tool_calls_json too large (max %d)\n", cap - 1);
+        buf[0] = '\0';
     }
+}
 
-    w += snprintf(buf + w, buf_len - w, "]");
-    if (w >= buf_len) return -1;
+/* ---- Request body writer ---- */
 
-    /* Add tools if provided */
-    if (tools_json && tools_json[0]) {
-        w += snprintf(buf + w, buf_len - w,
-            ",\"tools\":%s,\"tool_choice\":\"auto\"", tools_json);
-        if (w >= buf_len) return -1;
+/*
+ * Writes go through one small buffer so the TLS layer sees full records
+ * instead of one per fragment. With client == nullptr only bytes are
+ * counted (sizing pass for Content-Length).
+ */
+struct BodyWriter {
+    Client *client;
+    int     len;      /* bytes buffered */
+    int     total;    /* bytes written (or counted) so far */
+    bool    failed;
+};
+
+static char s_body_buf[LLM_WRITE_BUF_LEN];
+
+static void bw_init(BodyWriter *bw, Client *client) {
+    bw->client = client;
+    bw->len = 0;
+    bw->total = 0;
+    bw->failed = false;
+}
+
+static void bw_flush(BodyWriter *bw) {
+    if (bw->client && bw->len > 0 && !bw->failed) {
+        if ((int)bw->client->write((const uint8_t *)s_body_buf, bw->len) != bw->len)
+            bw->failed = true;
     }
+    bw->len = 0;
+}
 
-    w += snprintf(buf + w, buf_len - w,
-        ",\"max_tokens\":2048,\"temperature\":0.7}");
+static void bw_write(BodyWriter *bw, const char *data, int len) {
+    bw->total += len;
+    if (!bw->client) return;
+    while (len > 0) {
+        if (bw->len == (int)sizeof(s_body_buf)) bw_flush(bw);
+        int n = (int)sizeof(s_body_buf) - bw->len;
+        if (n > len) n = len;
+        memcpy(s_body_buf + bw->len, data, n);
+        bw->len += n;
+        data += n;
+        len -= n;
+    }
+}
 
-    if (w >= buf_len) return -1;
-    return w;
+static void bw_puts(BodyWriter *bw, const char *str) {
+    bw_write(bw, str, strlen(str));
 }
 
-int LlmClient::parseToolCalls(const char *body, int body_len, LlmResult *result) {
-    result->tool_call_count = 0;
-    result->tool_calls_json[0] = '\0';
+/* Same escaping as json_escape(), without a destination buffer */
+static void bw_escaped(BodyWriter *bw, const char *src) {
+    const char *run = src;
+    for (const char *p = src; ; p++) {
+        char c = *p;
+        const char *esc = nullptr;
+        switch (c) {
+            case '\\': esc = "\\\\"; break;
+            case '"':  esc = "\\\""; break;
+            case '\n': esc = "\\n";  break;
+            case '\r': esc = "\\r";  break;
+            case '\t': esc = "\\t";  break;
+            default:
+                if (c != '\0' && (unsigned char)c >= 0x20) continue;
+                break;
+        }
+        if (p > run) bw_write(bw, run, p - run);
+        if (c == '\0') break;
+        if (esc) bw_puts(bw, esc);  /* other control chars are dropped */
+        run = p + 1;
+    }
+}
 
-    /* Find "tool_calls" key */
-    const char *tc_key = "\"tool_calls\"";
-    const char *found = (const char *)memmem(body, body_len, tc_key, strlen(tc_key));
-    if (!found) return 0;
+/* ---- Request size estimation ---- */
 
-    /* Skip to the array start '[' */
-    const char *end = body + body_len;
-    const char *p = found + strlen(tc_key);
-    while (p < end && *p != '[') p++;
-    if (p >= end) return 0;
+/* Keys, role and separators of one message, plus a cache_control part */
+#define LLM_MSG_OVERHEAD 112
 
-    const char *arr_start = p;
+int llmEscapedLen(const char *text) {
+    int n = 0;
+    for (const char *p = text; *p; p++) {
+        switch (*p) {
+            case '\\': case '"': case '\n': case '\r': case '\t':
+                n += 2;
+                break;
+            default:
+                if ((unsigned char)*p >= 0x20) n++;
+                break;
+        }
+    }
+    return n;
+}
 
-    /* Find matching ']' */
-    const char *arr_end = json_skip_value(p, end);
-    if (!arr_end) return 0;
+int llmMessageBytes(const LlmMessage *msg) {
+    int n = LLM_MSG_OVERHEAD;
+    if (msg->content) n += llmEscapedLen(msg->content);
+    if (msg->tool_call_id) n += strlen(msg->tool_call_id);
+    if (msg->tool_calls_json) n += strlen(msg->tool_calls_json);
+    return n;
+}
 
-    /* Save raw tool_calls JSON for echoing back */
-    int tc_json_len = arr_end - arr_start;
-    if (tc_json_len < (int)sizeof(result->tool_calls_json) - 1) {
-        memcpy(result->tool_calls_json, arr_start, tc_json_len);
-        result->tool_calls_json[tc_json_len] = '\0';
-    } else {
-        Serial.printf("[LLM] Warning: tool_calls_json too large (%d bytes, max %d)\n",
-                      tc_json_len, (int)sizeof(result->tool_calls_json) - 1);
+int LlmClient::envelopeBytes(const char *const *tools, int tool_count) const {
+    int model = 0;  /* the longest, whichever endpoint answers */
+    for (int i = 0; i < m_ep_count; i++) {
+        int len = strlen(modelFor(i));
+        if (len > model) model = len;
     }
+    int n = 160 + model;  /* settings, stream options, brackets */
+    for (int i = 0; tools && i < tool_count; i++) n += strlen(tools[i]) + 1;
+    return n;
+}
+
+/* ---- LlmClient implementation ---- */
 
-    /* Parse individual tool calls from the array */
-    p = arr_start + 1; /* skip '[' */
-    int count = 0;
+/* A buffered (non-streamed) reply is read whole before it is parsed */
+#define LLM_RESPONSE_BUF_LEN (LLM_MAX_RESPONSE_LEN + 2048)
 
-    while (p < arr_end && count < LLM_MAX_TOOL_CALLS) {
-        /* Find next '{' */
-        while (p < arr_end && *p != '{') p++;
-        if (p >= arr_end) break;
+LlmClient::LlmClient()
+    : m_ep_count(0), m_last_ep(-1), m_conn(&m_conns[0]), m_client(nullptr),
+      m_model(nullptr), m_stream(true), m_prompt_cache(false), m_hedge(false),
+      m_gzip(true), m_gzip_window(nullptr), m_response_buf(nullptr), m_first_byte_ms(0),
+      m_connect_ms(0), m_reused(false), m_connect_count(0), m_connect_total_ms(0),
+      m_hedges(0), m_hedge_wins(0), m_rx_wire(0), m_rx_body(0) {
+    m_error[0] = '\0';
+    for (int i = 0; i < 2; i++) {
+        m_conns[i].client = nullptr;
+        m_conns[i].ep = -1;
+        m_conns[i].keep_alive = false;
+        m_conns[i].last_used = 0;
+        m_conns[i].reused = false;
+        m_conns[i].connect_ms = 0;
+    }
+}
 
-        const char *obj_start = p;
-        const char *obj_end = json_skip_value(p, arr_end);
-        if (!obj_end) break;
+/** Fill an endpoint from base_url, or with the OpenRouter defaults. */
+bool LlmClient::parseUrl(LlmEndpoint *ep, const char *base_url) {
+    ep->ip_valid = false;
+    ep->dns_time = 0;
+    ep->failures = 0;
+    ep->down_until = 0;
+    ep->requests = 0;
+    ep->errors = 0;
+    ep->latency_count = 0;
+    ep->latency_next = 0;
+
+    if (!base_url || !base_url[0]) {
+        ep->use_tls = true;
+        strncpy(ep->host, DEFAULT_HOST, sizeof(ep->host));
+        ep->port = DEFAULT_PORT;
+        strncpy(ep->path, DEFAULT_PATH, sizeof(ep->path));
+        return true;
+    }
 
-        int obj_len = obj_end - obj_start;
-        LlmToolCall *tc = &result->tool_calls[count];
+    const char *p = base_url;
+    if (strncmp(p, "https://", 8) == 0) {
+        ep->use_tls = true;
+        ep->port = 443;
+        p += 8;
+    } else if (strncmp(p, "http://", 7) == 0) {
+        ep->use_tls = false;
+        ep->port = 80;
+        p += 7;
+    } else {
+        ep->use_tls = true;
+        ep->port = 443;
+    }
 
-        /* Extract "id" */
-        int id_len = 0;
-        const char *id = json_find_string(obj_start, obj_len, "id", &id_len);
-        if (id && id_len > 0) {
-            int clen = id_len < (int)sizeof(tc->id) - 1 ? id_len : (int)sizeof(tc->id) - 1;
-            memcpy(tc->id, id, clen);
-            tc->id[clen] = '\0';
+    /* Extract host:port and path */
+    const char *slash = strchr(p, '/');
+    const char *colon = strchr(p, ':');
+    if (colon && (!slash || colon < slash)) {
+        int hlen = colon - p;
+        if (hlen >= (int)sizeof(ep->host)) hlen = sizeof(ep->host) - 1;
+        memcpy(ep->host, p, hlen);
+        ep->host[hlen] = '\0';
+        ep->port = atoi(colon + 1);
+        if (slash) {
+            strncpy(ep->path, slash, sizeof(ep->path) - 1);
+            ep->path[sizeof(ep->path) - 1] = '\0';
         } else {
-            tc->id[0] = '\0';
+            strncpy(ep->path, "/", sizeof(ep->path));
         }
+    } else if (slash) {
+        int hlen = slash - p;
+        if (hlen >= (int)sizeof(ep->host)) hlen = sizeof(ep->host) - 1;
+        memcpy(ep->host, p, hlen);
+        ep->host[hlen] = '\0';
+        strncpy(ep->path, slash, sizeof(ep->path) - 1);
+        ep->path[sizeof(ep->path) - 1] = '\0';
+    } else {
+        strncpy(ep->host, p, sizeof(ep->host) - 1);
+        ep->host[sizeof(ep->host) - 1] = '\0';
+        strncpy(ep->path, "/", sizeof(ep->path));
+    }
+    if (ep->host[0] == '\0' || ep->port <= 0) return false;
+
+    Serial.printf("LLM: %s%s://%s:%d%s\n", m_ep_count > 0 ? "fallback " : "",
+                  ep->use_tls ? "https" : "http", ep->host, ep->port, ep->path);
+    return true;
+}
+
+void LlmClient::begin(const char *api_key, const char *model, const char *base_url) {
+    disconnect();
+    for (int i = 0; i < 2; i++) {
+        m_conns[i].secure.setInsecure();
+        m_conns[i].secure.setTimeout(LLM_READ_TIMEOUT_MS / 1000);
+        m_conns[i].plain.setTimeout(LLM_READ_TIMEOUT_MS / 1000);
+        m_conns[i].ep = -1;
+    }
+    m_ep_count = 0;
+    m_last_ep = -1;
+    addEndpoint(base_url, model, api_key);
+}
+
+bool LlmClient::addEndpoint(const char *base_url, const char *model, const char *api_key) {
+    if (m_ep_count >= LLM_MAX_ENDPOINTS) return false;
+    LlmEndpoint *ep = &m_eps[m_ep_count];
+    ep->api_key = api_key;
+    ep->model = model;
+    if (!parseUrl(ep, base_url)) {
+        Serial.printf("LLM: invalid endpoint URL: %s\n", base_url);
+        return false;
+    }
+    m_ep_count++;
+    return true;
+}
+
+/* ---- Endpoint health ---- */
+
+bool LlmClient::endpointDown(int i) const {
+    return m_eps[i].down_until != 0 && (long)(millis() - m_eps[i].down_until) < 0;
+}
+
+/**
+ * Order the endpoints for a request: healthy ones as configured, then
+ * those marked down, the soonest to recover first. Every endpoint is
+ * listed, so a single one is always tried.
+ */
+int LlmClient::pickEndpoints(int *order) const {
+    int n = 0;
+    for (int i = 0; i < m_ep_count; i++) {
+        if (!endpointDown(i)) order[n++] = i;
+    }
+    for (int i = 0; i < m_ep_count; i++) {
+        if (!endpointDown(i)) continue;
+        int j = n++;
+        while (j > 0 && endpointDown(order[j - 1]) &&
+               (long)(m_eps[order[j - 1]].down_until - m_eps[i].down_until) > 0) {
+            order[j] = order[j - 1];
+            j--;
+        }
+        order[j] = i;
+    }
+    return n;
+}
 
-        /* Extract function name - find "function" object first */
-        int name_len = 0;
-        const char *name = json_find_string(obj_start, obj_len, "name", &name_len);
-        if (name && name_len > 0) {
-            int clen = name_len < (int)sizeof(tc->name) - 1 ? name_len : (int)sizeof(tc->name) - 1;
-            memcpy(tc->name, name, clen);
-            tc->name[clen] = '\0';
+/** Skip the endpoint for a while, twice as long after each further failure. */
+void LlmClient::endpointFailed(int i) {
+    LlmEndpoint *ep = &m_eps[i];
+    ep->errors++;
+    if (ep->failures < 8) ep->failures++;
+    unsigned long down = (unsigned long)LLM_DOWN_MS << (ep->failures - 1);
+    if (down > LLM_DOWN_MAX_MS) down = LLM_DOWN_MAX_MS;
+    ep->down_until = millis() + down;
+    if (ep->down_until == 0) ep->down_until = 1;
+    if (m_ep_count > 1)
+        Serial.printf("[LLM] %s failed (%s), trying it last for %lus\n",
+                      ep->host, m_error, down / 1000);
+}
+
+/** Record a first-byte time; a response also clears the failure state. */
+void LlmClient::endpointLatency(int i, unsigned long ms) {
+    LlmEndpoint *ep = &m_eps[i];
+    ep->latency[ep->latency_next] = ms < 65535 ? (uint16_t)ms : 65535;
+    ep->latency_next = (ep->latency_next + 1) % LLM_LATENCY_SAMPLES;
+    if (ep->latency_count < LLM_LATENCY_SAMPLES) ep->latency_count++;
+    ep->failures = 0;
+    ep->down_until = 0;
+}
+
+unsigned long LlmClient::endpointP95(int i) const {
+    const LlmEndpoint *ep = &m_eps[i];
+    int n = ep->latency_count;
+    if (n == 0) return 0;
+
+    uint16_t sorted[LLM_LATENCY_SAMPLES];
+    for (int a = 0; a < n; a++) {
+        uint16_t v = ep->latency[a];
+        int b = a;
+        while (b > 0 && sorted[b - 1] > v) {
+            sorted[b] = sorted[b - 1];
+            b--;
+        }
+        sorted[b] = v;
+    }
+    return sorted[(n * 95 + 99) / 100 - 1];
+}
+
+/** How long to wait for the endpoint's first byte before hedging. */
+unsigned long LlmClient::hedgeDeadline(int i) const {
+    if (m_eps[i].latency_count < 4) return LLM_HEDGE_DEFAULT_MS;
+    unsigned long p95 = endpointP95(i);
+    return p95 > LLM_HEDGE_MIN_MS ? p95 : LLM_HEDGE_MIN_MS;
+}
+
+/* ---- Connections ---- */
+
+/**
+ * Resolve the endpoint's host, reusing the cached address for
+ * LLM_DNS_CACHE_MS. A stale address is kept if the lookup fails.
+ */
+bool LlmClient::resolveHost(LlmEndpoint *ep) {
+    if (ep->ip_valid && millis() - ep->dns_time < LLM_DNS_CACHE_MS) return true;
+
+    unsigned long t0 = millis();
+    IPAddress ip;
+    if (!WiFi.hostByName(ep->host, ip)) {
+        if (ep->ip_valid) {
+            Serial.printf("[LLM] DNS lookup for %s failed, using cached %s\n",
+                          ep->host, ep->ip.toString().c_str());
+            return true;
+        }
+        snprintf(m_error, sizeof(m_error), "DNS lookup failed for %s", ep->host);
+        return false;
+    }
+    ep->ip = ip;
+    ep->ip_valid = true;
+    ep->dns_time = millis();
+    if (g_debug) Serial.printf("[LLM] DNS %s -> %s (%lums)\n",
+                               ep->host, ep->ip.toString().c_str(), millis() - t0);
+    return true;
+}
+
+/**
+ * Reuse the connection if it is open to the same endpoint and still fresh,
+ * otherwise connect to the cached address (SNI still carries the host).
+ * Connecting gives up after LLM_CONNECT_TIMEOUT_MS.
+ */
+bool LlmClient::openConnection(LlmConn *conn, int i) {
+    LlmEndpoint *ep = &m_eps[i];
+    if (conn->ep == i && conn->keep_alive && conn->client->connected() &&
+        millis() - conn->last_used < LLM_KEEPALIVE_IDLE_MS &&
+        conn->client->available() == 0) {
+        conn->reused = true;
+        conn->connect_ms = 0;
+        return true;
+    }
+    if (conn->client) conn->client->stop();
+    conn->client = ep->use_tls ? (Client *)&conn->secure : (Client *)&conn->plain;
+    conn->ep = i;
+    conn->keep_alive = false;
+    conn->reused = false;
+
+    unsigned long t0 = millis();
+    for (int attempt = 0; attempt < 2; attempt++) {
+        if (!resolveHost(ep)) return false;
+        if (g_debug) Serial.printf("[LLM] Connecting to %s:%d...\n", ep->host, ep->port);
+
+        bool ok;
+        if (ep->use_tls) {
+            conn->secure.setHandshakeTimeout(LLM_CONNECT_TIMEOUT_MS / 1000);
+            conn->secure.setTimeout(LLM_CONNECT_TIMEOUT_MS / 1000);
+            ok = conn->secure.connect(ep->ip, ep->port, ep->host, nullptr, nullptr, nullptr);
+            conn->secure.setTimeout(LLM_READ_TIMEOUT_MS / 1000);
         } else {
-            tc->name[0] = '\0';
-        }
-
-        /* Extract arguments - it's a JSON string value containing JSON */
-        int args_len = 0;
-        const char *args = json_find_string(obj_start, obj_len, "arguments", &args_len);
-        if (args && args_len > 0) {
-            int clen = args_len < (int)sizeof(tc->arguments) - 1 ? args_len : (int)sizeof(tc->arguments) - 1;
-            memcpy(tc->arguments, args, clen);
-            tc->arguments[clen] = '\0';
-            /* Unescape the JSON string (arguments contain escaped JSON) */
-            json_unescape(tc->arguments, clen);
+            ok = conn->plain.connect(ep->ip, ep->port, LLM_CONNECT_TIMEOUT_MS);
+        }
+        if (ok) {
+            /* Fresh, so a preconnect()ed connection is kept for the request */
+            conn->keep_alive = true;
+            conn->last_used = millis();
+            conn->connect_ms = millis() - t0;
+            m_connect_count++;
+            m_connect_total_ms += conn->connect_ms;
+            if (g_debug) Serial.printf("[LLM] Connected (%lums)\n", conn->connect_ms);
+            return true;
+        }
+        /* The host may have moved - retry once with a fresh lookup */
+        ep->ip_valid = false;
+    }
+    snprintf(m_error, sizeof(m_error), "%s connect to %s failed",
+             ep->use_tls ? "TLS" : "TCP", ep->host);
+    return false;
+}
+
+bool LlmClient::preconnect() {
+    if (m_ep_count == 0 || WiFi.status() != WL_CONNECTED) return false;
+    int order[LLM_MAX_ENDPOINTS];
+    pickEndpoints(order);
+    if (openConnection(&m_conns[0], order[0])) return true;
+    endpointFailed(order[0]);
+    return false;
+}
+
+void LlmClient::disconnect() {
+    for (int i = 0; i < 2; i++) {
+        if (m_conns[i].client) m_conns[i].client->stop();
+        m_conns[i].keep_alive = false;
+    }
+}
+
+/* Message content as a JSON string, or as a single text part carrying a
+ * cache_control breakpoint */
+static void bw_content(BodyWriter *bw, const char *text, bool cache) {
+    if (cache) {
+        bw_puts(bw, "[{\"type\":\"text\",\"text\":\"");
+        bw_escaped(bw, text);
+        bw_puts(bw, "\",\"cache_control\":{\"type\":\"ephemeral\"}}]");
+    } else {
+        bw_puts(bw, "\"");
+        bw_escaped(bw, text);
+        bw_puts(bw, "\"");
+    }
+}
+
+/**
+ * Serialize the request body. Called twice per request: a sizing pass with
+ * client == nullptr to get the Content-Length, then the same bytes are
+ * streamed to the socket. Returns the body length, or -1 if a write failed.
+ *
+ * Everything that stays the same between calls comes first - settings,
+ * tools, then the system messages - so consecutive requests of a tool loop
+ * share a byte-identical prefix that provider prompt caches can match.
+ */
+int LlmClient::writeBody(Client *client, const char *model,
+                         const LlmMessage *messages, int count,
+                         const char *const *tools, int tool_count) {
+    BodyWriter bw;
+    bw_init(&bw, client);
+
+    bw_puts(&bw, "{\"model\":\"");
+    bw_puts(&bw, model);
+    char settings[48];
+    snprintf(settings, sizeof(settings), "\",\"max_tokens\":%d,\"temperature\":0.7",
+             LLM_REPLY_TOKENS);
+    bw_puts(&bw, settings);
+
+    if (m_stream) {
+        bw_puts(&bw, ",\"stream\":true,\"stream_options\":{\"include_usage\":true}");
+    }
+
+    /* Add tools if provided */
+    if (tools && tool_count > 0) {
+        bw_puts(&bw, ",\"tool_choice\":\"auto\",\"tools\":[");
+        for (int i = 0; i < tool_count; i++) {
+            if (i > 0) bw_puts(&bw, ",");
+            bw_puts(&bw, tools[i]);
+        }
+        bw_puts(&bw, "]");
+    }
+
+    /* Cache breakpoints: end of the leading system messages, and the newest
+     * message so the next iteration can extend the cached prefix */
+    int cache_sys = -1;
+    if (m_prompt_cache) {
+        for (int i = 0; i < count; i++) {
+            if (messages[i].type != LLM_MSG_NORMAL ||
+                strcmp(messages[i].role, "system") != 0) break;
+            cache_sys = i;
+        }
+    }
+
+    bw_puts(&bw, ",\"messages\":[");
+
+    for (int i = 0; i < count; i++) {
+        if (i > 0) bw_puts(&bw, ",");
+
+        const LlmMessage *msg = &messages[i];
+        bool cache = m_prompt_cache && (i == cache_sys || i == count - 1);
+
+        if (msg->type == LLM_MSG_TOOL_CALL) {
+            /* Assistant message with tool_calls */
+            bw_puts(&bw, "{\"role\":\"assistant\"");
+            if (msg->content && msg->content[0]) {
+                bw_puts(&bw, ",\"content\":\"");
+                bw_escaped(&bw, msg->content);
+                bw_puts(&bw, "\"");
+            } else {
+                bw_puts(&bw, ",\"content\":null");
+            }
+            if (msg->tool_calls_json) {
+                bw_puts(&bw, ",\"tool_calls\":");
+                bw_puts(&bw, msg->tool_calls_json);
+            }
+            bw_puts(&bw, "}");
+
+        } else if (msg->type == LLM_MSG_TOOL_RESULT) {
+            /* Tool result message */
+            bw_puts(&bw, "{\"role\":\"tool\",\"tool_call_id\":\"");
+            bw_puts(&bw, msg->tool_call_id ? msg->tool_call_id : "");
+            bw_puts(&bw, "\",\"content\":");
+            bw_content(&bw, msg->content ? msg->content : "", cache);
+            bw_puts(&bw, "}");
+
         } else {
-            tc->arguments[0] = '\0';
+            /* Normal message */
+            bw_puts(&bw, "{\"role\":\"");
+            bw_puts(&bw, msg->role);
+            bw_puts(&bw, "\",\"content\":");
+            bw_content(&bw, msg->content ? msg->content : "", cache);
+            bw_puts(&bw, "}");
         }
+    }
+
+    bw_puts(&bw, "]}");
+    bw_flush(&bw);
 
-        count++;
-        p = obj_end;
+    return bw.failed ? -1 : bw.total;
+}
+
+/* ---- Buffered response parsing ---- */
+
+struct ResponseCtx {
+    LlmResult *result;
+    char      *error;        /* LlmClient::m_error */
+    int        error_len;
+    bool       has_error;
+};
+
+static void response_tool_call(LlmResult *r, const char *path,
+                               const char *val, int len, char type) {
+    char *rest;
+    long idx = strtol(path, &rest, 10);
+    if (rest == path || *rest != '.' || idx < 0 || idx >= LLM_MAX_TOOL_CALLS) return;
+    while (r->tool_call_count <= idx) {
+        LlmToolCall *blank = &r->tool_calls[r->tool_call_count++];
+        blank->id[0] = '\0';
+        blank->name[0] = '\0';
+        blank->arguments[0] = '\0';
+    }
+    LlmToolCall *tc = &r->tool_calls[idx];
+    rest++;
+
+    if (type == '"' && strcmp(rest, "id") == 0) {
+        json_copy_string(tc->id, sizeof(tc->id), val, len);
+    } else if (type == '"' && strcmp(rest, "function.name") == 0) {
+        json_copy_string(tc->name, sizeof(tc->name), val, len);
+    } else if (strcmp(rest, "function.arguments") == 0) {
+        if (type == '"') {
+            json_copy_string(tc->arguments, sizeof(tc->arguments), val, len);
+        } else if (type == '{') {
+            /* Ollama native: arguments is an object, keep it as JSON text */
+            if (len > (int)sizeof(tc->arguments) - 1) len = sizeof(tc->arguments) - 1;
+            memcpy(tc->arguments, val, len);
+            tc->arguments[len] = '\0';
+        }
+    }
+}
+
+static void response_value(JsonSax *sax, const char *val, int len, char type) {
+    ResponseCtx *rc = (ResponseCtx *)sax->ctx;
+    LlmResult *r = rc->result;
+    const char *path = sax->path;
+
+    /* OpenAI format nests the reply in choices[]; Ollama native does not */
+    if (strncmp(path, "choices.", 8) == 0) {
+        if (strncmp(path + 8, "0.", 2) != 0) return;
+        path += 10;
+    }
+
+    if (strncmp(path, "message.", 8) == 0) {
+        path += 8;
+        if (type == '"' && strcmp(path, "content") == 0) {
+            r->content_len = json_copy_string(r->content, LLM_MAX_RESPONSE_LEN, val, len);
+        } else if (strncmp(path, "tool_calls.", 11) == 0) {
+            response_tool_call(r, path + 11, val, len, type);
+        } else if (type == '[' && strcmp(path, "tool_calls") == 0) {
+            /* Save raw tool_calls JSON for echoing back */
+            if (len < (int)sizeof(r->tool_calls_json) - 1) {
+                memcpy(r->tool_calls_json, val, len);
+                r->tool_calls_json[len] = '\0';
+            } else {
+                Serial.printf("[LLM] Warning: tool_calls_json too large (%d bytes, max %d)\n",
+                              len, (int)sizeof(r->tool_calls_json) - 1);
+            }
+        }
+        return;
     }
 
-    result->tool_call_count = count;
-    return count;
+    if (type == '0') {
+        /* Usage (OpenAI: usage{}, Ollama: *_count), cache fields as in
+         * json_find_cached_tokens(). Other numbers (Ollama's durations in
+         * ns) are not converted; they overflow an int. */
+        int *dst = nullptr;
+        if (strcmp(path, "usage.prompt_tokens") == 0 ||
+            strcmp(path, "prompt_eval_count") == 0) {
+            dst = &r->prompt_tokens;
+        } else if (strcmp(path, "usage.completion_tokens") == 0 ||
+                   strcmp(path, "eval_count") == 0) {
+            dst = &r->completion_tokens;
+        } else if (r->cached_tokens == 0 &&
+                   (strcmp(path, "usage.prompt_tokens_details.cached_tokens") == 0 ||
+                    strcmp(path, "usage.cache_read_input_tokens") == 0 ||
+                    strcmp(path, "usage.prompt_cache_hit_tokens") == 0 ||
+                    strcmp(path, "timings.cache_n") == 0)) {
+            dst = &r->cached_tokens;
+        }
+        if (!dst) return;
+        int v = 0;
+        for (int i = 0; i < len && i < 9 && val[i] >= '0' && val[i] <= '9'; i++)
+            v = v * 10 + (val[i] - '0');
+        *dst = v;
+    } else if (type == '"' &&
+               (strcmp(path, "error.message") == 0 || strcmp(path, "error") == 0)) {
+        json_copy_string(rc->error, rc->error_len, val, len);
+        rc->has_error = true;
+    }
 }
 
+/**
+ * Extract content, tool calls and usage from a complete response in one
+ * forward pass over the body.
+ */
 bool LlmClient::parseResponse(const char *body, int body_len, LlmResult *result) {
     result->ok = false;
     result->content[0] = '\0';
     result->content_len = 0;
     result->prompt_tokens = 0;
     result->completion_tokens = 0;
+    result->cached_tokens = 0;
     result->tool_call_count = 0;
     result->tool_calls_json[0] = '\0';
 
-    /* Check for tool calls first */
-    int tc_count = parseToolCalls(body, body_len, result);
-
-    /* Extract "content" field */
-    int clen = 0;
-    const char *content = json_find_string(body, body_len, "content", &clen);
-    if (content && clen > 0) {
-        int copy_len = clen < LLM_MAX_RESPONSE_LEN - 1 ? clen : LLM_MAX_RESPONSE_LEN - 1;
-        memcpy(result->content, content, copy_len);
-        result->content[copy_len] = '\0';
-        result->content_len = json_unescape(result->content, copy_len);
+    ResponseCtx rc = { result, m_error, (int)sizeof(m_error), false };
+    JsonSax sax;
+    sax.end = body + body_len;
+    sax.path[0] = '\0';
+    sax.path_len = 0;
+    sax.lost = 0;
+    sax.on_value = response_value;
+    sax.ctx = &rc;
+
+    if (!json_sax_value(&sax, body, 0) && g_debug) {
+        Serial.printf("[LLM] Response JSON malformed or truncated\n");
     }
 
-    /* If we got tool calls, that's a success even without content */
-    if (tc_count > 0) {
+    /* Tool calls are a success even without content */
+    if (result->tool_call_count > 0 || result->content_len > 0) {
         result->ok = true;
-        result->prompt_tokens = json_find_int(body, body_len, "prompt_tokens", 0);
-        result->completion_tokens = json_find_int(body, body_len, "completion_tokens", 0);
         return true;
     }
 
-    /* No tool calls - need content */
-    if (result->content_len <= 0) {
-        int elen = 0;
-        const char *errmsg = json_find_string(body, body_len, "message", &elen);
-        if (errmsg && elen > 0) {
-            int copy = elen < (int)sizeof(m_error) - 1 ? elen : (int)sizeof(m_error) - 1;
-            memcpy(m_error, errmsg, copy);
-            m_error[copy] = '\0';
-        } else {
-            snprintf(m_error, sizeof(m_error), "No content in response");
-        }
-        return false;
+    if (!rc.has_error || m_error[0] == '\0') {
+        snprintf(m_error, sizeof(m_error), "No content in response");
     }
-
-    result->prompt_tokens = json_find_int(body, body_len, "prompt_tokens", 0);
-    result->completion_tokens = json_find_int(body, body_len, "completion_tokens", 0);
-    result->ok = true;
-    return true;
+    return false;
 }
 
-int LlmClient::readResponse(char *buf, int buf_len) {
-    int content_length = -1;
-    bool chunked = false;
+/**
+ * Read the status line and headers. Returns the HTTP status, or -1.
+ */
+int LlmClient::readHeaders(int *content_length, bool *chunked, bool *gzip) {
+    *content_length = -1;
+    *chunked = false;
+    *gzip = false;
+    m_conn->keep_alive = false;
 
     String status_line = m_client->readStringUntil('\n');
     if (status_line.length() < 12) {
@@ -474,6 +1329,8 @@ int LlmClient::readResponse(char *buf, int buf_len) {
     }
     int http_status = status_line.substring(9, 12).toInt();
     if (g_debug) Serial.printf("[LLM] HTTP %d\n", http_status);
+    /* HTTP/1.1 keeps the connection unless the server says otherwise */
+    m_conn->keep_alive = status_line.startsWith("HTTP/1.1");
 
     while (m_client->connected()) {
         String header = m_client->readStringUntil('\n');
@@ -482,110 +1339,503 @@ int LlmClient::readResponse(char *buf, int buf_len) {
 
         if (header.startsWith("Content-Length:") ||
             header.startsWith("content-length:")) {
-            content_length = header.substring(15).toInt();
+            *content_length = header.substring(15).toInt();
         }
         if (header.indexOf("chunked") >= 0) {
-            chunked = true;
+            *chunked = true;
+        }
+        if ((header.startsWith("Content-Encoding:") ||
+             header.startsWith("content-encoding:")) && header.indexOf("gzip") >= 0) {
+            *gzip = true;
+        }
+        if ((header.startsWith("Connection:") || header.startsWith("connection:")) &&
+            header.indexOf("close") >= 0) {
+            m_conn->keep_alive = false;
         }
     }
-    if (g_debug) Serial.printf("[LLM] content_length=%d chunked=%d\n", content_length, chunked);
+    if (g_debug) Serial.printf("[LLM] content_length=%d chunked=%d gzip=%d\n",
+                               *content_length, *chunked, *gzip);
+    return http_status;
+}
 
-    int total = 0;
-    int target = (content_length > 0 && !chunked)
-                 ? (content_length < buf_len - 1 ? content_length : buf_len - 1)
-                 : buf_len - 1;
+/**
+ * Read a buffered (non-streamed) response body. Chunked bodies are decoded
+ * as they arrive and end exactly at the terminating chunk, so neither
+ * framing mode waits for the server to close. A gzip body is inflated
+ * straight into buf: the output so far is the deflate history, so it
+ * needs no window of its own. Returns the body length, or -1 with
+ * m_error set.
+ */
+int LlmClient::readResponse(char *buf, int buf_len, int *status) {
+    int content_length = -1;
+    bool chunked = false;
+    bool gzip = false;
 
+    *status = readHeaders(&content_length, &chunked, &gzip);
+    if (*status < 0) return -1;
+
+    static GzipInflater gz;
+    if (gzip) gzipInit(&gz, (uint8_t *)buf, buf_len - 1, false);
+    ChunkDecoder dec;
+    chunk_init(&dec);
+
+    char rx[512];
+    int body_read = 0;   /* bytes on the wire */
+    int total = 0;       /* bytes in buf */
+    bool truncated = false;
     unsigned long last_data = millis();
-    while (total < target) {
+
+    while (!truncated) {
         esp_task_wdt_reset();
+        if (chunked && dec.state == CHUNK_DONE) break;
+        if (!chunked && content_length >= 0 && body_read >= content_length) break;
+        if (gzip && gz.status == GZIP_ERROR) break;
+
         int avail = m_client->available();
-        if (avail > 0) {
-            int to_read = avail < (target - total) ? avail : (target - total);
-            int rd = m_client->readBytes(buf + total, to_read);
-            total += rd;
-            last_data = millis();
-        } else if (!m_client->connected()) {
-            break;
-        } else if (millis() - last_data > 10000) {
-            if (g_debug) Serial.printf("[LLM] Read timeout after %d bytes\n", total);
-            break;
+        if (avail <= 0) {
+            if (!m_client->connected()) break;
+            if (millis() - last_data > 10000) {
+                if (g_debug) Serial.printf("[LLM] Read timeout after %d bytes\n", total);
+                break;
+            }
+            delay(5);
+            continue;
+        }
+
+        int to_read = avail < (int)sizeof(rx) ? avail : (int)sizeof(rx);
+        if (!chunked && content_length >= 0 && to_read > content_length - body_read)
+            to_read = content_length - body_read;
+        int n = m_client->read((uint8_t *)rx, to_read);
+        if (n <= 0) continue;
+        body_read += n;
+        last_data = millis();
+
+        if (chunked) n = chunk_decode(&dec, rx, n);
+        if (gzip) {
+            /* Bytes after the end of the gzip member are ignored */
+            int used;
+            const uint8_t *out;
+            if (gz.status == GZIP_MORE)
+                total += gzipInflate(&gz, (const uint8_t *)rx, n, &used, &out);
+            truncated = gz.status == GZIP_FULL;
         } else {
-            delay(10);
+            int room = buf_len - 1 - total;
+            if (n > room) {
+                n = room;
+                truncated = true;
+            }
+            memcpy(buf + total, rx, n);
+            total += n;
         }
     }
+    m_rx_wire += body_read;
+    m_rx_body += gzip ? total : body_read;
+
+    /* Only a body read to the end of its framing leaves the connection usable */
+    bool complete = chunked ? dec.state == CHUNK_DONE
+                            : content_length >= 0 && body_read == content_length;
+    if (!complete) m_conn->keep_alive = false;
+    if (truncated)
+        Serial.printf("[LLM] Warning: response over %d bytes truncated\n", buf_len - 1);
+    else if (gzip && gz.status != GZIP_DONE) {
+        m_conn->keep_alive = false;
+        snprintf(m_error, sizeof(m_error), "Bad gzip response body (%d of %d bytes)",
+                 total, body_read);
+        return -1;
+    }
+    if (g_debug && gzip)
+        Serial.printf("[LLM] gzip: %d bytes inflated to %d\n", body_read, total);
 
     buf[total] = '\0';
     return total;
 }
 
-bool LlmClient::chat(const LlmMessage *messages, int count,
-                       const char *tools_json, LlmResult *result) {
-    result->ok = false;
-    result->content[0] = '\0';
-    result->content_len = 0;
-    result->http_status = 0;
-    result->tool_call_count = 0;
+/**
+ * Consume a streamed response, handing content to on_delta as it arrives.
+ * Lines are assembled from the (possibly chunked) body one read at a time,
+ * so only one event is ever buffered. A gzip body is inflated through
+ * m_gzip_window, which chat() only sets up when it asked for gzip.
+ */
+bool LlmClient::readStream(LlmResult *result, LlmDeltaFn on_delta, void *delta_ctx) {
+    result->prompt_tokens = 0;
+    result->completion_tokens = 0;
+    result->cached_tokens = 0;
+    result->tool_calls_json[0] = '\0';
 
-    static char request_buf[LLM_MAX_REQUEST_LEN];
-    int req_len = buildRequest(request_buf, sizeof(request_buf),
-                                messages, count, tools_json);
-    if (req_len < 0) {
-        snprintf(m_error, sizeof(m_error), "Request too large for buffer");
+    int content_length = -1;
+    bool chunked = false;
+    bool gzip = false;
+    int status = readHeaders(&content_length, &chunked, &gzip);
+    if (status < 0) return false;
+    result->http_status = status;
+    if (gzip && !m_gzip_window) {
+        snprintf(m_error, sizeof(m_error), "Unrequested gzip response");
+        m_conn->keep_alive = false;
         return false;
     }
 
-    if (g_debug) Serial.printf("[LLM] Connecting to %s:%d...\n", m_host, m_port);
-    unsigned long t0 = millis();
+    static char line[LLM_STREAM_LINE_LEN];
+    static GzipInflater gz;
+    if (gzip) gzipInit(&gz, m_gzip_window, GZIP_WINDOW_LEN, true);
+
+    StreamCtx sc;
+    sc.result = result;
+    sc.on_delta = on_delta;
+    sc.delta_ctx = delta_ctx;
+    sc.error = m_error;
+    sc.error_len = sizeof(m_error);
+    sc.ndjson = false;
+    sc.done = false;
+    sc.failed = false;
+    sc.line = line;
+    sc.line_len = 0;
+    sc.overflow = false;
+
+    ChunkDecoder dec;
+    chunk_init(&dec);
+
+    char rx[512];
+    int body_read = 0;
+    unsigned long inflated = 0;
+    unsigned long last_data = millis();
+
+    /* After the final event, keep reading to the end of the body framing so
+     * the connection can be reused; without framing it must be closed. */
+    while (true) {
+        esp_task_wdt_reset();
+        if (chunked && dec.state == CHUNK_DONE) break;
+        if (!chunked && content_length >= 0 && body_read >= content_length) break;
+        if (sc.done && !chunked && content_length < 0) break;
+
+        int avail = m_client->available();
+        if (avail <= 0) {
+            if (!m_client->connected()) break;
+            if (sc.done && millis() - last_data > 1000) break;
+            if (millis() - last_data > LLM_STREAM_IDLE_MS) {
+                snprintf(m_error, sizeof(m_error), "Stream stalled (%ds)",
+                         LLM_STREAM_IDLE_MS / 1000);
+                sc.failed = true;
+                break;
+            }
+            delay(5);
+            continue;
+        }
+
+        int to_read = avail < (int)sizeof(rx) ? avail : (int)sizeof(rx);
+        if (!chunked && content_length >= 0 && to_read > content_length - body_read)
+            to_read = content_length - body_read;
+        int n = m_client->read((uint8_t *)rx, to_read);
+        if (n <= 0) continue;
+        body_read += n;
+        last_data = millis();
+
+        if (chunked) n = chunk_decode(&dec, rx, n);
+        if (!gzip) {
+            stream_bytes(&sc, rx, n);
+            continue;
+        }
 
-    if (!m_client->connect(m_host, m_port)) {
-        snprintf(m_error, sizeof(m_error), "%s connect failed",
-                 m_use_tls ? "TLS" : "TCP");
+        /* The ring hands out one run per call, up to its end */
+        const uint8_t *in = (const uint8_t *)rx;
+        while (n > 0 && gz.status == GZIP_MORE) {
+            int used;
+            const uint8_t *out;
+            int got = gzipInflate(&gz, in, n, &used, &out);
+            inflated += got;
+            stream_bytes(&sc, (const char *)out, got);
+            in += used;
+            n -= used;
+        }
+        if (gz.status == GZIP_ERROR) {
+            snprintf(m_error, sizeof(m_error), "Bad gzip stream");
+            sc.failed = true;
+            break;
+        }
+    }
+    /* A non-streamed error body may end without a newline */
+    if (!sc.done && sc.line_len > 0 && !sc.overflow) stream_line(&sc, line, sc.line_len);
+
+    m_rx_wire += body_read;
+    m_rx_body += gzip ? inflated : body_read;
+    if (g_debug && gzip)
+        Serial.printf("[LLM] gzip: %d bytes inflated to %lu\n", body_read, inflated);
+
+    bool complete = chunked ? dec.state == CHUNK_DONE
+                            : content_length >= 0 && body_read >= content_length;
+    if (!complete || sc.failed) m_conn->keep_alive = false;
+
+    if (sc.failed) return false;
+
+    if (result->tool_call_count > 0) {
+        build_tool_calls_json(result, sc.ndjson);
+        result->ok = true;
+        return true;
+    }
+    if (result->content_len <= 0) {
+        snprintf(m_error, sizeof(m_error), "No content in response (HTTP %d)", status);
         return false;
     }
+    result->ok = true;
+    return true;
+}
+
+/** Send the request headers and body on an open connection. */
+bool LlmClient::sendRequest(LlmConn *conn, int base_len,
+                            const LlmMessage *messages, int count,
+                            const char *const *tools, int tool_count) {
+    LlmEndpoint *ep = &m_eps[conn->ep];
+    const char *model = modelFor(conn->ep);
+    Client *client = conn->client;
+    int body_len = base_len + strlen(model);
+    ep->requests++;
+
+    if (g_debug) Serial.printf("[LLM] %s connection to %s. Sending %d bytes...\n",
+                               conn->reused ? "Reusing" : "New", ep->host, body_len);
+
+    client->printf("POST %s HTTP/1.1\r\n", ep->path);
+    client->printf("Host: %s\r\n", ep->host);
+    if (ep->api_key && ep->api_key[0])
+        client->printf("Authorization: Bearer %s\r\n", ep->api_key);
+    client->printf("Content-Type: application/json\r\n");
+    client->printf("Content-Length: %d\r\n", body_len);
+    if (m_gzip && (!m_stream || m_gzip_window))
+        client->printf("Accept-Encoding: gzip\r\n");
+    client->printf("Connection: keep-alive\r\n");
+    client->printf("\r\n");
+    return writeBody(client, model, messages, count, tools, tool_count) == body_len;
+}
 
-    if (g_debug) Serial.printf("[LLM] Connected (%lums). Sending %d bytes...\n",
-                               millis() - t0, req_len);
+/**
+ * Send the request to endpoint ep and wait for the first response byte.
+ * With hedge_ep >= 0, a copy goes to that endpoint once ep is later than
+ * its hedge deadline, and the first to answer wins; the other connection
+ * is closed. Returns the connection that answered (0 or 1), or -1 with
+ * m_error set if ep failed and no copy answered.
+ */
+int LlmClient::request(int ep, int hedge_ep, int base_len,
+                       const LlmMessage *messages, int count,
+                       const char *const *tools, int tool_count) {
+    LlmConn *main = &m_conns[0];
+    LlmConn *copy = &m_conns[1];
+
+    /* A kept-alive connection may have been closed by the server while
+     * idle; if it yields nothing, retry once on a fresh connection. */
+    for (int attempt = 0; ; attempt++) {
+        if (!openConnection(main, ep)) return -1;
+
+        bool live[2] = { sendRequest(main, base_len, messages, count, tools, tool_count),
+                         false };
+        bool hedged = false;
+        unsigned long start = millis();
+        unsigned long copy_start = 0;
+        unsigned long deadline = hedge_ep >= 0 ? hedgeDeadline(ep) : 0;
+
+        if (g_debug) Serial.printf("[LLM] Request sent. Waiting for response...\n");
+
+        while (live[0] || live[1]) {
+            esp_task_wdt_reset();
+            for (int i = 0; i < 2; i++) {
+                LlmConn *conn = &m_conns[i];
+                if (!live[i]) continue;
+                if (conn->client->available()) {
+                    unsigned long now = millis();
+                    endpointLatency(conn->ep, now - (i == 0 ? start : copy_start));
+                    m_first_byte_ms = now - start;
+                    m_reused = conn->reused;
+                    m_connect_ms = conn->connect_ms;
+                    if (i == 1) {
+                        m_hedge_wins++;
+                        if (!live[0]) {
+                            snprintf(m_error, sizeof(m_error), "Connection closed before response");
+                            endpointFailed(ep);
+                        }
+                    }
+                    LlmConn *other = &m_conns[1 - i];
+                    if (live[1 - i]) {
+                        other->client->stop();
+                        other->keep_alive = false;
+                    }
+                    return i;
+                }
+                if (!conn->client->connected()) {
+                    live[i] = false;
+                    conn->client->stop();
+                    conn->keep_alive = false;
+                    if (i == 1) {
+                        snprintf(m_error, sizeof(m_error), "Connection closed before response");
+                        endpointFailed(hedge_ep);
+                    }
+                }
+            }
 
-    m_client->printf("POST %s HTTP/1.1\r\n", m_path);
-    m_client->printf("Host: %s\r\n", m_host);
-    if (m_api_key && m_api_key[0])
-        m_client->printf("Authorization: Bearer %s\r\n", m_api_key);
-    m_client->printf("Content-Type: application/json\r\n");
-    m_client->printf("Content-Length: %d\r\n", req_len);
-    m_client->printf("Connection: close\r\n");
-    m_client->printf("\r\n");
-    m_client->write((uint8_t *)request_buf, req_len);
+            /* The first byte is late: send a copy to the next endpoint */
+            if (hedge_ep >= 0 && !hedged && live[0] && millis() - start > deadline) {
+                hedged = true;
+                if (m_eps[hedge_ep].use_tls && ESP.getFreeHeap() < LLM_HEDGE_MIN_HEAP) {
+                    if (g_debug) Serial.printf("[LLM] Not hedging, low heap\n");
+                } else {
+                    Serial.printf("[LLM] No response from %s after %lums, hedging to %s\n",
+                                  m_eps[ep].host, millis() - start, m_eps[hedge_ep].host);
+                    m_hedges++;
+                    if (openConnection(copy, hedge_ep) &&
+                        sendRequest(copy, base_len, messages, count, tools, tool_count)) {
+                        live[1] = true;
+                        copy_start = millis();
+                    } else {
+                        copy->client->stop();
+                        endpointFailed(hedge_ep);
+                    }
+                }
+            }
 
-    if (g_debug) Serial.printf("[LLM] Request sent. Waiting for response...\n");
+            if (millis() - start > LLM_READ_TIMEOUT_MS) {
+                snprintf(m_error, sizeof(m_error), "Response timeout (%ds)",
+                         LLM_READ_TIMEOUT_MS / 1000);
+                disconnect();
+                return -1;
+            }
+            delay(10);
+        }
 
-    unsigned long wait_start = millis();
-    while (!m_client->available()) {
-        esp_task_wdt_reset();
-        if (millis() - wait_start > LLM_READ_TIMEOUT_MS) {
-            snprintf(m_error, sizeof(m_error), "Response timeout (%ds)",
-                     LLM_READ_TIMEOUT_MS / 1000);
-            m_client->stop();
+        if (main->reused && attempt == 0 && !hedged) {
+            if (g_debug) Serial.printf("[LLM] Kept-alive connection was closed, reconnecting\n");
+            continue;
+        }
+        snprintf(m_error, sizeof(m_error), "Connection closed before response");
+        return -1;
+    }
+}
+
+bool LlmClient::chat(const LlmMessage *messages, int count,
+                       const char *const *tools, int tool_count, LlmResult *result,
+                       LlmDeltaFn on_delta, void *delta_ctx) {
+    /* A streamed gzip reply needs the whole deflate window; it is taken
+     * from the heap for this request only, and only when there is room */
+    if (m_gzip && m_stream && ESP.getFreeHeap() >= LLM_GZIP_MIN_HEAP)
+        m_gzip_window = (uint8_t *)malloc(GZIP_WINDOW_LEN);
+
+    /* Likewise the buffer a non-streamed reply is read into */
+    if (!m_stream) {
+        m_response_buf = (char *)malloc(LLM_RESPONSE_BUF_LEN);
+        if (!m_response_buf) {
+            snprintf(m_error, sizeof(m_error), "No heap for the response buffer");
+            result->ok = false;
+            result->content[0] = '\0';
+            result->content_len = 0;
+            result->tool_call_count = 0;
             return false;
         }
-        delay(50);
     }
 
-    static char response_buf[LLM_MAX_RESPONSE_LEN + 2048];
-    int body_len = readResponse(response_buf, sizeof(response_buf));
+    bool ok = chatEndpoints(messages, count, tools, tool_count, result,
+                            on_delta, delta_ctx);
+    free(m_gzip_window);
+    m_gzip_window = nullptr;
+    free(m_response_buf);
+    m_response_buf = nullptr;
+    return ok;
+}
 
-    m_client->stop();
+/** chat() over the endpoints in order, with failover and hedging. */
+bool LlmClient::chatEndpoints(const LlmMessage *messages, int count,
+                              const char *const *tools, int tool_count,
+                              LlmResult *result, LlmDeltaFn on_delta, void *delta_ctx) {
+    result->ok = false;
+    m_reused = false;
+    m_connect_ms = 0;
+    m_first_byte_ms = 0;
+    m_last_ep = -1;
 
-    if (body_len <= 0) {
-        snprintf(m_error, sizeof(m_error), "Empty response body");
+    if (m_ep_count == 0) {
+        snprintf(m_error, sizeof(m_error), "No LLM endpoint");
         return false;
     }
 
-    if (g_debug) {
-        Serial.printf("[LLM] Response: %d bytes (%lums total)\n",
-                      body_len, millis() - t0);
-        Serial.printf("[LLM] Body: %.*s\n", body_len < 500 ? body_len : 500,
-                      response_buf);
+    /* Sizing pass without the model name, which differs per endpoint -
+     * the body is never held in memory */
+    int base_len = writeBody(nullptr, "", messages, count, tools, tool_count);
+    if (base_len + (int)strlen(modelFor(0)) > LLM_MAX_REQUEST_LEN) {
+        snprintf(m_error, sizeof(m_error), "Request too large (%d bytes)",
+                 base_len + (int)strlen(modelFor(0)));
+        return false;
     }
 
-    return parseResponse(response_buf, body_len, result);
+    unsigned long t0 = millis();
+    int order[LLM_MAX_ENDPOINTS];
+    int n = pickEndpoints(order);
+    unsigned failed = 0;  /* endpoints that failed during this chat */
+
+    for (int k = 0; k < n; k++) {
+        int ep = order[k];
+        if (failed & (1u << ep)) continue;
+
+        int hedge_ep = -1;
+        if (m_hedge && k + 1 < n && !endpointDown(order[k + 1]))
+            hedge_ep = order[k + 1];
+
+        result->content[0] = '\0';
+        result->content_len = 0;
+        result->http_status = 0;
+        result->tool_call_count = 0;
+
+        int won = request(ep, hedge_ep, base_len, messages, count, tools, tool_count);
+        if (won < 0) {
+            endpointFailed(ep);
+            failed |= 1u << ep;
+            continue;
+        }
+        if (won == 1) failed |= 1u << ep;  /* lost the race; not tried again */
+
+        m_conn = &m_conns[won];
+        m_client = m_conn->client;
+        int answered = m_conn->ep;
+        bool ok;
+
+        if (m_stream) {
+            ok = readStream(result, on_delta, delta_ctx);
+            if (g_debug) {
+                Serial.printf("[LLM] Stream: %d chars, %d tool call(s) (%lums total)\n",
+                              result->content_len, result->tool_call_count,
+                              millis() - t0);
+            }
+        } else {
+            char *response_buf = m_response_buf;
+            int status = 0;
+            int body_len = readResponse(response_buf, LLM_RESPONSE_BUF_LEN, &status);
+            result->http_status = status;
+
+            if (body_len <= 0) {
+                if (body_len == 0) snprintf(m_error, sizeof(m_error), "Empty response body");
+                ok = false;
+            } else {
+                if (g_debug) {
+                    Serial.printf("[LLM] Response: %d bytes (%lums total)\n",
+                                  body_len, millis() - t0);
+                    Serial.printf("[LLM] Body: %.*s\n", body_len < 500 ? body_len : 500,
+                                  response_buf);
+                }
+                ok = parseResponse(response_buf, body_len, result);
+            }
+        }
+
+        if (m_conn->keep_alive) m_conn->last_used = millis();
+        else m_client->stop();
+
+        /* An overloaded or failing server may be retried elsewhere, as long
+         * as nothing of the reply has been delivered */
+        int status = result->http_status;
+        if (!ok && (status == 429 || status >= 500 || status <= 0) &&
+            result->content_len == 0 && result->tool_call_count == 0) {
+            endpointFailed(answered);
+            failed |= 1u << answered;
+            continue;
+        }
+
+        m_last_ep = answered;
+        if (answered != 0 && g_debug)
+            Serial.printf("[LLM] Answered by %s (%s)\n",
+                          m_eps[answered].host, modelFor(answered));
+        return ok;
+    }
+    return false;
 }
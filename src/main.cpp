@@ -13,6 +13,8 @@
 #include <WiFi.h>
 #include <LittleFS.h>
 #include <esp_task_wdt.h>
+#include <freertos/semphr.h>
+#include <ctype.h>
 #if !defined(CONFIG_IDF_TARGET_ESP32)
 #include "driver/temperature_sensor.h"
 #endif
@@ -24,6 +26,11 @@
 #include "version.h"
 #include "web_config.h"
 #include "nats_hal.h"
+#include "intent.h"
+#include "plan_cache.h"
+#include "state_snapshot.h"
+#include "cascade.h"
+#include "agent.h"
 #include <nats_esp32.h>
 
 /*============================================================================
@@ -32,15 +39,28 @@
 
 #define LED_BRIGHTNESS   20
 #define SERIAL_BUF_SIZE  512
-#define MAX_HISTORY      4  /* Keep last N user+assistant turns (pairs) */
+#define HISTORY_ARENA_LEN    8192  /* conversation text, at its real length */
+#define HISTORY_MAX_TURNS    16    /* user+assistant pairs */
+#define HISTORY_TOKEN_BUDGET 2048  /* oldest turns are dropped beyond this */
+#define HISTORY_USER_MAX     511
 
 /* Runtime config - loaded from LittleFS, falls back to secrets.h */
 char cfg_wifi_ssid[64];
 char cfg_wifi_pass[64];
 char cfg_api_key[128];
 char cfg_model[64];
+char cfg_model_fast[64];         /* tried first for short requests ("" = main model only) */
 char cfg_device_name[32];
 char cfg_api_base_url[128];
+bool cfg_llm_stream = true;      /* stream LLM replies (SSE/NDJSON) */
+bool cfg_llm_cache = false;      /* cache_control breakpoints for prompt caching */
+bool cfg_llm_gzip = true;        /* accept gzip-compressed LLM responses */
+int  cfg_context_tokens = 16384; /* model context window the requests are fitted to */
+char cfg_llm_fallbacks[128];     /* "url|model;..." tried when api_base_url fails */
+char cfg_llm_fallback_key[128];  /* API key for fallbacks with a URL */
+bool cfg_llm_hedge = false;      /* race a slow request against the next endpoint */
+bool cfg_plan_mode = false;      /* offer run_plan: many tool calls from one response */
+bool cfg_state_snapshot = true;  /* send devices and rules with each chat */
 char cfg_nats_host[64];
 int  cfg_nats_port = 4222;
 char cfg_telegram_token[64];
@@ -48,6 +68,8 @@ char cfg_telegram_chat_id[16];
 char cfg_system_prompt[4096];
 char cfg_timezone[64];
 int cfg_telegram_cooldown = 3;  /* seconds, 0 = disabled */
+bool cfg_nats_jetstream = false; /* publish events via JetStream with PubAck */
+char cfg_nats_fleet[32];         /* fleet queue group name ("" = disabled) */
 
 /* Placeholder defaults - overridden by LittleFS config.json */
 static void configDefaults() {
@@ -55,10 +77,22 @@ static void configDefaults() {
     cfg_wifi_pass[0] = '\0';
     cfg_api_key[0] = '\0';
     strncpy(cfg_model, "google/gemini-2.5-flash", sizeof(cfg_model));
+    cfg_model_fast[0] = '\0';
     strncpy(cfg_device_name, "wireclaw", sizeof(cfg_device_name));
     cfg_api_base_url[0] = '\0';
+    cfg_llm_stream = true;
+    cfg_llm_gzip = true;
+    cfg_llm_cache = false;
+    cfg_context_tokens = 16384;
+    cfg_llm_fallbacks[0] = '\0';
+    cfg_llm_fallback_key[0] = '\0';
+    cfg_llm_hedge = false;
+    cfg_plan_mode = false;
+    cfg_state_snapshot = true;
     cfg_nats_host[0] = '\0';
     cfg_nats_port = 4222;
+    cfg_nats_jetstream = false;
+    cfg_nats_fleet[0] = '\0';
     cfg_telegram_token[0] = '\0';
     cfg_telegram_chat_id[0] = '\0';
     strncpy(cfg_timezone, "UTC0", sizeof(cfg_timezone));
@@ -158,7 +192,7 @@ static bool loadConfig() {
     Serial.printf("LittleFS: mounted OK\n");
 
     /* Load config.json */
-    static char json_buf[1024];
+    static char json_buf[1536];
     int len = readFile("/config.json", json_buf, sizeof(json_buf));
     if (len > 0) {
         Serial.printf("LittleFS: loaded config.json (%d bytes)\n", len);
@@ -166,13 +200,52 @@ static bool loadConfig() {
         jsonGetString(json_buf, "wifi_pass", cfg_wifi_pass, sizeof(cfg_wifi_pass));
         jsonGetString(json_buf, "api_key", cfg_api_key, sizeof(cfg_api_key));
         jsonGetString(json_buf, "model", cfg_model, sizeof(cfg_model));
+        jsonGetString(json_buf, "model_fast", cfg_model_fast, sizeof(cfg_model_fast));
         jsonGetString(json_buf, "device_name", cfg_device_name, sizeof(cfg_device_name));
         jsonGetString(json_buf, "api_base_url", cfg_api_base_url, sizeof(cfg_api_base_url));
+        char stream_buf[8];
+        if (jsonGetString(json_buf, "llm_stream", stream_buf, sizeof(stream_buf))) {
+            cfg_llm_stream = strcmp(stream_buf, "false") != 0 && strcmp(stream_buf, "0") != 0;
+        }
+        char cache_buf[8];
+        if (jsonGetString(json_buf, "llm_cache", cache_buf, sizeof(cache_buf))) {
+            cfg_llm_cache = strcmp(cache_buf, "true") == 0 || strcmp(cache_buf, "1") == 0;
+        }
+        char gzip_buf[8];
+        if (jsonGetString(json_buf, "llm_gzip", gzip_buf, sizeof(gzip_buf))) {
+            cfg_llm_gzip = strcmp(gzip_buf, "false") != 0 && strcmp(gzip_buf, "0") != 0;
+        }
+        jsonGetString(json_buf, "llm_fallbacks", cfg_llm_fallbacks, sizeof(cfg_llm_fallbacks));
+        jsonGetString(json_buf, "llm_fallback_key", cfg_llm_fallback_key,
+                      sizeof(cfg_llm_fallback_key));
+        char hedge_buf[8];
+        if (jsonGetString(json_buf, "llm_hedge", hedge_buf, sizeof(hedge_buf))) {
+            cfg_llm_hedge = strcmp(hedge_buf, "true") == 0 || strcmp(hedge_buf, "1") == 0;
+        }
+        char plan_buf[8];
+        if (jsonGetString(json_buf, "plan_mode", plan_buf, sizeof(plan_buf))) {
+            cfg_plan_mode = strcmp(plan_buf, "true") == 0 || strcmp(plan_buf, "1") == 0;
+        }
+        char state_buf[8];
+        if (jsonGetString(json_buf, "state_snapshot", state_buf, sizeof(state_buf))) {
+            cfg_state_snapshot = strcmp(state_buf, "true") == 0 || strcmp(state_buf, "1") == 0;
+        }
+        char ctx_buf[12];
+        if (jsonGetString(json_buf, "context_tokens", ctx_buf, sizeof(ctx_buf))) {
+            cfg_context_tokens = atoi(ctx_buf);
+            if (cfg_context_tokens < LLM_REPLY_TOKENS + 1024)
+                cfg_context_tokens = LLM_REPLY_TOKENS + 1024;
+        }
         jsonGetString(json_buf, "nats_host", cfg_nats_host, sizeof(cfg_nats_host));
         char port_buf[8];
         if (jsonGetString(json_buf, "nats_port", port_buf, sizeof(port_buf))) {
             cfg_nats_port = atoi(port_buf);
         }
+        char js_buf[8];
+        if (jsonGetString(json_buf, "nats_jetstream", js_buf, sizeof(js_buf))) {
+            cfg_nats_jetstream = strcmp(js_buf, "true") == 0 || strcmp(js_buf, "1") == 0;
+        }
+        jsonGetString(json_buf, "nats_fleet", cfg_nats_fleet, sizeof(cfg_nats_fleet));
         jsonGetString(json_buf, "telegram_token", cfg_telegram_token, sizeof(cfg_telegram_token));
         jsonGetString(json_buf, "telegram_chat_id", cfg_telegram_chat_id, sizeof(cfg_telegram_chat_id));
         char cd_buf[8];
@@ -209,35 +282,161 @@ LlmClient llm;
 char serialBuf[SERIAL_BUF_SIZE];
 int  serialPos = 0;
 
+/* Longest gap between loop() passes while a chat was running */
+static unsigned long loopMaxGapMs = 0;
+
 /* NATS client (optional - only used if nats_host is configured) */
 NatsClient natsClient;
 bool g_nats_enabled = false;
 bool g_nats_connected = false;
 static unsigned long natsLastReconnect = 0;
 #define NATS_RECONNECT_DELAY_MS 30000
+/* Per-loop NATS dispatch budget - a message flood must not starve rules,
+ * web and Telegram. Leftover messages are handled on the next pass. */
+#define NATS_PROCESS_MAX_MSGS 8
+#define NATS_PROCESS_MAX_US   20000
+static bool natsWorkPending = false;
 static char natsSubjectChat[64];
+static char natsSubjectChatStream[64];
 static char natsSubjectCmd[64];
 char natsSubjectEvents[64];
 static char natsSubjectToolExec[64];
 static char natsSubjectCapabilities[64];
 static char natsSubjectHal[64];
+static char natsSubjectUpload[64];
 static const char natsSubjectDiscover[] = "_ion.discover";
 
-/* Conversation history */
-struct Turn {
-    char user[256];
-    char assistant[LLM_MAX_RESPONSE_LEN];
-    bool used;
+/* Fleet subjects (fleet.{nats_fleet}.chat / .tool_exec) are served through
+ * a queue group, so each request goes to one member. A device leaves the
+ * group while its agent is busy and rejoins when idle. */
+static char natsSubjectFleetChat[64];
+static char natsSubjectFleetToolExec[64];
+static uint16_t natsSidFleetChat = 0;
+static uint16_t natsSidFleetToolExec = 0;
+static bool natsFleetBusy = false;
+static void natsFleetSetBusy(bool busy);
+
+/* JetStream publishing for events (only used if nats_jetstream is set) */
+static nats_js_t natsJs;
+bool g_nats_js_enabled = false;
+
+/*
+ * Conversation history: a ring of turns whose text lives in one arena at
+ * its real length ("user\0assistant\0"). The oldest turns are evicted when
+ * the estimated tokens exceed HISTORY_TOKEN_BUDGET or the arena is full,
+ * so nothing is ever shifted.
+ */
+struct HistoryTurn {
+    uint16_t off;       /* user text at historyArena + off */
+    uint16_t len;       /* both strings, including NULs */
+    uint16_t userLen;
+    uint16_t bytes;     /* both messages in a request (llmMessageBytes) */
+    uint16_t tokens;    /* llmTokens(bytes) */
 };
 
-static Turn history[MAX_HISTORY];
-static int  historyCount = 0;
+static char        historyArena[HISTORY_ARENA_LEN];
+static HistoryTurn historyTurns[HISTORY_MAX_TURNS]; /* oldest at historyFirst */
+static int historyFirst = 0;
+static int historyCount = 0;
+static int historyTokens = 0;
+
+/*============================================================================
+ * History Arena
+ *============================================================================*/
+
+static const HistoryTurn *historyAt(int i) {
+    return &historyTurns[(historyFirst + i) % HISTORY_MAX_TURNS];
+}
+
+static const char *historyUser(int i) {
+    return historyArena + historyAt(i)->off;
+}
+
+static const char *historyAssistant(int i) {
+    const HistoryTurn *t = historyAt(i);
+    return historyArena + t->off + t->userLen + 1;
+}
+
+static int historyBytes(int i) {
+    return historyAt(i)->bytes;
+}
+
+static void historyEvict() {
+    historyTokens -= historyTurns[historyFirst].tokens;
+    historyFirst = (historyFirst + 1) % HISTORY_MAX_TURNS;
+    historyCount--;
+}
+
+static void historyClear() {
+    historyFirst = 0;
+    historyCount = 0;
+    historyTokens = 0;
+}
+
+/** Offset of len contiguous free bytes after the newest turn. Evicts the
+ *  oldest turns until they fit; len must not exceed the arena. */
+static int historyAlloc(int len) {
+    while (historyCount > 0) {
+        const HistoryTurn *last = historyAt(historyCount - 1);
+        int tail = historyTurns[historyFirst].off;
+        int head = last->off + last->len;
+        if (head > tail) {
+            /* Used: [tail, head) - free space at the end, then at the start */
+            if (HISTORY_ARENA_LEN - head >= len) return head;
+            if (tail >= len) return 0;
+        } else {
+            /* Wrapped: used [tail, end) and [0, head) */
+            if (tail - head >= len) return head;
+        }
+        historyEvict();
+    }
+    return 0;
+}
+
+/** Reserve the newest turn for ulen + alen characters of text. */
+static HistoryTurn *historyPush(int ulen, int alen) {
+    if (historyCount == HISTORY_MAX_TURNS) historyEvict();
+    int len = ulen + alen + 2;
+    int off = historyAlloc(len);
+
+    HistoryTurn *t = &historyTurns[(historyFirst + historyCount) % HISTORY_MAX_TURNS];
+    t->off = off;
+    t->len = len;
+    t->userLen = ulen;
+    t->bytes = 0;
+    t->tokens = 0;
+    historyCount++;
+    return t;
+}
+
+/** Once the newest turn's text is in place: estimate its size once, for
+ *  the token budget and for context planning, and apply the budget.
+ *  The oldest turns are evicted; the newest always stays. */
+static void historyCommit(HistoryTurn *t) {
+    const char *user = historyArena + t->off;
+    LlmMessage u = llmMsg("user", user);
+    LlmMessage a = llmMsg("assistant", user + t->userLen + 1);
+    t->bytes = llmMessageBytes(&u) + llmMessageBytes(&a);
+    t->tokens = llmTokens(t->bytes);
+    historyTokens += t->tokens;
+
+    while (historyTokens > HISTORY_TOKEN_BUDGET && historyCount > 1) historyEvict();
+}
 
 /*============================================================================
  * History Persistence (LittleFS)
  *============================================================================*/
 
-#define HISTORY_FILE "/history.json"
+/*
+ * One {"u":"...","a":"..."} line per turn. New turns are appended; the
+ * file is rewritten from the arena once it holds HISTORY_FILE_SLACK
+ * evicted turns.
+ */
+#define HISTORY_FILE       "/history.jsonl"
+#define HISTORY_FILE_OLD   "/history.json"  /* pre-arena format, migrated */
+#define HISTORY_FILE_SLACK 8
+
+static int historyFileTurns = 0; /* lines in HISTORY_FILE, evicted ones included */
 
 static int jsonEscape(char *dst, int dst_len, const char *src) {
     int w = 0;
@@ -261,81 +460,147 @@ static int jsonEscape(char *dst, int dst_len, const char *src) {
     return w;
 }
 
+/** Write src as a JSON string body, escaping in small pieces. */
+static void historyPrintEscaped(File &f, const char *src) {
+    char buf[128];
+    int w = 0;
+    for (; *src; src++) {
+        char c = *src;
+        if (c == '"' || c == '\\') {
+            buf[w++] = '\\';
+            buf[w++] = c;
+        } else if (c == '\n') {
+            buf[w++] = '\\';
+            buf[w++] = 'n';
+        } else if ((uint8_t)c >= 0x20) {
+            buf[w++] = c;
+        }
+        if (w >= (int)sizeof(buf) - 2) {
+            f.write((const uint8_t *)buf, w);
+            w = 0;
+        }
+    }
+    if (w > 0) f.write((const uint8_t *)buf, w);
+}
+
+static void historyPrintTurn(File &f, int i) {
+    f.print("{\"u\":\"");
+    historyPrintEscaped(f, historyUser(i));
+    f.print("\",\"a\":\"");
+    historyPrintEscaped(f, historyAssistant(i));
+    f.print("\"}\n");
+}
+
+/** Rewrite the file with the turns in the arena. */
 static void historySave() {
     File f = LittleFS.open(HISTORY_FILE, "w");
     if (!f) return;
-
-    static char escaped[LLM_MAX_RESPONSE_LEN + 512];
-
-    f.print("[");
-    for (int i = 0; i < historyCount; i++) {
-        if (i > 0) f.print(",");
-        f.print("{\"u\":\"");
-        jsonEscape(escaped, sizeof(escaped), history[i].user);
-        f.print(escaped);
-        f.print("\",\"a\":\"");
-        jsonEscape(escaped, sizeof(escaped), history[i].assistant);
-        f.print(escaped);
-        f.print("\"}");
-    }
-    f.print("]");
+    for (int i = 0; i < historyCount; i++) historyPrintTurn(f, i);
     f.close();
+    historyFileTurns = historyCount;
 
     if (g_debug) Serial.printf("History: saved %d turns\n", historyCount);
 }
 
-static void historyLoad() {
-    static char buf[8192];
-    int len = readFile(HISTORY_FILE, buf, sizeof(buf));
-    if (len <= 0) return;
-
-    historyCount = 0;
-    const char *p = buf;
+/** Append a turn to the history and persist it. */
+static void historyAdd(const char *user, const char *assistant) {
+    int ulen = strlen(user);
+    int alen = strlen(assistant);
+    if (ulen > HISTORY_USER_MAX) ulen = HISTORY_USER_MAX;
+    if (ulen + alen + 2 > HISTORY_ARENA_LEN) alen = HISTORY_ARENA_LEN - ulen - 2;
+
+    HistoryTurn *t = historyPush(ulen, alen);
+    char *p = historyArena + t->off;
+    memcpy(p, user, ulen);
+    p[ulen] = '\0';
+    memcpy(p + ulen + 1, assistant, alen);
+    p[ulen + 1 + alen] = '\0';
+    historyCommit(t);
+
+    if (historyFileTurns >= historyCount + HISTORY_FILE_SLACK) {
+        historySave();
+        return;
+    }
+    File f = LittleFS.open(HISTORY_FILE, "a");
+    if (!f) return;
+    historyPrintTurn(f, historyCount - 1);
+    f.close();
+    historyFileTurns++;
+}
 
-    while (*p && historyCount < MAX_HISTORY) {
-        const char *uStart = strstr(p, "\"u\":\"");
-        if (!uStart) break;
-        uStart += 5;
+/** Skip past the next occurrence of key. */
+static bool historyFind(File &f, const char *key) {
+    int m = 0;
+    int c;
+    while ((c = f.read()) >= 0) {
+        if (c == key[m]) m++;
+        else m = (c == key[0]) ? 1 : 0;
+        if (!key[m]) return true;
+    }
+    return false;
+}
 
-        int w = 0;
-        const char *s = uStart;
-        while (*s && *s != '"' && w < (int)sizeof(history[0].user) - 1) {
-            if (*s == '\\' && *(s + 1)) {
-                s++;
-                if (*s == 'n') history[historyCount].user[w++] = '\n';
-                else history[historyCount].user[w++] = *s;
-            } else {
-                history[historyCount].user[w++] = *s;
-            }
-            s++;
+/**
+ * Read a JSON string body up to its closing quote, unescaping into dst
+ * (nullptr to only measure). Returns the length kept, at most max, or -1
+ * if the file ends first.
+ */
+static int historyReadString(File &f, char *dst, int max) {
+    int w = 0;
+    int c;
+    while ((c = f.read()) >= 0 && c != '"') {
+        if (c == '\\') {
+            c = f.read();
+            if (c < 0) break;
+            if (c == 'n') c = '\n';
+        }
+        if (w < max) {
+            if (dst) dst[w] = (char)c;
+            w++;
         }
-        history[historyCount].user[w] = '\0';
+    }
+    if (c != '"') return -1;
+    if (dst) dst[w] = '\0';
+    return w;
+}
 
-        const char *aStart = strstr(s, "\"a\":\"");
-        if (!aStart) break;
-        aStart += 5;
+static void historyLoad() {
+    bool migrate = !LittleFS.exists(HISTORY_FILE);
+    const char *path = migrate ? HISTORY_FILE_OLD : HISTORY_FILE;
+    File f = LittleFS.open(path, "r");
+    if (!f) return;
 
-        w = 0;
-        s = aStart;
-        while (*s && *s != '"' && w < (int)sizeof(history[0].assistant) - 1) {
-            if (*s == '\\' && *(s + 1)) {
-                s++;
-                if (*s == 'n') history[historyCount].assistant[w++] = '\n';
-                else history[historyCount].assistant[w++] = *s;
-            } else {
-                history[historyCount].assistant[w++] = *s;
-            }
-            s++;
-        }
-        history[historyCount].assistant[w] = '\0';
+    historyClear();
+    int turns = 0;
+
+    /* Measure each turn, then read it again straight into the arena */
+    while (historyFind(f, "\"u\":\"")) {
+        size_t start = f.position();
+        int ulen = historyReadString(f, nullptr, HISTORY_USER_MAX);
+        if (ulen < 0 || !historyFind(f, "\"a\":\"")) break;
+        int alen = historyReadString(f, nullptr, HISTORY_ARENA_LEN - ulen - 2);
+        if (alen < 0) break;
+
+        f.seek(start);
+        HistoryTurn *t = historyPush(ulen, alen);
+        char *p = historyArena + t->off;
+        historyReadString(f, p, ulen);
+        historyFind(f, "\"a\":\"");
+        historyReadString(f, p + ulen + 1, alen);
+        historyCommit(t);
+        turns++;
+    }
+    f.close();
 
-        history[historyCount].used = true;
-        historyCount++;
-        p = s;
+    historyFileTurns = turns;
+    if (migrate || turns > historyCount) {
+        historySave();
+        LittleFS.remove(HISTORY_FILE_OLD);
     }
 
     if (historyCount > 0) {
-        Serial.printf("History: loaded %d turns from %s\n", historyCount, HISTORY_FILE);
+        Serial.printf("History: loaded %d turns (~%d tokens) from %s\n",
+                      historyCount, historyTokens, path);
     }
 }
 
@@ -382,91 +647,406 @@ bool connectWiFi() {
     return true;
 }
 
+/*============================================================================
+ * LLM Endpoints
+ *============================================================================*/
+
+/**
+ * Register the llm_fallbacks entries, "url|model" separated by ';'. An
+ * empty model means the main one; an empty URL means OpenRouter with the
+ * main API key, other URLs get llm_fallback_key.
+ */
+static void llmAddFallbacks() {
+    static char buf[sizeof(cfg_llm_fallbacks)];  /* endpoints keep pointers into it */
+    strncpy(buf, cfg_llm_fallbacks, sizeof(buf) - 1);
+    buf[sizeof(buf) - 1] = '\0';
+
+    char *save = nullptr;
+    for (char *entry = strtok_r(buf, ";", &save); entry;
+         entry = strtok_r(nullptr, ";", &save)) {
+        while (*entry == ' ') entry++;
+        char *model = strchr(entry, '|');
+        if (model) *model++ = '\0';
+        if (!model || !model[0]) model = cfg_model;
+
+        const char *key = entry[0] ? cfg_llm_fallback_key : cfg_api_key;
+        if (!llm.addEndpoint(entry, model, key)) {
+            Serial.printf("LLM: fallback \"%s\" not added\n", entry);
+        }
+    }
+}
+
 /*============================================================================
  * Chat with LLM - Agentic Loop with Tool Calling
  *============================================================================*/
 
 #define MAX_AGENT_ITERATIONS 5
+#define CONTEXT_HISTORY_MSGS 12  /* message slots for history; the rest is for tool loops */
+#define CONTEXT_STEP_MSGS    (1 + LLM_MAX_TOOL_CALLS)  /* tool calls and their results */
+
+/*
+ * Context planning: each message's size in the request is estimated once,
+ * when it is added (history turns carry theirs from historyCommit), so
+ * fitting a request to the budget is a sum and the body is only serialized
+ * to be sent. Over budget, the oldest history goes first, then the memory
+ * notes, then the state snapshot, then tool categories the model can load
+ * again with tools_more. Message slots are planned too: before each step
+ * the oldest history makes room for the step's tool calls and results.
+ */
+struct ContextPlan {
+    LlmMessage messages[LLM_MAX_MESSAGES];
+    int        bytes[LLM_MAX_MESSAGES];  /* llmMessageBytes() of each */
+    int        count;
+    int        total;      /* sum of bytes */
+    int        memory;     /* index of the memory message, or -1 */
+    int        histStart;  /* history pairs are [histStart, histEnd) */
+    int        histEnd;
+    bool       snapshot;   /* state snapshot at histEnd */
+};
+
+/** Returns false if there is no slot left; the message is not added. */
+static bool planAdd(ContextPlan *p, const LlmMessage &msg, int bytes = -1) {
+    if (p->count >= LLM_MAX_MESSAGES) {
+        Serial.printf("[Agent] Context: no message slot for %s\n", msg.role);
+        return false;
+    }
+    if (bytes < 0) bytes = llmMessageBytes(&msg);
+    p->messages[p->count] = msg;
+    p->bytes[p->count] = bytes;
+    p->count++;
+    p->total += bytes;
+    return true;
+}
+
+static void planRemove(ContextPlan *p, int at, int n) {
+    for (int i = at; i < at + n; i++) p->total -= p->bytes[i];
+    memmove(&p->messages[at], &p->messages[at + n],
+            (p->count - at - n) * sizeof(LlmMessage));
+    memmove(&p->bytes[at], &p->bytes[at + n], (p->count - at - n) * sizeof(int));
+    p->count -= n;
+}
+
+/** Request budget in bytes: the model's context less the reply, capped
+ *  by the request size limit. */
+static int planBudget() {
+    long bytes = (long)(cfg_context_tokens - LLM_REPLY_TOKENS) * LLM_BYTES_PER_TOKEN;
+    return bytes < LLM_MAX_REQUEST_LEN ? (int)bytes : LLM_MAX_REQUEST_LEN;
+}
+
+/**
+ * Free CONTEXT_STEP_MSGS slots for the coming step by dropping the oldest
+ * history turns. Returns false if the step's messages cannot fit.
+ */
+static bool planReserve(ContextPlan *p) {
+    int dropped = 0;
+    while (LLM_MAX_MESSAGES - p->count < CONTEXT_STEP_MSGS && p->histEnd > p->histStart) {
+        planRemove(p, p->histStart, 2);
+        p->histEnd -= 2;
+        dropped++;
+    }
+    if (dropped > 0)
+        Serial.printf("[Agent] Context: dropped %d history turn(s) for message slots\n", dropped);
+    return LLM_MAX_MESSAGES - p->count >= CONTEXT_STEP_MSGS;
+}
+
+/**
+ * Trim the plan to the budget before a request. Tool definitions may be
+ * re-read. Returns the estimated request size, or -1 if it cannot fit.
+ */
+static int planFit(ContextPlan *p, const char **toolDefs, int *toolCount) {
+    int budget = planBudget();
+    int tools = llm.envelopeBytes(toolDefs, *toolCount);
+    int dropped = 0;
+
+    while (tools + p->total > budget && p->histEnd > p->histStart) {
+        planRemove(p, p->histStart, 2);
+        p->histEnd -= 2;
+        dropped++;
+    }
+    if (dropped > 0)
+        Serial.printf("[Agent] Context: dropped %d oldest history turn(s)\n", dropped);
+
+    if (tools + p->total > budget && p->memory >= 0) {
+        planRemove(p, p->memory, 1);
+        p->memory = -1;
+        p->histStart--;
+        p->histEnd--;
+        Serial.printf("[Agent] Context: left out memory notes\n");
+    }
+
+    if (tools + p->total > budget && p->snapshot) {
+        planRemove(p, p->histEnd, 1);
+        p->snapshot = false;
+        Serial.printf("[Agent] Context: left out state snapshot\n");
+    }
+
+    if (tools + p->total > budget) {
+        toolsLimit(0);
+        *toolCount = toolsGetDefinitions(toolDefs, TOOL_MAX_DEFS);
+        tools = llm.envelopeBytes(toolDefs, *toolCount);
+        Serial.printf("[Agent] Context: tools reduced to tools_more\n");
+    }
+
+    int size = tools + p->total;
+    return size <= budget ? size : -1;
+}
 
 /* Static storage for tool call results (persists across loop iterations) */
 static char toolResultBufs[LLM_MAX_TOOL_CALLS][TOOL_RESULT_MAX_LEN];
-char toolCallJsonBuf[4096]; /* copy of tool_calls_json for message building */
+static char chatToolCallBuf[4096]; /* copy of tool_calls_json for message building */
+/* Scratch for NATS handlers in loop(), which run while the agent task is
+ * in a chat; never referenced by a chat's messages */
+char toolCallJsonBuf[4096];
 static char memoryBuf[512]; /* persistent AI memory from /memory.txt */
 
+/* Streamed reply text is echoed to Serial as it arrives and published on
+ * {device}.chat.stream in small batches; an empty message ends a reply.
+ * The agent task only prints; publishing happens in loop(). */
+#define CHAT_STREAM_FLUSH_BYTES 96
+#define CHAT_STREAM_FLUSH_MS    250
+static char chatStreamBuf[128];
+static int chatStreamLen = 0;
+static unsigned long chatStreamLastFlush = 0;
+static bool chatStreamOpen = false;   /* text published for this reply */
+static bool chatStreamed = false;     /* any delta seen in this chat */
+static LlmDeltaFn chatDeltaFn = nullptr;
+static void *chatDeltaCtx = nullptr;
+static char chatError[96];            /* set when a chat fails before a request */
+static char chatPlanReply[512];       /* reply given with a run_plan call */
+static unsigned long chatCount = 0;   /* chats and LLM requests since boot */
+static unsigned long chatLlmCalls = 0;
+
+static void chatStreamFlush() {
+    if (chatStreamLen > 0 && g_nats_connected) {
+        natsClient.publish(natsSubjectChatStream,
+                           (const uint8_t *)chatStreamBuf, chatStreamLen);
+    }
+    chatStreamLen = 0;
+    chatStreamLastFlush = millis();
+}
+
+/** loop(): batch reply text forwarded by agentPoll(). */
+static void chatStreamText(const char *text, int len) {
+    if (!chatStreamOpen) {
+        chatStreamOpen = true;
+        chatStreamLastFlush = millis();
+    }
+    if (chatStreamLen + len > (int)sizeof(chatStreamBuf)) chatStreamFlush();
+    if (len > (int)sizeof(chatStreamBuf)) {
+        if (g_nats_connected) {
+            natsClient.publish(natsSubjectChatStream, (const uint8_t *)text, len);
+        }
+    } else {
+        memcpy(chatStreamBuf + chatStreamLen, text, len);
+        chatStreamLen += len;
+    }
+    if (chatStreamLen >= CHAT_STREAM_FLUSH_BYTES) chatStreamFlush();
+}
+
+/** loop(): publish a batch that has waited long enough. */
+static void chatStreamTick() {
+    if (chatStreamLen > 0 && millis() - chatStreamLastFlush >= CHAT_STREAM_FLUSH_MS) {
+        chatStreamFlush();
+    }
+}
+
+/** loop(): close the streamed reply - flush the tail, send the end marker. */
+static void chatStreamEnd() {
+    if (!chatStreamOpen) return;
+    chatStreamFlush();
+    if (g_nats_connected) {
+        natsClient.publish(natsSubjectChatStream, (const uint8_t *)"", 0);
+    }
+    chatStreamOpen = false;
+}
+
+static void chatDelta(const char *text, int len, void *ctx) {
+    (void)ctx;
+    if (!chatStreamed) {
+        Serial.printf("\n");
+        chatStreamed = true;
+    }
+    Serial.printf("%.*s", len, text);
+    agentStreamWrite(text, len);
+
+    if (chatDeltaFn) chatDeltaFn(text, len, chatDeltaCtx);
+}
+
+/* Read in loop() for the running chat. stateSnapshot() is next called by
+ * the next chat, so chatState stays valid until this one ends. */
+static const char *chatState = nullptr;
+static uint8_t chatToolMask = 0;
+static int chatMemoryLen = 0;
+
+/* Reply to add to the history when the chat is delivered (chatDone) */
+static const char *chatHistoryReply = nullptr;
+
+/**
+ * loop(): read what the registries, the tool selection and the memory file
+ * hold for a chat that is starting. arg is the user message.
+ */
+static void chatReadState(void *arg) {
+    chatState = cfg_state_snapshot ? stateSnapshot() : nullptr;
+    chatToolMask = toolsSelect((const char *)arg);
+    memoryBuf[0] = '\0';
+    chatMemoryLen = readFile("/memory.txt", memoryBuf, sizeof(memoryBuf));
+    planTraceBegin();
+}
+
+static void tgAgentTick();
+
 /**
- * Run the agentic chat loop. Returns pointer to the response text
- * (valid until next call), or nullptr on error.
+ * Run the agentic chat loop, in the agent task. Returns pointer to the
+ * response text (valid until next call), or nullptr on error. With
+ * streaming enabled, onDelta (optional) receives reply text as it is
+ * generated. State loop() owns is read through chatReadState(), and the
+ * turn is added to the history by chatDone().
  */
-const char *chatWithLLM(const char *userMessage) {
-    /* Re-entrancy guard: remote_chat calls natsClient.process() which can
-     * dispatch onNatsChat, leading to nested chatWithLLM. Block it. */
+const char *chatWithLLM(const char *userMessage,
+                        LlmDeltaFn onDelta = nullptr, void *deltaCtx = nullptr) {
+    /* Re-entrancy guard: without the agent task, chats run inline, and
+     * remote_chat waits in toolWait(), whose natsClient.process() can
+     * dispatch onNatsChat.
+     * agentSubmit() queues such a chat behind this one; anything that still
+     * nests is blocked. */
     static bool chatActive = false;
     if (chatActive) {
         Serial.printf("[Agent] Blocked re-entrant chatWithLLM call\n");
         return "[error: busy]";
     }
+
     chatActive = true;
+    chatCount++;
+    chatStreamed = false;
+    chatError[0] = '\0';
+    chatHistoryReply = nullptr;
+    chatDeltaFn = onDelta;
+    chatDeltaCtx = deltaCtx;
 
     g_led_user = false; /* Reset - status LEDs allowed until a tool sets the LED */
     ledBlue(); /* Thinking... */
 
+    /* Open the LLM connection now; it is kept alive across the agent
+     * iterations below and closed when the chat ends. */
+    unsigned long connectCount0 = llm.connectCount();
+    unsigned long connectMs0 = llm.connectTotalMs();
+    llm.preconnect();
+
     /*
-     * Message array for the full agentic conversation.
-     * Layout: system + history pairs + user + [assistant+tool results]*iterations
-     * Static to avoid blowing the 8KB loop task stack.
+     * Messages for the full agentic conversation.
+     * Layout: system + memory + history pairs + state + user + [assistant+tool results]*iterations
+     * Static to keep it off the agent task stack.
      */
-    static LlmMessage messages[LLM_MAX_MESSAGES];
-    int msgCount = 0;
+    static ContextPlan plan;
+    plan.count = 0;
+    plan.total = 0;
+    plan.memory = -1;
+    plan.snapshot = false;
 
     /* System prompt */
-    messages[msgCount++] = llmMsg("system", cfg_system_prompt);
+    planAdd(&plan, llmMsg("system", cfg_system_prompt));
+
+    /* Devices, rules, tool selection and memory, read in loop() */
+    agentRunInLoop(chatReadState, (void *)userMessage);
 
     /* Persistent AI memory */
-    memoryBuf[0] = '\0';
-    int memLen = readFile("/memory.txt", memoryBuf, sizeof(memoryBuf));
-    if (memLen > 0) {
-        messages[msgCount++] = llmMsg("system", memoryBuf);
+    if (chatMemoryLen > 0) {
+        plan.memory = plan.count;
+        planAdd(&plan, llmMsg("system", memoryBuf));
+    }
+
+    /* History: the newest turns that have message slots */
+    plan.histStart = plan.count;
+    int first = historyCount - CONTEXT_HISTORY_MSGS / 2;
+    for (int i = first > 0 ? first : 0; i < historyCount; i++) {
+        /* The turn's estimate covers both messages; pairs are dropped together */
+        planAdd(&plan, llmMsg("user", historyUser(i)), 0);
+        planAdd(&plan, llmMsg("assistant", historyAssistant(i)), historyBytes(i));
     }
+    plan.histEnd = plan.count;
 
-    /* History */
-    int histStart = msgCount;  /* index where history pairs begin */
-    for (int i = 0; i < historyCount && msgCount < LLM_MAX_MESSAGES - 2; i++) {
-        messages[msgCount++] = llmMsg("user", history[i].user);
-        messages[msgCount++] = llmMsg("assistant", history[i].assistant);
+    /* Devices and rules as they are now. After the history, so the prefix
+     * before it stays the same from chat to chat for prompt caching. */
+    if (chatState && chatState[0]) {
+        planAdd(&plan, llmMsg("system", chatState));
+        plan.snapshot = true;
     }
-    int histEnd = msgCount;    /* index after last history message */
 
-    /* Current user message */
-    messages[msgCount++] = llmMsg("user", userMessage);
+    /* Current user message; history is at most CONTEXT_HISTORY_MSGS, so
+     * there is always a slot */
+    planAdd(&plan, llmMsg("user", userMessage));
 
     Serial.printf("\n--- Thinking... ---\n");
     unsigned long t0 = millis();
 
-    const char *tools_json = toolsGetDefinitions();
+    /* Only tool categories relevant to this message are sent; tools_more
+     * lets the model widen the set, so definitions are re-read per iteration */
+    static const char *toolDefs[TOOL_MAX_DEFS];
+    int toolCount = 0;
+    if (g_debug) Serial.printf("[Agent] tool categories 0x%02x\n", chatToolMask);
+
+    /* Fast replies are not streamed: an escalated one is thrown away */
+    bool fast = cfg_model_fast[0] && !cascadeLongForm(userMessage);
+
     static LlmResult result;
     int totalPromptTokens = 0;
     int totalCompletionTokens = 0;
+    int totalCachedTokens = 0;
     const char *finalContent = nullptr;
     bool ok = false;
 
+    bool stopped = false;
     for (int iter = 0; iter < MAX_AGENT_ITERATIONS; iter++) {
-        ok = llm.chat(messages, msgCount, tools_json, &result);
-
-        /* If request too large, drop oldest history pair and retry */
-        while (!ok && strstr(llm.lastError(), "too large") &&
-               histStart + 2 <= histEnd) {
-            Serial.printf("[Agent] Request too large, dropping oldest history\n");
-            /* Remove 2 messages (user+assistant) at histStart */
-            memmove(&messages[histStart], &messages[histStart + 2],
-                    (msgCount - histStart - 2) * sizeof(LlmMessage));
-            msgCount -= 2;
-            histEnd -= 2;
-            ok = llm.chat(messages, msgCount, tools_json, &result);
+        /* /stop: finish the step that is running, start no new one */
+        if (agentStopping()) {
+            stopped = true;
+            ok = false;
+            break;
+        }
+        tgAgentTick();
+
+        llm.setModel(fast ? cfg_model_fast : nullptr);
+        toolCount = toolsGetDefinitions(toolDefs, TOOL_MAX_DEFS);
+
+        /* Slots for this step's tool calls and results; then fit the
+         * request to the context before anything is serialized */
+        if (!planReserve(&plan)) {
+            snprintf(chatError, sizeof(chatError), "Too many messages for one chat");
+            ok = false;
+            break;
+        }
+        int estimate = planFit(&plan, toolDefs, &toolCount);
+        if (estimate < 0) {
+            snprintf(chatError, sizeof(chatError),
+                     "Request does not fit context_tokens (%d)", cfg_context_tokens);
+            ok = false;
+            break;
+        }
+
+        unsigned long tReq = millis();
+        chatLlmCalls++;
+        ok = llm.chat(plan.messages, plan.count, toolDefs, toolCount, &result,
+                      fast ? nullptr : chatDelta, nullptr);
+        cascadeAccount(fast, ok, &result, millis() - tReq);
+        if (g_debug) Serial.printf("[Agent] iteration %d (%s): %d tools, ~%d/%d prompt tokens, "
+                                   "connect %s (%lums), first byte %lums, %d cached\n",
+                                   iter + 1, fast ? "fast" : "main",
+                                   toolCount, llmTokens(estimate),
+                                   ok ? result.prompt_tokens : 0,
+                                   llm.lastReused() ? "reused" : "new",
+                                   llm.lastConnectMs(), llm.lastFirstByteMs(),
+                                   ok ? result.cached_tokens : 0);
+        if (fast && (!ok || cascadeUnsure(&result))) {
+            cascadeEscalate(ok ? "unsure reply" : llm.lastError(), cfg_model);
+            fast = false;
+            iter--;  /* the same step again, on the main model */
+            continue;
         }
         if (!ok) break;
 
         totalPromptTokens += result.prompt_tokens;
         totalCompletionTokens += result.completion_tokens;
+        totalCachedTokens += result.cached_tokens;
 
         /* No tool calls - we're done */
         if (result.tool_call_count == 0) {
@@ -479,58 +1059,83 @@ const char *chatWithLLM(const char *userMessage) {
                       result.tool_call_count, iter + 1);
 
         /* Save tool_calls_json for message building */
-        strncpy(toolCallJsonBuf, result.tool_calls_json, sizeof(toolCallJsonBuf) - 1);
-        toolCallJsonBuf[sizeof(toolCallJsonBuf) - 1] = '\0';
-
-        /* Add assistant message with tool calls */
-        if (msgCount < LLM_MAX_MESSAGES) {
-            messages[msgCount++] = llmToolCallMsg(
-                result.content[0] ? result.content : nullptr,
-                toolCallJsonBuf);
+        strncpy(chatToolCallBuf, result.tool_calls_json, sizeof(chatToolCallBuf) - 1);
+        chatToolCallBuf[sizeof(chatToolCallBuf) - 1] = '\0';
+
+        /* Add assistant message with tool calls. planReserve() made room for
+         * it and every result; a provider rejects calls without results. */
+        if (!planAdd(&plan, llmToolCallMsg(result.content[0] ? result.content : nullptr,
+                                           chatToolCallBuf))) {
+            snprintf(chatError, sizeof(chatError), "No message slot for tool calls");
+            ok = false;
+            break;
         }
 
         /* Execute each tool and add result messages */
-        for (int t = 0; t < result.tool_call_count && msgCount < LLM_MAX_MESSAGES; t++) {
+        bool toolError = false;
+        int executed = 0;
+        for (int t = 0; t < result.tool_call_count && ok; t++) {
             LlmToolCall *tc = &result.tool_calls[t];
 
             Serial.printf("  -> %s(%s)\n", tc->name, tc->arguments);
+            planTraceCall(iter, tc->name, tc->arguments);
 
-            toolExecute(tc->name, tc->arguments,
-                        toolResultBufs[t], TOOL_RESULT_MAX_LEN);
+            agentToolExecute(tc->name, tc->arguments,
+                             toolResultBufs[t], TOOL_RESULT_MAX_LEN);
 
             Serial.printf("     = %s\n", toolResultBufs[t]);
+            if (strncmp(toolResultBufs[t], "Error", 5) == 0) toolError = true;
+            executed++;
 
-            messages[msgCount++] = llmToolResult(tc->id, toolResultBufs[t]);
+            if (!planAdd(&plan, llmToolResult(tc->id, toolResultBufs[t]))) {
+                snprintf(chatError, sizeof(chatError), "No message slot for tool results");
+                ok = false;
+            }
+        }
+        if (!ok) break;
+
+        if (fast && toolError) {
+            cascadeEscalate("tool error", cfg_model);
+            fast = false;
+        }
+
+        /* A plan that ran through with a reply needs no second request */
+        if (executed == 1 && result.tool_call_count == 1 &&
+            strcmp(result.tool_calls[0].name, "run_plan") == 0 &&
+            strncmp(toolResultBufs[0], "OK", 2) == 0 &&
+            jsonGetString(result.tool_calls[0].arguments, "reply",
+                          chatPlanReply, sizeof(chatPlanReply))) {
+            finalContent = chatPlanReply;
+            break;
         }
 
         if (!g_led_user) ledPurple(); /* Show we're in a tool loop */
     }
 
+    llm.disconnect(); /* free the TLS session for Telegram */
+    llm.setModel(nullptr);
+    planTraceEnd(ok);
     unsigned long elapsed = millis() - t0;
+    int connectCount = (int)(llm.connectCount() - connectCount0);
+    unsigned long connectMs = llm.connectTotalMs() - connectMs0;
+    if (chatStreamed) Serial.printf("\n");
 
-    if (ok && finalContent && finalContent[0]) {
+    if (stopped) {
         if (!g_led_user) ledGreen();
+        Serial.printf("\n[Agent] Stopped after %lums\n\n", elapsed);
+        chatActive = false;
+        return "[stopped]";
 
-        Serial.printf("\n%s\n", finalContent);
-        Serial.printf("--- (%lums, %d+%d tokens) ---\n\n",
-                      elapsed, totalPromptTokens, totalCompletionTokens);
+    } else if (ok && finalContent && finalContent[0]) {
+        if (!g_led_user) ledGreen();
 
-        /* Save to history (circular buffer) */
-        int slot;
-        if (historyCount >= MAX_HISTORY) {
-            for (int i = 0; i < MAX_HISTORY - 1; i++)
-                history[i] = history[i + 1];
-            slot = MAX_HISTORY - 1;
-        } else {
-            slot = historyCount++;
-        }
-        strncpy(history[slot].user, userMessage, sizeof(history[slot].user) - 1);
-        history[slot].user[sizeof(history[slot].user) - 1] = '\0';
-        strncpy(history[slot].assistant, finalContent,
-                sizeof(history[slot].assistant) - 1);
-        history[slot].assistant[sizeof(history[slot].assistant) - 1] = '\0';
-        history[slot].used = true;
-        historySave();
+        if (!chatStreamed) Serial.printf("\n%s\n", finalContent);
+        Serial.printf("--- (%lums, %d+%d tokens, %d cached, %d connect(s) %lums) ---\n\n",
+                      elapsed, totalPromptTokens, totalCompletionTokens,
+                      totalCachedTokens, connectCount, connectMs);
+
+        /* loop() saves the turn on delivery; the history is its own */
+        chatHistoryReply = finalContent;
 
         chatActive = false;
         return finalContent;
@@ -539,13 +1144,15 @@ const char *chatWithLLM(const char *userMessage) {
         /* Tools executed but no final text (LLM only used tools) */
         if (!g_led_user) ledGreen();
         Serial.printf("\n[Agent] Tools executed, no text response.\n");
-        Serial.printf("--- (%lums, %d+%d tokens) ---\n\n",
-                      elapsed, totalPromptTokens, totalCompletionTokens);
+        Serial.printf("--- (%lums, %d+%d tokens, %d cached, %d connect(s) %lums) ---\n\n",
+                      elapsed, totalPromptTokens, totalCompletionTokens,
+                      totalCachedTokens, connectCount, connectMs);
         chatActive = false;
         return "[Tools executed, no text response]";
     } else {
         ledRed();
-        Serial.printf("\n[ERROR] LLM call failed: %s\n\n", llm.lastError());
+        Serial.printf("\n[ERROR] LLM call failed: %s\n\n",
+                      chatError[0] ? chatError : llm.lastError());
         chatActive = false;
         return nullptr;
     }
@@ -576,51 +1183,88 @@ static void onNatsEvent(nats_client_t *client, nats_event_t event,
     }
 }
 
-static void tgYield(); /* forward declaration */
+/** Log JetStream publishes that were rejected or never acknowledged. */
+static void onNatsJsAck(nats_js_t *js, const nats_js_ack_t *ack,
+                        void *userdata) {
+    (void)js; (void)userdata;
+    if (ack->status == NATS_JS_ACK_OK) {
+        if (g_debug) Serial.printf("[NATS] js ack #%u -> %s seq=%u%s\n",
+                                   (unsigned)ack->id, ack->stream,
+                                   (unsigned)ack->seq,
+                                   ack->duplicate ? " (dup)" : "");
+    } else if (ack->status == NATS_JS_ACK_ERROR) {
+        Serial.printf("[NATS] js publish #%u rejected (err_code %d) - "
+                      "is a stream capturing %s?\n",
+                      (unsigned)ack->id, (int)ack->err_code, natsSubjectEvents);
+    } else {
+        Serial.printf("[NATS] js publish #%u not acked after retries\n",
+                      (unsigned)ack->id);
+    }
+}
 
 /**
- * NATS chat handler - request/reply. Caller sends a message,
- * we run the agentic loop and respond with the LLM answer.
+ * Publish to the events subject, payload gathered from segments. With
+ * nats_jetstream enabled the event goes through the PubAck window so the
+ * stream confirms storage; payloads that don't fit a retry slot, or a full
+ * window, fall back to a core publish (the stream still captures it, just
+ * without ack tracking).
+ */
+void natsPublishEventIov(const nats_iovec_t *iov, size_t iovcnt) {
+    if (!g_nats_connected || natsSubjectEvents[0] == '\0') return;
+
+    if (g_nats_js_enabled) {
+        nats_err_t err = nats_js_publish_iov(&natsJs, natsSubjectEvents,
+                                             iov, iovcnt, nullptr);
+        if (err == NATS_OK) return;
+        if (g_debug) Serial.printf("[NATS] js publish: %s, using core publish\n",
+                                   nats_err_str(err));
+    }
+    natsClient.publishIov(natsSubjectEvents, iov, iovcnt);
+}
+
+void natsPublishEvent(const char *payload) {
+    nats_iovec_t iov = { payload, strlen(payload) };
+    natsPublishEventIov(&iov, 1);
+}
+
+static void chatSubmit(AgentSource source, const char *message,
+                       const char *replyTo); /* forward declaration */
+
+/**
+ * NATS chat handler - request/reply. Caller sends a message, the agent
+ * task runs the agentic loop and the answer is sent to the reply subject
+ * when it is done (chatDone).
  */
 static void onNatsChat(nats_client_t *client, const nats_msg_t *msg,
                        void *userdata) {
-    (void)userdata;
+    (void)client; (void)userdata;
     if (msg->data_len == 0) return;
 
     /* Copy payload (not null-terminated) */
-    static char chatBuf[512];
+    static char chatBuf[AGENT_MSG_LEN];
     size_t len = msg->data_len < sizeof(chatBuf) - 1
                  ? msg->data_len : sizeof(chatBuf) - 1;
     memcpy(chatBuf, msg->data, len);
     chatBuf[len] = '\0';
 
-    Serial.printf("\n[NATS] chat: %s\n", chatBuf);
-
-    tgYield(); /* Free Telegram TLS so LLM can allocate */
-    const char *response = chatWithLLM(chatBuf);
-
-    /* Reply if caller expects a response */
-    if (msg->reply_len > 0) {
-        if (response) {
-            nats_msg_respond_str(client, msg, response);
-        } else {
-            nats_msg_respond_str(client, msg, "[error]");
-        }
-    }
-
-    /* Also publish to events */
-    if (response && g_nats_connected) {
-        natsClient.publish(natsSubjectEvents, response);
+    static char replyTo[AGENT_REPLY_TO_LEN];
+    replyTo[0] = '\0';
+    if (msg->reply_len >= sizeof(replyTo)) {
+        Serial.printf("[NATS] chat: reply subject too long, not replying\n");
+    } else if (msg->reply_len > 0) {
+        memcpy(replyTo, msg->reply, msg->reply_len);
+        replyTo[msg->reply_len] = '\0';
     }
 
-    Serial.printf("> ");
+    Serial.printf("\n[NATS] chat: %s\n", chatBuf);
+    chatSubmit(AGENT_SRC_NATS, chatBuf, replyTo);
 }
 
 /* Forward declaration (defined in Telegram section, needed by handleCommand) */
 extern bool g_telegram_enabled;
 
 /* Shared command response buffer (NATS + Telegram + Serial, single-threaded so safe) */
-static char cmdResponseBuf[1024];
+static char cmdResponseBuf[1280];
 
 /**
  * Execute a device command, writing compact result to buf.
@@ -629,29 +1273,139 @@ static char cmdResponseBuf[1024];
  */
 static bool handleCommand(const char *cmd, char *buf, int buf_len) {
     if (strcmp(cmd, "status") == 0) {
+        unsigned intentHits, intentMisses;
+        intentStats(&intentHits, &intentMisses);
+        unsigned planHits, planMisses;
+        int planReady;
+        planCacheStats(&planHits, &planMisses, &planReady);
+        char llmStatus[160];
+        int lw = 0;
+        for (int i = 0; i < llm.endpointCount() && lw < (int)sizeof(llmStatus); i++) {
+            const LlmEndpoint *ep = llm.endpoint(i);
+            lw += snprintf(llmStatus + lw, sizeof(llmStatus) - lw, "%s%s %s, p95 %lums",
+                           i > 0 ? "; " : "", ep->host,
+                           ep->failures > 0 ? "failing" : "ok", llm.endpointP95(i));
+        }
+        if (cfg_llm_hedge && lw < (int)sizeof(llmStatus))
+            lw += snprintf(llmStatus + lw, sizeof(llmStatus) - lw, "; %lu hedged, %lu won",
+                           llm.hedgeCount(), llm.hedgeWins());
+        if (lw < (int)sizeof(llmStatus))
+            snprintf(llmStatus + lw, sizeof(llmStatus) - lw, "; received %lu KB for %lu KB",
+                     llm.rxWireBytes() / 1024, llm.rxBodyBytes() / 1024);
+        char cascadeStatus[160];
+        if (cfg_model_fast[0]) {
+            int cw = 0;
+            for (int i = 0; i < 2; i++) {
+                const CascadeTier *t = cascadeTier(i);
+                cw += snprintf(cascadeStatus + cw, sizeof(cascadeStatus) - cw,
+                    "%s %lu req (%lu failed), avg %lums, %lu+%lu tokens; ",
+                    i == 0 ? "fast" : "main", t->requests, t->failures,
+                    t->requests ? t->ms / t->requests : 0,
+                    t->promptTokens, t->completionTokens);
+                if (cw >= (int)sizeof(cascadeStatus)) cw = sizeof(cascadeStatus) - 1;
+            }
+            snprintf(cascadeStatus + cw, sizeof(cascadeStatus) - cw, "%lu escalated",
+                     cascadeEscalations());
+        } else {
+            snprintf(cascadeStatus, sizeof(cascadeStatus), "off");
+        }
+        /* Per source: replies, average and slowest time to the reply */
+        static const char *const sourceNames[AGENT_SRC_COUNT] = { "serial", "telegram", "nats" };
+        char queueStatus[200];
+        int qw = 0;
+        unsigned long merged = 0, dropped = 0;
+        for (int i = 0; i < AGENT_SRC_COUNT && qw < (int)sizeof(queueStatus); i++) {
+            const AgentSourceStats *st = agentStats(i);
+            merged += st->merged;
+            dropped += st->dropped;
+            if (st->jobs == 0) continue;
+            qw += snprintf(queueStatus + qw, sizeof(queueStatus) - qw,
+                           "%s %lu, avg %lums (%lums queued), max %lums; ", sourceNames[i],
+                           st->jobs, st->totalMs / st->jobs, st->waitMs / st->jobs, st->maxMs);
+        }
+        if (qw < (int)sizeof(queueStatus))
+            snprintf(queueStatus + qw, sizeof(queueStatus) - qw, "%lu merged, %lu dropped",
+                     merged, dropped);
+        char jsStatus[96];
+        if (g_nats_js_enabled) {
+            nats_js_stats_t js;
+            nats_js_get_stats(&natsJs, &js);
+            snprintf(jsStatus, sizeof(jsStatus),
+                "%u acked, %u pending, %u retried, %u failed",
+                (unsigned)js.acked, (unsigned)nats_js_pending(&natsJs),
+                (unsigned)js.retries, (unsigned)(js.errors + js.timeouts));
+        } else {
+            snprintf(jsStatus, sizeof(jsStatus), "disabled");
+        }
+        char natsStatus[128];
+        if (g_nats_enabled) {
+            nats_stats_t ns;
+            nats_get_stats(natsClient.core(), &ns);
+            int w = snprintf(natsStatus, sizeof(natsStatus),
+                "%s (budget hit %u, dropped %u)",
+                g_nats_connected ? "connected" : "disconnected",
+                (unsigned)ns.budget_hits, (unsigned)ns.msgs_dropped);
+            if (cfg_nats_fleet[0] != '\0' && w > 0 && w < (int)sizeof(natsStatus)) {
+                snprintf(natsStatus + w, sizeof(natsStatus) - w, ", fleet %s %s",
+                         cfg_nats_fleet,
+                         natsSidFleetChat != 0 ? "joined" : "left");
+            }
+        } else {
+            snprintf(natsStatus, sizeof(natsStatus), "disabled");
+        }
         snprintf(buf, buf_len,
             "WiFi: %s (%s)\n"
             "Heap: %u / %u\n"
-            "History: %d turns\n"
+            "History: %d turns (~%d/%d tokens)\n"
             "Model: %s\n"
+            "LLM: %s\n"
+            "Cascade: %s\n"
             "Debug: %s\n"
             "NATS: %s\n"
+            "JetStream: %s\n"
             "Telegram: %s\n"
+            "Fast path: %u local, %u to LLM\n"
+            "Plans: %u replayed, %u to LLM, %d learned\n"
+            "Agent: %s, %d queued, loop max %lums during chats, "
+            "%lu LLM calls for %lu chats\n"
+            "Queue: %s\n"
             "Uptime: %lus",
             WiFi.status() == WL_CONNECTED ? "connected" : "disconnected",
             WiFi.localIP().toString().c_str(),
             ESP.getFreeHeap(), ESP.getHeapSize(),
-            historyCount, cfg_model,
+            historyCount, historyTokens, HISTORY_TOKEN_BUDGET, cfg_model,
+            llmStatus,
+            cascadeStatus,
             g_debug ? "ON" : "OFF",
-            g_nats_enabled
-                ? (g_nats_connected ? "connected" : "disconnected")
-                : "disabled",
+            natsStatus,
+            jsStatus,
             g_telegram_enabled ? "enabled" : "disabled",
+            intentHits, intentMisses,
+            planHits, planMisses, planReady,
+            agentBusy() ? "busy" : "idle", agentQueued(), loopMaxGapMs,
+            chatLlmCalls, chatCount,
+            queueStatus,
             millis() / 1000);
         return true;
     }
+    if (strcmp(cmd, "stop") == 0) {
+        bool running = agentBusy();
+        int dropped = agentStop();
+        if (!running)
+            snprintf(buf, buf_len, "Nothing to stop");
+        else
+            snprintf(buf, buf_len, "Stopped: %d queued chat(s) dropped%s", dropped,
+                     agentBusy() ? ", the running one ends after its current step" : "");
+        return true;
+    }
     if (strcmp(cmd, "clear") == 0) {
-        historyCount = 0;
+        /* The running chat has pointers into the history */
+        if (agentBusy()) {
+            snprintf(buf, buf_len, "Busy - try again when the current chat is done");
+            return true;
+        }
+        historyClear();
+        historyFileTurns = 0;
         LittleFS.remove(HISTORY_FILE);
         snprintf(buf, buf_len, "History cleared");
         return true;
@@ -791,15 +1545,17 @@ static bool handleCommand(const char *cmd, char *buf, int buf_len) {
             snprintf(buf, buf_len, "No conversation history");
             return true;
         }
-        int w = snprintf(buf, buf_len, "History: %d turns\n", historyCount);
+        int w = snprintf(buf, buf_len, "History: %d turns (~%d tokens)\n",
+                         historyCount, historyTokens);
         for (int i = 0; i < historyCount && w < buf_len - 80; i++) {
-            int alen = strlen(history[i].assistant);
+            const char *user = historyUser(i);
+            const char *assistant = historyAssistant(i);
             w += snprintf(buf + w, buf_len - w,
                 "[%d] %.40s%s\n  -> %.60s%s\n",
-                i + 1, history[i].user,
-                strlen(history[i].user) > 40 ? "..." : "",
-                history[i].assistant,
-                alen > 60 ? "..." : "");
+                i + 1, user,
+                strlen(user) > 40 ? "..." : "",
+                assistant,
+                strlen(assistant) > 60 ? "..." : "");
         }
         return true;
     }
@@ -817,7 +1573,7 @@ static bool handleCommand(const char *cmd, char *buf, int buf_len) {
     }
     if (strcmp(cmd, "help") == 0) {
         snprintf(buf, buf_len,
-            "Commands: /status /clear /heap /debug /devices /rules "
+            "Commands: /status /stop /clear /heap /debug /devices /rules "
             "/memory /time /history /model /reboot /help");
         return true;
     }
@@ -884,8 +1640,7 @@ static void onNatsToolExec(nats_client_t *client, const nats_msg_t *msg,
         return;
     }
 
-    /* Copy payload into toolCallJsonBuf (idle — only used by chatWithLLM,
-     * which we never call from this callback). */
+    /* Copy payload into toolCallJsonBuf (loop() scratch, see its comment) */
     size_t len = msg->data_len < sizeof(toolCallJsonBuf) - 1
                  ? msg->data_len : sizeof(toolCallJsonBuf) - 1;
     memcpy(toolCallJsonBuf, msg->data, len);
@@ -933,21 +1688,22 @@ static void onNatsToolExec(nats_client_t *client, const nats_msg_t *msg,
     /* Determine success: unknown tool or "Error:" prefix */
     bool ok = found && strncmp(cmdResponseBuf, "Error:", 6) != 0;
 
-    /* Build JSON reply — escape directly into reply buffer (no intermediate) */
-    static char reply[768];
-    int w;
-    if (ok) {
-        w = snprintf(reply, sizeof(reply), "{\"ok\":true,\"result\":\"");
-    } else {
-        w = snprintf(reply, sizeof(reply), "{\"ok\":false,\"error\":\"");
-    }
-    w += jsonEscape(reply + w, sizeof(reply) - w - 3, cmdResponseBuf);
-    snprintf(reply + w, sizeof(reply) - w, "\"}");
+    /* JSON reply gathered from static prefix + escaped result + suffix.
+     * The tool args in toolCallJsonBuf are spent, so the escaped result
+     * goes there (4096 holds a fully escaped 1024-byte result). */
+    static const char P_OK[]  = "{\"ok\":true,\"result\":\"";
+    static const char P_ERR[] = "{\"ok\":false,\"error\":\"";
+    int escLen = jsonEscape(toolCallJsonBuf, sizeof(toolCallJsonBuf), cmdResponseBuf);
 
     Serial.printf("[NATS] tool_exec -> %s\n> ", ok ? "ok" : "error");
 
     if (msg->reply_len > 0) {
-        nats_msg_respond_str(client, msg, reply);
+        nats_iovec_t iov[] = {
+            { ok ? P_OK : P_ERR, ok ? sizeof(P_OK) - 1 : sizeof(P_ERR) - 1 },
+            { toolCallJsonBuf, (size_t)escLen },
+            { "\"}", 2 },
+        };
+        nats_msg_respond_iov(client, msg, iov, sizeof(iov) / sizeof(iov[0]));
     }
 
     /* Publish brief event for observability */
@@ -968,31 +1724,43 @@ static void onNatsCapabilities(nats_client_t *client, const nats_msg_t *msg,
                                void *userdata) {
     (void)userdata;
 
-    /* Reuse toolCallJsonBuf[4096] — idle here (only used by chatWithLLM,
-     * which we never call from this callback). */
+    /* Build in toolCallJsonBuf[4096] (loop() scratch, see its comment) */
     int w = 0;
 
     w += snprintf(toolCallJsonBuf + w, sizeof(toolCallJsonBuf) - w,
         "{\"device\":\"%s\",\"version\":\"%s\",\"free_heap\":%u,",
         cfg_device_name, WIRECLAW_VERSION, ESP.getFreeHeap());
 
-    /* Tools list */
-    w += snprintf(toolCallJsonBuf + w, sizeof(toolCallJsonBuf) - w,
+    /* Tools list and HAL block are constant - published straight from
+     * flash as their own segments */
+    static const char TOOLS_JSON[] =
         "\"tools\":[\"led_set\",\"gpio_write\",\"gpio_read\",\"device_info\","
         "\"file_read\",\"file_write\",\"nats_publish\",\"temperature_read\","
         "\"device_register\",\"device_list\",\"device_remove\",\"sensor_read\","
         "\"actuator_set\",\"rule_create\",\"rule_list\",\"rule_delete\","
-        "\"rule_enable\",\"serial_send\",\"chain_create\"],");
+        "\"rule_enable\",\"serial_send\",\"chain_create\"],";
+    static const char HAL_JSON[] =
+        "],\"hal\":{\"gpio\":true,\"adc\":true,\"pwm\":true,"
+        "\"dac\":false,\"uart\":true,\"system_temp\":true}}";
+    int head = w;
+
+    /* The whole reply, constant segments included, must fit in one NATS
+     * payload. Entries that would not fit are left out whole, with room
+     * kept to close the arrays. */
+    int cap = (int)sizeof(toolCallJsonBuf);
+    if (cap > (int)NATS_MAX_PAYLOAD_LEN) cap = (int)NATS_MAX_PAYLOAD_LEN;
+    cap -= (int)(sizeof(TOOLS_JSON) - 1 + sizeof(HAL_JSON) - 1);
+    static const char DEVICES_END[] = "],\"rules\":[";
 
     /* Devices */
     w += snprintf(toolCallJsonBuf + w, sizeof(toolCallJsonBuf) - w, "\"devices\":[");
     Device *devs = deviceGetAll();
     bool firstDev = true;
-    for (int i = 0; i < MAX_DEVICES && w < (int)sizeof(toolCallJsonBuf) - 200; i++) {
+    for (int i = 0; i < MAX_DEVICES; i++) {
         if (!devs[i].used) continue;
         Device *d = &devs[i];
+        int start = w;
         if (!firstDev) toolCallJsonBuf[w++] = ',';
-        firstDev = false;
         if (deviceIsSensor(d->kind)) {
             float val = deviceReadSensor(d);
             w += snprintf(toolCallJsonBuf + w, sizeof(toolCallJsonBuf) - w,
@@ -1003,18 +1771,22 @@ static void onNatsCapabilities(nats_client_t *client, const nats_msg_t *msg,
                 "{\"name\":\"%s\",\"kind\":\"%s\",\"pin\":%d}",
                 d->name, deviceKindName(d->kind), d->pin);
         }
+        if (w > cap - (int)(sizeof(DEVICES_END) - 1)) {
+            w = start;
+            break;
+        }
+        firstDev = false;
     }
-    w += snprintf(toolCallJsonBuf + w, sizeof(toolCallJsonBuf) - w, "],");
+    w += snprintf(toolCallJsonBuf + w, sizeof(toolCallJsonBuf) - w, "%s", DEVICES_END);
 
-    /* Rules */
-    w += snprintf(toolCallJsonBuf + w, sizeof(toolCallJsonBuf) - w, "\"rules\":[");
+    /* Rules; HAL_JSON closes the array */
     const Rule *rules = ruleGetAll();
     bool firstRule = true;
-    for (int i = 0; i < MAX_RULES && w < (int)sizeof(toolCallJsonBuf) - 200; i++) {
+    for (int i = 0; i < MAX_RULES; i++) {
         if (!rules[i].used) continue;
         const Rule *r = &rules[i];
+        int start = w;
         if (!firstRule) toolCallJsonBuf[w++] = ',';
-        firstRule = false;
         w += snprintf(toolCallJsonBuf + w, sizeof(toolCallJsonBuf) - w,
             "{\"id\":\"%s\",\"name\":\"%s\",\"enabled\":%s,\"condition\":\"%s\","
             "\"sensor\":\"%s\",\"fired\":%s}",
@@ -1023,15 +1795,24 @@ static void onNatsCapabilities(nats_client_t *client, const nats_msg_t *msg,
             conditionOpName(r->condition),
             r->sensor_name,
             r->fired ? "true" : "false");
+        if (w > cap) {
+            w = start;
+            break;
+        }
+        firstRule = false;
     }
-    w += snprintf(toolCallJsonBuf + w, sizeof(toolCallJsonBuf) - w,
-        "],\"hal\":{\"gpio\":true,\"adc\":true,\"pwm\":true,"
-        "\"dac\":false,\"uart\":true,\"system_temp\":true}}");
 
-    Serial.printf("[NATS] capabilities: %d bytes\n> ", w);
+    nats_iovec_t iov[] = {
+        { toolCallJsonBuf, (size_t)head },
+        { TOOLS_JSON, sizeof(TOOLS_JSON) - 1 },
+        { toolCallJsonBuf + head, (size_t)(w - head) },
+        { HAL_JSON, sizeof(HAL_JSON) - 1 },
+    };
+    Serial.printf("[NATS] capabilities: %d bytes\n> ",
+                  w + (int)(sizeof(TOOLS_JSON) - 1 + sizeof(HAL_JSON) - 1));
 
     if (msg->reply_len > 0) {
-        nats_msg_respond_str(client, msg, toolCallJsonBuf);
+        nats_msg_respond_iov(client, msg, iov, sizeof(iov) / sizeof(iov[0]));
     }
 }
 
@@ -1072,6 +1853,16 @@ void natsSubscribeDeviceSensors() {
     }
 }
 
+static void natsUnsubscribeDeviceSensors() {
+    if (!g_nats_connected) return;
+    Device *devs = deviceGetAllMutable();
+    for (int i = 0; i < MAX_DEVICES; i++) {
+        if (!devs[i].used || devs[i].nats_sid == 0) continue;
+        natsClient.unsubscribe(devs[i].nats_sid);
+        devs[i].nats_sid = 0;
+    }
+}
+
 void natsUnsubscribeDevice(const char *name) {
     if (!g_nats_connected) return;
     Device *devs = deviceGetAllMutable();
@@ -1088,12 +1879,148 @@ void natsUnsubscribeDevice(const char *name) {
     }
 }
 
+/*============================================================================
+ * NATS File Upload ({device}.upload.<target>)
+ *
+ * Payloads are streamed straight to a temp file as they arrive, so uploads
+ * are not limited by the NATS receive buffer. The target file is only
+ * replaced once the whole payload has been written.
+ *============================================================================*/
+
+struct UploadTarget {
+    const char *name;
+    const char *path;
+};
+
+static const UploadTarget UPLOAD_TARGETS[] = {
+    { "prompt",  "/system_prompt.txt" },
+    { "memory",  "/memory.txt" },
+    { "rules",   "/rules.json" },
+    { "devices", "/devices.json" },
+};
+#define UPLOAD_TARGET_COUNT (sizeof(UPLOAD_TARGETS) / sizeof(UPLOAD_TARGETS[0]))
+#define UPLOAD_TMP_PATH "/upload.tmp"
+
+static File uploadFile;
+static const UploadTarget *uploadTarget = nullptr;
+static const char *uploadError = nullptr;
+static uint8_t uploadPending = 0;  /* UPLOAD_TARGETS saved while a chat ran */
+
+/**
+ * Reload whatever was just replaced on flash. Not while a chat runs: the
+ * agent task reads the prompt, devices and rules (see uploadTick()).
+ */
+static void uploadApply(const UploadTarget *t) {
+    if (strcmp(t->name, "prompt") == 0) {
+        readFile(t->path, cfg_system_prompt, sizeof(cfg_system_prompt));
+    } else if (strcmp(t->name, "rules") == 0) {
+        rulesInit();
+    } else if (strcmp(t->name, "devices") == 0) {
+        natsUnsubscribeDeviceSensors();
+        devicesReload();
+        natsSubscribeDeviceSensors();
+    }
+    /* memory is re-read on every chat */
+}
+
+/** loop(): apply uploads that arrived during a chat, once it is over. */
+static void uploadTick() {
+    if (uploadPending == 0 || agentBusy()) return;
+    for (size_t i = 0; i < UPLOAD_TARGET_COUNT; i++) {
+        if (!(uploadPending & (1 << i))) continue;
+        uploadApply(&UPLOAD_TARGETS[i]);
+        Serial.printf("[NATS] upload %s: applied\n", UPLOAD_TARGETS[i].name);
+    }
+    uploadPending = 0;
+}
+
+static void onNatsUpload(nats_client_t *client, nats_stream_event_t event,
+                         const nats_msg_t *msg, size_t offset, size_t total,
+                         void *userdata) {
+    (void)userdata;
+    static char reply[128];
+
+    switch (event) {
+    case NATS_STREAM_BEGIN: {
+        uploadTarget = nullptr;
+        uploadError = nullptr;
+
+        const char *name = strrchr(msg->subject, '.');
+        name = name ? name + 1 : msg->subject;
+        for (size_t i = 0; i < UPLOAD_TARGET_COUNT; i++) {
+            if (strcmp(name, UPLOAD_TARGETS[i].name) == 0) {
+                uploadTarget = &UPLOAD_TARGETS[i];
+                break;
+            }
+        }
+
+        if (!uploadTarget) {
+            uploadError = "unknown target";
+        } else if (total > LittleFS.totalBytes() - LittleFS.usedBytes()) {
+            uploadError = "not enough flash";
+        } else {
+            uploadFile = LittleFS.open(UPLOAD_TMP_PATH, "w");
+            if (!uploadFile) uploadError = "cannot open temp file";
+        }
+        Serial.printf("[NATS] upload %s: %u bytes%s%s\n", name, (unsigned)total,
+                      uploadError ? " - " : "", uploadError ? uploadError : "");
+        break;
+    }
+
+    case NATS_STREAM_CHUNK:
+        if (uploadError) break;
+        if (uploadFile.write(msg->data, msg->data_len) != msg->data_len) {
+            uploadError = "write failed";
+        }
+        break;
+
+    case NATS_STREAM_END:
+        if (uploadFile) uploadFile.close();
+        if (!uploadError) {
+            LittleFS.remove(uploadTarget->path);
+            if (LittleFS.rename(UPLOAD_TMP_PATH, uploadTarget->path)) {
+                uploadPending |= 1 << (uploadTarget - UPLOAD_TARGETS);
+                uploadTick();
+                Serial.printf("[NATS] upload %s: saved %u bytes to %s%s\n",
+                              uploadTarget->name, (unsigned)offset,
+                              uploadTarget->path,
+                              uploadPending ? ", applied after the chat" : "");
+            } else {
+                uploadError = "rename failed";
+            }
+        }
+        if (uploadError) {
+            LittleFS.remove(UPLOAD_TMP_PATH);
+            snprintf(reply, sizeof(reply),
+                     "{\"ok\":false,\"error\":\"%s\"}", uploadError);
+        } else {
+            snprintf(reply, sizeof(reply),
+                     "{\"ok\":true,\"target\":\"%s\",\"bytes\":%u%s}",
+                     uploadTarget->name, (unsigned)offset,
+                     uploadPending ? ",\"pending\":true" : "");
+        }
+        if (msg->reply_len > 0) {
+            nats_msg_respond_str(client, msg, reply);
+        }
+        break;
+
+    case NATS_STREAM_ABORT:
+    default:
+        if (uploadFile) uploadFile.close();
+        LittleFS.remove(UPLOAD_TMP_PATH);
+        Serial.printf("[NATS] upload aborted after %u bytes\n", (unsigned)offset);
+        break;
+    }
+}
+
 /**
  * Build NATS subject strings from device_name prefix.
  */
 static void buildNatsSubjects() {
     snprintf(natsSubjectChat, sizeof(natsSubjectChat),
              "%s.chat", cfg_device_name);
+    snprintf(natsSubjectChatStream, sizeof(natsSubjectChatStream),
+             "%s.chat.stream", cfg_device_name);
     snprintf(natsSubjectCmd, sizeof(natsSubjectCmd),
              "%s.cmd", cfg_device_name);
     snprintf(natsSubjectEvents, sizeof(natsSubjectEvents),
@@ -1104,22 +2031,80 @@ static void buildNatsSubjects() {
              "%s.capabilities", cfg_device_name);
     snprintf(natsSubjectHal, sizeof(natsSubjectHal),
              "%s.hal.>", cfg_device_name);
+    snprintf(natsSubjectUpload, sizeof(natsSubjectUpload),
+             "%s.upload.*", cfg_device_name);
+    if (cfg_nats_fleet[0] != '\0') {
+        snprintf(natsSubjectFleetChat, sizeof(natsSubjectFleetChat),
+                 "fleet.%s.chat", cfg_nats_fleet);
+        snprintf(natsSubjectFleetToolExec, sizeof(natsSubjectFleetToolExec),
+                 "fleet.%s.tool_exec", cfg_nats_fleet);
+    }
 }
 
 /**
- * Connect to NATS server and subscribe to topics.
+ * Join the fleet queue group. No-op while busy, disconnected, or with no
+ * fleet configured; connectNats() and natsFleetSetBusy() call it again.
  */
-static bool connectNats() {
-    Serial.printf("NATS: connecting to %s:%d...\n", cfg_nats_host, cfg_nats_port);
+static void natsFleetJoin() {
+    if (cfg_nats_fleet[0] == '\0' || natsFleetBusy || !g_nats_connected) return;
 
-    natsClient.onEvent(onNatsEvent, nullptr);
-
-    if (!natsClient.connect(cfg_nats_host, (uint16_t)cfg_nats_port, 2000)) {
-        Serial.printf("NATS: connection failed\n");
-        return false;
+    nats_err_t err;
+    if (natsSidFleetChat == 0) {
+        err = natsClient.subscribeQueue(natsSubjectFleetChat, cfg_nats_fleet,
+                                        onNatsChat, nullptr, &natsSidFleetChat);
+        if (err != NATS_OK) {
+            Serial.printf("NATS: subscribe %s failed: %s\n",
+                          natsSubjectFleetChat, nats_err_str(err));
+        }
     }
+    if (natsSidFleetToolExec == 0) {
+        err = natsClient.subscribeQueue(natsSubjectFleetToolExec, cfg_nats_fleet,
+                                        onNatsToolExec, nullptr,
+                                        &natsSidFleetToolExec);
+        if (err != NATS_OK) {
+            Serial.printf("NATS: subscribe %s failed: %s\n",
+                          natsSubjectFleetToolExec, nats_err_str(err));
+        }
+    }
+    if (g_debug) Serial.printf("[NATS] fleet '%s' joined\n", cfg_nats_fleet);
+}
 
-    /* Subscribe to chat and cmd */
+/**
+ * Leave the fleet queue group. Works while disconnected too: the
+ * subscriptions are dropped locally and not restored on reconnect.
+ */
+static void natsFleetLeave() {
+    bool left = false;
+    if (natsSidFleetChat != 0) {
+        natsClient.unsubscribe(natsSidFleetChat);
+        natsSidFleetChat = 0;
+        left = true;
+    }
+    if (natsSidFleetToolExec != 0) {
+        natsClient.unsubscribe(natsSidFleetToolExec);
+        natsSidFleetToolExec = 0;
+        left = true;
+    }
+    if (g_debug && left)
+        Serial.printf("[NATS] fleet '%s' left (busy)\n", cfg_nats_fleet);
+}
+
+/**
+ * Mark the agent busy/idle. A busy device takes no fleet requests, so the
+ * server routes them to idle members instead of queueing them here. Each
+ * rejoin takes new SIDs; the core wraps them, so this can go on forever.
+ */
+static void natsFleetSetBusy(bool busy) {
+    if (busy == natsFleetBusy) return;
+    natsFleetBusy = busy;
+    if (busy) natsFleetLeave();
+    else natsFleetJoin();
+}
+
+/**
+ * Subscribe the per-device subjects (chat, cmd, tool_exec, ...).
+ */
+static void natsSubscribeFixed() {
     nats_err_t err;
     err = natsClient.subscribe(natsSubjectChat, onNatsChat, nullptr);
     if (err != NATS_OK) {
@@ -1157,23 +2142,57 @@ static bool connectNats() {
                       natsSubjectHal, nats_err_str(err));
     }
 
+    err = natsClient.subscribeStream(natsSubjectUpload, onNatsUpload, nullptr);
+    if (err != NATS_OK) {
+        Serial.printf("NATS: subscribe %s failed: %s\n",
+                      natsSubjectUpload, nats_err_str(err));
+    }
+
+    Serial.printf("NATS: subscribed to %s, %s, %s, %s, %s, %s\n",
+                  natsSubjectChat, natsSubjectCmd,
+                  natsSubjectToolExec, natsSubjectCapabilities,
+                  natsSubjectHal, natsSubjectUpload);
+}
+
+/**
+ * Connect to NATS server and subscribe to topics.
+ *
+ * The client keeps its subscriptions across a reconnect and re-sends them
+ * itself, so the fixed subjects are only subscribed on the first connect.
+ */
+static bool connectNats() {
+    static bool subscribed = false;
+
+    Serial.printf("NATS: connecting to %s:%d...\n", cfg_nats_host, cfg_nats_port);
+
+    natsClient.onEvent(onNatsEvent, nullptr);
+    natsClient.setProcessBudget(NATS_PROCESS_MAX_MSGS, NATS_PROCESS_MAX_US);
+
+    if (!natsClient.connect(cfg_nats_host, (uint16_t)cfg_nats_port, 2000)) {
+        Serial.printf("NATS: connection failed\n");
+        return false;
+    }
+
+    if (!subscribed) {
+        natsSubscribeFixed();
+        subscribed = true;
+    }
+
+    /* Fleet membership follows the agent's busy state */
+    natsFleetJoin();
+
     /* Publish online event */
-    static char onlineMsg[256];
+    static char onlineMsg[320];
     snprintf(onlineMsg, sizeof(onlineMsg),
              "{\"event\":\"online\",\"device\":\"%s\",\"version\":\"%s\","
              "\"ip\":\"%s\",\"tool_exec\":\"%s\",\"capabilities\":\"%s\","
-             "\"hal\":\"%s\"}",
+             "\"hal\":\"%s\",\"fleet\":\"%s\"}",
              cfg_device_name, WIRECLAW_VERSION,
              WiFi.localIP().toString().c_str(),
              natsSubjectToolExec, natsSubjectCapabilities,
-             natsSubjectHal);
+             natsSubjectHal, cfg_nats_fleet);
     natsClient.publish(natsSubjectEvents, onlineMsg);
 
-    Serial.printf("NATS: subscribed to %s, %s, %s, %s, %s\n",
-                  natsSubjectChat, natsSubjectCmd,
-                  natsSubjectToolExec, natsSubjectCapabilities,
-                  natsSubjectHal);
-
     /* Subscribe NATS virtual sensors */
     natsSubscribeDeviceSensors();
 
@@ -1186,6 +2205,10 @@ static bool connectNats() {
 
 static WiFiClientSecure tgClient;
 bool g_telegram_enabled = false;
+/* The client is used by loop() (long poll, outbox while idle) and by the
+ * agent task (chat replies, outbox between steps); this serializes the
+ * client and its buffers */
+static SemaphoreHandle_t tgLock = nullptr;
 static int  tgLastUpdateId = 0;
 static unsigned long tgLastPoll = 0;
 
@@ -1196,6 +2219,7 @@ static unsigned long tgWaitStart = 0;
 #define TG_RECONNECT_MS   5000   /* 5s between long-poll cycles */
 #define TG_LONG_POLL_S    30     /* Telegram server hold time (seconds) */
 #define TG_WAIT_TIMEOUT   35000  /* client-side timeout: long-poll + 5s grace */
+#define TG_BUSY_POLL_MS   10000  /* short polls between steps of a chat */
 
 static const char *TG_HOST = "api.telegram.org";
 static const int   TG_PORT = 443;
@@ -1286,9 +2310,11 @@ static int tgApiCall(const char *method, const char *body, int body_len,
 }
 
 /**
- * Send a message to the allowed chat.
+ * Send (messageId = 0) or edit (messageId > 0) a text message in the
+ * allowed chat, with tgLock held. Returns the message_id from Telegram's
+ * reply (0 if it has none), or -1 on error.
  */
-bool tgSendMessage(const char *text) {
+static int tgPostTextLocked(const char *method, int messageId, const char *text) {
     static char req[LLM_MAX_RESPONSE_LEN + 256];
     static char escaped[LLM_MAX_RESPONSE_LEN + 128];
 
@@ -1308,16 +2334,205 @@ bool tgSendMessage(const char *text) {
     }
     escaped[w] = '\0';
 
-    int req_len = snprintf(req, sizeof(req),
-        "{\"chat_id\":%s,\"text\":\"%s\"}", cfg_telegram_chat_id, escaped);
+    int req_len;
+    if (messageId > 0) {
+        req_len = snprintf(req, sizeof(req),
+            "{\"chat_id\":%s,\"message_id\":%d,\"text\":\"%s\"}",
+            cfg_telegram_chat_id, messageId, escaped);
+    } else {
+        req_len = snprintf(req, sizeof(req),
+            "{\"chat_id\":%s,\"text\":\"%s\"}", cfg_telegram_chat_id, escaped);
+    }
 
     static char resp[256];
-    int rlen = tgApiCall("sendMessage", req, req_len, resp, sizeof(resp));
-    if (rlen < 0) {
-        Serial.printf("[TG] sendMessage failed\n");
-        return false;
+    int rlen = tgApiCall(method, req, req_len, resp, sizeof(resp));
+    const char *id = rlen < 0 ? nullptr : strstr(resp, "\"message_id\":");
+    return rlen < 0 ? -1 : (id ? atoi(id + 13) : 0);
+}
+
+/** Agent task: tgPostTextLocked() under tgLock. */
+static int tgPostText(const char *method, int messageId, const char *text) {
+    if (tgLock) xSemaphoreTake(tgLock, portMAX_DELAY);
+    int msgId = tgPostTextLocked(method, messageId, text);
+    if (tgLock) xSemaphoreGive(tgLock);
+    return msgId;
+}
+
+/* Outbox for messages from loop() (command and intent replies, rule
+ * alerts). loop() must not wait on tgLock or a TLS session, so it only
+ * queues; the agent task sends between chat steps, and loop() itself
+ * once the agent is idle. tgOutLock guards the ring and is never held
+ * across I/O. */
+#define TG_OUTBOX_LEN      4
+#define TG_OUTBOX_MSG_LEN  1024
+static char tgOutbox[TG_OUTBOX_LEN][TG_OUTBOX_MSG_LEN];
+static int  tgOutHead = 0;    /* oldest message, sent next */
+static int  tgOutCount = 0;
+static SemaphoreHandle_t tgOutLock = nullptr;
+
+/**
+ * loop(): queue a message to the allowed chat. Returns false if the
+ * outbox is full.
+ */
+bool tgSendMessage(const char *text) {
+    if (!tgOutLock) return false;
+    xSemaphoreTake(tgOutLock, portMAX_DELAY);
+    bool queued = tgOutCount < TG_OUTBOX_LEN;
+    if (queued) {
+        snprintf(tgOutbox[(tgOutHead + tgOutCount) % TG_OUTBOX_LEN],
+                 TG_OUTBOX_MSG_LEN, "%s", text);
+        tgOutCount++;
+    }
+    xSemaphoreGive(tgOutLock);
+    if (!queued) Serial.printf("[TG] Outbox full, message dropped\n");
+    return queued;
+}
+
+/**
+ * Send what the outbox holds. wait is how long to wait for tgLock: the
+ * agent task waits, loop() only sends when the lock is free and otherwise
+ * retries on its next pass. The slot being sent is not touched by
+ * tgSendMessage() until it is released here.
+ */
+static void tgOutboxFlush(TickType_t wait) {
+    if (tgOutCount == 0 || !tgLock) return;
+    if (xSemaphoreTake(tgLock, wait) != pdTRUE) return;
+    for (;;) {
+        xSemaphoreTake(tgOutLock, portMAX_DELAY);
+        int count = tgOutCount;
+        xSemaphoreGive(tgOutLock);
+        if (count == 0) break;
+
+        if (tgPostTextLocked("sendMessage", 0, tgOutbox[tgOutHead]) < 0) {
+            Serial.printf("[TG] sendMessage failed\n");
+        }
+        xSemaphoreTake(tgOutLock, portMAX_DELAY);
+        tgOutHead = (tgOutHead + 1) % TG_OUTBOX_LEN;
+        tgOutCount--;
+        xSemaphoreGive(tgOutLock);
     }
-    return true;
+    xSemaphoreGive(tgLock);
+}
+
+/* Streamed replies: a placeholder message is edited as text arrives.
+ * Each edit opens a second TLS session next to the LLM one, so edits are
+ * throttled and skipped while the heap is low; the final text always
+ * lands in one last edit. */
+#define TG_STREAM_EDIT_MS   2000
+#define TG_STREAM_MIN_HEAP  60000
+static struct {
+    int msgId;
+    char text[LLM_MAX_RESPONSE_LEN];
+    int len;
+    unsigned long lastEdit;
+} tgStream;
+
+static void tgStreamDelta(const char *text, int len, void *ctx) {
+    (void)ctx;
+    int room = (int)sizeof(tgStream.text) - 1 - tgStream.len;
+    if (len > room) len = room;
+    memcpy(tgStream.text + tgStream.len, text, len);
+    tgStream.len += len;
+    tgStream.text[tgStream.len] = '\0';
+
+    if (tgStream.msgId <= 0 || tgStream.len == 0) return;
+    if (millis() - tgStream.lastEdit < TG_STREAM_EDIT_MS) return;
+    if (ESP.getFreeHeap() < TG_STREAM_MIN_HEAP) return;
+    tgPostText("editMessageText", tgStream.msgId, tgStream.text);
+    tgStream.lastEdit = millis();
+}
+
+/**
+ * Act on one getUpdates reply: from the allowed chat, a slash command runs
+ * here and any other text is submitted as a chat.
+ */
+static void tgHandleUpdate(const char *resp) {
+    /* Quick check: is there a result with "update_id"? */
+    const char *uid_str = strstr(resp, "\"update_id\"");
+    if (!uid_str) return; /* No updates - normal */
+
+    /* Parse update_id */
+    const char *p = uid_str + 11;
+    while (*p == ':' || *p == ' ') p++;
+    int update_id = atoi(p);
+    if (g_debug) Serial.printf("[TG] update_id=%d (last=%d)\n", update_id, tgLastUpdateId);
+    if (update_id <= tgLastUpdateId) return;
+    tgLastUpdateId = update_id;
+
+    /* Extract chat_id from message.chat.id */
+    const char *chat_id_str = strstr(resp, "\"chat\"");
+    if (!chat_id_str) { if (g_debug) Serial.printf("[TG] no chat field\n"); return; }
+    const char *id_str = strstr(chat_id_str, "\"id\"");
+    if (!id_str) { if (g_debug) Serial.printf("[TG] no id in chat\n"); return; }
+    p = id_str + 4;
+    while (*p == ':' || *p == ' ') p++;
+    char incoming_chat_id[16];
+    int cw = 0;
+    while ((*p >= '0' && *p <= '9') || *p == '-') {
+        if (cw < (int)sizeof(incoming_chat_id) - 1)
+            incoming_chat_id[cw++] = *p;
+        p++;
+    }
+    incoming_chat_id[cw] = '\0';
+
+    if (g_debug) Serial.printf("[TG] chat_id=%s (allowed=%s)\n", incoming_chat_id, cfg_telegram_chat_id);
+
+    /* Security: only allow configured chat_id */
+    if (strcmp(incoming_chat_id, cfg_telegram_chat_id) != 0) {
+        Serial.printf("[TG] Rejected chat %s\n", incoming_chat_id);
+        return;
+    }
+
+    /* Extract message text - find "text":"..." */
+    const char *text_key = strstr(resp, "\"text\"");
+    if (!text_key) { if (g_debug) Serial.printf("[TG] no text field\n"); return; }
+    p = text_key + 6;
+    while (*p == ':' || *p == ' ') p++;
+    if (*p != '"') { if (g_debug) Serial.printf("[TG] text not a string\n"); return; }
+    p++;
+
+    static char msgBuf[512];
+    int mw = 0;
+    while (*p && *p != '"' && mw < (int)sizeof(msgBuf) - 1) {
+        if (*p == '\\' && *(p + 1)) {
+            p++;
+            if (*p == 'n') msgBuf[mw++] = '\n';
+            else msgBuf[mw++] = *p;
+        } else {
+            msgBuf[mw++] = *p;
+        }
+        p++;
+    }
+    msgBuf[mw] = '\0';
+
+    if (mw == 0) { if (g_debug) Serial.printf("[TG] empty text\n"); return; }
+
+    Serial.printf("\n[TG] Message from %s: %s\n", incoming_chat_id, msgBuf);
+
+    /* Slash command? Execute locally, no LLM call */
+    if (msgBuf[0] == '/') {
+        const char *cmd = msgBuf + 1;
+        /* Strip @botname suffix (Telegram sends "/status@MyBot" in groups) */
+        static char cmdCopy[64];
+        strncpy(cmdCopy, cmd, sizeof(cmdCopy) - 1);
+        cmdCopy[sizeof(cmdCopy) - 1] = '\0';
+        char *at = strchr(cmdCopy, '@');
+        if (at) *at = '\0';
+
+        if (handleCommand(cmdCopy, cmdResponseBuf, sizeof(cmdResponseBuf))) {
+            Serial.printf("[TG] cmd: /%s -> %s\n", cmdCopy, cmdResponseBuf);
+            tgSendMessage(cmdResponseBuf);
+        } else {
+            snprintf(cmdResponseBuf, sizeof(cmdResponseBuf),
+                     "Unknown command: /%s (try /help)", cmdCopy);
+            tgSendMessage(cmdResponseBuf);
+        }
+        Serial.printf("> ");
+        return;
+    }
+
+    /* Run chat - the agent task replies (tgChat) */
+    chatSubmit(AGENT_SRC_TELEGRAM, msgBuf, "");
 }
 
 /**
@@ -1435,113 +2650,164 @@ static void telegramTick() {
         if (total <= 0) return;
         if (g_debug) Serial.printf("[TG] poll: %.200s\n", resp);
 
-        /* Quick check: is there a result with "update_id"? */
-        const char *uid_str = strstr(resp, "\"update_id\"");
-        if (!uid_str) return; /* No updates - normal */
-
-        /* Parse update_id */
-        const char *p = uid_str + 11;
-        while (*p == ':' || *p == ' ') p++;
-        int update_id = atoi(p);
-        if (g_debug) Serial.printf("[TG] update_id=%d (last=%d)\n", update_id, tgLastUpdateId);
-        if (update_id <= tgLastUpdateId) return;
-        tgLastUpdateId = update_id;
-
-        /* Extract chat_id from message.chat.id */
-        const char *chat_id_str = strstr(resp, "\"chat\"");
-        if (!chat_id_str) { if (g_debug) Serial.printf("[TG] no chat field\n"); return; }
-        const char *id_str = strstr(chat_id_str, "\"id\"");
-        if (!id_str) { if (g_debug) Serial.printf("[TG] no id in chat\n"); return; }
-        p = id_str + 4;
-        while (*p == ':' || *p == ' ') p++;
-        char incoming_chat_id[16];
-        int cw = 0;
-        while ((*p >= '0' && *p <= '9') || *p == '-') {
-            if (cw < (int)sizeof(incoming_chat_id) - 1)
-                incoming_chat_id[cw++] = *p;
-            p++;
-        }
-        incoming_chat_id[cw] = '\0';
+        tgHandleUpdate(resp);
+        return;
+    }
+    }
+}
 
-        if (g_debug) Serial.printf("[TG] chat_id=%s (allowed=%s)\n", incoming_chat_id, cfg_telegram_chat_id);
+/** Release Telegram TLS connection if active, so LLM can use the heap. */
+static void tgYield() {
+    if (tgState != TG_IDLE) {
+        tgClient.stop();
+        tgState = TG_IDLE;
+        tgLastPoll = millis();
+    }
+}
 
-        /* Security: only allow configured chat_id */
-        if (strcmp(incoming_chat_id, cfg_telegram_chat_id) != 0) {
-            Serial.printf("[TG] Rejected chat %s\n", incoming_chat_id);
-            return;
-        }
+/** loop(): tgHandleUpdate() for an update the agent task fetched. */
+static void tgHandleUpdateInLoop(void *arg) {
+    tgHandleUpdate((const char *)arg);
+}
 
-        /* Extract message text - find "text":"..." */
-        const char *text_key = strstr(resp, "\"text\"");
-        if (!text_key) { if (g_debug) Serial.printf("[TG] no text field\n"); return; }
-        p = text_key + 6;
-        while (*p == ':' || *p == ' ') p++;
-        if (*p != '"') { if (g_debug) Serial.printf("[TG] text not a string\n"); return; }
-        p++;
+/**
+ * Agent task: poll while a chat runs, so Telegram messages queue, merge
+ * and get their priority like the other sources, and /stop gets through.
+ * No long poll: a short getUpdates at most every TG_BUSY_POLL_MS, and the
+ * update is handled in loop().
+ */
+static void tgBusyPoll() {
+    if (millis() - tgLastPoll < TG_BUSY_POLL_MS) return;
+
+    static char body[64];
+    int body_len = snprintf(body, sizeof(body),
+        "{\"offset\":%d,\"limit\":1,\"timeout\":0}", tgLastUpdateId + 1);
+    static char resp[2048];
+    xSemaphoreTake(tgLock, portMAX_DELAY);
+    int total = tgApiCall("getUpdates", body, body_len, resp, sizeof(resp));
+    xSemaphoreGive(tgLock);
+    tgLastPoll = millis();
+
+    if (total > 0) agentRunInLoop(tgHandleUpdateInLoop, resp);
+}
 
-        static char msgBuf[512];
-        int mw = 0;
-        while (*p && *p != '"' && mw < (int)sizeof(msgBuf) - 1) {
-            if (*p == '\\' && *(p + 1)) {
-                p++;
-                if (*p == 'n') msgBuf[mw++] = '\n';
-                else msgBuf[mw++] = *p;
-            } else {
-                msgBuf[mw++] = *p;
-            }
-            p++;
-        }
-        msgBuf[mw] = '\0';
+/**
+ * Agent task, between chat steps: send what loop() queued in the outbox
+ * and poll for updates, when there is heap for a second TLS session next
+ * to the LLM one. loop() makes no Telegram calls while the agent is busy.
+ */
+static void tgAgentTick() {
+    if (!g_telegram_enabled || ESP.getFreeHeap() < TG_STREAM_MIN_HEAP) return;
+    tgOutboxFlush(portMAX_DELAY);
+    tgBusyPoll();
+}
 
-        if (mw == 0) { if (g_debug) Serial.printf("[TG] empty text\n"); return; }
+/**
+ * Telegram chat, in the agent task. With streaming, the reply goes into a
+ * placeholder message that is edited as text arrives. While it runs,
+ * updates are polled by tgAgentTick() between steps.
+ */
+static const char *tgChat(const char *message) {
+    tgStream.msgId = 0;
+    tgStream.len = 0;
+    tgStream.text[0] = '\0';
+    tgStream.lastEdit = millis();
+    if (llm.streaming()) {
+        tgStream.msgId = tgPostText("sendMessage", 0, "...");
+    }
+    const char *response = chatWithLLM(message, tgStreamDelta, nullptr);
+    const char *text = response ? response : "[error: LLM call failed]";
+
+    if (tgStream.msgId > 0) {
+        if (tgPostText("editMessageText", tgStream.msgId, text) < 0) {
+            Serial.printf("[TG] editMessageText failed\n");
+        }
+    } else if (tgPostText("sendMessage", 0, text) < 0) {
+        Serial.printf("[TG] sendMessage failed\n");
+    }
+    return response;
+}
 
-        Serial.printf("\n[TG] Message from %s: %s\n", incoming_chat_id, msgBuf);
+/*============================================================================
+ * Agent Jobs
+ *============================================================================*/
 
-        /* Slash command? Execute locally, no LLM call */
-        if (msgBuf[0] == '/') {
-            const char *cmd = msgBuf + 1;
-            /* Strip @botname suffix (Telegram sends "/status@MyBot" in groups) */
-            static char cmdCopy[64];
-            strncpy(cmdCopy, cmd, sizeof(cmdCopy) - 1);
-            cmdCopy[sizeof(cmdCopy) - 1] = '\0';
-            char *at = strchr(cmdCopy, '@');
-            if (at) *at = '\0';
+/** Agent task: run one chat. */
+static const char *agentRun(const AgentJob *job) {
+    if (job->source == AGENT_SRC_TELEGRAM) return tgChat(job->message);
+    return chatWithLLM(job->message);
+}
 
-            if (handleCommand(cmdCopy, cmdResponseBuf, sizeof(cmdResponseBuf))) {
-                Serial.printf("[TG] cmd: /%s -> %s\n", cmdCopy, cmdResponseBuf);
-                tgSendMessage(cmdResponseBuf);
-            } else {
-                snprintf(cmdResponseBuf, sizeof(cmdResponseBuf),
-                         "Unknown command: /%s (try /help)", cmdCopy);
-                tgSendMessage(cmdResponseBuf);
-            }
-            Serial.printf("> ");
-            return;
+/** loop(): answer a NATS request. Telegram replies are sent by tgChat(). */
+static void chatReply(const AgentJob *job, const char *response) {
+    if (job->source == AGENT_SRC_NATS) {
+        if (job->replyTo[0] != '\0' && g_nats_connected) {
+            natsClient.publish(job->replyTo, response ? response : "[error]");
         }
+        if (response) natsPublishEvent(response);
+    }
+    Serial.printf("> ");
+}
 
-        /* Run chat */
-        const char *response = chatWithLLM(msgBuf);
+/** loop(): a chat finished in the agent task. */
+static void chatDone(const AgentJob *job, const char *response) {
+    chatStreamEnd();
+    if (chatHistoryReply) historyAdd(job->message, chatHistoryReply);
+    chatHistoryReply = nullptr;
+    planCacheLearn(job->message);
+    chatReply(job, response);
+    if (!agentBusy()) natsFleetSetBusy(false);
+}
 
-        /* Send response back to Telegram */
-        if (response) {
-            tgSendMessage(response);
-        } else {
-            tgSendMessage("[error: LLM call failed]");
-        }
+/** loop(): a queued chat that will not run (queue full, or /stop). */
+static void chatDropped(const AgentJob *job, const char *reason) {
+    if (job->source == AGENT_SRC_TELEGRAM) tgSendMessage(reason);
+    chatReply(job, reason);
+    if (!agentBusy()) natsFleetSetBusy(false);
+}
 
-        Serial.printf("> ");
+/**
+ * loop(): start a chat from any source. Simple device commands are handled
+ * right here; everything else is queued for the agent task.
+ */
+static void chatSubmit(AgentSource source, const char *message,
+                       const char *replyTo) {
+    static AgentJob job;
+    job.source = source;
+    strncpy(job.message, message, sizeof(job.message) - 1);
+    job.message[sizeof(job.message) - 1] = '\0';
+    strncpy(job.replyTo, replyTo, sizeof(job.replyTo) - 1);
+    job.replyTo[sizeof(job.replyTo) - 1] = '\0';
+
+    /* Fast path: simple device commands run locally, no LLM round trip.
+     * A running chat reads the history, so it is only updated when idle. */
+    static char intentReply[TOOL_RESULT_MAX_LEN];
+    if (intentHandle(message, intentReply, sizeof(intentReply))) {
+        Serial.printf("\n%s\n--- (local) ---\n\n", intentReply);
+        if (!agentBusy()) historyAdd(message, intentReply);
+        if (source == AGENT_SRC_TELEGRAM) tgSendMessage(intentReply);
+        chatReply(&job, intentReply);
         return;
     }
+
+    /* Requests the model has answered with the same tools before */
+    if (planCacheReplay(message, intentReply, sizeof(intentReply))) {
+        Serial.printf("\n%s\n--- (learned plan) ---\n\n", intentReply);
+        if (!agentBusy()) historyAdd(message, intentReply);
+        if (source == AGENT_SRC_TELEGRAM) tgSendMessage(intentReply);
+        chatReply(&job, intentReply);
+        return;
     }
-}
 
-/** Release Telegram TLS connection if active, so LLM can use the heap. */
-static void tgYield() {
-    if (tgState != TG_IDLE) {
-        tgClient.stop();
-        tgState = TG_IDLE;
-        tgLastPoll = millis();
+    tgYield(); /* Free Telegram TLS so LLM can allocate */
+    natsFleetSetBusy(true);
+    if (agentSubmit(&job)) {
+        if (agentQueued() > 0) Serial.printf("[Agent] Queued (%d waiting)\n", agentQueued());
+        return;
     }
+
+    Serial.printf("[Agent] Queue full, dropping: %s\n", message);
+    chatDropped(&job, "[error: busy]");
 }
 
 /*============================================================================
@@ -1555,9 +2821,11 @@ void handleSerialCommand(const char *input) {
         Serial.printf("WiFi SSID: %s\n", cfg_wifi_ssid);
         Serial.printf("API key:   %.8s...\n", cfg_api_key);
         Serial.printf("Model:     %s\n", cfg_model);
+        Serial.printf("Fast:      %s\n", cfg_model_fast[0] ? cfg_model_fast : "(none)");
         Serial.printf("Device:    %s\n", cfg_device_name);
         Serial.printf("NATS:      %s:%d (%s)\n", cfg_nats_host, cfg_nats_port,
                       g_nats_enabled ? "enabled" : "disabled");
+        Serial.printf("JetStream: %s\n", g_nats_js_enabled ? "enabled" : "disabled");
         Serial.printf("Telegram:  %s\n", g_telegram_enabled ? "enabled" : "disabled");
         Serial.printf("Prompt:    %d chars\n", (int)strlen(cfg_system_prompt));
         Serial.printf("> ");
@@ -1576,8 +2844,8 @@ void handleSerialCommand(const char *input) {
         }
         Serial.printf("--- history (%d turns) ---\n", historyCount);
         for (int i = 0; i < historyCount; i++) {
-            Serial.printf("[%d] User: %s\n", i + 1, history[i].user);
-            Serial.printf("[%d] Assistant: %s\n\n", i + 1, history[i].assistant);
+            Serial.printf("[%d] User: %s\n", i + 1, historyUser(i));
+            Serial.printf("[%d] Assistant: %s\n\n", i + 1, historyAssistant(i));
         }
         Serial.printf("---\n> ");
         return;
@@ -1599,9 +2867,7 @@ void handleSerialCommand(const char *input) {
     }
 
     /* Unknown command - treat as chat */
-    tgYield(); /* Free Telegram TLS so LLM can allocate */
-    chatWithLLM(input);
-    Serial.printf("> ");
+    chatSubmit(AGENT_SRC_SERIAL, input, "");
 }
 
 /*============================================================================
@@ -1635,6 +2901,7 @@ void setup() {
     /* Initialize device registry and rule engine */
     devicesInit();
     rulesInit();
+    planCacheInit();
 
     if (cfg_wifi_ssid[0] == '\0') {
         Serial.printf("\n[!] No WiFi config — starting setup portal\n");
@@ -1655,6 +2922,12 @@ void setup() {
 
     /* Init LLM client */
     llm.begin(cfg_api_key, cfg_model, cfg_api_base_url);
+    llmAddFallbacks();
+    llm.setStreaming(cfg_llm_stream);
+    llm.setPromptCache(cfg_llm_cache);
+    llm.setGzip(cfg_llm_gzip);
+    toolsSetPlanMode(cfg_plan_mode);
+    llm.setHedging(cfg_llm_hedge && llm.endpointCount() > 1);
 
     /* Watchdog - reconfigure to 60s (Arduino already inits WDT at 5s) */
     esp_task_wdt_config_t wdt_cfg = { .timeout_ms = 60000, .idle_core_mask = 0,
@@ -1662,10 +2935,18 @@ void setup() {
     esp_task_wdt_reconfigure(&wdt_cfg);
     esp_task_wdt_add(NULL); /* Add loop task */
 
+    /* Chats run in their own task so loop() keeps going during LLM calls */
+    agentBegin(agentRun, chatDone, chatStreamText, chatDropped);
+
     /* Connect NATS (optional) */
     if (cfg_nats_host[0] != '\0') {
         g_nats_enabled = true;
         buildNatsSubjects();
+        if (cfg_nats_jetstream) {
+            nats_js_init(&natsJs, natsClient.core(), nullptr);
+            nats_js_set_ack_callback(&natsJs, onNatsJsAck, nullptr);
+            g_nats_js_enabled = true;
+        }
         if (!connectNats()) {
             Serial.printf("NATS: will retry in background\n");
         }
@@ -1676,6 +2957,8 @@ void setup() {
     /* Telegram (optional) */
     if (cfg_telegram_token[0] != '\0' && cfg_telegram_chat_id[0] != '\0') {
         g_telegram_enabled = true;
+        tgLock = xSemaphoreCreateMutex();
+        tgOutLock = xSemaphoreCreateMutex();
         tgClient.setInsecure();
         tgClient.setTimeout(30); /* seconds - matches LLM client pattern */
         tgLastPoll = millis();   /* delay first poll by one interval */
@@ -1701,11 +2984,21 @@ void setup() {
 static unsigned long lastHeartbeat = 0;
 #define HEARTBEAT_INTERVAL_MS 3000
 
+static unsigned long loopLastMs = 0;
+
 void loop() {
     esp_task_wdt_reset(); /* Feed the watchdog */
 
-    /* LED heartbeat - brief dim green blink when idle */
-    if (!g_led_user) {
+    /* How long rules and NATS can wait while a chat runs */
+    unsigned long loopNow = millis();
+    if (agentBusy() && loopLastMs != 0 && loopNow - loopLastMs > loopMaxGapMs) {
+        loopMaxGapMs = loopNow - loopLastMs;
+    }
+    loopLastMs = loopNow;
+
+    /* LED heartbeat - brief dim green blink when idle (the agent shows
+     * its own status while busy) */
+    if (!g_led_user && !agentBusy()) {
         unsigned long now = millis();
         if (now - lastHeartbeat > HEARTBEAT_INTERVAL_MS) {
             lastHeartbeat = now;
@@ -1730,6 +3023,7 @@ void loop() {
     webConfigLoop();
 
     /* Process NATS */
+    natsWorkPending = false;
     if (g_nats_enabled) {
         if (natsClient.connected()) {
             nats_err_t err = natsClient.process();
@@ -1737,6 +3031,8 @@ void loop() {
                 if (g_debug) Serial.printf("NATS: process error: %s\n",
                                            nats_err_str(err));
             }
+            natsWorkPending = natsClient.workPending();
+            if (g_nats_js_enabled) nats_js_process(&natsJs);
         } else {
             /* Reconnect with backoff */
             unsigned long now = millis();
@@ -1747,8 +3043,18 @@ void loop() {
         }
     }
 
-    /* Poll Telegram */
-    if (g_telegram_enabled) {
+    /* Agent: run its tool calls, forward streamed text, deliver replies */
+    agentPoll();
+    chatStreamTick();
+    uploadTick();
+
+    /* Telegram - when idle, send the outbox and long poll. While the
+     * agent is busy, its task does both between chat steps. */
+    if (g_telegram_enabled && !agentBusy()) {
+        if (tgOutCount > 0) {
+            tgYield();
+            tgOutboxFlush(0);
+        }
         telegramTick();
     }
 
@@ -1804,9 +3110,7 @@ void loop() {
             if (input[0] == '/') {
                 handleSerialCommand(input);
             } else {
-                tgYield(); /* Free Telegram TLS so LLM can allocate */
-                chatWithLLM(input);
-                Serial.printf("> ");
+                chatSubmit(AGENT_SRC_SERIAL, input, "");
             }
             continue;
         }
@@ -1818,5 +3122,10 @@ void loop() {
         }
     }
 
-    delay(10); /* Yield */
+    /* Yield - unless NATS still has buffered messages to dispatch */
+    if (natsWorkPending) {
+        yield();
+    } else {
+        delay(10);
+    }
 }
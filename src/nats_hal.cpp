@@ -47,10 +47,19 @@ static int halPrefixLen() {
 
 static void halError(nats_client_t *client, const nats_msg_t *msg,
                      const char *error, const char *detail) {
-    snprintf(g_hal_reply, sizeof(g_hal_reply),
-             "{\"error\":\"%s\",\"detail\":\"%s\"}", error, detail);
-    if (msg->reply_len > 0)
-        nats_msg_respond_str(client, msg, g_hal_reply);
+    if (msg->reply_len == 0) return;
+
+    /* {"error":"%s","detail":"%s"} gathered without a copy */
+    static const char P_ERROR[]  = "{\"error\":\"";
+    static const char P_DETAIL[] = "\",\"detail\":\"";
+    nats_iovec_t iov[] = {
+        { P_ERROR, sizeof(P_ERROR) - 1 },
+        { error, strlen(error) },
+        { P_DETAIL, sizeof(P_DETAIL) - 1 },
+        { detail, strlen(detail) },
+        { "\"}", 2 },
+    };
+    nats_msg_respond_iov(client, msg, iov, sizeof(iov) / sizeof(iov[0]));
 }
 
 static int parsePin(const char *s) {
@@ -232,10 +241,8 @@ static void halUart(nats_client_t *client, const nats_msg_t *msg,
             halError(client, msg, "no_uart", "no serial_text device registered");
             return;
         }
-        const char *line = serialTextGetMsg();
-        snprintf(g_hal_reply, sizeof(g_hal_reply), "%s", line);
         if (msg->reply_len > 0)
-            nats_msg_respond_str(client, msg, g_hal_reply);
+            nats_msg_respond_str(client, msg, serialTextGetMsg());
     } else if (strcmp(rest, "write") == 0) {
         if (!serialTextActive()) {
             halError(client, msg, "no_uart", "no serial_text device registered");
@@ -0,0 +1,322 @@
+/**
+ * @file plan_cache.cpp
+ * @brief Learned tool plans for repeated requests
+ *
+ * A plan is only learned when every tool call was made in one iteration:
+ * the model picked them all before it saw a result, so for the same
+ * message and the same state it would pick them again. Calls that change
+ * devices, rules or files, or talk to another LLM, are never replayed.
+ * Asking the model twice before trusting a plan keeps out messages whose
+ * meaning depends on the conversation ("turn it off").
+ *
+ * The trace is written by the agent task and read by planCacheLearn()
+ * while the finished job is delivered; the table itself is only touched
+ * from loop().
+ */
+
+#include "plan_cache.h"
+#include "tools.h"
+#include "devices.h"
+#include "rules.h"
+#include <LittleFS.h>
+#include <ctype.h>
+
+extern bool g_debug;
+extern char cfg_model[64];
+extern char cfg_model_fast[64];
+extern char cfg_system_prompt[4096];
+
+#define PLAN_FILE       "/plans.bin"
+#define PLAN_FILE_MAGIC 0x314E4C50  /* "PLN1" */
+
+struct PlanEntry {
+    uint32_t key;       /* normalized message, 0 = free slot */
+    uint32_t state;     /* planStateHash() when the plan was made */
+    uint32_t plan;      /* hash of calls */
+    uint32_t used;      /* planClock at last use */
+    uint16_t len;       /* bytes in calls */
+    uint8_t  count;     /* tool calls */
+    uint8_t  seen;      /* times the model produced this plan */
+    char     calls[PLAN_CACHE_PLAN_LEN];
+};
+
+struct PlanFileHeader {
+    uint32_t magic;
+    uint16_t entrySize;
+    uint16_t count;
+};
+
+static PlanEntry planTable[PLAN_CACHE_ENTRIES];
+static uint32_t planClock = 0;
+static unsigned planHits = 0;
+static unsigned planMisses = 0;
+
+static struct {
+    bool     done;      /* planTraceEnd() ran, not yet learned */
+    bool     valid;
+    int      iter;      /* iteration of the calls, -1 = none yet */
+    uint32_t state;
+    uint8_t  count;
+    int      len;
+    char     calls[PLAN_CACHE_PLAN_LEN];
+} planTrace;
+
+/* Tools that only read, or set something to a given value */
+static const char *const PLAN_REPLAYABLE[] = {
+    "led_set", "gpio_write", "gpio_read", "device_info", "temperature_read",
+    "device_list", "sensor_read", "actuator_set", "rule_list", "rule_enable",
+    "nats_publish", "serial_send", nullptr
+};
+
+/*============================================================================
+ * Hashing
+ *============================================================================*/
+
+static uint32_t fnv1a(uint32_t hash, const void *data, size_t len) {
+    const uint8_t *p = (const uint8_t *)data;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= p[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static uint32_t fnv1aStr(uint32_t hash, const char *s) {
+    return fnv1a(hash, s, strlen(s) + 1);
+}
+
+/**
+ * Hash of the message with case, punctuation and repeated spaces ignored,
+ * so "Morning mode!" and "morning  mode" share a plan. Never 0.
+ */
+static uint32_t planKey(const char *msg) {
+    uint32_t hash = 2166136261u;
+    bool space = false, any = false;
+    for (; *msg; msg++) {
+        char c = tolower((unsigned char)*msg);
+        if (c == '\'') continue;
+        if (!isalnum((unsigned char)c)) {
+            space = any;
+            continue;
+        }
+        if (space) hash = fnv1a(hash, " ", 1);
+        hash = fnv1a(hash, &c, 1);
+        space = false;
+        any = true;
+    }
+    return hash ? hash : 1;
+}
+
+/** What the model saw when it chose the tools: models, prompt, devices, rules. */
+static uint32_t planStateHash() {
+    uint32_t hash = 2166136261u;
+    hash = fnv1aStr(hash, cfg_model);
+    hash = fnv1aStr(hash, cfg_model_fast);
+    hash = fnv1aStr(hash, cfg_system_prompt);
+
+    const Device *devs = deviceGetAll();
+    for (int i = 0; i < MAX_DEVICES; i++) {
+        if (!devs[i].used) continue;
+        hash = fnv1aStr(hash, devs[i].name);
+        hash = fnv1a(hash, &devs[i].kind, sizeof(devs[i].kind));
+        hash = fnv1a(hash, &devs[i].pin, sizeof(devs[i].pin));
+        hash = fnv1a(hash, &devs[i].inverted, sizeof(devs[i].inverted));
+    }
+
+    const Rule *rules = ruleGetAll();
+    for (int i = 0; i < MAX_RULES; i++) {
+        if (!rules[i].used) continue;
+        hash = fnv1aStr(hash, rules[i].id);
+        hash = fnv1aStr(hash, rules[i].name);
+        hash = fnv1a(hash, &rules[i].enabled, sizeof(rules[i].enabled));
+    }
+    return hash;
+}
+
+/*============================================================================
+ * Table
+ *============================================================================*/
+
+static PlanEntry *planFind(uint32_t key) {
+    for (int i = 0; i < PLAN_CACHE_ENTRIES; i++) {
+        if (planTable[i].key == key) return &planTable[i];
+    }
+    return nullptr;
+}
+
+/** A free slot, or the least recently used plan. */
+static PlanEntry *planVictim() {
+    PlanEntry *victim = &planTable[0];
+    for (int i = 0; i < PLAN_CACHE_ENTRIES; i++) {
+        if (planTable[i].key == 0) return &planTable[i];
+        if (planTable[i].used < victim->used) victim = &planTable[i];
+    }
+    return victim;
+}
+
+static void planSave() {
+    PlanFileHeader hdr = { PLAN_FILE_MAGIC, sizeof(PlanEntry), 0 };
+    for (int i = 0; i < PLAN_CACHE_ENTRIES; i++) {
+        if (planTable[i].key != 0) hdr.count++;
+    }
+
+    File f = LittleFS.open(PLAN_FILE, "w");
+    if (!f) return;
+    f.write((const uint8_t *)&hdr, sizeof(hdr));
+    for (int i = 0; i < PLAN_CACHE_ENTRIES; i++) {
+        if (planTable[i].key != 0)
+            f.write((const uint8_t *)&planTable[i], sizeof(PlanEntry));
+    }
+    f.close();
+}
+
+/** calls must hold exactly count "name\0args\0" pairs. */
+static bool planWellFormed(const PlanEntry *e) {
+    if (e->count == 0 || e->count > PLAN_CACHE_MAX_CALLS ||
+        e->len > PLAN_CACHE_PLAN_LEN) return false;
+    int strings = 0;
+    for (int i = 0; i < e->len; i++) {
+        if (e->calls[i] == '\0') strings++;
+    }
+    return strings == 2 * e->count && e->calls[e->len - 1] == '\0';
+}
+
+void planCacheInit() {
+    File f = LittleFS.open(PLAN_FILE, "r");
+    if (!f) return;
+
+    PlanFileHeader hdr;
+    int loaded = 0;
+    if (f.read((uint8_t *)&hdr, sizeof(hdr)) == sizeof(hdr) &&
+        hdr.magic == PLAN_FILE_MAGIC && hdr.entrySize == sizeof(PlanEntry)) {
+        for (int i = 0; i < hdr.count && loaded < PLAN_CACHE_ENTRIES; i++) {
+            PlanEntry *e = &planTable[loaded];
+            if (f.read((uint8_t *)e, sizeof(PlanEntry)) != sizeof(PlanEntry)) break;
+            if (e->key == 0 || !planWellFormed(e)) continue;
+            if (e->used > planClock) planClock = e->used;
+            loaded++;
+        }
+    }
+    f.close();
+    memset(&planTable[loaded], 0, (PLAN_CACHE_ENTRIES - loaded) * sizeof(PlanEntry));
+    Serial.printf("Plans: %d loaded\n", loaded);
+}
+
+/*============================================================================
+ * Replay
+ *============================================================================*/
+
+bool planCacheReplay(const char *msg, char *reply, int reply_len) {
+    PlanEntry *e = planFind(planKey(msg));
+    if (!e || e->seen < PLAN_CACHE_CONFIRM || e->state != planStateHash()) {
+        planMisses++;
+        return false;
+    }
+
+    static char result[TOOL_RESULT_MAX_LEN];
+    bool failed = false;
+    int w = 0;
+    reply[0] = '\0';
+    const char *p = e->calls;
+    for (int i = 0; i < e->count; i++) {
+        const char *name = p;
+        const char *args = name + strlen(name) + 1;
+        p = args + strlen(args) + 1;
+
+        if (g_debug) Serial.printf("[Plan] %s(%s)\n", name, args);
+        toolExecute(name, args, result, sizeof(result));
+        if (strncmp(result, "Error", 5) == 0) failed = true;
+        if (w < reply_len) {
+            w += snprintf(reply + w, reply_len - w, "%s%s", i > 0 ? "\n" : "", result);
+        }
+    }
+
+    planHits++;
+    e->used = ++planClock;
+    if (failed) {
+        /* Something changed that the state hash does not cover */
+        if (g_debug) Serial.printf("[Plan] replay failed, forgetting plan\n");
+        memset(e, 0, sizeof(*e));
+        planSave();
+    }
+    return true;
+}
+
+/*============================================================================
+ * Learning
+ *============================================================================*/
+
+void planTraceBegin() {
+    planTrace.done = false;
+    planTrace.valid = true;
+    planTrace.iter = -1;
+    planTrace.state = planStateHash();
+    planTrace.count = 0;
+    planTrace.len = 0;
+}
+
+void planTraceCall(int iter, const char *name, const char *args) {
+    if (strcmp(name, "tools_more") == 0) return; /* only widens the tool set */
+    if (!planTrace.valid) return;
+
+    bool replayable = false;
+    for (int i = 0; PLAN_REPLAYABLE[i]; i++) {
+        if (strcmp(name, PLAN_REPLAYABLE[i]) == 0) replayable = true;
+    }
+    int nameLen = strlen(name) + 1;
+    int argsLen = strlen(args) + 1;
+    if (!replayable || (planTrace.iter >= 0 && iter != planTrace.iter) ||
+        planTrace.count >= PLAN_CACHE_MAX_CALLS ||
+        planTrace.len + nameLen + argsLen > PLAN_CACHE_PLAN_LEN) {
+        planTrace.valid = false;
+        return;
+    }
+
+    planTrace.iter = iter;
+    memcpy(planTrace.calls + planTrace.len, name, nameLen);
+    memcpy(planTrace.calls + planTrace.len + nameLen, args, argsLen);
+    planTrace.len += nameLen + argsLen;
+    planTrace.count++;
+}
+
+void planTraceEnd(bool ok) {
+    planTrace.done = ok;
+}
+
+void planCacheLearn(const char *msg) {
+    if (!planTrace.done) return;
+    planTrace.done = false;
+    if (!planTrace.valid || planTrace.count == 0) return;
+
+    uint32_t key = planKey(msg);
+    uint32_t plan = fnv1a(2166136261u, planTrace.calls, planTrace.len);
+    PlanEntry *e = planFind(key);
+
+    if (e && e->state == planTrace.state && e->plan == plan) {
+        e->used = ++planClock;
+        if (e->seen >= PLAN_CACHE_CONFIRM) return;
+        e->seen++;
+    } else {
+        if (!e) e = planVictim();
+        e->key = key;
+        e->state = planTrace.state;
+        e->plan = plan;
+        e->used = ++planClock;
+        e->len = planTrace.len;
+        e->count = planTrace.count;
+        e->seen = 1;
+        memcpy(e->calls, planTrace.calls, planTrace.len);
+    }
+    if (g_debug) Serial.printf("[Plan] %d call(s) for \"%s\" seen %d/%d\n",
+                               e->count, msg, e->seen, PLAN_CACHE_CONFIRM);
+    planSave();
+}
+
+void planCacheStats(unsigned *hits, unsigned *misses, int *ready) {
+    *hits = planHits;
+    *misses = planMisses;
+    *ready = 0;
+    for (int i = 0; i < PLAN_CACHE_ENTRIES; i++) {
+        if (planTable[i].key != 0 && planTable[i].seen >= PLAN_CACHE_CONFIRM) (*ready)++;
+    }
+}
@@ -18,12 +18,14 @@ extern bool g_debug;
 extern bool g_telegram_enabled;
 extern int cfg_telegram_cooldown;
 extern bool tgSendMessage(const char *text);
+extern void natsPublishEventIov(const nats_iovec_t *iov, size_t iovcnt);
 
 /* NATS events subject - built from device name in main.cpp */
 extern char natsSubjectEvents[];
 
 static Rule g_rules[MAX_RULES];
 static int g_rule_counter = 0; /* auto-increment for IDs */
+static uint32_t g_rule_gen = 0;  /* bumped when rules are added, removed or toggled */
 
 /*============================================================================
  * Name helpers
@@ -83,6 +85,10 @@ const Rule *ruleGetAll() {
     return g_rules;
 }
 
+uint32_t ruleGeneration() {
+    return g_rule_gen;
+}
+
 Rule *ruleFind(const char *id) {
     for (int i = 0; i < MAX_RULES; i++) {
         if (g_rules[i].used && strcmp(g_rules[i].id, id) == 0)
@@ -183,6 +189,7 @@ const char *ruleCreate(const char *name, const char *sensor_name, uint8_t sensor
     r->last_reading = 0.0f;
     r->enabled = true;
     r->used = true;
+    g_rule_gen++;
 
     return r->id;
 }
@@ -193,12 +200,14 @@ bool ruleDelete(const char *id) {
             g_rules[i].used = false;
         }
         g_rule_counter = 0;
+        g_rule_gen++;
         return true;
     }
 
     Rule *r = ruleFind(id);
     if (!r) return false;
     r->used = false;
+    g_rule_gen++;
     return true;
 }
 
@@ -207,6 +216,7 @@ bool ruleEnable(const char *id, bool enable) {
     if (!r) return false;
     r->enabled = enable;
     r->fired = false; /* Reset triggered state when toggling */
+    g_rule_gen++;
     return true;
 }
 
@@ -358,11 +368,27 @@ static void publishRuleEvent(const Rule *r, bool is_on) {
     if (!g_nats_connected) return;
     if (natsSubjectEvents[0] == '\0') return;
 
-    static char eventBuf[192];
-    snprintf(eventBuf, sizeof(eventBuf),
-        "{\"event\":\"rule\",\"rule\":\"%s\",\"state\":\"%s\",\"reading\":%.1f,\"threshold\":%d}",
-        r->name, is_on ? "on" : "off", r->last_reading, (int)r->threshold);
-    natsClient.publish(natsSubjectEvents, eventBuf);
+    /* {"event":"rule","rule":"%s","state":"%s","reading":%.1f,"threshold":%d}
+     * gathered from constant segments - only the numbers are formatted */
+    static const char P_RULE[]   = "{\"event\":\"rule\",\"rule\":\"";
+    static const char P_ON[]     = "\",\"state\":\"on\",\"reading\":";
+    static const char P_OFF[]    = "\",\"state\":\"off\",\"reading\":";
+    static const char P_THRESH[] = ",\"threshold\":";
+    char reading[48]; /* fits any %.1f float */
+    char threshold[12];
+    int readingLen = snprintf(reading, sizeof(reading), "%.1f", r->last_reading);
+    int thresholdLen = snprintf(threshold, sizeof(threshold), "%d", (int)r->threshold);
+
+    nats_iovec_t iov[] = {
+        { P_RULE, sizeof(P_RULE) - 1 },
+        { r->name, strlen(r->name) },
+        { is_on ? P_ON : P_OFF, is_on ? sizeof(P_ON) - 1 : sizeof(P_OFF) - 1 },
+        { reading, (size_t)readingLen },
+        { P_THRESH, sizeof(P_THRESH) - 1 },
+        { threshold, (size_t)thresholdLen },
+        { "}", 1 },
+    };
+    natsPublishEventIov(iov, sizeof(iov) / sizeof(iov[0]));
 }
 
 /* Simple djb2 hash for text-aware COND_CHANGE */
@@ -771,6 +797,7 @@ void rulesInit() {
     memset(g_rules, 0, sizeof(g_rules));
     g_rule_counter = 0;
     rulesLoad();
+    g_rule_gen++;  /* after the table is complete */
 
     int count = 0;
     for (int i = 0; i < MAX_RULES; i++)
@@ -0,0 +1,191 @@
+/**
+ * @file state_snapshot.cpp
+ * @brief Compact device and rule state for the LLM prompt
+ *
+ * Uses the notation of device_list so the model reads both the same way,
+ * with rule ids included so a rule can be enabled or deleted without
+ * listing first. Values are only what the registry already holds (see
+ * deviceCachedValue()); building the snapshot never touches hardware. It
+ * runs in loop(), which owns the registries, before a chat starts. A
+ * sensor with no cached value is listed without one and the model reads
+ * it if it needs to.
+ */
+
+#include "state_snapshot.h"
+#include "devices.h"
+#include "rules.h"
+
+extern bool g_debug;
+
+#define SNAP_HEAD_LEN  64
+#define SNAP_VALUE_LEN 40
+#define SNAP_RULE_LEN  320
+
+/* Per device slot; an empty head is a free slot */
+static char snapHead[MAX_DEVICES][SNAP_HEAD_LEN];    /* "fan(relay pin5 inv)" */
+static char snapValue[MAX_DEVICES][SNAP_VALUE_LEN];  /* "=1", "=23.4C" */
+static char snapRules[SNAPSHOT_MAX_LEN - MAX_DEVICES * (SNAP_HEAD_LEN + SNAP_VALUE_LEN) - 128];
+static char snapText[SNAPSHOT_MAX_LEN];
+static bool snapBuilt = false;
+static uint32_t snapDeviceGen = 0;
+static uint32_t snapRuleGen = 0;
+
+/*============================================================================
+ * Devices
+ *============================================================================*/
+
+static void snapDeviceHead(const Device *d, char *out) {
+    if (d->kind == DEV_SENSOR_NATS_VALUE) {
+        snprintf(out, SNAP_HEAD_LEN, "%s(nats_value %s)", d->name, d->nats_subject);
+    } else if (d->kind == DEV_SENSOR_SERIAL_TEXT) {
+        snprintf(out, SNAP_HEAD_LEN, "%s(serial_text %ubaud)", d->name, (unsigned)d->baud);
+    } else if (d->pin == PIN_NONE) {
+        snprintf(out, SNAP_HEAD_LEN, "%s(%s)", d->name, deviceKindName(d->kind));
+    } else {
+        snprintf(out, SNAP_HEAD_LEN, "%s(%s pin%d%s)", d->name, deviceKindName(d->kind),
+                 d->pin, d->inverted ? " inv" : "");
+    }
+}
+
+static void snapDeviceValue(const Device *d, char *out) {
+    float val;
+    out[0] = '\0';
+    if (!deviceCachedValue(d, &val)) return;
+
+    if (d->kind == DEV_ACTUATOR_RGB_LED) {
+        snprintf(out, SNAP_VALUE_LEN, "=#%06X", (unsigned)d->last_value & 0xFFFFFF);
+    } else if (deviceIsActuator(d->kind)) {
+        snprintf(out, SNAP_VALUE_LEN, "=%d", d->last_value);
+    } else {
+        const char *msg = d->kind == DEV_SENSOR_SERIAL_TEXT ? serialTextGetMsg()
+                                                             : deviceGetNatsMsg(d);
+        if (msg[0])
+            snprintf(out, SNAP_VALUE_LEN, "=%.1f%s '%.16s'", val, d->unit, msg);
+        else
+            snprintf(out, SNAP_VALUE_LEN, "=%.1f%s", val, d->unit);
+    }
+}
+
+/*============================================================================
+ * Rules
+ *============================================================================*/
+
+static int snapAction(char *out, int len, ActionType act, const char *actuator,
+                      uint8_t pin, int32_t value, const char *subject) {
+    switch (act) {
+        case ACT_ACTUATOR:     return snprintf(out, len, "%s=%d", actuator, (int)value);
+        case ACT_GPIO_WRITE:   return snprintf(out, len, "gpio%d=%d", pin, (int)value);
+        case ACT_LED_SET:      return snprintf(out, len, "led #%06X", (unsigned)value & 0xFFFFFF);
+        case ACT_NATS_PUBLISH: return snprintf(out, len, "nats %s", subject);
+        default:               return snprintf(out, len, "%s", actionTypeName(act));
+    }
+}
+
+/** One rule: "rule_01 'hot' ON temp gt 28 -> fan=1, off fan=0". */
+static void snapRuleLine(const Rule *r, char *out, int len) {
+    int w = snprintf(out, len, "%s '%s' %s ", r->id, r->name, r->enabled ? "ON" : "OFF");
+
+    char sensor[DEV_NAME_LEN];
+    if (r->sensor_name[0])
+        snprintf(sensor, sizeof(sensor), "%s", r->sensor_name);
+    else
+        snprintf(sensor, sizeof(sensor), "pin%d", r->sensor_pin);
+
+    if (r->condition == COND_CHAINED)
+        w += snprintf(out + w, len - w, "chained");
+    else if (r->condition == COND_ALWAYS)
+        w += snprintf(out + w, len - w, "every %us", (unsigned)(r->interval_ms / 1000));
+    else if (r->condition == COND_CHANGE)
+        w += snprintf(out + w, len - w, "%s change", sensor);
+    else
+        w += snprintf(out + w, len - w, "%s %s %d", sensor,
+                      conditionOpName(r->condition), (int)r->threshold);
+
+    w += snprintf(out + w, len - w, " -> ");
+    w += snapAction(out + w, len - w, r->on_action, r->on_actuator,
+                    r->on_pin, r->on_value, r->on_nats_subj);
+    if (r->has_off_action) {
+        w += snprintf(out + w, len - w, ", off ");
+        w += snapAction(out + w, len - w, r->off_action, r->off_actuator,
+                        r->off_pin, r->off_value, r->off_nats_subj);
+    }
+    if (r->chain_id[0])
+        w += snprintf(out + w, len - w, ", then %s", r->chain_id);
+    if (r->chain_off_id[0])
+        snprintf(out + w, len - w, ", off then %s", r->chain_off_id);
+}
+
+static void snapRuleLines() {
+    const Rule *rules = ruleGetAll();
+    int w = 0;
+    snapRules[0] = '\0';
+
+    for (int i = 0; i < MAX_RULES; i++) {
+        if (!rules[i].used) continue;
+        char line[SNAP_RULE_LEN];
+        snapRuleLine(&rules[i], line, sizeof(line));
+        int n = strlen(line);
+        if (w + n + 3 > (int)sizeof(snapRules)) break;
+        w += snprintf(snapRules + w, sizeof(snapRules) - w, "%s%s", w > 0 ? "; " : "", line);
+    }
+}
+
+/*============================================================================
+ * Snapshot
+ *============================================================================*/
+
+const char *stateSnapshot() {
+    const Device *devs = deviceGetAll();
+    bool dirty = !snapBuilt;
+
+    uint32_t gen = deviceGeneration();
+    if (!snapBuilt || gen != snapDeviceGen) {
+        for (int i = 0; i < MAX_DEVICES; i++) {
+            snapHead[i][0] = '\0';
+            snapValue[i][0] = '\0';
+            if (devs[i].used) snapDeviceHead(&devs[i], snapHead[i]);
+        }
+        snapDeviceGen = gen;
+        dirty = true;
+    }
+
+    gen = ruleGeneration();
+    if (!snapBuilt || gen != snapRuleGen) {
+        snapRuleLines();
+        snapRuleGen = gen;
+        dirty = true;
+    }
+
+    /* Values move all the time; only a change in what is printed counts */
+    for (int i = 0; i < MAX_DEVICES; i++) {
+        if (!snapHead[i][0] || !devs[i].used) continue;
+        char value[SNAP_VALUE_LEN];
+        snapDeviceValue(&devs[i], value);
+        if (strcmp(value, snapValue[i]) != 0) {
+            memcpy(snapValue[i], value, sizeof(value));
+            dirty = true;
+        }
+    }
+
+    snapBuilt = true;
+    if (!dirty) return snapText;
+
+    /* Every device part fits: the buffer is larger than all of them */
+    int len = sizeof(snapText);
+    int w = snprintf(snapText, len,
+                     "Current state (cached values; no need to list devices or rules first):");
+    int header = w;
+    const char *sep = "\nDevices: ";
+    for (int i = 0; i < MAX_DEVICES; i++) {
+        if (!snapHead[i][0]) continue;
+        w += snprintf(snapText + w, len - w, "%s%s%s", sep, snapHead[i], snapValue[i]);
+        sep = "; ";
+    }
+    if (snapRules[0])
+        snprintf(snapText + w, len - w, "\nRules: %s", snapRules);
+    else if (w == header)
+        snapText[0] = '\0';
+
+    if (g_debug) Serial.printf("[State] snapshot rebuilt, %d bytes\n", (int)strlen(snapText));
+    return snapText;
+}
@@ -14,6 +14,7 @@
 #include <LittleFS.h>
 #include <nats_esp32.h>
 #include <esp_task_wdt.h>
+#include <ctype.h>
 #if !defined(CONFIG_IDF_TARGET_ESP32)
 #include "driver/temperature_sensor.h"
 #endif
@@ -87,30 +88,46 @@ static bool jsonArgExists(const char *json, const char *key) {
 
 /*============================================================================
  * Tool Definitions (OpenAI function calling format) - compacted
+ *
+ * One JSON object per tool, grouped into categories. A request carries only
+ * the categories picked for the current message (toolsSelect) plus the
+ * tools_more meta tool, which lets the model load the rest on demand.
  *============================================================================*/
 
-static const char *TOOLS_JSON = R"JSON([
-{"type":"function","function":{"name":"led_set","description":"Set RGB LED 0-255","parameters":{"type":"object","properties":{"r":{"type":"integer"},"g":{"type":"integer"},"b":{"type":"integer"}},"required":["r","g","b"]}}},
-{"type":"function","function":{"name":"gpio_write","description":"Set GPIO pin HIGH/LOW","parameters":{"type":"object","properties":{"pin":{"type":"integer"},"value":{"type":"integer"}},"required":["pin","value"]}}},
-{"type":"function","function":{"name":"gpio_read","description":"Read GPIO pin state","parameters":{"type":"object","properties":{"pin":{"type":"integer"}},"required":["pin"]}}},
-{"type":"function","function":{"name":"device_info","description":"Get heap, uptime, WiFi, chip info","parameters":{"type":"object","properties":{}}}},
-{"type":"function","function":{"name":"file_read","description":"Read file from filesystem","parameters":{"type":"object","properties":{"path":{"type":"string"}},"required":["path"]}}},
-{"type":"function","function":{"name":"file_write","description":"Write file to filesystem","parameters":{"type":"object","properties":{"path":{"type":"string"},"content":{"type":"string"}},"required":["path","content"]}}},
-{"type":"function","function":{"name":"nats_publish","description":"Publish NATS message","parameters":{"type":"object","properties":{"subject":{"type":"string"},"payload":{"type":"string"}},"required":["subject","payload"]}}},
-{"type":"function","function":{"name":"temperature_read","description":"Read chip temperature (C)","parameters":{"type":"object","properties":{}}}},
-{"type":"function","function":{"name":"device_register","description":"Register sensor/actuator","parameters":{"type":"object","properties":{"name":{"type":"string"},"type":{"type":"string","enum":["digital_in","analog_in","ntc_10k","ldr","nats_value","serial_text","digital_out","relay","pwm"],"description":"digital_in: GPIO digital read, analog_in: raw ADC reading, ntc_10k: NTC 10K thermistor (temp in C, set inverted=true if NTC is on the 3.3V side), ldr: light-dependent resistor (light level), nats_value: virtual sensor from NATS subject, serial_text: UART text input, digital_out: GPIO digital write, relay: relay on/off, pwm: PWM output"},"pin":{"type":"integer"},"unit":{"type":"string"},"inverted":{"type":"boolean"},"subject":{"type":"string","description":"NATS subject (for nats_value)"},"baud":{"type":"integer","description":"Baud rate for serial_text (default 9600)"}},"required":["name","type"]}}},
-{"type":"function","function":{"name":"device_list","description":"List registered devices","parameters":{"type":"object","properties":{}}}},
-{"type":"function","function":{"name":"device_remove","description":"Remove device by name","parameters":{"type":"object","properties":{"name":{"type":"string"}},"required":["name"]}}},
-{"type":"function","function":{"name":"sensor_read","description":"Read named sensor value","parameters":{"type":"object","properties":{"name":{"type":"string"}},"required":["name"]}}},
-{"type":"function","function":{"name":"actuator_set","description":"Set actuator value","parameters":{"type":"object","properties":{"name":{"type":"string"},"value":{"type":"integer"}},"required":["name","value"]}}},
-{"type":"function","function":{"name":"rule_create","description":"Create automation rule. Use chained condition for chain-only targets.","parameters":{"type":"object","properties":{"rule_name":{"type":"string"},"sensor_name":{"type":"string"},"sensor_pin":{"type":"integer"},"condition":{"type":"string","description":"gt|lt|eq|neq|change|always|chained"},"threshold":{"type":"integer"},"interval_seconds":{"type":"integer"},"actuator_name":{"type":"string"},"on_action":{"type":"string","description":"gpio_write|led_set|nats_publish|actuator|telegram|serial_send"},"on_pin":{"type":"integer"},"on_value":{"type":"integer"},"on_r":{"type":"integer"},"on_g":{"type":"integer"},"on_b":{"type":"integer"},"on_nats_subject":{"type":"string"},"on_nats_payload":{"type":"string"},"on_telegram_message":{"type":"string","description":"Use {value} or {device_name}"},"on_serial_text":{"type":"string","description":"Text to send via serial_text UART"},"off_action":{"type":"string","description":"auto|none|gpio_write|led_set|nats_publish|actuator|telegram|serial_send"},"off_pin":{"type":"integer"},"off_value":{"type":"integer"},"off_r":{"type":"integer"},"off_g":{"type":"integer"},"off_b":{"type":"integer"},"off_nats_subject":{"type":"string"},"off_nats_payload":{"type":"string"},"off_telegram_message":{"type":"string"},"off_serial_text":{"type":"string","description":"Text for serial off-action"},"chain_rule":{"type":"string","description":"Rule ID to trigger after ON action (e.g. rule_01)"},"chain_delay_seconds":{"type":"integer","description":"Delay before ON chain fires (0=immediate)"},"chain_off_rule":{"type":"string","description":"Rule ID to trigger after OFF action"},"chain_off_delay_seconds":{"type":"integer","description":"Delay before OFF chain fires (0=immediate)"}},"required":["rule_name"]}}},
-{"type":"function","function":{"name":"rule_list","description":"List all rules","parameters":{"type":"object","properties":{}}}},
-{"type":"function","function":{"name":"rule_delete","description":"Delete rule by ID (e.g. rule_01), or pass 'all' to delete every rule at once.","parameters":{"type":"object","properties":{"rule_id":{"type":"string","description":"Rule ID or 'all'"}},"required":["rule_id"]}}},
-{"type":"function","function":{"name":"rule_enable","description":"Enable/disable rule","parameters":{"type":"object","properties":{"rule_id":{"type":"string"},"enabled":{"type":"boolean"}},"required":["rule_id","enabled"]}}},
-{"type":"function","function":{"name":"serial_send","description":"Send text over serial_text UART","parameters":{"type":"object","properties":{"text":{"type":"string","description":"Text to send (newline appended)"}},"required":["text"]}}},
-{"type":"function","function":{"name":"remote_chat","description":"Chat with another WireClaw device via NATS","parameters":{"type":"object","properties":{"device":{"type":"string"},"message":{"type":"string"}},"required":["device","message"]}}},
-{"type":"function","function":{"name":"chain_create","description":"Create multi-step automation chain (up to 5 steps) in one call. Steps execute in order with delays.","parameters":{"type":"object","properties":{"sensor_name":{"type":"string","description":"Sensor to monitor"},"condition":{"type":"string","description":"gt|lt|eq|neq|change|always"},"threshold":{"type":"integer"},"interval_seconds":{"type":"integer"},"step1_action":{"type":"string","description":"telegram|led_set|gpio_write|nats_publish|actuator|serial_send"},"step1_message":{"type":"string","description":"For telegram/nats/serial_send"},"step1_r":{"type":"integer"},"step1_g":{"type":"integer"},"step1_b":{"type":"integer"},"step1_pin":{"type":"integer"},"step1_value":{"type":"integer"},"step1_actuator":{"type":"string"},"step1_nats_subject":{"type":"string"},"step2_action":{"type":"string","description":"Action after step1"},"step2_delay":{"type":"integer","description":"Seconds before step2"},"step2_message":{"type":"string"},"step2_r":{"type":"integer"},"step2_g":{"type":"integer"},"step2_b":{"type":"integer"},"step2_pin":{"type":"integer"},"step2_value":{"type":"integer"},"step2_actuator":{"type":"string"},"step2_nats_subject":{"type":"string"},"step3_action":{"type":"string","description":"Step3 (optional)"},"step3_delay":{"type":"integer","description":"Seconds before step3"},"step3_message":{"type":"string"},"step3_r":{"type":"integer"},"step3_g":{"type":"integer"},"step3_b":{"type":"integer"},"step3_pin":{"type":"integer"},"step3_value":{"type":"integer"},"step3_actuator":{"type":"string"},"step3_nats_subject":{"type":"string"},"step4_action":{"type":"string","description":"Step4 (optional)"},"step4_delay":{"type":"integer","description":"Seconds before step4"},"step4_message":{"type":"string"},"step4_r":{"type":"integer"},"step4_g":{"type":"integer"},"step4_b":{"type":"integer"},"step4_pin":{"type":"integer"},"step4_value":{"type":"integer"},"step4_actuator":{"type":"string"},"step4_nats_subject":{"type":"string"},"step5_action":{"type":"string","description":"Step5 (optional)"},"step5_delay":{"type":"integer","description":"Seconds before step5"},"step5_message":{"type":"string"},"step5_r":{"type":"integer"},"step5_g":{"type":"integer"},"step5_b":{"type":"integer"},"step5_pin":{"type":"integer"},"step5_value":{"type":"integer"},"step5_actuator":{"type":"string"},"step5_nats_subject":{"type":"string"}},"required":["sensor_name","condition","threshold","step1_action","step2_action"]}}}
-])JSON";
+struct ToolDef {
+    const char *name;
+    uint8_t     category;
+    const char *json;
+};
+
+static const ToolDef TOOL_DEFS[] = {
+{"led_set", TOOL_CAT_GPIO, R"JSON({"type":"function","function":{"name":"led_set","description":"Set RGB LED 0-255","parameters":{"type":"object","properties":{"r":{"type":"integer"},"g":{"type":"integer"},"b":{"type":"integer"}},"required":["r","g","b"]}}})JSON"},
+{"gpio_write", TOOL_CAT_GPIO, R"JSON({"type":"function","function":{"name":"gpio_write","description":"Set GPIO pin HIGH/LOW","parameters":{"type":"object","properties":{"pin":{"type":"integer"},"value":{"type":"integer"}},"required":["pin","value"]}}})JSON"},
+{"gpio_read", TOOL_CAT_GPIO, R"JSON({"type":"function","function":{"name":"gpio_read","description":"Read GPIO pin state","parameters":{"type":"object","properties":{"pin":{"type":"integer"}},"required":["pin"]}}})JSON"},
+{"device_info", TOOL_CAT_SYSTEM, R"JSON({"type":"function","function":{"name":"device_info","description":"Get heap, uptime, WiFi, chip info","parameters":{"type":"object","properties":{}}}})JSON"},
+{"file_read", TOOL_CAT_SYSTEM, R"JSON({"type":"function","function":{"name":"file_read","description":"Read file from filesystem","parameters":{"type":"object","properties":{"path":{"type":"string"}},"required":["path"]}}})JSON"},
+{"file_write", TOOL_CAT_SYSTEM, R"JSON({"type":"function","function":{"name":"file_write","description":"Write file to filesystem","parameters":{"type":"object","properties":{"path":{"type":"string"},"content":{"type":"string"}},"required":["path","content"]}}})JSON"},
+{"nats_publish", TOOL_CAT_COMMS, R"JSON({"type":"function","function":{"name":"nats_publish","description":"Publish NATS message","parameters":{"type":"object","properties":{"subject":{"type":"string"},"payload":{"type":"string"}},"required":["subject","payload"]}}})JSON"},
+{"temperature_read", TOOL_CAT_SYSTEM, R"JSON({"type":"function","function":{"name":"temperature_read","description":"Read chip temperature (C)","parameters":{"type":"object","properties":{}}}})JSON"},
+{"device_register", TOOL_CAT_DEVICES, R"JSON({"type":"function","function":{"name":"device_register","description":"Register sensor/actuator","parameters":{"type":"object","properties":{"name":{"type":"string"},"type":{"type":"string","enum":["digital_in","analog_in","ntc_10k","ldr","nats_value","serial_text","digital_out","relay","pwm"],"description":"digital_in: GPIO digital read, analog_in: raw ADC reading, ntc_10k: NTC 10K thermistor (temp in C, set inverted=true if NTC is on the 3.3V side), ldr: light-dependent resistor (light level), nats_value: virtual sensor from NATS subject, serial_text: UART text input, digital_out: GPIO digital write, relay: relay on/off, pwm: PWM output"},"pin":{"type":"integer"},"unit":{"type":"string"},"inverted":{"type":"boolean"},"subject":{"type":"string","description":"NATS subject (for nats_value)"},"baud":{"type":"integer","description":"Baud rate for serial_text (default 9600)"}},"required":["name","type"]}}})JSON"},
+{"device_list", TOOL_CAT_DEVICES, R"JSON({"type":"function","function":{"name":"device_list","description":"List registered devices","parameters":{"type":"object","properties":{}}}})JSON"},
+{"device_remove", TOOL_CAT_DEVICES, R"JSON({"type":"function","function":{"name":"device_remove","description":"Remove device by name","parameters":{"type":"object","properties":{"name":{"type":"string"}},"required":["name"]}}})JSON"},
+{"sensor_read", TOOL_CAT_DEVICES, R"JSON({"type":"function","function":{"name":"sensor_read","description":"Read named sensor value","parameters":{"type":"object","properties":{"name":{"type":"string"}},"required":["name"]}}})JSON"},
+{"actuator_set", TOOL_CAT_DEVICES, R"JSON({"type":"function","function":{"name":"actuator_set","description":"Set actuator value","parameters":{"type":"object","properties":{"name":{"type":"string"},"value":{"type":"integer"}},"required":["name","value"]}}})JSON"},
+{"rule_create", TOOL_CAT_RULES, R"JSON({"type":"function","function":{"name":"rule_create","description":"Create automation rule. Use chained condition for chain-only targets.","parameters":{"type":"object","properties":{"rule_name":{"type":"string"},"sensor_name":{"type":"string"},"sensor_pin":{"type":"integer"},"condition":{"type":"string","description":"gt|lt|eq|neq|change|always|chained"},"threshold":{"type":"integer"},"interval_seconds":{"type":"integer"},"actuator_name":{"type":"string"},"on_action":{"type":"string","description":"gpio_write|led_set|nats_publish|actuator|telegram|serial_send"},"on_pin":{"type":"integer"},"on_value":{"type":"integer"},"on_r":{"type":"integer"},"on_g":{"type":"integer"},"on_b":{"type":"integer"},"on_nats_subject":{"type":"string"},"on_nats_payload":{"type":"string"},"on_telegram_message":{"type":"string","description":"Use {value} or {device_name}"},"on_serial_text":{"type":"string","description":"Text to send via serial_text UART"},"off_action":{"type":"string","description":"auto|none|gpio_write|led_set|nats_publish|actuator|telegram|serial_send"},"off_pin":{"type":"integer"},"off_value":{"type":"integer"},"off_r":{"type":"integer"},"off_g":{"type":"integer"},"off_b":{"type":"integer"},"off_nats_subject":{"type":"string"},"off_nats_payload":{"type":"string"},"off_telegram_message":{"type":"string"},"off_serial_text":{"type":"string","description":"Text for serial off-action"},"chain_rule":{"type":"string","description":"Rule ID to trigger after ON action (e.g. rule_01)"},"chain_delay_seconds":{"type":"integer","description":"Delay before ON chain fires (0=immediate)"},"chain_off_rule":{"type":"string","description":"Rule ID to trigger after OFF action"},"chain_off_delay_seconds":{"type":"integer","description":"Delay before OFF chain fires (0=immediate)"}},"required":["rule_name"]}}})JSON"},
+{"rule_list", TOOL_CAT_RULES, R"JSON({"type":"function","function":{"name":"rule_list","description":"List all rules","parameters":{"type":"object","properties":{}}}})JSON"},
+{"rule_delete", TOOL_CAT_RULES, R"JSON({"type":"function","function":{"name":"rule_delete","description":"Delete rule by ID (e.g. rule_01), or pass 'all' to delete every rule at once.","parameters":{"type":"object","properties":{"rule_id":{"type":"string","description":"Rule ID or 'all'"}},"required":["rule_id"]}}})JSON"},
+{"rule_enable", TOOL_CAT_RULES, R"JSON({"type":"function","function":{"name":"rule_enable","description":"Enable/disable rule","parameters":{"type":"object","properties":{"rule_id":{"type":"string"},"enabled":{"type":"boolean"}},"required":["rule_id","enabled"]}}})JSON"},
+{"serial_send", TOOL_CAT_COMMS, R"JSON({"type":"function","function":{"name":"serial_send","description":"Send text over serial_text UART","parameters":{"type":"object","properties":{"text":{"type":"string","description":"Text to send (newline appended)"}},"required":["text"]}}})JSON"},
+{"remote_chat", TOOL_CAT_COMMS, R"JSON({"type":"function","function":{"name":"remote_chat","description":"Chat with another WireClaw device via NATS","parameters":{"type":"object","properties":{"device":{"type":"string"},"message":{"type":"string"}},"required":["device","message"]}}})JSON"},
+{"chain_create", TOOL_CAT_RULES, R"JSON({"type":"function","function":{"name":"chain_create","description":"Create multi-step automation chain (up to 5 steps) in one call. Steps execute in order with delays.","parameters":{"type":"object","properties":{"sensor_name":{"type":"string","description":"Sensor to monitor"},"condition":{"type":"string","description":"gt|lt|eq|neq|change|always"},"threshold":{"type":"integer"},"interval_seconds":{"type":"integer"},"step1_action":{"type":"string","description":"telegram|led_set|gpio_write|nats_publish|actuator|serial_send"},"step1_message":{"type":"string","description":"For telegram/nats/serial_send"},"step1_r":{"type":"integer"},"step1_g":{"type":"integer"},"step1_b":{"type":"integer"},"step1_pin":{"type":"integer"},"step1_value":{"type":"integer"},"step1_actuator":{"type":"string"},"step1_nats_subject":{"type":"string"},"step2_action":{"type":"string","description":"Action after step1"},"step2_delay":{"type":"integer","description":"Seconds before step2"},"step2_message":{"type":"string"},"step2_r":{"type":"integer"},"step2_g":{"type":"integer"},"step2_b":{"type":"integer"},"step2_pin":{"type":"integer"},"step2_value":{"type":"integer"},"step2_actuator":{"type":"string"},"step2_nats_subject":{"type":"string"},"step3_action":{"type":"string","description":"Step3 (optional)"},"step3_delay":{"type":"integer","description":"Seconds before step3"},"step3_message":{"type":"string"},"step3_r":{"type":"integer"},"step3_g":{"type":"integer"},"step3_b":{"type":"integer"},"step3_pin":{"type":"integer"},"step3_value":{"type":"integer"},"step3_actuator":{"type":"string"},"step3_nats_subject":{"type":"string"},"step4_action":{"type":"string","description":"Step4 (optional)"},"step4_delay":{"type":"integer","description":"Seconds before step4"},"step4_message":{"type":"string"},"step4_r":{"type":"integer"},"step4_g":{"type":"integer"},"step4_b":{"type":"integer"},"step4_pin":{"type":"integer"},"step4_value":{"type":"integer"},"step4_actuator":{"type":"string"},"step4_nats_subject":{"type":"string"},"step5_action":{"type":"string","description":"Step5 (optional)"},"step5_delay":{"type":"integer","description":"Seconds before step5"},"step5_message":{"type":"string"},"step5_r":{"type":"integer"},"step5_g":{"type":"integer"},"step5_b":{"type":"integer"},"step5_pin":{"type":"integer"},"step5_value":{"type":"integer"},"step5_actuator":{"type":"string"},"step5_nats_subject":{"type":"string"}},"required":["sensor_name","condition","threshold","step1_action","step2_action"]}}})JSON"},
+};
+#define TOOL_DEF_COUNT ((int)(sizeof(TOOL_DEFS) / sizeof(TOOL_DEFS[0])))
+
+static const char *TOOLS_MORE_JSON = R"JSON({"type":"function","function":{"name":"tools_more","description":"Load more tools when none of the current ones fit the task","parameters":{"type":"object","properties":{"category":{"type":"string","enum":["gpio","system","devices","rules","comms","all"],"description":"gpio: LED and pins, system: info/files/chip temp, devices: sensors and actuators, rules: automation rules and chains, comms: NATS/serial/other devices"}},"required":["category"]}}})JSON";
+
+/* Offered in plan mode only, whatever the categories */
+static const char *RUN_PLAN_JSON = R"JSON({"type":"function","function":{"name":"run_plan","description":"Run several tool calls at once, in order, stopping at the first error. Use it instead of separate calls whenever a request needs more than one tool. Each step is the tool name plus that tool's own arguments, e.g. {\"tool\":\"device_register\",\"name\":\"fan\",\"type\":\"relay\",\"pin\":5}","parameters":{"type":"object","properties":{"steps":{"type":"array","items":{"type":"object","properties":{"tool":{"type":"string"}},"required":["tool"]}},"reply":{"type":"string","description":"Reply for the user if every step succeeds. Omit it to see the results first."}},"required":["steps"]}}})JSON";
 
 /*============================================================================
  * Original Tool Handlers
@@ -862,16 +879,33 @@ static void tool_serial_send(const char *args, char *result, int result_len) {
  * Multi-Device Tool Handler
  *============================================================================*/
 
+/* The remote_chat in flight. loop() keeps processing NATS while it waits;
+ * the chat that made the call polls it through toolPoll(). */
+static nats_request_t toolRemoteReq;
+static bool toolRemotePending = false;
+static char toolRemoteDevice[32];
+
+/* Set while toolExecuteChat() runs: the call comes from a chat */
+static bool toolChatCall = false;
+
 static void tool_remote_chat(const char *args, char *result, int result_len) {
+    if (!toolChatCall) {
+        snprintf(result, result_len, "Error: remote_chat is only available in chats");
+        return;
+    }
+    if (toolRemotePending) {
+        snprintf(result, result_len, "Error: a remote_chat is already in progress");
+        return;
+    }
     if (!g_nats_connected) {
         snprintf(result, result_len, "Error: NATS not connected");
         return;
     }
 
-    char device[32];
+    char *device = toolRemoteDevice;
     char message[256];
 
-    if (!jsonArgString(args, "device", device, sizeof(device))) {
+    if (!jsonArgString(args, "device", device, sizeof(toolRemoteDevice))) {
         snprintf(result, result_len, "Error: missing 'device'");
         return;
     }
@@ -884,35 +918,15 @@ static void tool_remote_chat(const char *args, char *result, int result_len) {
     char subject[64];
     snprintf(subject, sizeof(subject), "%s.chat", device);
 
-    /* NATS request/reply with 30s timeout */
-    static nats_request_t req;
-
-    nats_err_t err = natsClient.requestStart(&req, subject, message, 30000);
+    /* NATS request/reply with 30s timeout; the reply arrives through
+     * loop()'s natsClient.process() and is picked up by toolPoll() */
+    nats_err_t err = natsClient.requestStart(&toolRemoteReq, subject, message, 30000);
     if (err != NATS_OK) {
         snprintf(result, result_len, "Error: request failed: %s", nats_err_str(err));
         return;
     }
-
-    /* Poll until complete or timeout */
-    while (true) {
-        esp_task_wdt_reset();
-        natsClient.process();
-        nats_err_t status = natsClient.requestCheck(&req);
-        if (status == NATS_OK) {
-            /* Got response - response_data is uint8_t[], response_len is size_t */
-            int copy_len = (int)req.response_len < result_len - 1
-                           ? (int)req.response_len : result_len - 1;
-            memcpy(result, req.response_data, copy_len);
-            result[copy_len] = '\0';
-            return;
-        }
-        if (status != NATS_ERR_WOULD_BLOCK) {
-            snprintf(result, result_len, "Error: %s (device '%s' may be offline)",
-                     nats_err_str(status), device);
-            return;
-        }
-        delay(50);
-    }
+    toolRemotePending = true;
+    result[0] = '\0';
 }
 
 /*============================================================================
@@ -1116,12 +1130,267 @@ static void tool_chain_create(const char *args, char *result, int result_len) {
     }
 }
 
+/*============================================================================
+ * Tool Selection
+ *============================================================================*/
+
+/* Keywords per category ('|'-separated), matched as substrings of the
+ * lowercased message. A false hit only costs a few definitions. */
+static const struct {
+    uint8_t category;
+    const char *words;
+} TOOL_KEYWORDS[] = {
+    { TOOL_CAT_GPIO,    "led|light|colo|red|green|blue|purple|white|yellow|blink|gpio|pin|"
+                        "high|low" },
+    { TOOL_CAT_SYSTEM,  "heap|memory|uptime|wifi|chip|file|temp|info|status|version|health" },
+    { TOOL_CAT_DEVICES, "sensor|device|actuator|relay|register|read|value|temp|humid|"
+                        "ntc|ldr|pwm|fan|pump|motor|switch|turn|level" },
+    { TOOL_CAT_RULES,   "rule|when|if |every|automat|chain|schedule|trigger|alert|"
+                        "notify|remind|threshold|above|below" },
+    { TOOL_CAT_COMMS,   "nats|publish|subject|serial|uart|send|remote|other device" },
+};
+
+static bool matchKeywords(const char *msg, const char *words) {
+    char word[16];
+    while (*words) {
+        const char *bar = strchr(words, '|');
+        int len = bar ? (int)(bar - words) : (int)strlen(words);
+        if (len > 0 && len < (int)sizeof(word)) {
+            memcpy(word, words, len);
+            word[len] = '\0';
+            if (strstr(msg, word)) return true;
+        }
+        words += bar ? len + 1 : len;
+    }
+    return false;
+}
+
+/* Categories stay selected for a few chats after one of their tools ran,
+ * so follow-ups like "and turn it off again" keep their tools */
+#define TOOL_RECENT_CHATS 3
+static const uint8_t TOOL_CAT_BITS[] = {
+    TOOL_CAT_GPIO, TOOL_CAT_SYSTEM, TOOL_CAT_DEVICES, TOOL_CAT_RULES, TOOL_CAT_COMMS
+};
+#define TOOL_CAT_COUNT ((int)sizeof(TOOL_CAT_BITS))
+static uint8_t toolRecent[TOOL_CAT_COUNT];
+
+static uint8_t toolActiveMask = TOOL_CAT_ALL;
+
+static void toolMarkUsed(const char *name) {
+    for (int i = 0; i < TOOL_DEF_COUNT; i++) {
+        if (strcmp(TOOL_DEFS[i].name, name) != 0) continue;
+        for (int c = 0; c < TOOL_CAT_COUNT; c++) {
+            if (TOOL_DEFS[i].category == TOOL_CAT_BITS[c])
+                toolRecent[c] = TOOL_RECENT_CHATS;
+        }
+        return;
+    }
+}
+
+static void tool_tools_more(const char *args, char *result, int result_len) {
+    char cat[16];
+    if (!jsonArgString(args, "category", cat, sizeof(cat))) strcpy(cat, "all");
+
+    static const char *const NAMES[] = { "gpio", "system", "devices", "rules", "comms" };
+    uint8_t add = 0;
+    for (int c = 0; c < TOOL_CAT_COUNT; c++) {
+        if (strcmp(cat, NAMES[c]) == 0) add = TOOL_CAT_BITS[c];
+    }
+    if (add == 0) add = TOOL_CAT_ALL;
+    toolActiveMask |= add;
+
+    int w = snprintf(result, result_len, "Loaded tools:");
+    for (int i = 0; i < TOOL_DEF_COUNT && w < result_len; i++) {
+        if (TOOL_DEFS[i].category & add)
+            w += snprintf(result + w, result_len - w, " %s", TOOL_DEFS[i].name);
+    }
+    if (w < result_len)
+        snprintf(result + w, result_len - w, ". Call the one you need now.");
+    if (g_debug) Serial.printf("[Tools] tools_more(%s) -> mask 0x%02x\n",
+                               cat, toolActiveMask);
+}
+
+/*============================================================================
+ * Plan Tool
+ *============================================================================*/
+
+#define PLAN_MAX_STEPS 8
+
+static bool toolPlanMode = false;
+
+/** Skip a JSON object or array starting at p; returns the char after it. */
+static const char *jsonSkipNested(const char *p) {
+    int depth = 0;
+    bool str = false;
+    for (; *p; p++) {
+        if (str) {
+            if (*p == '\\' && p[1]) p++;
+            else if (*p == '"') str = false;
+        } else if (*p == '"') {
+            str = true;
+        } else if (*p == '{' || *p == '[') {
+            depth++;
+        } else if (*p == '}' || *p == ']') {
+            if (--depth == 0) return p + 1;
+        }
+    }
+    return nullptr;
+}
+
+/**
+ * Run the steps of a plan in order. A step is {"tool":"name", ...args},
+ * or {"tool":"name","args":{...}}; it is passed to toolExecute() like a
+ * NATS tool_exec payload. The first failing step stops the plan, since
+ * later steps usually build on it (a rule on a device just registered).
+ */
+static void tool_run_plan(const char *args, char *result, int result_len) {
+    static char stepArgs[1024];
+    static char stepResult[TOOL_RESULT_MAX_LEN];
+
+    const char *p = strstr(args, "\"steps\"");
+    if (p) p = strchr(p, '[');
+    if (!p) {
+        snprintf(result, result_len, "Error: missing 'steps' array");
+        return;
+    }
+    p++;
+
+    /* Collect the step objects first, so a malformed plan runs nothing */
+    const char *steps[PLAN_MAX_STEPS];
+    int stepLen[PLAN_MAX_STEPS];
+    int count = 0;
+    for (;;) {
+        while (*p == ' ' || *p == ',' || *p == '\n' || *p == '\r' || *p == '\t') p++;
+        if (*p == ']') break;
+        const char *end = (*p == '{') ? jsonSkipNested(p) : nullptr;
+        if (!end) {
+            snprintf(result, result_len, "Error: steps must be objects");
+            return;
+        }
+        if (count == PLAN_MAX_STEPS) {
+            snprintf(result, result_len, "Error: more than %d steps", PLAN_MAX_STEPS);
+            return;
+        }
+        steps[count] = p;
+        stepLen[count] = end - p;
+        count++;
+        p = end;
+    }
+    if (count == 0) {
+        snprintf(result, result_len, "Error: no steps");
+        return;
+    }
+
+    static char lines[TOOL_RESULT_MAX_LEN];
+    int w = 0;
+    int failed = -1;
+    for (int i = 0; i < count && failed < 0; i++) {
+        char tool[24] = "";
+        if (stepLen[i] >= (int)sizeof(stepArgs)) {
+            snprintf(stepResult, sizeof(stepResult), "Error: step too long");
+            failed = i;
+        } else {
+            memcpy(stepArgs, steps[i], stepLen[i]);
+            stepArgs[stepLen[i]] = '\0';
+            if (!jsonArgString(stepArgs, "tool", tool, sizeof(tool))) {
+                snprintf(stepResult, sizeof(stepResult), "Error: step has no 'tool'");
+                failed = i;
+            } else if (strcmp(tool, "run_plan") == 0 || strcmp(tool, "remote_chat") == 0) {
+                snprintf(stepResult, sizeof(stepResult), "Error: %s cannot be a step", tool);
+                failed = i;
+            }
+        }
+
+        if (failed < 0) {
+            /* Nested "args" object, or the flat form */
+            char *a = strstr(stepArgs, "\"args\"");
+            if (a) a = strchr(a, '{');
+            const char *aEnd = a ? jsonSkipNested(a) : nullptr;
+            const char *callArgs = stepArgs;
+            if (aEnd) {
+                stepArgs[aEnd - stepArgs] = '\0';
+                callArgs = a;
+            }
+            if (g_debug) Serial.printf("[Tools] plan step %d: %s(%s)\n", i + 1, tool, callArgs);
+            if (!toolExecute(tool, callArgs, stepResult, sizeof(stepResult)) ||
+                strncmp(stepResult, "Error", 5) == 0)
+                failed = i;
+        }
+        if (w < (int)sizeof(lines))
+            w += snprintf(lines + w, sizeof(lines) - w, "\n%d. %s: %s", i + 1,
+                          tool[0] ? tool : "?", stepResult);
+    }
+
+    if (failed < 0) {
+        snprintf(result, result_len, "OK: %d step(s) done%s", count, lines);
+    } else {
+        snprintf(result, result_len, "Error: step %d failed, %d skipped%s",
+                 failed + 1, count - failed - 1, lines);
+    }
+}
+
 /*============================================================================
  * Public API
  *============================================================================*/
 
-const char *toolsGetDefinitions() {
-    return TOOLS_JSON;
+void toolsSetPlanMode(bool enabled) {
+    toolPlanMode = enabled;
+}
+
+uint8_t toolsSelect(const char *userMessage) {
+    static char msg[256];
+    int n = 0;
+    for (; userMessage[n] && n < (int)sizeof(msg) - 1; n++)
+        msg[n] = tolower((unsigned char)userMessage[n]);
+    msg[n] = '\0';
+
+    uint8_t mask = 0;
+    for (int k = 0; k < (int)(sizeof(TOOL_KEYWORDS) / sizeof(TOOL_KEYWORDS[0])); k++) {
+        if (matchKeywords(msg, TOOL_KEYWORDS[k].words))
+            mask |= TOOL_KEYWORDS[k].category;
+    }
+
+    /* A registered device mentioned by name needs the device tools */
+    if (!(mask & TOOL_CAT_DEVICES)) {
+        Device *devs = deviceGetAll();
+        char name[DEV_NAME_LEN];
+        for (int i = 0; i < MAX_DEVICES; i++) {
+            if (!devs[i].used || strlen(devs[i].name) < 3) continue;
+            int j = 0;
+            for (; devs[i].name[j] && j < (int)sizeof(name) - 1; j++)
+                name[j] = tolower((unsigned char)devs[i].name[j]);
+            name[j] = '\0';
+            if (strstr(msg, name)) {
+                mask |= TOOL_CAT_DEVICES;
+                break;
+            }
+        }
+    }
+
+    for (int c = 0; c < TOOL_CAT_COUNT; c++) {
+        if (toolRecent[c] > 0) {
+            mask |= TOOL_CAT_BITS[c];
+            toolRecent[c]--;
+        }
+    }
+
+    toolActiveMask = mask;
+    return mask;
+}
+
+int toolsGetDefinitions(const char **defs, int max) {
+    int n = 0;
+    for (int i = 0; i < TOOL_DEF_COUNT && n < max; i++) {
+        if (TOOL_DEFS[i].category & toolActiveMask) defs[n++] = TOOL_DEFS[i].json;
+    }
+    if ((toolActiveMask & TOOL_CAT_ALL) != TOOL_CAT_ALL && n < max)
+        defs[n++] = TOOLS_MORE_JSON;
+    if (toolPlanMode && n < max) defs[n++] = RUN_PLAN_JSON;
+    return n;
+}
+
+void toolsLimit(uint8_t mask) {
+    toolActiveMask &= mask;
 }
 
 bool toolExecute(const char *name, const char *args_json,
@@ -1168,9 +1437,52 @@ bool toolExecute(const char *name, const char *args_json,
         tool_remote_chat(args_json, result, result_len);
     } else if (strcmp(name, "chain_create") == 0) {
         tool_chain_create(args_json, result, result_len);
+    } else if (strcmp(name, "tools_more") == 0) {
+        tool_tools_more(args_json, result, result_len);
+    } else if (strcmp(name, "run_plan") == 0) {
+        tool_run_plan(args_json, result, result_len);
     } else {
         snprintf(result, result_len, "Error: unknown tool '%s'", name);
         return false;
     }
+    if (toolChatCall) toolMarkUsed(name);
+    return true;
+}
+
+bool toolExecuteChat(const char *name, const char *args_json,
+                     char *result, int result_len) {
+    toolChatCall = true;
+    bool found = toolExecute(name, args_json, result, result_len);
+    toolChatCall = false;
+    return found;
+}
+
+bool toolPending() {
+    return toolRemotePending;
+}
+
+bool toolPoll(char *result, int result_len) {
+    if (!toolRemotePending) return true;
+    nats_err_t status = natsClient.requestCheck(&toolRemoteReq);
+    if (status == NATS_ERR_WOULD_BLOCK) return false;
+
+    if (status == NATS_OK) {
+        int copy_len = (int)toolRemoteReq.response_len < result_len - 1
+                       ? (int)toolRemoteReq.response_len : result_len - 1;
+        memcpy(result, toolRemoteReq.response_data, copy_len);
+        result[copy_len] = '\0';
+    } else {
+        snprintf(result, result_len, "Error: %s (device '%s' may be offline)",
+                 nats_err_str(status), toolRemoteDevice);
+    }
+    toolRemotePending = false;
     return true;
 }
+
+void toolWait(char *result, int result_len) {
+    while (!toolPoll(result, result_len)) {
+        esp_task_wdt_reset();
+        natsClient.process();
+        delay(50);
+    }
+}
@@ -14,14 +14,25 @@
 #include "version.h"
 #include "rules.h"
 #include "devices.h"
+#include "agent.h"
 
 /* Externs from main.cpp */
 extern char cfg_wifi_ssid[64];
 extern char cfg_wifi_pass[64];
 extern char cfg_api_key[128];
 extern char cfg_model[64];
+extern char cfg_model_fast[64];
 extern char cfg_device_name[32];
 extern char cfg_api_base_url[128];
+extern bool cfg_llm_stream;
+extern bool cfg_llm_cache;
+extern bool cfg_llm_gzip;
+extern int  cfg_context_tokens;
+extern char cfg_llm_fallbacks[];
+extern char cfg_llm_fallback_key[];
+extern bool cfg_llm_hedge;
+extern bool cfg_plan_mode;
+extern bool cfg_state_snapshot;
 extern char cfg_nats_host[64];
 extern int  cfg_nats_port;
 extern char cfg_telegram_token[64];
@@ -29,6 +40,8 @@ extern char cfg_telegram_chat_id[16];
 extern char cfg_system_prompt[4096];
 extern char cfg_timezone[64];
 extern int  cfg_telegram_cooldown;
+extern bool cfg_nats_jetstream;
+extern char cfg_nats_fleet[32];
 extern bool g_nats_enabled;
 extern bool g_nats_connected;
 extern bool g_telegram_enabled;
@@ -115,9 +128,10 @@ static void maskSensitive(const char *src, char *dst, int dst_len) {
  *============================================================================*/
 
 static void handleGetConfig() {
-    static char buf[1024];
-    char masked_key[16], masked_pass[16], masked_tg[16];
+    static char buf[1536];
+    char masked_key[16], masked_pass[16], masked_tg[16], masked_fb_key[16];
     maskSensitive(cfg_api_key, masked_key, sizeof(masked_key));
+    maskSensitive(cfg_llm_fallback_key, masked_fb_key, sizeof(masked_fb_key));
     maskSensitive(cfg_wifi_pass, masked_pass, sizeof(masked_pass));
     maskSensitive(cfg_telegram_token, masked_tg, sizeof(masked_tg));
 
@@ -127,17 +141,36 @@ static void handleGetConfig() {
         "\"wifi_pass\":\"%s\","
         "\"api_key\":\"%s\","
         "\"model\":\"%s\","
+        "\"model_fast\":\"%s\","
         "\"device_name\":\"%s\","
         "\"api_base_url\":\"%s\","
+        "\"llm_stream\":\"%s\","
+        "\"llm_cache\":\"%s\","
+        "\"llm_gzip\":\"%s\","
+        "\"context_tokens\":\"%d\","
+        "\"llm_fallbacks\":\"%s\","
+        "\"llm_fallback_key\":\"%s\","
+        "\"llm_hedge\":\"%s\","
+        "\"plan_mode\":\"%s\","
+        "\"state_snapshot\":\"%s\","
         "\"nats_host\":\"%s\","
         "\"nats_port\":\"%d\","
+        "\"nats_jetstream\":\"%s\","
+        "\"nats_fleet\":\"%s\","
         "\"telegram_token\":\"%s\","
         "\"telegram_chat_id\":\"%s\","
         "\"telegram_cooldown\":\"%d\","
         "\"timezone\":\"%s\""
         "}",
-        cfg_wifi_ssid, masked_pass, masked_key, cfg_model,
-        cfg_device_name, cfg_api_base_url, cfg_nats_host, cfg_nats_port,
+        cfg_wifi_ssid, masked_pass, masked_key, cfg_model, cfg_model_fast,
+        cfg_device_name, cfg_api_base_url,
+        cfg_llm_stream ? "true" : "false",
+        cfg_llm_cache ? "true" : "false", cfg_llm_gzip ? "true" : "false",
+        cfg_context_tokens,
+        cfg_llm_fallbacks, masked_fb_key, cfg_llm_hedge ? "true" : "false",
+        cfg_plan_mode ? "true" : "false", cfg_state_snapshot ? "true" : "false",
+        cfg_nats_host, cfg_nats_port,
+        cfg_nats_jetstream ? "true" : "false", cfg_nats_fleet,
         masked_tg, cfg_telegram_chat_id, cfg_telegram_cooldown, cfg_timezone);
 
     server.send(200, "application/json", buf);
@@ -151,6 +184,17 @@ static bool isMasked(const char *val) {
     return false;
 }
 
+/* Keys persisted to /config.json. Keys not on the form (advanced options)
+ * are absent from the POST body and keep their existing value. */
+static const char *const CONFIG_KEYS[] = {
+    "wifi_ssid", "wifi_pass", "api_key", "model", "model_fast", "device_name",
+    "api_base_url", "llm_stream", "llm_cache", "llm_gzip", "context_tokens", "llm_fallbacks",
+    "llm_fallback_key", "llm_hedge", "plan_mode", "state_snapshot", "nats_host",
+    "nats_port", "nats_jetstream", "nats_fleet", "telegram_token", "telegram_chat_id",
+    "telegram_cooldown", "timezone"
+};
+#define CONFIG_KEY_COUNT ((int)(sizeof(CONFIG_KEYS) / sizeof(CONFIG_KEYS[0])))
+
 static void handlePostConfig() {
     if (!server.hasArg("plain")) {
         server.send(400, "application/json", "{\"error\":\"no body\"}");
@@ -160,7 +204,7 @@ static void handlePostConfig() {
     const String &body = server.arg("plain");
 
     /* Read existing config to preserve masked fields */
-    static char existing[1024];
+    static char existing[1536];
     int elen = wcReadFile("/config.json", existing, sizeof(existing));
     if (elen <= 0) existing[0] = '\0';
 
@@ -169,24 +213,19 @@ static void handlePostConfig() {
         const char *key;
         char val[128];
     };
-    static Field fields[12];
-    const char *keys[] = {
-        "wifi_ssid", "wifi_pass", "api_key", "model", "device_name",
-        "api_base_url", "nats_host", "nats_port", "telegram_token",
-        "telegram_chat_id", "telegram_cooldown", "timezone"
-    };
+    static Field fields[CONFIG_KEY_COUNT];
 
-    for (int i = 0; i < 12; i++) {
-        fields[i].key = keys[i];
+    for (int i = 0; i < CONFIG_KEY_COUNT; i++) {
+        fields[i].key = CONFIG_KEYS[i];
         fields[i].val[0] = '\0';
 
         char newVal[128] = {0};
-        bool hasNew = wcJsonGetString(body.c_str(), keys[i], newVal, sizeof(newVal));
+        bool hasNew = wcJsonGetString(body.c_str(), CONFIG_KEYS[i], newVal, sizeof(newVal));
 
         if (hasNew && !isMasked(newVal)) {
             strncpy(fields[i].val, newVal, sizeof(fields[i].val) - 1);
         } else if (existing[0]) {
-            wcJsonGetString(existing, keys[i], fields[i].val, sizeof(fields[i].val));
+            wcJsonGetString(existing, CONFIG_KEYS[i], fields[i].val, sizeof(fields[i].val));
         }
     }
 
@@ -198,10 +237,10 @@ static void handlePostConfig() {
     }
 
     f.print("{\n");
-    for (int i = 0; i < 12; i++) {
+    for (int i = 0; i < CONFIG_KEY_COUNT; i++) {
         f.print("  \""); f.print(fields[i].key); f.print("\": ");
         wcWriteJsonEscaped(f, fields[i].val);
-        if (i < 11) f.print(",");
+        if (i < CONFIG_KEY_COUNT - 1) f.print(",");
         f.print("\n");
     }
     f.print("}\n");
@@ -225,6 +264,11 @@ static void handlePostPrompt() {
         server.send(400, "text/plain", "too large");
         return;
     }
+    /* The running chat sends cfg_system_prompt from the agent task */
+    if (agentBusy()) {
+        server.send(409, "text/plain", "busy - try again when the current chat is done");
+        return;
+    }
 
     File f = LittleFS.open("/system_prompt.txt", "w");
     if (!f) {
@@ -661,6 +705,9 @@ nav button{padding:0.4rem 0.6rem;font-size:0.8rem}
 <input type="password" id="c_api_key">
 <label>Model</label>
 <input type="text" id="c_model">
+<label>Fast Model</label>
+<input type="text" id="c_model_fast" placeholder="optional">
+<p class="hint">Tried first for short requests; Model takes over when needed.</p>
 <label>Device Name</label>
 <input type="text" id="c_device_name">
 <label>API Base URL</label>
@@ -761,13 +808,13 @@ setTimeout(function(){t.className='toast'},2500);
 }
 function loadConfig(){
 fetch('/api/config').then(r=>r.json()).then(d=>{
-var f=['wifi_ssid','wifi_pass','api_key','model','device_name','api_base_url',
+var f=['wifi_ssid','wifi_pass','api_key','model','model_fast','device_name','api_base_url',
 'nats_host','nats_port','telegram_token','telegram_chat_id','telegram_cooldown','timezone'];
 f.forEach(k=>{var el=document.getElementById('c_'+k);if(el)el.value=d[k]||''});
 }).catch(e=>toast('Failed to load config',false));
 }
 function saveConfig(){
-var f=['wifi_ssid','wifi_pass','api_key','model','device_name','api_base_url',
+var f=['wifi_ssid','wifi_pass','api_key','model','model_fast','device_name','api_base_url',
 'nats_host','nats_port','telegram_token','telegram_chat_id','telegram_cooldown','timezone'];
 var d={};f.forEach(k=>{d[k]=document.getElementById('c_'+k).value});
 fetch('/api/config',{method:'POST',headers:{'Content-Type':'application/json'},
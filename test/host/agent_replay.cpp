@@ -0,0 +1,412 @@
+/**
+ * @file agent_replay.cpp
+ * @brief Replays recorded chats and counts their LLM calls
+ *
+ * A corpus (a text file in corpus/) holds multi-step requests: the user message,
+ * the devices and rules present before it, and the model's recorded
+ * answers. The mock server (mock_net.h) hands out one answer per request,
+ * in order. chat() below is chatWithLLM()'s loop, and the tool calls run
+ * for real through src/tools.cpp, the device registry and the rule
+ * engine, built on the host. A case fails if the chat wants more answers
+ * than were recorded or leaves some unused, if an answer calls a tool the
+ * request did not offer, or if a request lacks a tool result the answer
+ * expects.
+ *
+ * plan.txt has each request recorded twice: step by step, and with
+ * plan_mode on. snapshot.txt has them step by step only, and replays
+ * them again with the state snapshot in the request. Then the discovery
+ * calls the snapshot answers are dropped: device_list, rule_list, and
+ * sensor_read of a device it shows a value for. An answer left with no
+ * calls is dropped too. The report is the LLM calls each way took.
+ *
+ * Build and run (from test/host):
+ *   make agent_replay
+ *   ./agent_replay [-v] [corpus files...]   (default: both in corpus/)
+ */
+
+#include "mock_net.h"
+#include "llm_client.h"
+#include "tools.h"
+#include "devices.h"
+#include "rules.h"
+#include "state_snapshot.h"
+#include <LittleFS.h>
+#include <nats_esp32.h>
+#include "soc/soc_caps.h"
+#include "driver/temperature_sensor.h"
+#include <deque>
+#include <fstream>
+
+HostSerial Serial;
+HostESP ESP;
+WiFiClass WiFi;
+HostFS LittleFS;
+
+static int failures = 0;
+static int checks = 0;
+
+#define CHECK(cond, ...) do {                           \
+    checks++;                                           \
+    if (!(cond)) {                                      \
+        failures++;                                     \
+        printf("FAIL %s:%d: ", __FILE__, __LINE__);     \
+        printf(__VA_ARGS__);                            \
+        printf("\n");                                   \
+    }                                                   \
+} while (0)
+
+#define MAX_STEPS 5  /* MAX_AGENT_ITERATIONS in main.cpp */
+
+/*============================================================================
+ * What the tools need from main.cpp and the hardware
+ *============================================================================*/
+
+bool g_debug = false;
+bool g_led_user = false;
+bool g_nats_connected = false;
+bool g_nats_enabled = false;
+bool g_telegram_enabled = false;
+int cfg_telegram_cooldown = 60;
+char natsSubjectEvents[64] = "wireclaw.host.events";
+NatsClient natsClient;
+static int chipTempSensor;
+temperature_sensor_handle_t g_temp_sensor = &chipTempSensor;
+
+void led(uint8_t r, uint8_t g, uint8_t b) { (void)r; (void)g; (void)b; }
+void ledOff() {}
+bool tgSendMessage(const char *text) { (void)text; return false; }
+void natsPublishEventIov(const nats_iovec_t *iov, size_t iovcnt) { (void)iov; (void)iovcnt; }
+void natsSubscribeDeviceSensors() {}
+void natsUnsubscribeDevice(const char *name) { (void)name; }
+bool halIsReservedName(const char *name) { (void)name; return false; }
+extern "C" const char *nats_err_str(nats_err_t err) { (void)err; return "not connected"; }
+
+/* Pin levels: digital 0/1, analog in mV; set by "pin" lines */
+static int pinLevel[SOC_GPIO_PIN_COUNT];
+
+void pinMode(uint8_t pin, uint8_t mode) { (void)pin; (void)mode; }
+void digitalWrite(uint8_t pin, uint8_t val) { if (pin < SOC_GPIO_PIN_COUNT) pinLevel[pin] = val; }
+int digitalRead(uint8_t pin) { return pin < SOC_GPIO_PIN_COUNT ? pinLevel[pin] : 0; }
+int analogRead(uint8_t pin) { return pin < SOC_GPIO_PIN_COUNT ? pinLevel[pin] * 4095 / 3300 : 0; }
+uint32_t analogReadMilliVolts(uint8_t pin) { return pin < SOC_GPIO_PIN_COUNT ? pinLevel[pin] : 0; }
+void analogWrite(uint8_t pin, int value) { (void)pin; (void)value; }
+
+bool getLocalTime(struct tm *info, uint32_t ms) {
+    (void)ms;
+    memset(info, 0, sizeof(*info));
+    info->tm_hour = 14;
+    info->tm_min = 30;
+    return true;
+}
+
+int temperature_sensor_get_celsius(temperature_sensor_handle_t tsens, float *out) {
+    (void)tsens;
+    *out = 41.5f;
+    return 0;
+}
+
+/*============================================================================
+ * Corpus
+ *============================================================================*/
+
+struct Answer {
+    std::vector<MockCall> calls;
+    std::string text;                  /* a reply, when there are no calls */
+    std::vector<std::string> expect;   /* must be in the request */
+};
+
+struct Case {
+    std::string name;
+    std::string user;
+    std::vector<std::pair<int, int>> pins;
+    std::vector<MockCall> setup;
+    std::vector<Answer> loop;          /* step by step */
+    std::vector<Answer> plan;          /* with plan_mode */
+};
+
+/*
+ * One directive per line; '#' starts a comment:
+ *   case <name>             starts a case
+ *   user <message>
+ *   pin <n> <level>         input level before the chat
+ *   setup <tool> <json>     run before the chat
+ *   loop | plan             the answers that follow, step by step or in plan mode
+ *   answer                  the next recorded answer
+ *   call <tool> <json>      a tool call in it
+ *   say <text>              or its text
+ *   expect <text>           text its request must contain (a tool result)
+ */
+static bool loadCorpus(const char *path, std::vector<Case> *cases) {
+    std::ifstream in(path);
+    if (!in) {
+        printf("FAIL cannot open %s\n", path);
+        failures++;
+        return false;
+    }
+    std::vector<Answer> *answers = nullptr;
+    std::string line;
+    int n = 0;
+    while (std::getline(in, line)) {
+        n++;
+        size_t a = line.find_first_not_of(" \t");
+        if (a == std::string::npos || line[a] == '#') continue;
+        line = line.substr(a);
+        size_t sp = line.find(' ');
+        std::string key = line.substr(0, sp);
+        std::string rest = sp == std::string::npos ? "" : line.substr(sp + 1);
+        std::string arg1 = rest.substr(0, rest.find(' '));
+        std::string arg2 = rest.find(' ') == std::string::npos ? "" : rest.substr(rest.find(' ') + 1);
+
+        if (key == "case") {
+            cases->push_back(Case());
+            cases->back().name = rest;
+            answers = nullptr;
+            continue;
+        }
+        if (cases->empty()) {
+            printf("FAIL %s:%d: '%s' before the first case\n", path, n, key.c_str());
+            failures++;
+            return false;
+        }
+        Case &c = cases->back();
+        Answer *ans = answers && !answers->empty() ? &answers->back() : nullptr;
+        if (key == "user") {
+            c.user = rest;
+        } else if (key == "pin") {
+            c.pins.push_back({ atoi(arg1.c_str()), atoi(arg2.c_str()) });
+        } else if (key == "setup") {
+            c.setup.push_back({ arg1, arg2 });
+        } else if (key == "loop") {
+            answers = &c.loop;
+        } else if (key == "plan") {
+            answers = &c.plan;
+        } else if (key == "answer" && answers) {
+            answers->push_back(Answer());
+        } else if (key == "call" && ans) {
+            ans->calls.push_back({ arg1, arg2 });
+        } else if (key == "say" && ans) {
+            ans->text = rest;
+        } else if (key == "expect" && ans) {
+            ans->expect.push_back(rest);
+        } else {
+            printf("FAIL %s:%d: unexpected '%s'\n", path, n, key.c_str());
+            failures++;
+            return false;
+        }
+    }
+    return true;
+}
+
+/*============================================================================
+ * Replay
+ *============================================================================*/
+
+static MockServer server;
+static const Case *current;
+static const std::vector<Answer> *script;
+static size_t nextAnswer;
+
+static MockReply replay(const MockRequest &req) {
+    if (nextAnswer >= script->size()) return mockError(400, "no recorded answer left");
+    const Answer &a = (*script)[nextAnswer++];
+    for (const std::string &e : a.expect) {
+        CHECK(req.body.find(e) != std::string::npos, "%s: answer %zu expects [%s]",
+              current->name.c_str(), nextAnswer, e.c_str());
+    }
+    if (a.calls.empty()) return mockText(req, a.text);
+    for (const MockCall &call : a.calls) {
+        std::string offered = "\"name\":\"" + call.name + "\"";
+        CHECK(req.body.find(offered) != std::string::npos, "%s: answer %zu calls %s, not offered",
+              current->name.c_str(), nextAnswer, call.name.c_str());
+    }
+    return mockToolCalls(req, a.calls);
+}
+
+/* A string argument of a tool call, unescaped */
+static bool argString(const char *json, const char *key, std::string *out) {
+    std::string pat = std::string("\"") + key + "\":\"";
+    const char *p = strstr(json, pat.c_str());
+    if (!p) return false;
+    out->clear();
+    for (p += pat.size(); *p && *p != '"'; p++) {
+        if (*p == '\\' && p[1]) {
+            p++;
+            *out += *p == 'n' ? '\n' : *p;
+        } else {
+            *out += *p;
+        }
+    }
+    return true;
+}
+
+/* Fresh registries, then the case's pins and setup calls */
+static void prepare(const Case &c) {
+    LittleFS.files.clear();
+    memset(pinLevel, 0, sizeof(pinLevel));
+    for (const auto &p : c.pins) pinLevel[p.first] = p.second;
+    devicesInit();
+    rulesInit();
+    char res[TOOL_RESULT_MAX_LEN];
+    for (const MockCall &s : c.setup) {
+        bool ok = toolExecute(s.name.c_str(), s.arguments.c_str(), res, sizeof(res));
+        CHECK(ok && strncmp(res, "Error", 5) != 0, "%s: setup %s: %s", c.name.c_str(),
+              s.name.c_str(), res);
+    }
+    delay(300000);  /* due for a history sample */
+    sensorsPoll();
+}
+
+static LlmClient llm;
+static LlmResult result;
+
+/* chatWithLLM()'s loop, with the snapshot (if any) before the user message;
+ * returns the LLM calls made, -1 if the chat failed */
+static int chat(const Case &c, const std::vector<Answer> &answers, const char *state) {
+    current = &c;
+    script = &answers;
+    nextAnswer = 0;
+    int requests0 = server.requests;
+
+    std::deque<std::string> text;  /* keeps message strings alive */
+    LlmMessage msgs[3 + MAX_STEPS * (1 + LLM_MAX_TOOL_CALLS)];
+    int count = 0;
+    msgs[count++] = { LLM_MSG_NORMAL, "system", "You control a device.", nullptr, nullptr };
+    if (state && state[0]) msgs[count++] = { LLM_MSG_NORMAL, "system", state, nullptr, nullptr };
+    msgs[count++] = { LLM_MSG_NORMAL, "user", c.user.c_str(), nullptr, nullptr };
+    toolsSelect(c.user.c_str());
+
+    const char *defs[TOOL_MAX_DEFS];
+    char results[LLM_MAX_TOOL_CALLS][TOOL_RESULT_MAX_LEN];
+    bool done = false;
+    for (int iter = 0; iter < MAX_STEPS && !done; iter++) {
+        int defCount = toolsGetDefinitions(defs, TOOL_MAX_DEFS);
+        if (!llm.chat(msgs, count, defs, defCount, &result)) {
+            CHECK(false, "%s: %s", c.name.c_str(), llm.lastError());
+            return -1;
+        }
+        if (result.tool_call_count == 0) break;
+
+        text.push_back(result.tool_calls_json);
+        msgs[count++] = { LLM_MSG_TOOL_CALL, "assistant", nullptr, nullptr,
+                          text.back().c_str() };
+        for (int t = 0; t < result.tool_call_count; t++) {
+            const LlmToolCall *tc = &result.tool_calls[t];
+            toolExecuteChat(tc->name, tc->arguments, results[t], TOOL_RESULT_MAX_LEN);
+            if (g_debug) printf("  %s -> %s\n", tc->name, results[t]);
+            text.push_back(tc->id);
+            msgs[count++] = { LLM_MSG_TOOL_RESULT, "tool", results[t], text.back().c_str(),
+                              nullptr };
+        }
+
+        /* A plan that ran through with a reply needs no second request */
+        std::string reply;
+        done = result.tool_call_count == 1 &&
+               strcmp(result.tool_calls[0].name, "run_plan") == 0 &&
+               strncmp(results[0], "OK", 2) == 0 &&
+               argString(result.tool_calls[0].arguments, "reply", &reply);
+    }
+    CHECK(nextAnswer == answers.size(), "%s: %zu of %zu recorded answers used", c.name.c_str(),
+          nextAnswer, answers.size());
+    return server.requests - requests0;
+}
+
+/*============================================================================
+ * State snapshot
+ *============================================================================*/
+
+/* A discovery call whose answer is already in the snapshot */
+static bool inSnapshot(const MockCall &call, const char *state) {
+    if (call.name == "device_list" || call.name == "rule_list") return true;
+    if (call.name != "sensor_read") return false;
+
+    /* "name(kind pinN)=value": listed with a value */
+    std::string name;
+    if (!argString(call.arguments.c_str(), "name", &name)) return false;
+    std::string head = " " + name + "(";
+    const char *p = strstr(state, head.c_str());
+    if (!p) return false;
+    p = strchr(p, ')');
+    return p && p[1] == '=';
+}
+
+/* The recorded answers less what the snapshot answers */
+static std::vector<Answer> withSnapshot(const std::vector<Answer> &answers, const char *state) {
+    std::vector<Answer> kept;
+    for (const Answer &a : answers) {
+        Answer k = a;
+        k.calls.clear();
+        for (const MockCall &call : a.calls) {
+            if (!inSnapshot(call, state)) k.calls.push_back(call);
+        }
+        if (a.calls.empty() || !k.calls.empty()) kept.push_back(k);
+    }
+    return kept;
+}
+
+/*============================================================================
+ * Report
+ *============================================================================*/
+
+/* Each case step by step, then with plan_mode if it has a plan recorded,
+ * otherwise with the snapshot */
+static void replayCorpus(const char *path) {
+    std::vector<Case> cases;
+    if (!loadCorpus(path, &cases)) return;
+
+    int planCases = 0, planLoopCalls = 0, planCalls = 0;
+    int snapCases = 0, snapLoopCalls = 0, snapCalls = 0;
+    printf("%s:\n", path);
+    for (const Case &c : cases) {
+        prepare(c);
+        int loop = chat(c, c.loop, nullptr);
+        prepare(c);
+        int other;
+        if (!c.plan.empty()) {
+            toolsSetPlanMode(true);
+            other = chat(c, c.plan, nullptr);
+            toolsSetPlanMode(false);
+            planCases++;
+            planLoopCalls += loop;
+            planCalls += other;
+        } else {
+            const char *state = stateSnapshot();
+            other = chat(c, withSnapshot(c.loop, state), state);
+            snapCases++;
+            snapLoopCalls += loop;
+            snapCalls += other;
+        }
+        printf("  %-16s %d -> %d\n", c.name.c_str(), loop, other);
+    }
+    if (planCases)
+        printf("  %d requests: %d LLM calls step by step, %d with plan_mode\n", planCases,
+               planLoopCalls, planCalls);
+    if (snapCases)
+        printf("  %d requests: %d LLM calls without the snapshot, %d with it\n", snapCases,
+               snapLoopCalls, snapCalls);
+}
+
+int main(int argc, char **argv) {
+    int arg = 1;
+    if (arg < argc && strcmp(argv[arg], "-v") == 0) {
+        Serial.enabled = true;
+        g_debug = true;
+        arg++;
+    }
+
+    server.host = "a.test";
+    server.handler = replay;
+    mockNet.add(&server);
+    hostNet = &mockNet;
+    llm.begin("key", "model", "http://a.test/v1/chat/completions");
+    llm.setGzip(false);
+
+    if (arg == argc) {
+        replayCorpus("corpus/plan.txt");
+        replayCorpus("corpus/snapshot.txt");
+    } else {
+        for (; arg < argc; arg++) replayCorpus(argv[arg]);
+    }
+
+    printf("agent replay: %d/%d checks passed\n", checks - failures, checks);
+    return failures ? 1 : 0;
+}
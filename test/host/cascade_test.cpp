@@ -0,0 +1,307 @@
+/**
+ * @file cascade_test.cpp
+ * @brief Host test for the fast/main model cascade (src/cascade.cpp)
+ *
+ * One mock server (mock_net.h) emulates two models, told apart by the
+ * "model" field of each request: a quick, weak fast model and a slow,
+ * strong main model. chat() below runs the cascade the way chatWithLLM()
+ * does, through the real LlmClient, with tools answered from a table.
+ * Each case checks which model took each step, when the chat escalated,
+ * and the per-model request, time and token totals.
+ *
+ * Build and run (from test/host):
+ *   g++ -std=gnu++17 -Wall -Istubs -I../../include cascade_test.cpp \
+ *       ../../src/cascade.cpp ../../src/llm_client.cpp \
+ *       ../../src/gzip_inflate.cpp -o cascade_test
+ *   ./cascade_test [-v]
+ *
+ * Or: make -C test/host
+ */
+
+#include "mock_net.h"
+#include "cascade.h"
+#include <deque>
+
+HostSerial Serial;
+HostESP ESP;
+WiFiClass WiFi;
+bool g_debug = false;
+
+static int failures = 0;
+static int checks = 0;
+
+#define CHECK(cond, ...) do {                           \
+    checks++;                                           \
+    if (!(cond)) {                                      \
+        failures++;                                     \
+        printf("FAIL %s:%d: ", __FILE__, __LINE__);     \
+        printf(__VA_ARGS__);                            \
+        printf("\n");                                   \
+    }                                                   \
+} while (0)
+
+#define FAST_MODEL "fast-model"
+#define MAIN_MODEL "main-model"
+#define FAST_MS    300
+#define MAIN_MS    2500
+#define MAX_STEPS  5
+
+/*============================================================================
+ * Two models on one server
+ *============================================================================*/
+
+static MockServer server;
+static MockHandler fastModel;
+static MockHandler mainModel;
+static std::string models;  /* model of each request, "f" or "m" */
+
+static bool hasToolResult(const MockRequest &req) {
+    return req.body.find("\"role\":\"tool\"") != std::string::npos;
+}
+
+static MockReply route(const MockRequest &req) {
+    bool fast = req.model == FAST_MODEL;
+    models += fast ? "f" : "m";
+    MockReply r = fast ? fastModel(req) : mainModel(req);
+    r.delay_ms = fast ? FAST_MS : MAIN_MS;
+    return r;
+}
+
+/* The main model gets it right: a tool call, then a summary */
+static MockReply mainAnswers(const MockRequest &req) {
+    if (hasToolResult(req)) return mockText(req, "Main: done.", 900, 40);
+    if (req.body.find("relay") != std::string::npos)
+        return mockToolCalls(req, { { "actuator_set", "{\"name\":\"relay\",\"value\":1}" } },
+                             900, 30);
+    return mockText(req, "Main: a long and careful answer.", 900, 200);
+}
+
+/*============================================================================
+ * The chat loop, as in chatWithLLM()
+ *============================================================================*/
+
+static LlmClient llm;
+static LlmResult result;
+static const char *brokenTool = nullptr;  /* returns an error when called */
+
+struct Chat {
+    bool ok;
+    std::string reply;
+};
+
+static Chat chat(const char *message) {
+    std::deque<std::string> text;  /* keeps message strings alive */
+    LlmMessage msgs[2 + MAX_STEPS * (1 + LLM_MAX_TOOL_CALLS)];
+    int count = 0;
+    msgs[count++] = { LLM_MSG_NORMAL, "system", "You control a device.", nullptr, nullptr };
+    msgs[count++] = { LLM_MSG_NORMAL, "user", message, nullptr, nullptr };
+
+    bool fast = !cascadeLongForm(message);
+    for (int iter = 0; iter < MAX_STEPS; iter++) {
+        llm.setModel(fast ? FAST_MODEL : nullptr);
+        unsigned long t0 = millis();
+        bool ok = llm.chat(msgs, count, nullptr, 0, &result);
+        cascadeAccount(fast, ok, &result, millis() - t0);
+        if (fast && (!ok || cascadeUnsure(&result))) {
+            cascadeEscalate(ok ? "unsure reply" : llm.lastError(), MAIN_MODEL);
+            fast = false;
+            iter--;
+            continue;
+        }
+        if (!ok) return { false, llm.lastError() };
+        if (result.tool_call_count == 0) return { true, result.content };
+
+        text.push_back(result.tool_calls_json);
+        msgs[count++] = { LLM_MSG_TOOL_CALL, "assistant", nullptr, nullptr,
+                          text.back().c_str() };
+        bool toolError = false;
+        for (int t = 0; t < result.tool_call_count; t++) {
+            const LlmToolCall *tc = &result.tool_calls[t];
+            bool broken = brokenTool && strcmp(tc->name, brokenTool) == 0;
+            toolError |= broken;
+            text.push_back(broken ? "Error: device not found" : "OK");
+            const char *res = text.back().c_str();
+            text.push_back(tc->id);
+            msgs[count++] = { LLM_MSG_TOOL_RESULT, "tool", res, text.back().c_str(), nullptr };
+        }
+        if (fast && toolError) {
+            cascadeEscalate("tool error", MAIN_MODEL);
+            fast = false;
+        }
+    }
+    return { false, "too many steps" };
+}
+
+static void reset() {
+    models.clear();
+    brokenTool = nullptr;
+    mainModel = mainAnswers;
+}
+
+/*============================================================================
+ * Cases
+ *============================================================================*/
+
+/* A simple command stays on the fast model from tool call to reply */
+static void testFastOnly() {
+    reset();
+    fastModel = [](const MockRequest &req) {
+        if (hasToolResult(req)) return mockText(req, "Relay is on.", 300, 5);
+        return mockToolCalls(req, { { "actuator_set", "{\"name\":\"relay\",\"value\":1}" } },
+                             300, 15);
+    };
+    unsigned long esc = cascadeEscalations();
+    Chat c = chat("turn on the relay");
+    CHECK(c.ok && c.reply == "Relay is on.", "fast only: [%s]", c.reply.c_str());
+    CHECK(models == "ff", "fast only: models %s", models.c_str());
+    CHECK(cascadeEscalations() == esc, "fast only: escalated");
+}
+
+/* An unsure answer is thrown away and the step re-run on the main model */
+static void testUnsure() {
+    reset();
+    fastModel = [](const MockRequest &req) {
+        return mockText(req, "I'm not sure what you mean.", 300, 8);
+    };
+    unsigned long esc = cascadeEscalations();
+    Chat c = chat("is the greenhouse ok");
+    CHECK(c.ok && c.reply == "Main: a long and careful answer.", "unsure: [%s]",
+          c.reply.c_str());
+    CHECK(models == "fm", "unsure: models %s", models.c_str());
+    CHECK(cascadeEscalations() == esc + 1, "unsure: not counted");
+
+    /* So is an empty one */
+    reset();
+    fastModel = [](const MockRequest &req) { return mockText(req, "", 300, 0); };
+    c = chat("status");
+    CHECK(c.ok && models == "fm", "empty: models %s", models.c_str());
+}
+
+/* A failed fast request is retried on the main model */
+static void testFastFails() {
+    reset();
+    fastModel = [](const MockRequest &) { return mockError(500, "model overloaded"); };
+    Chat c = chat("toggle the relay");
+    CHECK(c.ok && c.reply == "Main: done.", "fast fails: [%s]", c.reply.c_str());
+    CHECK(models == "fmm", "fast fails: models %s", models.c_str());
+}
+
+/* A tool error hands the rest of the chat to the main model, which sees it */
+static void testToolError() {
+    reset();
+    brokenTool = "actuator_set";
+    fastModel = [](const MockRequest &req) {
+        if (hasToolResult(req)) return mockText(req, "Done!", 300, 5);
+        return mockToolCalls(req, { { "actuator_set", "{\"name\":\"relai\",\"value\":1}" } },
+                             300, 15);
+    };
+    mainModel = [](const MockRequest &req) {
+        bool sawError = req.body.find("Error: device not found") != std::string::npos;
+        return mockText(req, sawError ? "There is no device called relai." : "?", 900, 20);
+    };
+    Chat c = chat("turn on relai");
+    CHECK(c.ok && c.reply == "There is no device called relai.", "tool error: [%s]",
+          c.reply.c_str());
+    CHECK(models == "fm", "tool error: models %s", models.c_str());
+}
+
+/* Long-form questions start on the main model */
+static void testLongForm() {
+    reset();
+    fastModel = [](const MockRequest &req) { return mockText(req, "Fast.", 300, 5); };
+    chat("Explain how the rule engine decides when to fire");
+    CHECK(models == "m", "explain: models %s", models.c_str());
+
+    reset();
+    std::string longMsg(CASCADE_LONG_MSG + 1, 'x');
+    chat(longMsg.c_str());
+    CHECK(models == "m", "long: models %s", models.c_str());
+
+    reset();
+    chat("  why is the led red?");
+    CHECK(models == "m", "why: models %s", models.c_str());
+
+    CHECK(!cascadeLongForm("howdy, set the led blue"), "howdy is long-form");
+    CHECK(!cascadeLongForm("whyever not"), "whyever is long-form");
+}
+
+/* The fast model name goes to the main endpoint only; a fallback keeps its own */
+static void testFallbackModel() {
+    reset();
+    static MockServer backup;
+    backup.host = "b.test";
+    backup.handler = [](const MockRequest &req) { return mockText(req, "backup", 50, 5); };
+    mockNet.add(&backup);
+    llm.addEndpoint("http://b.test/v1/chat/completions", "backup-model", "key");
+    llm.disconnect();
+    server.down = true;
+    fastModel = [](const MockRequest &req) { return mockText(req, "Fast.", 300, 5); };
+
+    chat("ping");
+    CHECK(!backup.log.empty() && backup.log[0].model == "backup-model",
+          "fallback got model [%s]", backup.log.empty() ? "" : backup.log[0].model.c_str());
+    server.down = false;
+    llm.begin("key", MAIN_MODEL, "http://a.test/v1/chat/completions");
+    llm.setGzip(false);
+}
+
+/* Per-model totals: every request, its time and its tokens */
+static void testAccounting() {
+    const CascadeTier *f = cascadeTier(0);
+    const CascadeTier *m = cascadeTier(1);
+    CascadeTier f0 = *f, m0 = *m;
+
+    reset();
+    fastModel = [](const MockRequest &req) {
+        if (hasToolResult(req)) return mockText(req, "On.", 310, 4);
+        return mockToolCalls(req, { { "actuator_set", "{\"name\":\"relay\",\"value\":1}" } },
+                             300, 15);
+    };
+    chat("relay on");
+    CHECK(f->requests - f0.requests == 2 && m->requests == m0.requests,
+          "accounting: %lu fast, %lu main", f->requests - f0.requests,
+          m->requests - m0.requests);
+    CHECK(f->promptTokens - f0.promptTokens == 610 &&
+          f->completionTokens - f0.completionTokens == 19,
+          "accounting: fast tokens %lu+%lu", f->promptTokens - f0.promptTokens,
+          f->completionTokens - f0.completionTokens);
+    unsigned long per = (f->ms - f0.ms) / 2;
+    CHECK(per >= FAST_MS && per < FAST_MS + 100, "accounting: fast avg %lums", per);
+
+    f0 = *f;
+    m0 = *m;
+    reset();
+    fastModel = [](const MockRequest &) { return mockError(503, "busy"); };
+    chat("say hi");
+    CHECK(f->failures - f0.failures == 1 && f->promptTokens == f0.promptTokens,
+          "accounting: failed fast request");
+    per = m->ms - m0.ms;
+    CHECK(m->requests - m0.requests == 1 && per >= MAIN_MS && per < MAIN_MS + 100,
+          "accounting: main %lu req, %lums", m->requests - m0.requests, per);
+}
+
+int main(int argc, char **argv) {
+    if (argc > 1 && strcmp(argv[1], "-v") == 0) Serial.enabled = true;
+
+    server.host = "a.test";
+    server.handler = route;
+    mockNet.add(&server);
+    hostNet = &mockNet;
+    llm.begin("key", MAIN_MODEL, "http://a.test/v1/chat/completions");
+    llm.setGzip(false);
+
+    for (int stream = 0; stream < 2; stream++) {
+        llm.setStreaming(stream);
+        testFastOnly();
+        testUnsure();
+        testFastFails();
+        testToolError();
+        testLongForm();
+        testAccounting();
+    }
+    testFallbackModel();
+
+    printf("cascade: %d/%d checks passed, %lu escalations\n", checks - failures, checks,
+           cascadeEscalations());
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,387 @@
+/**
+ * @file gzip_test.cpp
+ * @brief Host test for the streaming gzip decompressor (src/gzip_inflate.cpp)
+ *
+ * Vectors are produced at run time by zlib: LLM-like JSON and SSE bodies,
+ * repetitive text and random bytes, at several levels and strategies,
+ * with optional header fields and sync flushes as a streaming server
+ * sends them. Each vector is fed in with fixed and random splits, down to
+ * one byte per call, through a 32 KB ring and through a plain buffer, and
+ * the output must match byte for byte. Also covered: ring wrap with a
+ * small window, the GZIP_FULL limit of a plain buffer, and truncated and
+ * corrupted input, which must never end in GZIP_DONE.
+ *
+ * Build and run (from the repo root; needs zlib):
+ *   g++ -std=gnu++17 -Wall -Iinclude test/host/gzip_test.cpp \
+ *       src/gzip_inflate.cpp -lz -o gzip_test
+ *   ./gzip_test [-v]
+ *
+ * Or: make -C test/host
+ */
+
+#include "gzip_inflate.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <zlib.h>
+
+typedef std::vector<uint8_t> Bytes;
+
+static bool verbose = false;
+static int failures = 0;
+static int checks = 0;
+
+#define CHECK(cond, ...) do {                           \
+    checks++;                                           \
+    if (!(cond)) {                                      \
+        failures++;                                     \
+        printf("FAIL %s:%d: ", __FILE__, __LINE__);     \
+        printf(__VA_ARGS__);                            \
+        printf("\n");                                   \
+    }                                                   \
+} while (0)
+
+static uint32_t rng = 12345;
+
+static uint32_t rnd() {
+    rng ^= rng << 13;
+    rng ^= rng >> 17;
+    rng ^= rng << 5;
+    return rng;
+}
+
+/*============================================================================
+ * Inputs
+ *============================================================================*/
+
+static Bytes bytesOf(const std::string &s) {
+    return Bytes(s.begin(), s.end());
+}
+
+static Bytes jsonReply() {
+    std::string s = "{\"id\":\"gen-1\",\"object\":\"chat.completion\",\"model\":\"openai/gpt-4o-mini\","
+                    "\"choices\":[{\"index\":0,\"message\":{\"role\":\"assistant\",\"content\":null,"
+                    "\"tool_calls\":[";
+    for (int i = 0; i < 4; i++) {
+        char call[200];
+        snprintf(call, sizeof(call),
+                 "%s{\"id\":\"call_%d\",\"type\":\"function\",\"function\":{\"name\":"
+                 "\"actuator_set\",\"arguments\":\"{\\\"name\\\":\\\"fan%d\\\",\\\"value\\\":%d}\"}}",
+                 i ? "," : "", i, i, i * 40);
+        s += call;
+    }
+    s += "]},\"finish_reason\":\"tool_calls\"}],"
+         "\"usage\":{\"prompt_tokens\":1234,\"completion_tokens\":56,\"total_tokens\":1290}}";
+    return bytesOf(s);
+}
+
+static Bytes sseStream(int events) {
+    std::string s;
+    for (int i = 0; i < events; i++) {
+        char ev[200];
+        snprintf(ev, sizeof(ev),
+                 "data: {\"id\":\"gen-1\",\"object\":\"chat.completion.chunk\",\"choices\":"
+                 "[{\"index\":0,\"delta\":{\"content\":\"word%d \"}}]}\n\n", i);
+        s += ev;
+    }
+    s += "data: [DONE]\n\n";
+    return bytesOf(s);
+}
+
+static Bytes wordText(int words) {
+    static const char *const WORDS[] = { "relay", "sensor", "rule", "the", "temperature", "fan" };
+    std::string s;
+    for (int i = 0; i < words; i++) {
+        if (i) s += ' ';
+        s += WORDS[rnd() % 6];
+    }
+    return bytesOf(s);
+}
+
+static Bytes randomBytes(int n) {
+    Bytes b(n);
+    for (int i = 0; i < n; i++) b[i] = (uint8_t)rnd();
+    return b;
+}
+
+/*============================================================================
+ * zlib vectors
+ *============================================================================*/
+
+struct GzOptions {
+    int level;
+    int strategy;
+    int window_bits;   /* 9..15 */
+    bool header;       /* FEXTRA, FNAME, FCOMMENT and FHCRC */
+    int flush_every;   /* Z_SYNC_FLUSH after this many input bytes, 0 = never */
+};
+
+static Bytes gzipWith(const Bytes &data, const GzOptions &o) {
+    z_stream s;
+    memset(&s, 0, sizeof(s));
+    deflateInit2(&s, o.level, Z_DEFLATED, 16 + o.window_bits, 8, o.strategy);
+
+    gz_header h;
+    static unsigned char extra[] = "ab\x02\x00xy";
+    if (o.header) {
+        memset(&h, 0, sizeof(h));
+        h.extra = extra;
+        h.extra_len = 6;
+        h.name = (Bytef *)"reply.json";
+        h.comment = (Bytef *)"test";
+        h.hcrc = 1;
+        deflateSetHeader(&s, &h);
+    }
+
+    Bytes out(deflateBound(&s, data.size()) + 64 + data.size() / 8);
+    s.next_out = out.data();
+    s.avail_out = out.size();
+    size_t pos = 0;
+    int step = o.flush_every ? o.flush_every : (int)data.size();
+    do {
+        size_t n = data.size() - pos < (size_t)step ? data.size() - pos : step;
+        s.next_in = (Bytef *)data.data() + pos;
+        s.avail_in = n;
+        pos += n;
+        deflate(&s, pos == data.size() ? Z_FINISH : Z_SYNC_FLUSH);
+    } while (pos < data.size());
+    if (data.empty()) deflate(&s, Z_FINISH);
+
+    out.resize(s.total_out);
+    deflateEnd(&s);
+    return out;
+}
+
+/*============================================================================
+ * Decoding
+ *============================================================================*/
+
+static uint8_t ringWindow[GZIP_WINDOW_LEN];
+
+/**
+ * Feed in through a ring the way readStream() does, in pieces of split
+ * bytes (0 = random 1..600). Returns the final status; output in *out.
+ */
+static GzipStatus inflateRing(const Bytes &in, int split, uint32_t ring_len, Bytes *out) {
+    GzipInflater z;
+    gzipInit(&z, ringWindow, ring_len, true);
+    out->clear();
+    size_t p = 0;
+    while (p < in.size() && z.status == GZIP_MORE) {
+        int n = split ? split : 1 + (int)(rnd() % 600);
+        if ((size_t)n > in.size() - p) n = in.size() - p;
+        const uint8_t *ip = &in[p];
+        p += n;
+        while (n > 0 && z.status == GZIP_MORE) {
+            int used;
+            const uint8_t *o;
+            int got = gzipInflate(&z, ip, n, &used, &o);
+            out->insert(out->end(), o, o + got);
+            ip += used;
+            n -= used;
+        }
+    }
+    return z.status;
+}
+
+/** Feed in to a plain buffer of buf_len bytes, the way readResponse() does. */
+static GzipStatus inflatePlain(const Bytes &in, int split, uint32_t buf_len, Bytes *out) {
+    Bytes buf(buf_len ? buf_len : 1);
+    GzipInflater z;
+    gzipInit(&z, buf.data(), buf_len, false);
+    size_t p = 0;
+    int total = 0;
+    while (p < in.size() && z.status == GZIP_MORE) {
+        int n = split ? split : 1 + (int)(rnd() % 600);
+        if ((size_t)n > in.size() - p) n = in.size() - p;
+        int used;
+        const uint8_t *o;
+        int got = gzipInflate(&z, &in[p], n, &used, &o);
+        CHECK(o == buf.data() + total, "plain output is not contiguous");
+        total += got;
+        p += n;
+    }
+    out->assign(buf.begin(), buf.begin() + total);
+    return z.status;
+}
+
+/*============================================================================
+ * Tests
+ *============================================================================*/
+
+static void roundTrip(const char *name, const Bytes &data, const GzOptions &o) {
+    Bytes gz = gzipWith(data, o);
+    static const int SPLITS[] = { 1, 2, 3, 7, 64, 511, 1 << 30, 0, 0 };
+    for (int split : SPLITS) {
+        Bytes out;
+        GzipStatus st = inflateRing(gz, split, GZIP_WINDOW_LEN, &out);
+        CHECK(st == GZIP_DONE && out == data,
+              "%s ring split %d: status %d, %zu of %zu bytes", name, split, st,
+              out.size(), data.size());
+
+        st = inflatePlain(gz, split, data.size(), &out);
+        CHECK(st == GZIP_DONE && out == data,
+              "%s plain split %d: status %d, %zu of %zu bytes", name, split, st,
+              out.size(), data.size());
+    }
+    if (verbose)
+        printf("ok   %-22s %7zu -> %6zu bytes\n", name, data.size(), gz.size());
+}
+
+static void testVectors() {
+    Bytes json = jsonReply();
+    Bytes sse = sseStream(1500);
+    Bytes text = wordText(30000);
+    Bytes random = randomBytes(70000);
+
+    roundTrip("empty", Bytes(), { 6, Z_DEFAULT_STRATEGY, 15, false, 0 });
+    roundTrip("one byte", bytesOf("x"), { 6, Z_DEFAULT_STRATEGY, 15, false, 0 });
+    roundTrip("json l1", json, { 1, Z_DEFAULT_STRATEGY, 15, false, 0 });
+    roundTrip("json l6", json, { 6, Z_DEFAULT_STRATEGY, 15, false, 0 });
+    roundTrip("json l9", json, { 9, Z_DEFAULT_STRATEGY, 15, false, 0 });
+    roundTrip("json stored", json, { 0, Z_DEFAULT_STRATEGY, 15, false, 0 });
+    roundTrip("json fixed", json, { 6, Z_FIXED, 15, false, 0 });
+    roundTrip("json huffman", json, { 6, Z_HUFFMAN_ONLY, 15, false, 0 });
+    roundTrip("json rle", json, { 6, Z_RLE, 15, false, 0 });
+    roundTrip("json header", json, { 6, Z_DEFAULT_STRATEGY, 15, true, 0 });
+    roundTrip("sse", sse, { 6, Z_DEFAULT_STRATEGY, 15, false, 0 });
+    roundTrip("sse sync flush", sse, { 6, Z_DEFAULT_STRATEGY, 15, false, 300 });
+    roundTrip("text", text, { 6, Z_DEFAULT_STRATEGY, 15, false, 0 });
+    roundTrip("text stored", text, { 0, Z_DEFAULT_STRATEGY, 15, false, 0 });
+    roundTrip("text stored flush", text, { 0, Z_DEFAULT_STRATEGY, 15, false, 1000 });
+    roundTrip("random", random, { 6, Z_DEFAULT_STRATEGY, 15, false, 0 });
+    roundTrip("random flush", random, { 9, Z_DEFAULT_STRATEGY, 15, false, 4096 });
+}
+
+/** Output longer than the ring wraps it; history must survive the wrap. */
+static void testRingWrap() {
+    Bytes text = wordText(30000);   /* ~180 KB, five times round the ring */
+
+    /* A 4 KB ring holds everything a 4 KB deflate window can refer to */
+    Bytes small = gzipWith(text, { 9, Z_DEFAULT_STRATEGY, 12, false, 0 });
+    Bytes out;
+    GzipStatus st = inflateRing(small, 0, 4096, &out);
+    CHECK(st == GZIP_DONE && out == text, "4 KB ring, 4 KB window: status %d", st);
+
+    /* A reference further back than the ring is an error, not garbage */
+    Bytes far;
+    Bytes block = randomBytes(8000);
+    far.insert(far.end(), block.begin(), block.end());
+    Bytes filler = randomBytes(8000);
+    far.insert(far.end(), filler.begin(), filler.end());
+    far.insert(far.end(), block.begin(), block.end());
+    Bytes gz = gzipWith(far, { 9, Z_DEFAULT_STRATEGY, 15, false, 0 });
+    st = inflateRing(gz, 0, 4096, &out);
+    CHECK(st == GZIP_ERROR, "distance past a 4 KB ring: status %d", st);
+    st = inflateRing(gz, 0, GZIP_WINDOW_LEN, &out);
+    CHECK(st == GZIP_DONE && out == far, "same data, 32 KB ring: status %d", st);
+}
+
+/** A plain buffer takes exactly its size and reports GZIP_FULL beyond it. */
+static void testPlainFull() {
+    Bytes json = jsonReply();
+    Bytes gz = gzipWith(json, { 6, Z_DEFAULT_STRATEGY, 15, false, 0 });
+    static const int SHORT_BY[] = { 1, 2, 100, (int)json.size() - 1 };
+    for (int by : SHORT_BY) {
+        for (int split : { 1, 13, 1 << 30 }) {
+            Bytes out;
+            GzipStatus st = inflatePlain(gz, split, json.size() - by, &out);
+            CHECK(st == GZIP_FULL, "buffer %d short, split %d: status %d", by, split, st);
+            CHECK(out.size() == json.size() - by &&
+                  memcmp(out.data(), json.data(), out.size()) == 0,
+                  "buffer %d short, split %d: %zu bytes kept", by, split, out.size());
+        }
+    }
+}
+
+/** Every prefix of a vector is incomplete, never done or broken. */
+static void testTruncated() {
+    Bytes json = jsonReply();
+    GzOptions opts[] = {
+        { 6, Z_DEFAULT_STRATEGY, 15, true, 0 },
+        { 0, Z_DEFAULT_STRATEGY, 15, false, 0 },
+        { 6, Z_FIXED, 15, false, 100 },
+    };
+    for (const GzOptions &o : opts) {
+        Bytes gz = gzipWith(json, o);
+        for (size_t len = 0; len < gz.size(); len++) {
+            Bytes cut(gz.begin(), gz.begin() + len);
+            Bytes out;
+            GzipStatus st = inflateRing(cut, 0, GZIP_WINDOW_LEN, &out);
+            CHECK(st == GZIP_MORE, "truncated to %zu of %zu: status %d", len, gz.size(), st);
+            CHECK(out.empty() || (out.size() <= json.size() &&
+                  memcmp(out.data(), json.data(), out.size()) == 0),
+                  "truncated to %zu: output differs", len);
+        }
+    }
+}
+
+/** Damaged input must end in GZIP_ERROR, or at least never in a wrong GZIP_DONE. */
+static void testCorrupt() {
+    Bytes json = jsonReply();
+    Bytes gz = gzipWith(json, { 6, Z_DEFAULT_STRATEGY, 15, false, 0 });
+    Bytes out;
+
+    Bytes bad = gz;
+    bad[0] = 0x1e;
+    CHECK(inflateRing(bad, 0, GZIP_WINDOW_LEN, &out) == GZIP_ERROR, "bad magic accepted");
+
+    bad = gz;
+    bad[2] = 7;
+    CHECK(inflateRing(bad, 0, GZIP_WINDOW_LEN, &out) == GZIP_ERROR, "method 7 accepted");
+
+    bad = gz;
+    bad[bad.size() - 8] ^= 0x01;
+    CHECK(inflateRing(bad, 0, GZIP_WINDOW_LEN, &out) == GZIP_ERROR, "bad CRC accepted");
+
+    bad = gz;
+    bad[bad.size() - 4] ^= 0x01;
+    CHECK(inflateRing(bad, 0, GZIP_WINDOW_LEN, &out) == GZIP_ERROR, "bad ISIZE accepted");
+
+    /* Block type 3 does not exist */
+    Bytes stored = gzipWith(json, { 0, Z_DEFAULT_STRATEGY, 15, false, 0 });
+    bad = stored;
+    bad[10] |= 0x06;
+    CHECK(inflateRing(bad, 0, GZIP_WINDOW_LEN, &out) == GZIP_ERROR, "block type 3 accepted");
+
+    /* Stored block whose length check does not match */
+    bad = stored;
+    bad[13] ^= 0xFF;
+    CHECK(inflateRing(bad, 0, GZIP_WINDOW_LEN, &out) == GZIP_ERROR, "bad NLEN accepted");
+
+    /* Random damage anywhere in the deflate data */
+    int errors = 0;
+    for (int i = 0; i < 3000; i++) {
+        bad = gz;
+        int flips = 1 + rnd() % 4;
+        for (int f = 0; f < flips; f++)
+            bad[10 + rnd() % (bad.size() - 18)] ^= (uint8_t)(1 << (rnd() % 8));
+        GzipStatus st = inflateRing(bad, 0, GZIP_WINDOW_LEN, &out);
+        CHECK(st != GZIP_DONE || out == json, "damaged input %d decoded wrongly", i);
+        if (st == GZIP_ERROR) errors++;
+    }
+    if (verbose) printf("ok   random damage: %d of 3000 rejected outright\n", errors);
+
+    /* Garbage that is not gzip at all */
+    for (int i = 0; i < 200; i++) {
+        Bytes junk = randomBytes(1 + rnd() % 2000);
+        GzipStatus st = inflateRing(junk, 0, GZIP_WINDOW_LEN, &out);
+        CHECK(st != GZIP_DONE, "random junk %d decoded", i);
+    }
+}
+
+int main(int argc, char **argv) {
+    verbose = argc > 1 && strcmp(argv[1], "-v") == 0;
+
+    testVectors();
+    testRingWrap();
+    testPlainFull();
+    testTruncated();
+    testCorrupt();
+
+    printf("gzip: %d/%d checks passed, decoder state %u bytes\n",
+           checks - failures, checks, (unsigned)sizeof(GzipInflater));
+    return failures ? 1 : 0;
+}
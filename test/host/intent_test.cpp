@@ -0,0 +1,165 @@
+/**
+ * @file intent_test.cpp
+ * @brief Host test for the local command fast path (src/intent.cpp)
+ *
+ * Runs intentHandle() over a corpus of commands it must handle, near
+ * misses and questions it must leave to the LLM, against a fixed set of
+ * devices. toolExecute() is stubbed to record the call, so each case
+ * checks the exact tool and arguments, or that no tool was called.
+ *
+ * Build and run (from the repo root):
+ *   g++ -std=gnu++17 -Wall -Itest/host/stubs -Iinclude \
+ *       test/host/intent_test.cpp src/intent.cpp -o intent_test
+ *   ./intent_test [-v]
+ *
+ * Or: make -C test/host
+ */
+
+#include "intent.h"
+#include "devices.h"
+#include "tools.h"
+
+HostSerial Serial;
+bool g_debug = false;
+
+unsigned long millis() { return 0; }
+void delay(unsigned long ms) { (void)ms; }
+
+/*============================================================================
+ * Stubs
+ *============================================================================*/
+
+static Device devs[MAX_DEVICES];
+static char lastCall[160];
+
+Device *deviceGetAll() { return devs; }
+
+bool deviceIsSensor(DeviceKind kind) { return kind <= DEV_SENSOR_SERIAL_TEXT; }
+
+bool deviceIsActuator(DeviceKind kind) { return kind >= DEV_ACTUATOR_DIGITAL; }
+
+bool toolExecute(const char *name, const char *args, char *result, int result_len) {
+    snprintf(lastCall, sizeof(lastCall), "%s %s", name, args);
+    snprintf(result, result_len, "ok");
+    return true;
+}
+
+static void addDevice(const char *name, DeviceKind kind) {
+    for (int i = 0; i < MAX_DEVICES; i++) {
+        if (devs[i].used) continue;
+        snprintf(devs[i].name, sizeof(devs[i].name), "%s", name);
+        devs[i].kind = kind;
+        devs[i].used = true;
+        return;
+    }
+}
+
+/*============================================================================
+ * Corpus
+ *============================================================================*/
+
+struct IntentCase {
+    const char *msg;
+    const char *call;   /* "tool {args}", or nullptr for "left to the LLM" */
+};
+
+static const IntentCase CASES[] = {
+    /* Actuators */
+    { "relay off",                      "actuator_set {\"name\":\"relay\",\"value\":0}" },
+    { "Relay ON!",                      "actuator_set {\"name\":\"relay\",\"value\":1}" },
+    { "switch on the relay please",     "actuator_set {\"name\":\"relay\",\"value\":1}" },
+    { "set relay to 1",                 "actuator_set {\"name\":\"relay\",\"value\":1}" },
+    { "set fan to 128",                 "actuator_set {\"name\":\"fan\",\"value\":128}" },
+    { "fan on",                         "actuator_set {\"name\":\"fan\",\"value\":255}" },
+    { "turn the fan off",               "actuator_set {\"name\":\"fan\",\"value\":0}" },
+    { "turn on pump_2",                 "actuator_set {\"name\":\"pump_2\",\"value\":1}" },
+    { "pump 2 off",                     "actuator_set {\"name\":\"pump_2\",\"value\":0}" },
+    { "rgb_led blue",                   "actuator_set {\"name\":\"rgb_led\",\"value\":255}" },
+    { "make the rgb led red",           "actuator_set {\"name\":\"rgb_led\",\"value\":16711680}" },
+    { "rgb led on",                     "actuator_set {\"name\":\"rgb_led\",\"value\":16777215}" },
+
+    /* Sensors */
+    { "read chip_temp",                 "sensor_read {\"name\":\"chip_temp\"}" },
+    { "what's the chip temp?",          "sensor_read {\"name\":\"chip_temp\"}" },
+    { "greenhouse",                     "sensor_read {\"name\":\"greenhouse\"}" },
+    { "check the current value of door", "sensor_read {\"name\":\"door\"}" },
+
+    /* Onboard LED */
+    { "turn the led red",               "led_set {\"r\":255,\"g\":0,\"b\":0}" },
+    { "led on",                         "led_set {\"r\":255,\"g\":255,\"b\":255}" },
+    { "turn off the led",               "led_set {\"r\":0,\"g\":0,\"b\":0}" },
+    { "LED: purple",                    "led_set {\"r\":128,\"g\":0,\"b\":255}" },
+
+    /* Near misses: values the device cannot take */
+    { "set relay to 2",                 nullptr },
+    { "set fan to 300",                 nullptr },
+    { "set fan to -5",                  nullptr },
+    { "set fan to 50%",                 nullptr },
+    { "set fan to 12.5",                nullptr },
+    { "set fan to 0x10",                nullptr },
+    { "set fan to 1e3",                 nullptr },
+    { "set fan to 99999999999999999999", nullptr },
+    { "relay red",                      nullptr },
+    { "led 5",                          nullptr },
+    { "fan on off",                     nullptr },
+    { "fan on 100",                     nullptr },
+
+    /* Near misses: words outside the grammar */
+    { "turn the led red slowly",        nullptr },
+    { "don't turn on the relay",        nullptr },
+    { "turn the relay on and the fan off", nullptr },
+    { "turn on the relay in 5 minutes", nullptr },
+    { "turn off",                       nullptr },
+    { "set the heater to 20",           nullptr },
+    { "read fan",                       nullptr },
+    { "set chip_temp to 5",             nullptr },
+    { "turn the relay ön",              nullptr },
+
+    /* Questions and chat */
+    { "is the relay on?",               nullptr },
+    { "what is the greenhouse temperature", nullptr },
+    { "Tell me a joke",                 nullptr },
+    { "why is the fan on",              nullptr },
+    { "",                               nullptr },
+    { "turn the relay on turn the relay on turn the relay on turn the relay on", nullptr },
+};
+#define CASE_COUNT ((int)(sizeof(CASES) / sizeof(CASES[0])))
+
+/*============================================================================
+ * Main
+ *============================================================================*/
+
+int main(int argc, char **argv) {
+    bool verbose = argc > 1 && strcmp(argv[1], "-v") == 0;
+
+    addDevice("chip_temp", DEV_SENSOR_INTERNAL_TEMP);
+    addDevice("greenhouse", DEV_SENSOR_NTC_10K);
+    addDevice("door", DEV_SENSOR_DIGITAL);
+    addDevice("relay", DEV_ACTUATOR_RELAY);
+    addDevice("fan", DEV_ACTUATOR_PWM);
+    addDevice("pump_2", DEV_ACTUATOR_DIGITAL);
+    addDevice("rgb_led", DEV_ACTUATOR_RGB_LED);
+
+    int failed = 0;
+    char reply[64];
+    for (int i = 0; i < CASE_COUNT; i++) {
+        const IntentCase *c = &CASES[i];
+        lastCall[0] = '\0';
+        bool handled = intentHandle(c->msg, reply, sizeof(reply));
+        const char *got = handled ? lastCall : nullptr;
+
+        bool pass = c->call ? (got && strcmp(got, c->call) == 0) : !got;
+        if (!pass) failed++;
+        if (!pass || verbose) {
+            printf("%s %-40s -> %s", pass ? "ok  " : "FAIL", c->msg, got ? got : "(LLM)");
+            if (!pass) printf("   expected %s", c->call ? c->call : "(LLM)");
+            printf("\n");
+        }
+    }
+
+    unsigned hits, misses;
+    intentStats(&hits, &misses);
+    printf("intent: %d/%d cases passed, %u local, %u to LLM\n",
+           CASE_COUNT - failed, CASE_COUNT, hits, misses);
+    return failed ? 1 : 0;
+}
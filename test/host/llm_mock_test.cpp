@@ -0,0 +1,272 @@
+/**
+ * @file llm_mock_test.cpp
+ * @brief Host test for LLM endpoint failover and hedging (src/llm_client.cpp)
+ *
+ * LlmClient::chat() runs whole against mock servers (mock_net.h) that
+ * refuse connections, hang, close early, answer 429/5xx or answer late,
+ * on a simulated clock. Each case checks which endpoint answered, how
+ * long the chat took, the health and hedge counters, and which servers
+ * saw requests. Every case runs buffered and streamed.
+ *
+ * Build and run (from test/host):
+ *   g++ -std=gnu++17 -Wall -Istubs -I../../include llm_mock_test.cpp \
+ *       ../../src/llm_client.cpp ../../src/gzip_inflate.cpp -o llm_mock_test
+ *   ./llm_mock_test [-v]
+ *
+ * Or: make -C test/host
+ */
+
+#include "mock_net.h"
+#include "llm_client.h"
+
+HostSerial Serial;
+HostESP ESP;
+WiFiClass WiFi;
+bool g_debug = false;
+
+static int failures = 0;
+static int checks = 0;
+
+#define CHECK(cond, ...) do {                           \
+    checks++;                                           \
+    if (!(cond)) {                                      \
+        failures++;                                     \
+        printf("FAIL %s:%d: ", __FILE__, __LINE__);     \
+        printf(__VA_ARGS__);                            \
+        printf("\n");                                   \
+    }                                                   \
+} while (0)
+
+static const LlmMessage MESSAGES[] = {
+    { LLM_MSG_NORMAL, "system", "You are a test.", nullptr, nullptr },
+    { LLM_MSG_NORMAL, "user", "Hello", nullptr, nullptr },
+};
+#define MESSAGE_COUNT 2
+
+static LlmResult result;
+
+/*============================================================================
+ * Setup
+ *============================================================================*/
+
+/* Main endpoint "a", fallback "b"; both answer with their own name */
+static MockServer srvA, srvB;
+
+static MockHandler answer(const char *text, unsigned long delay_ms) {
+    return [text, delay_ms](const MockRequest &req) {
+        MockReply r = mockText(req, text);
+        r.delay_ms = delay_ms;
+        return r;
+    };
+}
+
+static LlmClient *newClient(bool stream) {
+    mockNet.reset();
+    srvA = MockServer();
+    srvA.host = "a.test";
+    srvA.handler = answer("from a", 400);
+    srvB = MockServer();
+    srvB.host = "b.test";
+    srvB.handler = answer("from b", 400);
+    mockNet.add(&srvA);
+    mockNet.add(&srvB);
+    hostNet = &mockNet;
+
+    LlmClient *llm = new LlmClient();
+    llm->begin("key", "model-a", "http://a.test:8080/v1/chat/completions");
+    llm->addEndpoint("http://b.test:8080/v1/chat/completions", "model-b", "key");
+    llm->setStreaming(stream);
+    llm->setGzip(false);
+    return llm;
+}
+
+static bool chat(LlmClient *llm, unsigned long *ms) {
+    unsigned long t0 = mockNow;
+    bool ok = llm->chat(MESSAGES, MESSAGE_COUNT, nullptr, 0, &result);
+    *ms = mockNow - t0;
+    return ok;
+}
+
+static bool answered(const char *text) {
+    return strcmp(result.content, text) == 0;
+}
+
+/*============================================================================
+ * Failover
+ *============================================================================*/
+
+/* A dead host costs two short connect timeouts, then the fallback answers
+ * and the dead one is tried last until its down time is over */
+static void testConnectTimeout(bool stream) {
+    LlmClient *llm = newClient(stream);
+    srvA.down = true;
+    unsigned long ms;
+
+    CHECK(chat(llm, &ms) && answered("from b"), "stream %d: fallback did not answer [%s]",
+          stream, llm->lastError());
+    CHECK(llm->lastEndpoint() == 1, "stream %d: answered by %d", stream, llm->lastEndpoint());
+    CHECK(srvA.connects == 2, "stream %d: %d connects to a", stream, srvA.connects);
+    CHECK(ms < 2 * LLM_CONNECT_TIMEOUT_MS + 1000, "stream %d: failover took %lums", stream, ms);
+    CHECK(llm->endpoint(0)->errors == 1, "stream %d: a has %lu errors",
+          stream, llm->endpoint(0)->errors);
+
+    /* Down: b goes first and a is not touched */
+    CHECK(chat(llm, &ms) && answered("from b"), "stream %d: second chat", stream);
+    CHECK(srvA.connects == 2, "stream %d: down endpoint tried first", stream);
+    CHECK(ms < 1000, "stream %d: second chat took %lums", stream, ms);
+
+    /* Back after LLM_DOWN_MS; it fails again and stays down twice as long */
+    delay(LLM_DOWN_MS);
+    CHECK(chat(llm, &ms) && answered("from b"), "stream %d: third chat", stream);
+    CHECK(srvA.connects == 4, "stream %d: a not retried after its down time", stream);
+    srvA.down = false;
+    delay(LLM_DOWN_MS);
+    CHECK(chat(llm, &ms) && answered("from b"), "stream %d: a tried before 2x down time",
+          stream);
+    delay(LLM_DOWN_MS);
+    CHECK(chat(llm, &ms) && answered("from a"), "stream %d: a did not come back [%s]",
+          stream, result.content);
+    CHECK(llm->endpoint(0)->failures == 0, "stream %d: a still failing", stream);
+    delete llm;
+}
+
+/* 429 and 5xx move on to the next endpoint; other errors do not */
+static void testStatusFailover(bool stream) {
+    LlmClient *llm = newClient(stream);
+    unsigned long ms;
+
+    srvA.handler = [](const MockRequest &) { return mockError(503, "overloaded"); };
+    CHECK(chat(llm, &ms) && answered("from b"), "stream %d: no failover on 503", stream);
+    CHECK(srvB.requests == 1, "stream %d: b saw %d requests", stream, srvB.requests);
+    delete llm;
+
+    llm = newClient(stream);
+    srvA.handler = [](const MockRequest &) { return mockError(429, "rate limited"); };
+    CHECK(chat(llm, &ms) && answered("from b"), "stream %d: no failover on 429", stream);
+    delete llm;
+
+    llm = newClient(stream);
+    srvA.handler = [](const MockRequest &) { return mockError(400, "bad request"); };
+    CHECK(!chat(llm, &ms), "stream %d: 400 succeeded", stream);
+    CHECK(srvB.requests == 0, "stream %d: 400 failed over", stream);
+    CHECK(strcmp(llm->lastError(), "bad request") == 0, "stream %d: error [%s]",
+          stream, llm->lastError());
+    delete llm;
+}
+
+/* A connection closed before any reply fails over too */
+static void testClosedEarly(bool stream) {
+    LlmClient *llm = newClient(stream);
+    unsigned long ms;
+    srvA.handler = [](const MockRequest &) {
+        MockReply r;
+        r.status = 0;
+        r.delay_ms = 200;
+        return r;
+    };
+    CHECK(chat(llm, &ms) && answered("from b"), "stream %d: no failover on close [%s]",
+          stream, llm->lastError());
+    CHECK(srvA.requests == 1 && srvB.requests == 1, "stream %d: requests %d/%d",
+          stream, srvA.requests, srvB.requests);
+    delete llm;
+}
+
+/* Each endpoint gets its own model in the request body */
+static void testModels(bool stream) {
+    LlmClient *llm = newClient(stream);
+    unsigned long ms;
+    srvA.down = true;
+    chat(llm, &ms);
+    CHECK(!srvB.log.empty() && srvB.log[0].model == "model-b", "stream %d: b got model [%s]",
+          stream, srvB.log.empty() ? "" : srvB.log[0].model.c_str());
+    CHECK(!srvB.log.empty() && srvB.log[0].stream == stream, "stream %d: stream flag", stream);
+    delete llm;
+}
+
+/*============================================================================
+ * Hedging
+ *============================================================================*/
+
+/* No first byte by the deadline: a copy goes to b, and b's reply wins */
+static void testHedge(bool stream) {
+    LlmClient *llm = newClient(stream);
+    llm->setHedging(true);
+    unsigned long ms;
+
+    srvA.handler = answer("from a", 20000);
+    CHECK(chat(llm, &ms) && answered("from b"), "stream %d: hedge did not win [%s]",
+          stream, result.content);
+    CHECK(llm->hedgeCount() == 1 && llm->hedgeWins() == 1, "stream %d: hedges %lu/%lu",
+          stream, llm->hedgeCount(), llm->hedgeWins());
+    /* Default deadline until a has samples, then b's connect and delay */
+    CHECK(ms >= LLM_HEDGE_DEFAULT_MS && ms < LLM_HEDGE_DEFAULT_MS + 1000,
+          "stream %d: hedged chat took %lums", stream, ms);
+    CHECK(srvA.abandoned == 1, "stream %d: a's request not dropped (%d)",
+          stream, srvA.abandoned);
+    delete llm;
+}
+
+/* With samples, the deadline follows a's p95, but never under the minimum */
+static void testHedgeDeadline(bool stream) {
+    LlmClient *llm = newClient(stream);
+    llm->setHedging(true);
+    unsigned long ms;
+
+    srvA.handler = answer("from a", 300);
+    for (int i = 0; i < 5; i++) chat(llm, &ms);
+    CHECK(llm->hedgeCount() == 0 && srvB.requests == 0, "stream %d: hedged a fast reply",
+          stream);
+    CHECK(llm->endpointP95(0) >= 300 && llm->endpointP95(0) < 400, "stream %d: p95 %lu",
+          stream, llm->endpointP95(0));
+    CHECK(srvA.connects == 1, "stream %d: kept-alive connection not reused (%d connects)",
+          stream, srvA.connects);
+
+    srvA.handler = answer("from a", 20000);
+    CHECK(chat(llm, &ms) && answered("from b"), "stream %d: slow a not hedged", stream);
+    CHECK(ms >= LLM_HEDGE_MIN_MS && ms < LLM_HEDGE_MIN_MS + 1000,
+          "stream %d: hedge after %lums", stream, ms);
+
+    /* b's first byte later than a's: a still wins */
+    srvA.handler = answer("from a", 1500);
+    srvB.handler = answer("from b", 5000);
+    CHECK(chat(llm, &ms) && answered("from a"), "stream %d: late hedge won", stream);
+    CHECK(llm->hedgeCount() == 2 && llm->hedgeWins() == 1, "stream %d: hedges %lu/%lu",
+          stream, llm->hedgeCount(), llm->hedgeWins());
+    delete llm;
+}
+
+/* A hedge to a TLS endpoint needs heap for a second session */
+static void testHedgeLowHeap(bool stream) {
+    LlmClient *llm = newClient(stream);
+    llm->begin("key", "model-a", "http://a.test:8080/v1/chat/completions");
+    llm->addEndpoint("https://b.test/v1/chat/completions", "model-b", "key");
+    llm->setStreaming(stream);
+    llm->setGzip(false);
+    llm->setHedging(true);
+    unsigned long ms;
+
+    srvA.handler = answer("from a", 12000);
+    ESP.free_heap = LLM_HEDGE_MIN_HEAP - 1;
+    CHECK(chat(llm, &ms) && answered("from a"), "stream %d: low heap chat", stream);
+    CHECK(srvB.connects == 0, "stream %d: hedged with low heap", stream);
+    ESP.free_heap = 200000;
+    CHECK(chat(llm, &ms) && answered("from b"), "stream %d: TLS hedge", stream);
+    delete llm;
+}
+
+int main(int argc, char **argv) {
+    if (argc > 1 && strcmp(argv[1], "-v") == 0) Serial.enabled = true;
+
+    for (int stream = 0; stream < 2; stream++) {
+        testConnectTimeout(stream);
+        testStatusFailover(stream);
+        testClosedEarly(stream);
+        testModels(stream);
+        testHedge(stream);
+        testHedgeDeadline(stream);
+        testHedgeLowHeap(stream);
+    }
+
+    printf("llm mock: %d/%d checks passed\n", checks - failures, checks);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,251 @@
+/**
+ * @file llm_parse_bench.cpp
+ * @brief Host bench for the buffered LLM response parser
+ *
+ * Times LlmClient::parseResponse() (the single-pass json_sax_value()
+ * scanner in src/llm_client.cpp) on hand-written OpenRouter and Ollama
+ * replies in llm_samples/, and checks what it extracts: content, tool
+ * calls, usage and errors, plus edge cases (nested arguments, extra
+ * choices, truncation, deep nesting, long keys). Every prefix of each
+ * sample is parsed as well; a value is only taken once it is complete.
+ * Re-run whenever the parser changes and compare.
+ *
+ * Build and run (from test/host):
+ *   g++ -std=gnu++17 -O2 -Wall -Istubs -I../../include llm_parse_bench.cpp \
+ *       ../../src/llm_client.cpp ../../src/gzip_inflate.cpp -o llm_parse_bench
+ *   ./llm_parse_bench [-n iterations] [-c] [-d samples_dir]
+ *
+ * Or: make -C test/host
+ *
+ * -c prints CSV (sample,bytes,us_per_parse,mb_per_s) for tracking over time.
+ */
+
+#include <Arduino.h>
+#include <WiFi.h>
+#include "llm_client.h"
+#include <chrono>
+#include <string>
+
+HostSerial Serial;
+HostESP ESP;
+WiFiClass WiFi;
+bool g_debug = false;
+
+unsigned long millis() { return 0; }
+void delay(unsigned long ms) { (void)ms; }
+
+static int failures = 0;
+static int checks = 0;
+
+#define CHECK(cond, ...) do {                           \
+    checks++;                                           \
+    if (!(cond)) {                                      \
+        failures++;                                     \
+        printf("FAIL %s:%d: ", __FILE__, __LINE__);     \
+        printf(__VA_ARGS__);                            \
+        printf("\n");                                   \
+    }                                                   \
+} while (0)
+
+static LlmClient llm;
+static LlmResult result;
+
+/*============================================================================
+ * Expectations
+ *============================================================================*/
+
+struct ToolExpect {
+    const char *id;
+    const char *name;
+    const char *arguments;
+};
+
+struct Expect {
+    const char *name;          /* sample, or edge case label */
+    bool        ok;
+    int         content_len;   /* -1: don't check */
+    const char *content;       /* prefix, or nullptr */
+    int         prompt_tokens;
+    int         completion_tokens;
+    int         cached_tokens;
+    int         tool_count;
+    ToolExpect  tools[LLM_MAX_TOOL_CALLS];
+    const char *error;         /* lastError() when !ok */
+};
+
+static const char *LINE = "The temperature is 21.4\xc2\xb0" "C and the \"relay\" is off.\n";
+
+static const Expect SAMPLES[] = {
+    { "openrouter_text", true, 792, LINE, 2143, 212, 1536, 0, {}, nullptr },
+    { "openrouter_tools", true, 0, nullptr, 1870, 64, 0, 2, {
+        { "call_AbC123", "file_write",
+          "{\"path\":\"/notes.txt\",\"content\":\"remember the milk\\n\"}" },
+        { "call_DeF456", "actuator_set", "{\"name\":\"relay\",\"value\":1}" } },
+      nullptr },
+    { "ollama_text", true, 537, LINE, 1402, 145, 0, 0, {}, nullptr },
+    { "ollama_tools", true, 0, nullptr, 1402, 38, 0, 2, {
+        { "", "sensor_read", "{\"name\":\"chip_temp\"}" },
+        { "", "led_set", "{\"r\":255,\"g\":0,\"b\":0}" } },
+      nullptr },
+    { "ollama_openai", true, 271, LINE, 1402, 70, 0, 0, {}, nullptr },
+    { "openrouter_error", false, 0, nullptr, 0, 0, 0, 0, {},
+      "No auth credentials found" },
+};
+#define SAMPLE_COUNT (int)(sizeof(SAMPLES) / sizeof(SAMPLES[0]))
+
+struct EdgeCase {
+    const char *json;
+    Expect      expect;
+};
+
+static const EdgeCase EDGES[] = {
+    { R"({"choices":[{"message":{"content":null,"tool_calls":[{"id":"c1","function":{"name":"file_write","arguments":{"path":"/a","content":"SECRET"}}}]}}]})",
+      { "arguments object", true, 0, nullptr, 0, 0, 0, 1,
+        { { "c1", "file_write", "{\"path\":\"/a\",\"content\":\"SECRET\"}" } }, nullptr } },
+    { R"({"choices":[{"index":0,"message":{"content":"first"}},{"index":1,"message":{"content":"second"}}]})",
+      { "second choice", true, 5, "first", 0, 0, 0, 0, {}, nullptr } },
+    { R"({"choices":[{"message":{"content":"partial reply"},"finish_reason":"len)",
+      { "truncated", true, 13, "partial reply", 0, 0, 0, 0, {}, nullptr } },
+    { R"({"error":"model 'foo' not found"})",
+      { "ollama error", false, 0, nullptr, 0, 0, 0, 0, {}, "model 'foo' not found" } },
+    { R"({"choices":[{"message":{"content":""}}]})",
+      { "empty content", false, 0, nullptr, 0, 0, 0, 0, {}, "No content in response" } },
+    { R"({"choices":[{"message":{"content":"a\\b \"q\" \/ \t end\\"}}]})",
+      { "escapes", true, 16, "a\\b \"q\" / \t end\\", 0, 0, 0, 0, {}, nullptr } },
+    { R"({"choices":[{"message":{"kkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkkk":{"content":"no"},"content":"yes"}}]})",
+      { "long key", true, 3, "yes", 0, 0, 0, 0, {}, nullptr } },
+    { R"({"choices":[{"message":{"tool_calls":[{"id":"a","function":{"name":"n"}},{"id":"b"},{"id":"c"},{"id":"d"},{"id":"e"}]}}]})",
+      { "too many tool calls", true, 0, nullptr, 0, 0, 0, LLM_MAX_TOOL_CALLS,
+        { { "a", "n", "" }, { "b", "", "" }, { "c", "", "" }, { "d", "", "" } }, nullptr } },
+};
+#define EDGE_COUNT (int)(sizeof(EDGES) / sizeof(EDGES[0]))
+
+static void checkResult(const Expect &e, bool ok) {
+    CHECK(ok == e.ok, "%s: ok=%d", e.name, ok);
+    if (e.content_len >= 0)
+        CHECK(result.content_len == e.content_len, "%s: content_len %d, expected %d",
+              e.name, result.content_len, e.content_len);
+    if (e.content)
+        CHECK(strncmp(result.content, e.content, strlen(e.content)) == 0,
+              "%s: content [%.60s]", e.name, result.content);
+    CHECK(result.prompt_tokens == e.prompt_tokens &&
+          result.completion_tokens == e.completion_tokens &&
+          result.cached_tokens == e.cached_tokens,
+          "%s: usage %d/%d/%d", e.name, result.prompt_tokens,
+          result.completion_tokens, result.cached_tokens);
+    CHECK(result.tool_call_count == e.tool_count, "%s: %d tool calls",
+          e.name, result.tool_call_count);
+    for (int i = 0; i < e.tool_count && i < result.tool_call_count; i++) {
+        const LlmToolCall &tc = result.tool_calls[i];
+        CHECK(strcmp(tc.id, e.tools[i].id) == 0 && strcmp(tc.name, e.tools[i].name) == 0 &&
+              strcmp(tc.arguments, e.tools[i].arguments) == 0,
+              "%s: tool %d is %s %s %s", e.name, i, tc.id, tc.name, tc.arguments);
+    }
+    if (e.tool_count > 0)
+        CHECK(result.tool_calls_json[0] == '[', "%s: no tool_calls JSON", e.name);
+    if (e.error)
+        CHECK(strcmp(llm.lastError(), e.error) == 0, "%s: error [%s]", e.name, llm.lastError());
+}
+
+/*============================================================================
+ * Samples
+ *============================================================================*/
+
+static bool readSample(const char *dir, const char *name, std::string *out) {
+    char path[256];
+    snprintf(path, sizeof(path), "%s/%s.json", dir, name);
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        printf("cannot open %s\n", path);
+        return false;
+    }
+    char buf[4096];
+    size_t n;
+    out->clear();
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0) out->append(buf, n);
+    fclose(f);
+    while (!out->empty() && (out->back() == '\n' || out->back() == '\r')) out->pop_back();
+    return true;
+}
+
+/* A value is reported only once it is complete: content from a cut body
+ * is either missing or whole */
+static void checkPrefixes(const char *name, const std::string &body, const LlmResult &full) {
+    int bad = 0;
+    for (size_t len = 0; len < body.size(); len++) {
+        std::string cut = body.substr(0, len);   /* own allocation, for ASan */
+        llm.parseResponse(cut.data(), (int)len, &result);
+        if (result.content_len != 0 && strcmp(result.content, full.content) != 0) bad++;
+        if (result.tool_call_count > full.tool_call_count) bad++;
+    }
+    CHECK(bad == 0, "%s: %d prefixes parsed wrongly", name, bad);
+}
+
+static double timeParse(const std::string &body, int iterations) {
+    using Clock = std::chrono::steady_clock;
+    Clock::time_point t0 = Clock::now();
+    for (int i = 0; i < iterations; i++)
+        llm.parseResponse(body.data(), (int)body.size(), &result);
+    Clock::time_point t1 = Clock::now();
+    return std::chrono::duration<double, std::micro>(t1 - t0).count() / iterations;
+}
+
+static void usage(const char *prog) {
+    printf("usage: %s [-n iterations] [-c] [-d samples_dir]\n", prog);
+}
+
+int main(int argc, char **argv) {
+    int iterations = 20000;
+    bool csv = false;
+    const char *dir = "llm_samples";
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            iterations = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-c") == 0) {
+            csv = true;
+        } else if (strcmp(argv[i], "-d") == 0 && i + 1 < argc) {
+            dir = argv[++i];
+        } else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+    if (iterations <= 0) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    for (int i = 0; i < EDGE_COUNT; i++) {
+        const char *json = EDGES[i].json;
+        checkResult(EDGES[i].expect, llm.parseResponse(json, strlen(json), &result));
+    }
+
+    /* Nesting past the scanner's depth limit is refused, not recursed into */
+    std::string deep;
+    for (int i = 0; i < 40; i++) deep += "{\"a\":";
+    deep += "1";
+    for (int i = 0; i < 40; i++) deep += "}";
+    CHECK(!llm.parseResponse(deep.data(), (int)deep.size(), &result), "deep nesting parsed");
+
+    if (csv) printf("sample,bytes,us_per_parse,mb_per_s\n");
+    static LlmResult full;
+    for (int i = 0; i < SAMPLE_COUNT; i++) {
+        const Expect &e = SAMPLES[i];
+        std::string body;
+        if (!readSample(dir, e.name, &body)) {
+            failures++;
+            continue;
+        }
+        checkResult(e, llm.parseResponse(body.data(), (int)body.size(), &result));
+        full = result;
+        checkPrefixes(e.name, body, full);
+
+        double us = timeParse(body, iterations);
+        double mbs = body.size() / us;
+        if (csv) printf("%s,%zu,%.3f,%.1f\n", e.name, body.size(), us, mbs);
+        else printf("%-18s %5zu B  %7.3f us/parse  %7.1f MB/s\n", e.name, body.size(), us, mbs);
+    }
+
+    if (!csv) printf("llm parse: %d/%d checks passed\n", checks - failures, checks);
+    return failures ? 1 : 0;
+}
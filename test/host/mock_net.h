@@ -0,0 +1,257 @@
+/**
+ * @file mock_net.h
+ * @brief Mock LLM servers behind the stub network clients
+ *
+ * A MockServer is a host name and a handler that turns each request into
+ * a reply: a status, a body and a delay before the first byte. The test
+ * sets hostNet = &mockNet, and the clients in stubs/WiFi.h reach the
+ * servers by host name. A reply is sent whole once its delay has passed.
+ *
+ * Time is the test's own: millis() returns mockNow and delay() advances
+ * it, so waiting out a 20 s first byte costs nothing. This header defines
+ * both; include it in one file per program.
+ */
+
+#ifndef HOST_MOCK_NET_H
+#define HOST_MOCK_NET_H
+
+#include <Arduino.h>
+#include <WiFi.h>
+#include <functional>
+#include <string>
+#include <vector>
+
+unsigned long mockNow = 1000;
+
+unsigned long millis() { return mockNow; }
+void delay(unsigned long ms) { mockNow += ms; }
+
+struct MockRequest {
+    std::string path;
+    std::string body;
+    std::string model;
+    bool stream;
+};
+
+struct MockReply {
+    int status = 200;            /* 0: close without answering */
+    unsigned long delay_ms = 0;  /* until the first byte */
+    std::string body;
+    bool close = false;          /* Connection: close */
+};
+
+typedef std::function<MockReply(const MockRequest &req)> MockHandler;
+
+struct MockServer {
+    std::string host;
+    MockHandler handler;
+    bool down = false;            /* connects hang until the client gives up */
+    unsigned long connect_ms = 30;
+    int connects = 0;             /* attempts, failed ones included */
+    int requests = 0;
+    int abandoned = 0;            /* closed by the client before the reply was read */
+    std::vector<MockRequest> log;
+};
+
+class MockNet : public HostNet {
+public:
+    void add(MockServer *srv) { servers_.push_back(srv); }
+
+    void reset() {
+        servers_.clear();
+        conns_.clear();
+    }
+
+    int open(const char *host, uint16_t port, unsigned long timeout_ms) override {
+        (void)port;
+        MockServer *srv = nullptr;
+        for (MockServer *s : servers_) {
+            if (s->host == host) srv = s;
+        }
+        if (!srv) return -1;
+        srv->connects++;
+        if (srv->down) {
+            delay(timeout_ms);
+            return -1;
+        }
+        delay(srv->connect_ms);
+        Conn c;
+        c.srv = srv;
+        conns_.push_back(c);
+        return (int)conns_.size() - 1;
+    }
+
+    int available(int h) override {
+        Conn &c = conns_[h];
+        if (!c.open || mockNow < c.ready_at) return 0;
+        return (int)(c.out.size() - c.pos);
+    }
+
+    bool connected(int h) override {
+        Conn &c = conns_[h];
+        if (!c.open) return false;
+        return !(c.hangup && mockNow >= c.ready_at && c.pos == c.out.size());
+    }
+
+    int read(int h, uint8_t *buf, size_t len) override {
+        int avail = available(h);
+        if (avail <= 0) return -1;
+        Conn &c = conns_[h];
+        size_t n = len < (size_t)avail ? len : (size_t)avail;
+        memcpy(buf, c.out.data() + c.pos, n);
+        c.pos += n;
+        return (int)n;
+    }
+
+    size_t write(int h, const uint8_t *buf, size_t len) override {
+        Conn &c = conns_[h];
+        if (!c.open || c.hangup) return 0;
+        c.in.append((const char *)buf, len);
+        serve(c);
+        return len;
+    }
+
+    void close(int h) override {
+        Conn &c = conns_[h];
+        if (c.open && c.pos < c.out.size()) c.srv->abandoned++;
+        c.open = false;
+    }
+
+private:
+    struct Conn {
+        MockServer *srv = nullptr;
+        std::string in, out;
+        size_t pos = 0;
+        unsigned long ready_at = 0;
+        bool open = true;
+        bool hangup = false;     /* closes once out has been read */
+    };
+
+    std::vector<MockServer *> servers_;
+    std::vector<Conn> conns_;
+
+    static std::string jsonField(const std::string &body, const char *key) {
+        std::string pat = std::string("\"") + key + "\":\"";
+        size_t i = body.find(pat);
+        if (i == std::string::npos) return "";
+        i += pat.size();
+        return body.substr(i, body.find('"', i) - i);
+    }
+
+    /* Answer the request in c.in once it has arrived in full */
+    void serve(Conn &c) {
+        size_t hdr_end = c.in.find("\r\n\r\n");
+        if (hdr_end == std::string::npos) return;
+        size_t cl = c.in.find("Content-Length: ");
+        size_t body_len = cl < hdr_end ? (size_t)atol(c.in.c_str() + cl + 16) : 0;
+        if (c.in.size() < hdr_end + 4 + body_len) return;
+
+        MockRequest req;
+        size_t sp = c.in.find(' ');
+        req.path = c.in.substr(sp + 1, c.in.find(' ', sp + 1) - sp - 1);
+        req.body = c.in.substr(hdr_end + 4, body_len);
+        req.model = jsonField(req.body, "model");
+        req.stream = req.body.find("\"stream\":true") != std::string::npos;
+        c.in.erase(0, hdr_end + 4 + body_len);
+
+        MockServer *srv = c.srv;
+        srv->requests++;
+        srv->log.push_back(req);
+        MockReply r = srv->handler(req);
+
+        c.out.clear();
+        c.pos = 0;
+        c.ready_at = mockNow + r.delay_ms;
+        if (r.status == 0) {
+            c.hangup = true;
+            return;
+        }
+        char head[160];
+        snprintf(head, sizeof(head),
+                 "HTTP/1.1 %d X\r\nContent-Length: %zu\r\n%s\r\n",
+                 r.status, r.body.size(), r.close ? "Connection: close\r\n" : "");
+        c.out = head + r.body;
+        c.hangup = r.close;
+    }
+};
+
+MockNet mockNet;
+
+/*============================================================================
+ * Replies in OpenAI format, buffered or streamed (SSE) as the request asks
+ *============================================================================*/
+
+inline std::string mockEscape(const std::string &s) {
+    std::string out;
+    for (char c : s) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if (c == '\n') {
+            out += "\\n";
+        } else {
+            out += c;
+        }
+    }
+    return out;
+}
+
+inline std::string mockUsage(int prompt_tokens, int completion_tokens) {
+    char buf[96];
+    snprintf(buf, sizeof(buf), "\"usage\":{\"prompt_tokens\":%d,\"completion_tokens\":%d}",
+             prompt_tokens, completion_tokens);
+    return buf;
+}
+
+struct MockCall {
+    std::string name;
+    std::string arguments;  /* JSON object */
+};
+
+inline MockReply mockText(const MockRequest &req, const std::string &text,
+                          int prompt_tokens = 100, int completion_tokens = 10) {
+    MockReply r;
+    if (req.stream) {
+        r.body = "data: {\"choices\":[{\"delta\":{\"content\":\"" + mockEscape(text) +
+                 "\"}}]}\n\ndata: {\"choices\":[]," +
+                 mockUsage(prompt_tokens, completion_tokens) + "}\n\ndata: [DONE]\n\n";
+    } else {
+        r.body = "{\"choices\":[{\"message\":{\"role\":\"assistant\",\"content\":\"" +
+                 mockEscape(text) + "\"}}]," + mockUsage(prompt_tokens, completion_tokens) + "}";
+    }
+    return r;
+}
+
+inline MockReply mockToolCalls(const MockRequest &req, const std::vector<MockCall> &calls,
+                               int prompt_tokens = 100, int completion_tokens = 20) {
+    std::string arr = "[";
+    for (size_t i = 0; i < calls.size(); i++) {
+        char head[80];
+        snprintf(head, sizeof(head), "%s{\"index\":%zu,\"id\":\"call_%zu\",",
+                 i ? "," : "", i, i);
+        arr += head;
+        arr += "\"type\":\"function\",\"function\":{\"name\":\"" + calls[i].name +
+               "\",\"arguments\":\"" + mockEscape(calls[i].arguments) + "\"}}";
+    }
+    arr += "]";
+    MockReply r;
+    if (req.stream) {
+        r.body = "data: {\"choices\":[{\"delta\":{\"tool_calls\":" + arr +
+                 "}}]}\n\ndata: {\"choices\":[]," +
+                 mockUsage(prompt_tokens, completion_tokens) + "}\n\ndata: [DONE]\n\n";
+    } else {
+        r.body = "{\"choices\":[{\"message\":{\"role\":\"assistant\",\"content\":null,"
+                 "\"tool_calls\":" + arr + "}}]," +
+                 mockUsage(prompt_tokens, completion_tokens) + "}";
+    }
+    return r;
+}
+
+inline MockReply mockError(int status, const std::string &message) {
+    MockReply r;
+    r.status = status;
+    r.body = "{\"error\":{\"message\":\"" + mockEscape(message) + "\"}}";
+    return r;
+}
+
+#endif /* HOST_MOCK_NET_H */
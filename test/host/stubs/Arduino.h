@@ -0,0 +1,114 @@
+/**
+ * @file Arduino.h
+ * @brief Just enough of Arduino for the host tests
+ *
+ * The modules under test are pure logic; they only need the C library,
+ * Serial.printf() and millis(). String and ESP are here for the LLM
+ * client, which is built whole and talks to mock servers (see WiFi.h).
+ * The pin functions are only declared: the replay harness, which builds
+ * the tools and registries, defines them (see agent_replay.cpp).
+ */
+
+#ifndef HOST_ARDUINO_H
+#define HOST_ARDUINO_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <ctype.h>
+#include <math.h>
+#include <time.h>
+#include <string>
+
+class HostSerial {
+public:
+    int printf(const char *fmt, ...) __attribute__((format(printf, 2, 3))) {
+        if (!enabled) return 0;
+        va_list ap;
+        va_start(ap, fmt);
+        int n = vprintf(fmt, ap);
+        va_end(ap);
+        return n;
+    }
+    void println(const char *s) { printf("%s\n", s); }
+    bool enabled = false;  /* set by a test to see the module's logging */
+};
+
+extern HostSerial Serial;
+
+class String {
+public:
+    String() {}
+    String(const char *s) : s_(s) {}
+    const char *c_str() const { return s_.c_str(); }
+    unsigned length() const { return (unsigned)s_.size(); }
+    bool startsWith(const char *p) const { return s_.compare(0, strlen(p), p) == 0; }
+    int indexOf(const char *p) const {
+        size_t i = s_.find(p);
+        return i == std::string::npos ? -1 : (int)i;
+    }
+    String substring(unsigned from) const { return substring(from, length()); }
+    String substring(unsigned from, unsigned to) const {
+        if (from > length()) from = length();
+        return String(s_.substr(from, to > from ? to - from : 0).c_str());
+    }
+    long toInt() const { return atol(s_.c_str()); }
+    void trim() {
+        size_t a = s_.find_first_not_of(" \t\r\n");
+        size_t b = s_.find_last_not_of(" \t\r\n");
+        s_ = a == std::string::npos ? "" : s_.substr(a, b - a + 1);
+    }
+private:
+    std::string s_;
+};
+
+class HostESP {
+public:
+    uint32_t getFreeHeap() { return free_heap; }
+    uint32_t getHeapSize() { return 327680; }
+    const char *getChipModel() { return "ESP32-C6"; }
+    uint8_t getChipRevision() { return 0; }
+    uint8_t getChipCores() { return 1; }
+    unsigned long getCpuFreqMHz() { return 160; }  /* uint32_t is unsigned long there */
+    uint32_t free_heap = 200000;  /* set by a test */
+};
+
+extern HostESP ESP;
+
+/* UART1 for the serial_text device; nothing is ever received */
+#define SERIAL_8N1 0
+
+class HardwareSerial {
+public:
+    explicit HardwareSerial(int uart) { (void)uart; }
+    void begin(unsigned long baud, int config, int rx, int tx) {
+        (void)baud; (void)config; (void)rx; (void)tx;
+    }
+    void end() {}
+    int available() { return 0; }
+    int read() { return -1; }
+    size_t print(const char *s) { return strlen(s); }
+    size_t print(char c) { (void)c; return 1; }
+};
+
+unsigned long millis();
+void delay(unsigned long ms);
+
+#define HIGH   1
+#define LOW    0
+#define INPUT  0
+#define OUTPUT 1
+#define constrain(x, lo, hi) ((x) < (lo) ? (lo) : ((x) > (hi) ? (hi) : (x)))
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t val);
+int digitalRead(uint8_t pin);
+int analogRead(uint8_t pin);
+uint32_t analogReadMilliVolts(uint8_t pin);
+void analogWrite(uint8_t pin, int value);
+bool getLocalTime(struct tm *info, uint32_t ms = 5000);
+
+#endif /* HOST_ARDUINO_H */
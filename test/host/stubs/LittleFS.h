@@ -0,0 +1,54 @@
+/**
+ * @file LittleFS.h
+ * @brief In-memory file system for the host tests
+ *
+ * Files live in LittleFS.files for the life of the program, so a module
+ * that saves and reloads its state gets back what it wrote.
+ */
+
+#ifndef HOST_LITTLEFS_H
+#define HOST_LITTLEFS_H
+
+#include <Arduino.h>
+#include <map>
+
+class File {
+public:
+    File() {}
+    File(std::string *data, bool write) : data_(data), write_(write) {
+        if (write_) data_->clear();
+    }
+    explicit operator bool() const { return data_ != nullptr; }
+    size_t print(const char *s) {
+        if (!data_ || !write_) return 0;
+        data_->append(s);
+        return strlen(s);
+    }
+    size_t readBytes(char *buf, size_t len) {
+        if (!data_ || write_) return 0;
+        size_t n = data_->size() - pos_ < len ? data_->size() - pos_ : len;
+        memcpy(buf, data_->data() + pos_, n);
+        pos_ += n;
+        return n;
+    }
+    void close() { data_ = nullptr; }
+
+private:
+    std::string *data_ = nullptr;
+    bool write_ = false;
+    size_t pos_ = 0;
+};
+
+class HostFS {
+public:
+    File open(const char *path, const char *mode = "r") {
+        if (mode[0] == 'w') return File(&files[path], true);
+        auto it = files.find(path);
+        return it == files.end() ? File() : File(&it->second, false);
+    }
+    std::map<std::string, std::string> files;
+};
+
+extern HostFS LittleFS;
+
+#endif /* HOST_LITTLEFS_H */
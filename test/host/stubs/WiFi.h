@@ -0,0 +1,106 @@
+/**
+ * @file WiFi.h
+ * @brief Network classes for the host tests
+ *
+ * Enough for src/llm_client.cpp and src/tools.cpp to build. Nothing
+ * connects unless a test sets hostNet (see ../mock_net.h); clients then
+ * talk to its servers, addressed by host name.
+ */
+
+#ifndef HOST_WIFI_H
+#define HOST_WIFI_H
+
+#include <Arduino.h>
+
+#define WL_CONNECTED 3
+
+/* Servers behind every client, keyed by connection handle */
+class HostNet {
+public:
+    virtual ~HostNet() {}
+    virtual int    open(const char *host, uint16_t port, unsigned long timeout_ms) = 0;
+    virtual int    available(int h) = 0;
+    virtual bool   connected(int h) = 0;
+    virtual int    read(int h, uint8_t *buf, size_t len) = 0;
+    virtual size_t write(int h, const uint8_t *buf, size_t len) = 0;
+    virtual void   close(int h) = 0;
+};
+
+inline HostNet *hostNet = nullptr;
+
+/* Carries the host name: the mock resolves every name to itself */
+class IPAddress {
+public:
+    IPAddress() { host[0] = '\0'; }
+    String toString() const { return String(host[0] ? host : "0.0.0.0"); }
+    char host[64];
+};
+
+class Client {
+public:
+    virtual ~Client() {}
+    int available() { return h_ >= 0 ? hostNet->available(h_) : 0; }
+    uint8_t connected() { return h_ >= 0 && hostNet->connected(h_); }
+    int read() {
+        uint8_t c;
+        return read(&c, 1) == 1 ? c : -1;
+    }
+    int read(uint8_t *buf, size_t len) { return h_ >= 0 ? hostNet->read(h_, buf, len) : -1; }
+    size_t write(const uint8_t *buf, size_t len) {
+        return h_ >= 0 ? hostNet->write(h_, buf, len) : 0;
+    }
+    size_t printf(const char *fmt, ...) __attribute__((format(printf, 2, 3))) {
+        char buf[512];
+        va_list ap;
+        va_start(ap, fmt);
+        int n = vsnprintf(buf, sizeof(buf), fmt, ap);
+        va_end(ap);
+        if (n < 0) return 0;
+        if (n > (int)sizeof(buf) - 1) n = sizeof(buf) - 1;
+        return write((const uint8_t *)buf, n);
+    }
+    /* The mock delivers a reply whole, so there is no need to wait */
+    String readStringUntil(char c) {
+        std::string s;
+        int ch;
+        while ((ch = read()) >= 0 && ch != c) s += (char)ch;
+        return String(s.c_str());
+    }
+    void setTimeout(unsigned long s) { (void)s; }
+    void stop() {
+        if (h_ >= 0) hostNet->close(h_);
+        h_ = -1;
+    }
+
+protected:
+    int open(const char *host, uint16_t port, unsigned long timeout_ms) {
+        stop();
+        if (hostNet) h_ = hostNet->open(host, port, timeout_ms);
+        return h_ >= 0;
+    }
+
+private:
+    int h_ = -1;
+};
+
+class WiFiClient : public Client {
+public:
+    int connect(IPAddress ip, uint16_t port, int32_t timeout_ms) {
+        return open(ip.host, port, timeout_ms);
+    }
+};
+
+class WiFiClass {
+public:
+    int status() { return hostNet ? WL_CONNECTED : 0; }
+    int hostByName(const char *host, IPAddress &ip) {
+        if (!hostNet) return 0;
+        snprintf(ip.host, sizeof(ip.host), "%s", host);
+        return 1;
+    }
+    IPAddress localIP() { return IPAddress(); }
+};
+
+extern WiFiClass WiFi;
+
+#endif /* HOST_WIFI_H */
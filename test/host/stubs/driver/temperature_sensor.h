@@ -0,0 +1,13 @@
+/**
+ * @file temperature_sensor.h
+ * @brief Chip temperature sensor stub for the host tests
+ */
+
+#ifndef HOST_TEMPERATURE_SENSOR_H
+#define HOST_TEMPERATURE_SENSOR_H
+
+typedef void *temperature_sensor_handle_t;
+
+int temperature_sensor_get_celsius(temperature_sensor_handle_t tsens, float *out);
+
+#endif /* HOST_TEMPERATURE_SENSOR_H */
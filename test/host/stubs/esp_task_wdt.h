@@ -0,0 +1,11 @@
+/**
+ * @file esp_task_wdt.h
+ * @brief Task watchdog stub for the host tests
+ */
+
+#ifndef HOST_ESP_TASK_WDT_H
+#define HOST_ESP_TASK_WDT_H
+
+static inline void esp_task_wdt_reset() {}
+
+#endif /* HOST_ESP_TASK_WDT_H */
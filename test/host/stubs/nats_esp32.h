@@ -0,0 +1,32 @@
+/**
+ * @file nats_esp32.h
+ * @brief NATS client stub for the host tests
+ *
+ * The protocol types come from lib/nats; the client never connects, so
+ * every call fails with NATS_ERR_NOT_CONNECTED.
+ */
+
+#ifndef HOST_NATS_ESP32_H
+#define HOST_NATS_ESP32_H
+
+#include "nats_core.h"
+
+class NatsClient {
+public:
+    nats_err_t process() { return NATS_ERR_NOT_CONNECTED; }
+    nats_err_t publish(const char *subject, const char *str) {
+        (void)subject; (void)str;
+        return NATS_ERR_NOT_CONNECTED;
+    }
+    nats_err_t requestStart(nats_request_t *req, const char *subject, const char *str,
+                            uint32_t timeout_ms) {
+        (void)req; (void)subject; (void)str; (void)timeout_ms;
+        return NATS_ERR_NOT_CONNECTED;
+    }
+    nats_err_t requestCheck(nats_request_t *req) {
+        (void)req;
+        return NATS_ERR_NOT_CONNECTED;
+    }
+};
+
+#endif /* HOST_NATS_ESP32_H */
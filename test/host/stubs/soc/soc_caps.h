@@ -0,0 +1,12 @@
+/**
+ * @file soc_caps.h
+ * @brief SoC capabilities for the host tests (ESP32-C6 values)
+ */
+
+#ifndef HOST_SOC_CAPS_H
+#define HOST_SOC_CAPS_H
+
+#define SOC_TEMP_SENSOR_SUPPORTED 1
+#define SOC_GPIO_PIN_COUNT        31
+
+#endif /* HOST_SOC_CAPS_H */